@@ -10,10 +10,15 @@ void handle_audio_input_rt(struct data *data, uint32_t n_samples)
   /* Get input buffer first - we need to process it even if not recording */
   float *in = pw_filter_get_dsp_buffer(data->audio_in, n_samples);
 
+  handle_audio_input_block_rt(data, in, n_samples);
+}
+
+void handle_audio_input_block_rt(struct data *data, const float *in, uint32_t n_samples)
+{
   if (!in)
   {
     /* Use silence if no input buffer available */
-    if (data->rt_bridge.rt_recording_enabled)
+    if (atomic_load_explicit(&data->rt_bridge.rt_recording_enabled, memory_order_relaxed))
     {
       /* Push silence to recording buffer */
       rt_bridge_push_audio(&data->rt_bridge, data->silence_buffer, n_samples);
@@ -40,7 +45,7 @@ void handle_audio_input_rt(struct data *data, uint32_t n_samples)
   }
 
   /* Push audio to ring buffer for recording (RT-safe) */
-  if (data->rt_bridge.rt_recording_enabled)
+  if (atomic_load_explicit(&data->rt_bridge.rt_recording_enabled, memory_order_relaxed))
   {
     if (!rt_bridge_push_audio(&data->rt_bridge, in, n_samples))
     {
@@ -81,7 +86,7 @@ void handle_audio_input_rt(struct data *data, uint32_t n_samples)
           struct rt_message msg = {
               .type = RT_MSG_ERROR,
           };
-          const char *error_msg = "Memory loop buffer full";
+          const char *error_msg = "Loop memory pool exhausted - recording truncated";
           memcpy(msg.data.error.message, error_msg, strlen(error_msg) + 1);
           rt_bridge_send_message(&data->rt_bridge, &msg);
           loop_full_counter = 0;
@@ -98,14 +103,31 @@ void handle_audio_input_rt(struct data *data, uint32_t n_samples)
 
 void process_audio_output_rt(struct data *data, struct spa_io_position *position)
 {
-  struct pw_buffer *b;
-  uint32_t n_samples = position->clock.duration;
+  struct audio_output_rt out;
 
-  /* Check if any loops are ready for playback */
-  bool any_loops_playing = false;
-  for (int i = 0; i < 128; i++)
+  audio_output_begin_rt(&out, position->clock.duration);
+  process_audio_output_block_rt(data, &out, 0, position->clock.duration);
+  audio_output_end_rt(data, &out);
+}
+
+void audio_output_begin_rt(struct audio_output_rt *out, uint32_t n_samples)
+{
+  out->b = NULL;
+  out->buf = NULL;
+  out->frames = n_samples;
+  out->written = 0;
+  out->mixed = false;
+  out->dequeued = false;
+}
+
+void process_audio_output_block_rt(struct data *data, struct audio_output_rt *out,
+                                   uint32_t offset, uint32_t n_samples)
+{
+  /* Check if any loops (or the streamed file) are ready for playback */
+  bool any_loops_playing = disk_stream_active(&data->disk_stream);
+  for (uint8_t v = 0; v < data->playing_voices.count; v++)
   {
-    if (data->memory_loops[i].is_playing && data->memory_loops[i].loop_ready)
+    if (data->memory_loops[data->playing_voices.notes[v]].loop_ready)
     {
       any_loops_playing = true;
       break;
@@ -117,24 +139,42 @@ void process_audio_output_rt(struct data *data, struct spa_io_position *position
     return; /* Skip processing if no loops are playing */
   }
 
-  /* Get output buffer */
-  if ((b = pw_filter_dequeue_buffer(data->audio_out)) == NULL)
+  /* Get output buffer the first time something plays this cycle */
+  if (!out->dequeued)
   {
-    return; /* No buffers available - this is normal */
+    out->dequeued = true;
+    if ((out->b = pw_filter_dequeue_buffer(data->audio_out)) == NULL)
+    {
+      data->loop_positions_stale = true;
+      return; /* No buffers available - this is normal */
+    }
+
+    out->buf = out->b->buffer->datas[0].data;
+    if (out->buf == NULL)
+    {
+      pw_filter_queue_buffer(data->audio_out, out->b);
+      out->b = NULL;
+      data->loop_positions_stale = true;
+      return;
+    }
+
+    if (out->b->requested)
+    {
+      out->frames = SPA_MIN(out->frames, out->b->requested);
+    }
   }
 
-  float *buf = b->buffer->datas[0].data;
-  if (buf == NULL)
+  /* Frames the loops don't get to play here are caught up on from their
+   * anchors at the next mixed block */
+  if (!out->buf || offset >= out->frames)
   {
-    pw_filter_queue_buffer(data->audio_out, b);
+    data->loop_positions_stale = true;
     return;
   }
-
-  uint32_t stride = sizeof(float);
-
-  if (b->requested)
+  if (n_samples > out->frames - offset)
   {
-    n_samples = SPA_MIN(n_samples, b->requested);
+    n_samples = out->frames - offset;
+    data->loop_positions_stale = true;
   }
 
   /* Handle audio reset (RT-safe file operations) */
@@ -153,23 +193,52 @@ void process_audio_output_rt(struct data *data, struct spa_io_position *position
       }
     }
 
-    /* Reset file playback position */
-    sf_seek(data->file, 0, SEEK_SET);
+    /* Restart file playback - the disk thread seeks, nothing blocks here */
+    disk_stream_rewind_rt(&data->disk_stream);
+    stretch_worker_reset(&data->stretch);
     data->sample_position = 0.0; /* Reset fractional position for variable speed */
     data->reset_audio = false;
   }
 
+  /* Silence for the part of the cycle before anything played */
+  if (offset > out->written)
+  {
+    memset(out->buf + out->written, 0, (offset - out->written) * sizeof(float));
+  }
+
   /* Mix all active memory loops */
-  sf_count_t frames_read = mix_all_active_loops_rt(data, buf, n_samples);
+  sf_count_t frames_read = mix_all_active_loops_rt(data, out->buf + offset, n_samples);
 
   /* Apply global volume (RT-optimized) */
-  apply_volume_rt(buf, frames_read, data->volume);
+  apply_volume_rt(out->buf + offset, frames_read, data->volume);
 
-  b->buffer->datas[0].chunk->offset = 0;
-  b->buffer->datas[0].chunk->stride = stride;
-  b->buffer->datas[0].chunk->size = frames_read * stride;
+  out->written = offset + n_samples;
+  if (frames_read > 0)
+  {
+    out->mixed = true;
+  }
+}
 
-  pw_filter_queue_buffer(data->audio_out, b);
+void audio_output_end_rt(struct data *data, struct audio_output_rt *out)
+{
+  if (!out->b)
+  {
+    return;
+  }
+
+  /* Silence after the last block that played */
+  if (out->written < out->frames)
+  {
+    memset(out->buf + out->written, 0, (out->frames - out->written) * sizeof(float));
+  }
+
+  uint32_t stride = sizeof(float);
+  out->b->buffer->datas[0].chunk->offset = 0;
+  out->b->buffer->datas[0].chunk->stride = stride;
+  out->b->buffer->datas[0].chunk->size = out->mixed ? out->frames * stride : 0;
+
+  pw_filter_queue_buffer(data->audio_out, out->b);
+  out->b = NULL;
 }
 
 float calculate_rms_rt(const float *buffer, uint32_t n_samples)
@@ -241,62 +310,12 @@ void apply_volume_rt(float *buf, uint32_t frames, float volume)
   }
 }
 
+/* File playback reads only the disk stream's prefetch ring - the disk
+ * thread does all seeking and decoding, and wraps at the end of the file */
 sf_count_t read_audio_frames_rt(struct data *data, float *buf, uint32_t n_samples)
 {
-  sf_count_t frames_read;
-
-  if (data->fileinfo.channels == 1)
-  {
-    /* Direct read for mono files - most efficient */
-    frames_read = sf_readf_float(data->file, buf, n_samples);
-  }
-  else
-  {
-    /* Multi-channel read with channel extraction */
-    /* Use pre-allocated temp buffer to avoid memory allocation */
-    sf_count_t temp_frames = sf_readf_float(data->file, data->temp_audio_buffer, n_samples);
-
-    /* Extract first channel using optimized pointer arithmetic */
-    float *src = data->temp_audio_buffer;
-    uint32_t channels = data->fileinfo.channels;
-
-    for (uint32_t i = 0; i < temp_frames; i++)
-    {
-      buf[i] = src[i * channels]; /* First channel only */
-    }
-
-    frames_read = temp_frames;
-  }
-
-  /* Handle end of file with single seek operation */
-  if (frames_read < n_samples)
-  {
-    sf_seek(data->file, 0, SEEK_SET);
-
-    /* Read remaining samples */
-    sf_count_t remaining = n_samples - frames_read;
-    sf_count_t additional;
-
-    if (data->fileinfo.channels == 1)
-    {
-      additional = sf_readf_float(data->file, &buf[frames_read], remaining);
-    }
-    else
-    {
-      additional = sf_readf_float(data->file, data->temp_audio_buffer, remaining);
-      float *src = data->temp_audio_buffer;
-      uint32_t channels = data->fileinfo.channels;
-
-      for (uint32_t i = 0; i < additional; i++)
-      {
-        buf[frames_read + i] = src[i * channels];
-      }
-    }
-
-    frames_read += additional;
-  }
-
-  return frames_read;
+  disk_stream_log_underruns_rt(&data->disk_stream);
+  return disk_stream_read_rt(&data->disk_stream, buf, n_samples, 1.0f);
 }
 
 sf_count_t read_audio_frames_variable_speed_rt(struct data *data, float *buf, uint32_t n_samples)
@@ -307,106 +326,24 @@ sf_count_t read_audio_frames_variable_speed_rt(struct data *data, float *buf, ui
     data->playback_speed = 1.0f;
   }
 
-  if (data->playback_speed == 1.0f)
-  {
-    /* Normal speed - use the optimized path */
-    return read_audio_frames_rt(data, buf, n_samples);
-  }
-
-  /* Variable speed playback using linear interpolation */
-  sf_count_t total_frames = data->fileinfo.frames;
-  uint32_t output_frames = 0;
-
-  for (uint32_t i = 0; i < n_samples && output_frames < n_samples; i++)
-  {
-    /* Get integer and fractional parts of sample position */
-    sf_count_t sample_index = (sf_count_t)data->sample_position;
-    double frac = data->sample_position - sample_index;
-
-    /* Handle looping */
-    if (sample_index >= total_frames)
-    {
-      data->sample_position = fmod(data->sample_position, total_frames);
-      sample_index = (sf_count_t)data->sample_position;
-      frac = data->sample_position - sample_index;
-      sf_seek(data->file, sample_index, SEEK_SET);
-    }
-
-    /* Read current and next samples for interpolation */
-    float current_sample = 0.0f;
-    float next_sample = 0.0f;
-
-    if (data->fileinfo.channels == 1)
-    {
-      /* Mono file - direct read */
-      sf_seek(data->file, sample_index, SEEK_SET);
-      sf_readf_float(data->file, &current_sample, 1);
-
-      if (sample_index + 1 < total_frames)
-      {
-        sf_readf_float(data->file, &next_sample, 1);
-      }
-      else
-      {
-        /* End of file - use first sample for looping */
-        sf_seek(data->file, 0, SEEK_SET);
-        sf_readf_float(data->file, &next_sample, 1);
-      }
-    }
-    else
-    {
-      /* Multi-channel file - extract first channel */
-      float temp_buffer[data->fileinfo.channels];
-
-      sf_seek(data->file, sample_index, SEEK_SET);
-      if (sf_readf_float(data->file, temp_buffer, 1) == 1)
-      {
-        current_sample = temp_buffer[0];
-      }
-
-      if (sample_index + 1 < total_frames)
-      {
-        if (sf_readf_float(data->file, temp_buffer, 1) == 1)
-        {
-          next_sample = temp_buffer[0];
-        }
-      }
-      else
-      {
-        /* End of file - use first sample for looping */
-        sf_seek(data->file, 0, SEEK_SET);
-        if (sf_readf_float(data->file, temp_buffer, 1) == 1)
-        {
-          next_sample = temp_buffer[0];
-        }
-      }
-    }
-
-    /* Linear interpolation */
-    buf[output_frames] = current_sample + (next_sample - current_sample) * frac;
-    output_frames++;
-
-    /* Advance sample position by speed multiplier */
-    data->sample_position += data->playback_speed;
-  }
-
-  /* Fill remaining buffer with silence if needed */
-  for (uint32_t i = output_frames; i < n_samples; i++)
-  {
-    buf[i] = 0.0f;
-  }
-
-  return output_frames;
+  /* Band-limited resampling over frames pulled from the ring (record-player mode) */
+  disk_stream_log_underruns_rt(&data->disk_stream);
+  return disk_stream_read_rt(&data->disk_stream, buf, n_samples, data->playback_speed);
 }
 
-int start_recording_rt(struct data *data, const char *filename)
+/* Ask the worker to open a recording file. An empty filename with a take
+ * time lets the worker name it after the loop take (no formatting in RT). */
+static int send_start_recording_rt(struct data *data, const char *filename,
+                                   uint8_t midi_note, time_t take_time)
 {
   /* Send message to non-RT thread to start recording */
   struct rt_message msg = {
       .type = RT_MSG_START_RECORDING,
       .data.recording = {
-          .sample_rate = data->format.info.raw.rate > 0 ? data->format.info.raw.rate : 48000,
-          .channels = 1}};
+          .sample_rate = data->format.info.raw.rate,
+          .channels = 1,
+          .midi_note = midi_note,
+          .take_time = take_time}};
 
   /* Copy filename if provided */
   if (filename)
@@ -437,17 +374,19 @@ int start_recording_rt(struct data *data, const char *filename)
   return 0;
 }
 
+int start_recording_rt(struct data *data, const char *filename)
+{
+  return send_start_recording_rt(data, filename, 255, 0);
+}
+
 int stop_recording_rt(struct data *data)
 {
-  /* Disable RT recording flag first */
-  rt_bridge_set_recording_enabled(&data->rt_bridge, false);
   data->recording_enabled = false;
 
-  /* Send message to non-RT thread to stop recording */
-  struct rt_message msg = {
-      .type = RT_MSG_STOP_RECORDING};
-
-  if (!rt_bridge_send_message(&data->rt_bridge, &msg))
+  /* Disables RT recording and tells the worker how far to flush before
+   * closing - completion is acknowledged asynchronously through
+   * rt_bridge_recording_flushed(), the RT thread never waits for it */
+  if (!rt_bridge_stop_recording(&data->rt_bridge))
   {
     return -1; /* Message queue full */
   }
@@ -457,275 +396,23 @@ int stop_recording_rt(struct data *data)
 
 uint32_t read_audio_frames_rubberband_rt(struct data *data, float *buf, uint32_t n_samples)
 {
-  if (!data->rubberband_enabled || !data->rubberband_state)
-  {
-    /* Fallback to variable speed if rubberband is disabled */
-    return read_audio_frames_variable_speed_rt(data, buf, n_samples);
-  }
-
-  /* Update rubberband parameters if playback speed changed */
-  static float last_speed = 1.0f;
-  static float last_pitch = 0.0f;
-  bool params_changed = false;
-
-  if (data->playback_speed != last_speed)
-  {
-    /* Set time ratio for speed changes (inverse of playback speed) */
-    double time_ratio = 1.0 / data->playback_speed;
-    rubberband_set_time_ratio(data->rubberband_state, time_ratio);
-    params_changed = true;
-    last_speed = data->playback_speed;
-  }
-
-  if (data->pitch_shift != last_pitch)
-  {
-    /* Set pitch scale for pitch changes, ensuring 1.0 means no pitch change */
-    if (data->pitch_shift == 0.0f)
-    {
-      rubberband_set_pitch_scale(data->rubberband_state, 1.0);
-    }
-    else
-    {
-      float pitch_scale = powf(2.0f, data->pitch_shift / 12.0f);
-      rubberband_set_pitch_scale(data->rubberband_state, pitch_scale);
-    }
-    params_changed = true;
-    last_pitch = data->pitch_shift;
-  }
-
-  /* If parameters changed, use different strategies based on change type */
-  if (params_changed)
-  {
-    /* Determine what type of change occurred */
-    bool pitch_changed = (data->pitch_shift != last_pitch);
-    bool speed_changed = (data->playback_speed != last_speed);
-
-    if (pitch_changed)
-    {
-      /* Pitch changes benefit from reset for immediate response */
-      rubberband_reset(data->rubberband_state);
-    }
-    else if (speed_changed)
-    {
-      /* For speed-only changes, use gentle flushing to avoid speedup artifacts */
-      uint32_t flush_size = 32; /* Very small chunks to minimize artifacts */
-      if (flush_size > data->rubberband_buffer_size)
-      {
-        flush_size = data->rubberband_buffer_size;
-      }
-
-      sf_count_t frames_read = read_audio_frames_buffered_rt(data, data->rubberband_input_buffer, flush_size);
-      if (frames_read > 0)
-      {
-        const float *input_ptr = data->rubberband_input_buffer;
-        rubberband_process(data->rubberband_state, &input_ptr, (size_t)frames_read, 0);
-      }
-    }
-  }
-
-  uint32_t total_output = 0;
-  uint32_t remaining = n_samples;
-
-  /* Prime the rubberband with some initial data if it's empty */
-  int available = rubberband_available(data->rubberband_state);
-  if (available == 0)
-  {
-    /* Feed some initial samples to get rubberband started */
-    uint32_t prime_size = 256; /* Small prime buffer */
-    if (prime_size > data->rubberband_buffer_size)
-    {
-      prime_size = data->rubberband_buffer_size;
-    }
-
-    sf_count_t frames_read = read_audio_frames_buffered_rt(data, data->rubberband_input_buffer, prime_size);
-    if (frames_read > 0)
-    {
-      const float *input_ptr = data->rubberband_input_buffer;
-      rubberband_process(data->rubberband_state, &input_ptr, (size_t)frames_read, 0);
-    }
-  }
-
-  /* Add a safety counter to prevent infinite loops */
-  int iteration_count = 0;
-  const int max_iterations = params_changed ? 25 : 15; /* Extra iterations when params changed for faster transition */
-
-  while (remaining > 0 && total_output < n_samples && iteration_count < max_iterations)
-  {
-    iteration_count++;
-    bool made_progress = false;
-
-    /* Check how many samples rubberband needs */
-    int required = rubberband_get_samples_required(data->rubberband_state);
-
-    if (required > 0)
-    {
-      /* Use smaller chunks when parameters changed for faster response */
-      uint32_t to_read = (uint32_t)required;
-      uint32_t chunk_limit = params_changed ? 64 : 128; /* Smaller chunks for parameter changes */
-      if (to_read > chunk_limit)
-      {
-        to_read = chunk_limit;
-      }
-      if (to_read > data->rubberband_buffer_size)
-      {
-        to_read = data->rubberband_buffer_size;
-      }
-
-      sf_count_t frames_read = read_audio_frames_buffered_rt(data, data->rubberband_input_buffer, to_read);
-
-      if (frames_read > 0)
-      {
-        /* Feed samples to rubberband */
-        const float *input_ptr = data->rubberband_input_buffer;
-        rubberband_process(data->rubberband_state, &input_ptr, (size_t)frames_read, 0);
-        made_progress = true;
-      }
-    }
-
-    /* Try to retrieve processed samples */
-    available = rubberband_available(data->rubberband_state);
-    if (available > 0)
-    {
-      uint32_t to_retrieve = (uint32_t)available;
-      if (to_retrieve > remaining)
-      {
-        to_retrieve = remaining;
-      }
-      if (to_retrieve > data->rubberband_buffer_size)
-      {
-        to_retrieve = data->rubberband_buffer_size;
-      }
-
-      float *output_ptr = data->rubberband_output_buffer;
-      size_t retrieved = rubberband_retrieve(data->rubberband_state, &output_ptr, to_retrieve);
-
-      /* Copy to output buffer */
-      for (size_t i = 0; i < retrieved && total_output < n_samples; i++)
-      {
-        buf[total_output++] = data->rubberband_output_buffer[i];
-      }
-
-      remaining = n_samples - total_output;
-      made_progress = true;
-    }
-
-    /* If no progress was made in this iteration, break to avoid infinite loop */
-    if (!made_progress)
-    {
-      break;
-    }
-  }
-
-  /* Fill remaining buffer with silence if needed */
-  for (uint32_t i = total_output; i < n_samples; i++)
-  {
-    buf[i] = 0.0f;
-  }
-
-  return total_output;
+  /* RubberBand runs on the stretch thread - this only copies its output,
+     or reads the disk ring at varispeed while rubberband is disabled */
+  memset(buf, 0, n_samples * sizeof(float));
+  return stretch_file_mix_rt(&data->stretch, &data->disk_stream, buf, n_samples, data->playback_speed,
+                             data->pitch_shift, data->rubberband_enabled, 1.0f);
 }
 
-/* Optimized buffered audio reading functions - minimize file I/O in RT thread */
+/* Buffered variants, kept for the rubberband path - the stream is the buffer */
 
 sf_count_t read_audio_frames_buffered_rt(struct data *data, float *buf, uint32_t n_samples)
 {
-  /* Use the buffered system to minimize file I/O operations */
-  return audio_buffer_rt_read(&data->audio_buffer, data->file, &data->fileinfo, buf, n_samples);
+  return read_audio_frames_rt(data, buf, n_samples);
 }
 
 sf_count_t read_audio_frames_variable_speed_buffered_rt(struct data *data, float *buf, uint32_t n_samples)
 {
-  if (data->playback_speed <= 0.0f || data->playback_speed > 10.0f)
-  {
-    /* Invalid speed, use normal speed as fallback */
-    data->playback_speed = 1.0f;
-  }
-
-  if (data->playback_speed == 1.0f)
-  {
-    /* Normal speed - use the optimized buffered path */
-    return read_audio_frames_buffered_rt(data, buf, n_samples);
-  }
-
-  /* Variable speed playback using linear interpolation with minimal file I/O */
-  sf_count_t total_frames = data->fileinfo.frames;
-  uint32_t output_frames = 0;
-
-  /* Pre-allocate a small working buffer to reduce individual sample reads */
-  const uint32_t work_buffer_size = 256;
-  static float work_buffer[256];
-  static sf_count_t work_buffer_start = -1;
-  static uint32_t work_buffer_valid = 0;
-
-  for (uint32_t i = 0; i < n_samples && output_frames < n_samples; i++)
-  {
-    /* Get integer and fractional parts of sample position */
-    sf_count_t sample_index = (sf_count_t)data->sample_position;
-    double frac = data->sample_position - sample_index;
-
-    /* Handle looping */
-    if (sample_index >= total_frames)
-    {
-      data->sample_position = fmod(data->sample_position, total_frames);
-      sample_index = (sf_count_t)data->sample_position;
-      frac = data->sample_position - sample_index;
-      audio_buffer_rt_reset(&data->audio_buffer);
-      work_buffer_start = -1; /* Invalidate work buffer */
-    }
-
-    /* Check if we need to refresh the work buffer */
-    if (work_buffer_start == -1 ||
-        sample_index < work_buffer_start ||
-        sample_index >= (work_buffer_start + work_buffer_valid))
-    {
-      /* Refresh work buffer from the main audio buffer */
-      work_buffer_start = sample_index;
-      work_buffer_valid = audio_buffer_rt_read(&data->audio_buffer, data->file, &data->fileinfo,
-                                               work_buffer, work_buffer_size);
-    }
-
-    /* Get samples for interpolation from work buffer */
-    float current_sample = 0.0f;
-    float next_sample = 0.0f;
-
-    sf_count_t local_index = sample_index - work_buffer_start;
-    if (local_index < work_buffer_valid)
-    {
-      current_sample = work_buffer[local_index];
-
-      if (local_index + 1 < work_buffer_valid)
-      {
-        next_sample = work_buffer[local_index + 1];
-      }
-      else if (sample_index + 1 < total_frames)
-      {
-        /* Need next sample, but it's beyond our work buffer */
-        sf_count_t next_pos = sample_index + 1;
-        audio_buffer_rt_read(&data->audio_buffer, data->file, &data->fileinfo, &next_sample, 1);
-      }
-      else
-      {
-        /* End of file - use first sample for looping */
-        audio_buffer_rt_reset(&data->audio_buffer);
-        audio_buffer_rt_read(&data->audio_buffer, data->file, &data->fileinfo, &next_sample, 1);
-      }
-    }
-
-    /* Linear interpolation */
-    buf[output_frames] = current_sample + (next_sample - current_sample) * frac;
-    output_frames++;
-
-    /* Advance sample position by speed multiplier */
-    data->sample_position += data->playback_speed;
-  }
-
-  /* Fill remaining buffer with silence if needed */
-  for (uint32_t i = output_frames; i < n_samples; i++)
-  {
-    buf[i] = 0.0f;
-  }
-
-  return output_frames;
+  return read_audio_frames_variable_speed_rt(data, buf, n_samples);
 }
 
 void reset_memory_loop_playback_rt(struct data *data, uint8_t midi_note)
@@ -753,12 +440,12 @@ void reset_memory_loop_playback_rt(struct data *data, uint8_t midi_note)
         if (pulse_position < loop->recorded_frames)
         {
           // Pulse position fits within this loop - start there
-          loop->playback_position = pulse_position;
+          loop_storage_seek(data, loop, pulse_position);
         }
         else
         {
           // Pulse position is beyond this loop's length - use modulo
-          loop->playback_position = pulse_position % loop->recorded_frames;
+          loop_storage_seek(data, loop, pulse_position % loop->recorded_frames);
         }
 
         return; // Early return - don't reset to 0
@@ -768,7 +455,7 @@ void reset_memory_loop_playback_rt(struct data *data, uint8_t midi_note)
   }
 
   // Default behavior - reset to beginning
-  data->memory_loops[midi_note].playback_position = 0;
+  loop_storage_seek(data, &data->memory_loops[midi_note], 0);
 }
 
 int start_loop_recording_rt(struct data *data, uint8_t midi_note, const char *filename)
@@ -778,17 +465,33 @@ int start_loop_recording_rt(struct data *data, uint8_t midi_note, const char *fi
 
   struct memory_loop *loop = &data->memory_loops[midi_note];
 
-  if (!loop->buffer)
+  /* A new take always gets a fresh chain: the previous take may still be
+   * being written to disk, and the writer's reference keeps it alive */
+  release_loop_memory(data, midi_note);
+
+  /* Arm the loop with its first pool block (RT-safe, no allocation) */
+  if (!acquire_loop_memory(data, midi_note))
+  {
+    struct rt_message msg = {
+        .type = RT_MSG_ERROR,
+    };
+    const char *error_msg = "Loop memory pool exhausted";
+    memcpy(msg.data.error.message, error_msg, strlen(error_msg) + 1);
+    rt_bridge_send_message(&data->rt_bridge, &msg);
     return -1;
+  }
 
   /* Reset loop state */
   loop->recorded_frames = 0;
-  loop->playback_position = 0;
+  loop_storage_seek(data, loop, 0);
   loop->loop_ready = false;
   loop->recording_to_memory = true;
 
-  /* Store filename for later file write */
-  if (filename)
+  /* Store filename for later file write. Without one, only the take time is
+   * recorded here - the name is formatted off the RT thread (localtime and
+   * snprintf are not RT-safe) by the worker and by config save. */
+  loop->take_time = time(NULL);
+  if (filename && filename[0])
   {
     size_t len = strlen(filename);
     if (len >= sizeof(loop->loop_filename))
@@ -800,18 +503,11 @@ int start_loop_recording_rt(struct data *data, uint8_t midi_note, const char *fi
   }
   else
   {
-    /* Generate timestamp-based filename */
-    time_t now;
-    time(&now);
-    struct tm *tm_info = localtime(&now);
-    snprintf(loop->loop_filename, sizeof(loop->loop_filename),
-             "loop_note%d_%04d-%02d-%02d_%02d-%02d-%02d.wav", midi_note,
-             tm_info->tm_year + 1900, tm_info->tm_mon + 1, tm_info->tm_mday,
-             tm_info->tm_hour, tm_info->tm_min, tm_info->tm_sec);
+    loop->loop_filename[0] = '\0';
   }
 
   /* Also start regular recording for backup */
-  start_recording_rt(data, loop->loop_filename);
+  send_start_recording_rt(data, loop->loop_filename, midi_note, loop->take_time);
 
   return 0;
 }
@@ -829,17 +525,24 @@ int stop_loop_recording_rt(struct data *data, uint8_t midi_note)
   /* Stop memory recording */
   loop->recording_to_memory = false;
 
+  /* Stop the backup recording first so the worker closes it before the
+   * trimmed loop is written over the same file */
+  stop_recording_rt(data);
+
   /* If we recorded something, mark loop as ready for playback */
   if (loop->recorded_frames > 0)
   {
     loop->loop_ready = true;
-    loop->playback_position = 0;
+    loop_storage_seek(data, loop, 0);
 
     /* Send message to non-RT thread to write loop to file */
     struct rt_message msg = {
         .type = RT_MSG_WRITE_LOOP_TO_FILE,
         .data.loop_write = {
-            .audio_data = loop->buffer,
+            .midi_note = midi_note,
+            .take_time = loop->take_time,
+            .pool = &data->loop_pool,
+            .first_block = loop->first_block,
             .num_frames = loop->recorded_frames,
             .sample_rate = loop->sample_rate}};
 
@@ -847,12 +550,14 @@ int stop_loop_recording_rt(struct data *data, uint8_t midi_note)
     memcpy(msg.data.loop_write.filename, loop->loop_filename,
            sizeof(msg.data.loop_write.filename));
 
-    rt_bridge_send_message(&data->rt_bridge, &msg);
+    /* The writer holds its own reference until the file is written */
+    loop_pool_chain_ref(&data->loop_pool, loop->first_block);
+    if (!rt_bridge_send_message(&data->rt_bridge, &msg))
+    {
+      loop_pool_chain_unref(&data->loop_pool, loop->first_block, loop->last_block, loop->block_count);
+    }
   }
 
-  /* Also stop regular recording */
-  stop_recording_rt(data);
-
   return 0;
 }
 
@@ -863,60 +568,32 @@ bool store_audio_in_memory_loop_rt(struct data *data, uint8_t midi_note, const f
 
   struct memory_loop *loop = &data->memory_loops[midi_note];
 
-  if (!loop->buffer || !loop->recording_to_memory)
+  if (loop->first_block == LOOP_POOL_NONE || !loop->recording_to_memory)
     return false;
 
-  /* Check if we have space in the buffer */
-  uint32_t space_available = loop->buffer_size - loop->recorded_frames;
-  uint32_t samples_to_store = n_samples;
-
-  if (samples_to_store > space_available)
-  {
-    samples_to_store = space_available;
-  }
-
-  /* Copy audio data to memory buffer */
-  float *dest = loop->buffer + loop->recorded_frames;
-  memcpy(dest, input, samples_to_store * sizeof(float));
-
-  loop->recorded_frames += samples_to_store;
+  /* Append to the block chain, growing it from the pool as needed */
+  uint32_t samples_stored = loop_storage_append(data, loop, input, n_samples);
 
-  /* Return true if we stored all samples, false if buffer is full */
-  return (samples_to_store == n_samples);
+  /* Return true if we stored all samples, false if the pool is exhausted */
+  return (samples_stored == n_samples);
 }
 
 sf_count_t read_audio_frames_from_memory_loop_rt(struct data *data, float *buf, uint32_t n_samples)
 {
   // TEMPORARY: Use first loop - this function needs proper multi-loop implementation
-  if (!data || !data->memory_loops[0].buffer || !data->memory_loops[0].loop_ready || !buf)
+  if (!data || data->memory_loops[0].first_block == LOOP_POOL_NONE || !data->memory_loops[0].loop_ready || !buf)
     return 0;
 
   if (data->memory_loops[0].recorded_frames == 0)
     return 0;
 
-  uint32_t frames_copied = 0;
-
-  for (uint32_t i = 0; i < n_samples; i++)
-  {
-    /* Handle looping */
-    if (data->memory_loops[0].playback_position >= data->memory_loops[0].recorded_frames)
-    {
-      data->memory_loops[0].playback_position = 0;
-    }
-
-    /* Copy sample from memory loop */
-    buf[i] = data->memory_loops[0].buffer[data->memory_loops[0].playback_position];
-    data->memory_loops[0].playback_position++;
-    frames_copied++;
-  }
-
-  return frames_copied;
+  return loop_storage_read(data, &data->memory_loops[0], buf, n_samples);
 }
 
 sf_count_t read_audio_frames_from_memory_loop_variable_speed_rt(struct data *data, float *buf, uint32_t n_samples)
 {
   // TEMPORARY: Use first loop - this function needs proper multi-loop implementation
-  if (!data || !data->memory_loops[0].buffer || !data->memory_loops[0].loop_ready || !buf)
+  if (!data || data->memory_loops[0].first_block == LOOP_POOL_NONE || !data->memory_loops[0].loop_ready || !buf)
     return 0;
 
   if (data->memory_loops[0].recorded_frames == 0)
@@ -933,231 +610,27 @@ sf_count_t read_audio_frames_from_memory_loop_variable_speed_rt(struct data *dat
     return read_audio_frames_from_memory_loop_rt(data, buf, n_samples);
   }
 
-  /* Variable speed playback using linear interpolation on memory loop */
-  uint32_t total_frames = data->memory_loops[0].recorded_frames;
-  uint32_t output_frames = 0;
-  static double loop_sample_position = 0.0; /* Separate position for memory loop */
-
-  for (uint32_t i = 0; i < n_samples && output_frames < n_samples; i++)
+  /* Band-limited varispeed through the loop's resampler; temp_audio_buffer is its work area */
+  struct loop_storage_reader reader = {data, &data->memory_loops[0]};
+  for (uint32_t done = 0; done < n_samples;)
   {
-    /* Get integer and fractional parts of sample position */
-    uint32_t sample_index = (uint32_t)loop_sample_position;
-    double frac = loop_sample_position - sample_index;
-
-    /* Handle looping */
-    if (sample_index >= total_frames)
+    uint32_t block = n_samples - done;
+    if (block > RESAMPLER_BLOCK)
     {
-      loop_sample_position = fmod(loop_sample_position, total_frames);
-      sample_index = (uint32_t)loop_sample_position;
-      frac = loop_sample_position - sample_index;
+      block = RESAMPLER_BLOCK;
     }
-
-    /* Get samples for interpolation */
-    float current_sample = data->memory_loops[0].buffer[sample_index];
-    float next_sample;
-
-    if (sample_index + 1 < total_frames)
-    {
-      next_sample = data->memory_loops[0].buffer[sample_index + 1];
-    }
-    else
-    {
-      /* End of loop - use first sample for seamless looping */
-      next_sample = data->memory_loops[0].buffer[0];
-    }
-
-    /* Linear interpolation */
-    buf[output_frames] = current_sample + (next_sample - current_sample) * frac;
-    output_frames++;
-
-    /* Advance sample position by speed multiplier */
-    loop_sample_position += data->playback_speed;
+    resampler_process_rt(&data->memory_loops[0].resampler, buf + done, block, data->playback_speed,
+                         loop_storage_pull_rt, &reader, data->temp_audio_buffer);
+    done += block;
   }
 
-  /* Fill remaining buffer with silence if needed */
-  for (uint32_t i = output_frames; i < n_samples; i++)
-  {
-    buf[i] = 0.0f;
-  }
-
-  return output_frames;
+  return n_samples;
 }
 
 uint32_t read_audio_frames_memory_loop_rubberband_rt(struct data *data, float *buf, uint32_t n_samples)
 {
-  pw_log_debug("Memory loop rubberband called: speed=%.2f, pitch=%.2f, enabled=%d, state=%p",
-               data->playback_speed, data->pitch_shift, data->rubberband_enabled, data->rubberband_state);
-
-  if (!data->rubberband_enabled || !data->rubberband_state)
-  {
-    pw_log_debug("Rubberband not available, falling back to variable speed");
-    /* Fallback to variable speed if rubberband is disabled */
-    return read_audio_frames_from_memory_loop_variable_speed_rt(data, buf, n_samples);
-  }
-
-  if (!data->memory_loops[0].loop_ready || data->memory_loops[0].recorded_frames == 0)
-  {
-    /* No loop available, fill with silence */
-    for (uint32_t i = 0; i < n_samples; i++)
-    {
-      buf[i] = 0.0f;
-    }
-    return n_samples;
-  }
-
-  /* Update rubberband parameters if playback speed or pitch changed */
-  static float last_speed = 1.0f;
-  static float last_pitch = 0.0f;
-  bool params_changed = false;
-  bool pitch_changed = false;
-  bool speed_changed = false;
-
-  if (data->playback_speed != last_speed)
-  {
-    /* Set time ratio for speed changes (inverse of playback speed) */
-    double time_ratio = 1.0 / data->playback_speed;
-    rubberband_set_time_ratio(data->rubberband_state, time_ratio);
-    params_changed = true;
-    speed_changed = true;
-    last_speed = data->playback_speed;
-    pw_log_debug("Speed changed to %.2f, time_ratio=%.2f", data->playback_speed, time_ratio);
-  }
-
-  if (data->pitch_shift != last_pitch)
-  {
-    /* Set pitch scale for pitch changes, ensuring 1.0 means no pitch change */
-    if (data->pitch_shift == 0.0f)
-    {
-      rubberband_set_pitch_scale(data->rubberband_state, 1.0);
-      pw_log_debug("Pitch reset to 0.0, pitch_scale=1.0");
-    }
-    else
-    {
-      float pitch_scale = powf(2.0f, data->pitch_shift / 12.0f);
-      rubberband_set_pitch_scale(data->rubberband_state, pitch_scale);
-      pw_log_debug("Pitch changed to %.2f semitones, pitch_scale=%.2f", data->pitch_shift, pitch_scale);
-    }
-    params_changed = true;
-    pitch_changed = true;
-    last_pitch = data->pitch_shift;
-  }
-
-  /* If parameters changed, use gentle flushing to avoid timing artifacts */
-  if (params_changed)
-  {
-    /* Use gentle flushing for both speed and pitch changes to avoid speedup artifacts */
-    uint32_t flush_size = 32; /* Very small chunks to minimize artifacts */
-    if (flush_size > data->rubberband_buffer_size)
-    {
-      flush_size = data->rubberband_buffer_size;
-    }
-
-    sf_count_t frames_read = read_audio_frames_from_memory_loop_rt(data, data->rubberband_input_buffer, flush_size);
-    if (frames_read > 0)
-    {
-      const float *input_ptr = data->rubberband_input_buffer;
-      rubberband_process(data->rubberband_state, &input_ptr, (size_t)frames_read, 0);
-    }
-  }
-
-  uint32_t total_output = 0;
-  uint32_t remaining = n_samples;
-
-  /* Prime the rubberband with some initial data if it's empty */
-  int available = rubberband_available(data->rubberband_state);
-  if (available == 0)
-  {
-    /* Feed some initial samples to get rubberband started */
-    uint32_t prime_size = 256; /* Small prime buffer */
-    if (prime_size > data->rubberband_buffer_size)
-    {
-      prime_size = data->rubberband_buffer_size;
-    }
-
-    sf_count_t frames_read = read_audio_frames_from_memory_loop_rt(data, data->rubberband_input_buffer, prime_size);
-    if (frames_read > 0)
-    {
-      const float *input_ptr = data->rubberband_input_buffer;
-      rubberband_process(data->rubberband_state, &input_ptr, (size_t)frames_read, 0);
-    }
-  }
-
-  /* Add a safety counter to prevent infinite loops */
-  int iteration_count = 0;
-  const int max_iterations = params_changed ? 25 : 15; /* Extra iterations when params changed for faster transition */
-
-  while (remaining > 0 && total_output < n_samples && iteration_count < max_iterations)
-  {
-    iteration_count++;
-    bool made_progress = false;
-
-    /* Check how many samples rubberband needs */
-    int required = rubberband_get_samples_required(data->rubberband_state);
-
-    if (required > 0)
-    {
-      /* Use smaller chunks when parameters changed for faster response */
-      uint32_t to_read = (uint32_t)required;
-      uint32_t chunk_limit = params_changed ? 64 : 128; /* Smaller chunks for parameter changes */
-      if (to_read > chunk_limit)
-      {
-        to_read = chunk_limit;
-      }
-      if (to_read > data->rubberband_buffer_size)
-      {
-        to_read = data->rubberband_buffer_size;
-      }
-
-      sf_count_t frames_read = read_audio_frames_from_memory_loop_rt(data, data->rubberband_input_buffer, to_read);
-
-      if (frames_read > 0)
-      {
-        /* Feed samples to rubberband */
-        const float *input_ptr = data->rubberband_input_buffer;
-        rubberband_process(data->rubberband_state, &input_ptr, (size_t)frames_read, 0);
-        made_progress = true;
-      }
-    }
-
-    /* Try to retrieve processed samples */
-    available = rubberband_available(data->rubberband_state);
-    if (available > 0)
-    {
-      uint32_t to_retrieve = (uint32_t)available;
-      if (to_retrieve > remaining)
-      {
-        to_retrieve = remaining;
-      }
-      if (to_retrieve > data->rubberband_buffer_size)
-      {
-        to_retrieve = data->rubberband_buffer_size;
-      }
-
-      float *output_ptr = data->rubberband_output_buffer;
-      size_t retrieved = rubberband_retrieve(data->rubberband_state, &output_ptr, to_retrieve);
-
-      /* Copy to output buffer */
-      for (size_t i = 0; i < retrieved && total_output < n_samples; i++)
-      {
-        buf[total_output++] = data->rubberband_output_buffer[i];
-      }
-
-      remaining = n_samples - total_output;
-      made_progress = true;
-    }
-
-    /* If no progress was made in this iteration, break to avoid infinite loop */
-    if (!made_progress)
-    {
-      break;
-    }
-  }
-
-  /* Fill remaining buffer with silence if needed */
-  for (uint32_t i = total_output; i < n_samples; i++)
-  {
-    buf[i] = 0.0f;
-  }
-
-  return total_output;
+  /* No RubberBand calls in the process callback. Loops are stretched in the
+     mixer from their own speed/pitch (set_loop_stretch) through the stretcher
+     pool; this single-loop reader stays varispeed */
+  return read_audio_frames_from_memory_loop_variable_speed_rt(data, buf, n_samples);
 }
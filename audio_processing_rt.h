@@ -7,6 +7,26 @@
 void handle_audio_input_rt(struct data *data, uint32_t n_samples);
 void process_audio_output_rt(struct data *data, struct spa_io_position *position);
 
+/* Output buffer for one cycle, filled a block at a time */
+struct audio_output_rt
+{
+  struct pw_buffer *b;
+  float *buf;
+  uint32_t frames;  /* Cycle length, clamped to what the buffer asked for */
+  uint32_t written; /* Frames filled so far */
+  bool mixed;       /* Any block produced audio */
+  bool dequeued;    /* Dequeue already attempted this cycle */
+};
+
+/* Sub-block processing, so MIDI events can take effect mid-cycle.
+ * The input block is the part of the cycle's input buffer (NULL for none)
+ * up to the next event; output blocks cover [offset, offset + n_samples). */
+void handle_audio_input_block_rt(struct data *data, const float *in, uint32_t n_samples);
+void audio_output_begin_rt(struct audio_output_rt *out, uint32_t n_samples);
+void process_audio_output_block_rt(struct data *data, struct audio_output_rt *out,
+                                   uint32_t offset, uint32_t n_samples);
+void audio_output_end_rt(struct data *data, struct audio_output_rt *out);
+
 /* RT-safe utility functions */
 float calculate_rms_rt(const float *buffer, uint32_t n_samples);
 void apply_volume_rt(float *buf, uint32_t frames, float volume);
@@ -29,7 +49,12 @@ bool store_audio_in_memory_loop_rt(struct data *data, uint8_t midi_note, const f
 
 /* Multi-loop mixing functions */
 sf_count_t mix_all_active_loops_rt(struct data *data, float *buf, uint32_t n_samples);
-sf_count_t read_audio_frames_from_memory_loop_basic_rt(struct memory_loop *loop, float *buf, uint32_t n_samples);
+sf_count_t read_audio_frames_from_memory_loop_variable_speed_rt(struct data *data, float *buf, uint32_t n_samples);
+sf_count_t read_audio_frames_from_memory_loop_basic_rt(struct data *data, struct memory_loop *loop, float *buf, uint32_t n_samples);
 void reset_memory_loop_playback_rt(struct data *data, uint8_t midi_note);
 
+/* Loop positions follow the graph clock: call at the start of each cycle so
+   loops that missed frames (xrun, clock jump) are put back in phase */
+void loop_clock_begin_cycle_rt(struct data *data, uint64_t cycle_frame, uint32_t n_samples);
+
 #endif /* AUDIO_PROCESSING_RT_H */
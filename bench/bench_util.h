@@ -0,0 +1,158 @@
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+/* Timing and reporting shared by the benchmarks in bench/.
+ *
+ * bench_measure() calibrates a batch size, warms up, then keeps the best of
+ * BENCH_REPEATS timed batches. Results go to stdout as one JSON document so
+ * runs can be archived and compared across releases; a readable table goes
+ * to stderr. "frames" is the work done per call - samples for the DSP
+ * cases, messages for the queue - so ns_per_frame is per sample or per
+ * message. cycles_per_sample counts TSC ticks and is null where there is
+ * no TSC; on modern x86 the TSC runs at a fixed reference frequency, not
+ * the current core clock. */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAVE_TSC 1
+#endif
+
+#define BENCH_REPEATS 5
+#define BENCH_BATCH_NS 20000000ULL /* Aim for 20 ms per timed batch */
+
+struct bench_result
+{
+  const char *name;
+  char variant[48];
+  uint32_t frames;     /* Work per call */
+  uint64_t iterations; /* Calls per timed batch */
+  double ns_per_call;
+  double ns_per_frame;
+  double cycles_per_sample; /* < 0 without a TSC */
+};
+
+struct bench_report
+{
+  const char *suite;
+  int count;
+};
+
+typedef void (*bench_fn)(void *ctx);
+
+static inline uint64_t bench_now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static inline uint64_t bench_cycles(void)
+{
+#ifdef BENCH_HAVE_TSC
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+static inline void bench_measure(struct bench_result *r, bench_fn fn, void *ctx)
+{
+  /* Double the batch until it takes long enough to time reliably */
+  uint64_t iterations = 1;
+  for (;;)
+  {
+    uint64_t start = bench_now_ns();
+    for (uint64_t i = 0; i < iterations; i++)
+      fn(ctx);
+    uint64_t elapsed = bench_now_ns() - start;
+    if (elapsed >= BENCH_BATCH_NS / 4 || iterations >= (1ULL << 40))
+    {
+      if (elapsed > 0)
+        iterations = iterations * BENCH_BATCH_NS / elapsed;
+      break;
+    }
+    iterations *= 2;
+  }
+  if (iterations == 0)
+    iterations = 1;
+
+  /* One untimed batch to settle caches, branch predictors and clocks */
+  for (uint64_t i = 0; i < iterations; i++)
+    fn(ctx);
+
+  double best_ns = -1.0, best_cycles = -1.0;
+  for (int rep = 0; rep < BENCH_REPEATS; rep++)
+  {
+    uint64_t c0 = bench_cycles();
+    uint64_t t0 = bench_now_ns();
+    for (uint64_t i = 0; i < iterations; i++)
+      fn(ctx);
+    uint64_t t1 = bench_now_ns();
+    uint64_t c1 = bench_cycles();
+
+    double ns = (double)(t1 - t0) / iterations;
+    if (best_ns < 0.0 || ns < best_ns)
+    {
+      best_ns = ns;
+      best_cycles = (double)(c1 - c0) / iterations;
+    }
+  }
+
+  r->iterations = iterations;
+  r->ns_per_call = best_ns;
+  r->ns_per_frame = best_ns / r->frames;
+#ifdef BENCH_HAVE_TSC
+  r->cycles_per_sample = best_cycles / r->frames;
+#else
+  (void)best_cycles;
+  r->cycles_per_sample = -1.0;
+#endif
+}
+
+static inline void bench_report_begin(struct bench_report *report, const char *suite)
+{
+  report->suite = suite;
+  report->count = 0;
+#ifdef BENCH_HAVE_TSC
+  const char *tsc = "true";
+#else
+  const char *tsc = "false";
+#endif
+  printf("{\n  \"suite\": \"%s\",\n  \"tsc\": %s,\n  \"results\": [", suite, tsc);
+  fprintf(stderr, "%-52s %-18s %8s %12s %10s %10s\n",
+          "benchmark", "variant", "frames", "ns/call", "ns/frame", "cyc/sample");
+}
+
+static inline void bench_report_add(struct bench_report *report, const struct bench_result *r)
+{
+  printf("%s\n    {\"name\": \"%s\", \"variant\": \"%s\", \"frames\": %u, \"iterations\": %llu, "
+         "\"ns_per_call\": %.3f, \"ns_per_frame\": %.4f, \"cycles_per_sample\": ",
+         report->count ? "," : "", r->name, r->variant, r->frames,
+         (unsigned long long)r->iterations, r->ns_per_call, r->ns_per_frame);
+  if (r->cycles_per_sample >= 0.0)
+    printf("%.4f}", r->cycles_per_sample);
+  else
+    printf("null}");
+  report->count++;
+
+  fprintf(stderr, "%-52s %-18s %8u %12.1f %10.4f ", r->name, r->variant, r->frames,
+          r->ns_per_call, r->ns_per_frame);
+  if (r->cycles_per_sample >= 0.0)
+    fprintf(stderr, "%10.3f\n", r->cycles_per_sample);
+  else
+    fprintf(stderr, "%10s\n", "-");
+}
+
+static inline void bench_report_end(struct bench_report *report)
+{
+  printf("\n  ]\n}\n");
+  fflush(stdout);
+  fprintf(stderr, "\n%d %s results\n", report->count, report->suite);
+}
+
+#endif /* BENCH_UTIL_H */
@@ -0,0 +1,202 @@
+/* Engine command queue benchmark
+ *
+ * Stress-tests the multi-producer command queue with several producer
+ * threads and one consumer standing in for the RT thread, all running flat
+ * out. Each command carries its producer and a sequence number twice over,
+ * so the consumer catches lost, duplicated, reordered or torn commands.
+ * Producers also take back some of their commands right after queueing
+ * them, racing the consumer for the claim: every command has to be either
+ * consumed or taken back, never both, and every ticket has to read as done
+ * once the consumer has passed it.
+ *
+ *   meson test --benchmark            or   ./command_bench [commands] [producers]
+ */
+#define _GNU_SOURCE
+#include "../uphonor.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define MAX_PRODUCERS 16
+#define RECLAIM_EVERY 61 /* Producers try to take back every Nth command */
+
+struct stress
+{
+  struct engine_command_queue queue;
+  uint32_t producers;
+  uint64_t per_producer; /* Commands each producer queues */
+
+  /* Per producer, written by that producer only */
+  uint64_t reclaimed[MAX_PRODUCERS];
+  uint64_t unfinished[MAX_PRODUCERS]; /* Tickets not done after the consumer passed them */
+
+  /* Consumer */
+  uint64_t consumed[MAX_PRODUCERS];
+  uint64_t errors; /* Torn, duplicated or out-of-order commands */
+  _Atomic uint32_t producers_done;
+};
+
+struct producer
+{
+  struct stress *s;
+  uint32_t id;
+};
+
+static double now_sec(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void pin_to_cpu(int cpu)
+{
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu % CPU_SETSIZE, &set);
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+/* Sequence numbers stay below 2^24 so they are exact in a float */
+static inline float sequence_value(uint64_t n)
+{
+  return (float)(n & 0xffffff);
+}
+
+static void *producer_thread(void *arg)
+{
+  struct producer *p = arg;
+  struct stress *s = p->s;
+  struct engine_command command = {.type = ENGINE_CMD_LOOP_STRETCH};
+
+  pin_to_cpu(1 + p->id);
+  for (uint64_t i = 0; i < s->per_producer; i++)
+  {
+    /* Two fields so a torn copy is detected as well as a stale one */
+    command.data.loop_stretch.note = (uint8_t)p->id;
+    command.data.loop_stretch.speed = sequence_value(i);
+    command.data.loop_stretch.pitch = -sequence_value(i);
+
+    uint32_t ticket;
+    while (!engine_command_push(&s->queue, &command, &ticket))
+      sched_yield();
+
+    if (i % RECLAIM_EVERY == 0 && engine_command_reclaim(&s->queue, ticket))
+      s->reclaimed[p->id]++;
+  }
+
+  /* Everything queued so far has to read as done once the consumer is past it */
+  uint32_t last;
+  command.data.loop_stretch.note = 0xff;
+  while (!engine_command_push(&s->queue, &command, &last))
+    sched_yield();
+  while (!engine_command_done(&s->queue, last))
+    sched_yield();
+  if (!engine_command_done(&s->queue, last - 1))
+    s->unfinished[p->id]++;
+
+  atomic_fetch_add_explicit(&s->producers_done, 1, memory_order_release);
+  return NULL;
+}
+
+static void *consumer_thread(void *arg)
+{
+  struct stress *s = arg;
+  uint64_t expected[MAX_PRODUCERS] = {0};
+
+  pin_to_cpu(0);
+  for (;;)
+  {
+    // Read before peeking, so an empty queue after the last producer is really the end
+    bool finished = atomic_load_explicit(&s->producers_done, memory_order_acquire) == s->producers;
+    const struct engine_command *command = engine_command_peek_rt(&s->queue);
+    if (!command)
+    {
+      if (finished)
+        break;
+      sched_yield();
+      continue;
+    }
+
+    uint8_t id = command->data.loop_stretch.note;
+    if (id != 0xff)
+    {
+      float speed = command->data.loop_stretch.speed;
+      float pitch = command->data.loop_stretch.pitch;
+
+      /* Taken-back commands leave gaps, but a producer's commands never go backwards */
+      if (id >= s->producers || speed != -pitch || speed < sequence_value(expected[id]))
+      {
+        s->errors++;
+      }
+      else
+      {
+        expected[id] = (uint64_t)speed + 1;
+        s->consumed[id]++;
+      }
+    }
+    engine_command_release_rt(&s->queue);
+  }
+  return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+  uint64_t commands = argc > 1 ? strtoull(argv[1], NULL, 10) : 10000000ULL;
+  uint32_t producers = argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 10) : 4;
+  if (producers < 1)
+    producers = 1;
+  if (producers > MAX_PRODUCERS)
+    producers = MAX_PRODUCERS;
+
+  struct stress *s = calloc(1, sizeof(*s));
+  if (!s)
+    return 1;
+  engine_command_queue_init(&s->queue);
+  s->producers = producers;
+  s->per_producer = SPA_MIN(commands / producers, (uint64_t)0xffffff);
+  atomic_init(&s->producers_done, 0);
+
+  printf("Engine command queue benchmark: %u producers x %llu commands\n\n", producers,
+         (unsigned long long)s->per_producer);
+
+  pthread_t consumer, threads[MAX_PRODUCERS];
+  struct producer args[MAX_PRODUCERS];
+
+  double start = now_sec();
+  pthread_create(&consumer, NULL, consumer_thread, s);
+  for (uint32_t i = 0; i < producers; i++)
+  {
+    args[i] = (struct producer){s, i};
+    pthread_create(&threads[i], NULL, producer_thread, &args[i]);
+  }
+  for (uint32_t i = 0; i < producers; i++)
+    pthread_join(threads[i], NULL);
+  pthread_join(consumer, NULL);
+  double elapsed = now_sec() - start;
+
+  uint64_t consumed = 0, reclaimed = 0, mismatched = 0, unfinished = 0;
+  for (uint32_t i = 0; i < producers; i++)
+  {
+    consumed += s->consumed[i];
+    reclaimed += s->reclaimed[i];
+    unfinished += s->unfinished[i];
+    // Lost commands show up as too few, ones both consumed and taken back as too many
+    uint64_t handled = s->consumed[i] + s->reclaimed[i];
+    mismatched += handled > s->per_producer ? handled - s->per_producer : s->per_producer - handled;
+  }
+
+  printf("%-12s %14s %12s %10s %10s %10s\n", "structure", "M commands/s", "taken back", "mismatched", "unfinished",
+         "errors");
+  printf("%-12s %14.1f %12llu %10llu %10llu %10llu\n", "mpsc queue",
+         (consumed + reclaimed) / elapsed / 1e6, (unsigned long long)reclaimed, (unsigned long long)mismatched,
+         (unsigned long long)unfinished, (unsigned long long)s->errors);
+
+  int failed = s->errors || mismatched || unfinished;
+  if (failed)
+    printf("FAILED\n");
+  free(s);
+  return failed;
+}
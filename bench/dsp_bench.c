@@ -0,0 +1,313 @@
+/* DSP and bridge hot path benchmark
+ *
+ * Times the functions the process callback spends its cycles in, against
+ * the engine library itself: level metering, volume, the loop mixer at 1,
+ * 16 and 128 loops (and 16 at varispeed), the sync backfill buffer, the
+ * bridge ring and queue, the varispeed resampler at each quality tier,
+ * streamed file playback and the old
+ * in-callback buffered file reader it replaced. Plain loops
+ * are timed next to the unrolled metering and volume code so the gain
+ * claimed for them can be checked. Output is JSON on stdout (see
+ * bench_util.h), a table on stderr.
+ *
+ *   meson test --benchmark dsp        or   ./dsp_bench [quantum] > dsp.json
+ */
+#include "../uphonor.h"
+#include "../mix_kernels.h"
+#include "bench_util.h"
+#include <stdlib.h>
+#include <unistd.h>
+
+#define MAX_QUANTUM 8192
+#define SAMPLE_RATE 48000
+#define FILE_SECONDS 10
+
+struct dsp_ctx
+{
+  struct data *data;
+  float *buf;
+  float *in;
+  uint32_t quantum;
+  float volume;
+  float sink; /* Keeps results alive */
+  struct audio_ring_buffer ring;
+  struct message_queue queue;
+  struct audio_buffer_rt reader;
+};
+
+/* Straightforward versions of the metering and volume loops */
+static float rms_reference(const float *buffer, uint32_t n_samples)
+{
+  float sum = 0.0f;
+  for (uint32_t i = 0; i < n_samples; i++)
+    sum += buffer[i] * buffer[i];
+  return sqrtf(sum / n_samples);
+}
+
+static void volume_reference(float *buf, uint32_t frames, float volume)
+{
+  for (uint32_t i = 0; i < frames; i++)
+    buf[i] *= volume;
+}
+
+static void run_rms(void *arg)
+{
+  struct dsp_ctx *ctx = arg;
+  ctx->sink += calculate_rms_rt(ctx->in, ctx->quantum);
+}
+
+static void run_rms_reference(void *arg)
+{
+  struct dsp_ctx *ctx = arg;
+  ctx->sink += rms_reference(ctx->in, ctx->quantum);
+}
+
+/* Alternate the gain so the buffer neither decays nor overflows */
+static void run_volume(void *arg)
+{
+  struct dsp_ctx *ctx = arg;
+  ctx->volume = ctx->volume == 0.5f ? 2.0f : 0.5f;
+  apply_volume_rt(ctx->buf, ctx->quantum, ctx->volume);
+}
+
+static void run_volume_reference(void *arg)
+{
+  struct dsp_ctx *ctx = arg;
+  ctx->volume = ctx->volume == 0.5f ? 2.0f : 0.5f;
+  volume_reference(ctx->buf, ctx->quantum, ctx->volume);
+}
+
+/* Varispeed readers get a fresh tap budget per call, as per cycle in the engine */
+static void run_mix(void *arg)
+{
+  struct dsp_ctx *ctx = arg;
+  resampler_begin_cycle_rt(ctx->quantum);
+  mix_all_active_loops_rt(ctx->data, ctx->buf, ctx->quantum);
+}
+
+static void run_backfill(void *arg)
+{
+  struct dsp_ctx *ctx = arg;
+  store_audio_in_backfill_buffer(ctx->data, ctx->in, ctx->quantum);
+}
+
+static void run_ring(void *arg)
+{
+  struct dsp_ctx *ctx = arg;
+  audio_ring_buffer_write(&ctx->ring, ctx->in, ctx->quantum);
+  audio_ring_buffer_read(&ctx->ring, ctx->buf, ctx->quantum);
+}
+
+static void run_queue(void *arg)
+{
+  struct dsp_ctx *ctx = arg;
+  struct rt_message msg = {.type = RT_MSG_AUDIO_LEVEL, .data.audio_level.rms_level = 0.5f};
+  message_queue_push(&ctx->queue, &msg);
+  message_queue_pop(&ctx->queue, &msg);
+  ctx->sink += msg.data.audio_level.rms_level;
+}
+
+/* The disk thread is not running: the ring is topped up inline once it is
+ * half empty, so the disk reads are included, amortized over the calls */
+static void run_disk_stream(void *arg)
+{
+  struct dsp_ctx *ctx = arg;
+  struct disk_stream *ds = &ctx->data->disk_stream;
+  resampler_begin_cycle_rt(ctx->quantum);
+  read_audio_frames_variable_speed_rt(ctx->data, ctx->buf, ctx->quantum);
+  if (audio_ring_buffer_read_space(&ds->ring) < ds->low_water)
+    disk_stream_fill(ds);
+}
+
+static void run_variable_speed_loop(void *arg)
+{
+  struct dsp_ctx *ctx = arg;
+  resampler_begin_cycle_rt(ctx->quantum);
+  read_audio_frames_from_memory_loop_variable_speed_rt(ctx->data, ctx->buf, ctx->quantum);
+}
+
+/* Rewinds at the end of the file like a looping player would */
+static void run_buffered_read(void *arg)
+{
+  struct dsp_ctx *ctx = arg;
+  if (audio_buffer_rt_read(&ctx->reader, ctx->data->file, &ctx->data->fileinfo,
+                           ctx->buf, ctx->quantum) < ctx->quantum)
+    audio_buffer_rt_reset(&ctx->reader);
+}
+
+static void measure(struct bench_report *report, struct dsp_ctx *ctx, const char *name,
+                    const char *variant, uint32_t frames, bench_fn fn)
+{
+  struct bench_result r = {.name = name, .frames = frames};
+  snprintf(r.variant, sizeof(r.variant), "%s", variant);
+  bench_measure(&r, fn, ctx);
+  bench_report_add(report, &r);
+}
+
+/* Ten seconds of mono noise in a temporary WAV file, unlinked by the caller */
+static SNDFILE *open_test_file(SF_INFO *info, char *path, const float *noise, uint32_t noise_frames)
+{
+  int fd = mkstemp(path);
+  if (fd < 0)
+    return NULL;
+
+  SF_INFO write_info = {.samplerate = SAMPLE_RATE, .channels = 1, .format = SF_FORMAT_WAV | SF_FORMAT_FLOAT};
+  SNDFILE *out = sf_open_fd(fd, SFM_WRITE, &write_info, 1);
+  if (!out)
+  {
+    unlink(path);
+    return NULL;
+  }
+  for (uint32_t written = 0; written < SAMPLE_RATE * FILE_SECONDS; written += noise_frames)
+    sf_writef_float(out, noise, noise_frames);
+  sf_close(out);
+
+  memset(info, 0, sizeof(*info));
+  SNDFILE *file = sf_open(path, SFM_READ, info);
+  if (!file)
+    unlink(path);
+  return file;
+}
+
+int main(int argc, char *argv[])
+{
+  uint32_t quantum = argc > 1 ? (uint32_t)atoi(argv[1]) : 256;
+  if (quantum == 0 || quantum > MAX_QUANTUM)
+  {
+    fprintf(stderr, "Quantum must be between 1 and %d\n", MAX_QUANTUM);
+    return 1;
+  }
+
+  static struct data data;
+  struct dsp_ctx ctx = {.data = &data, .quantum = quantum, .volume = 0.5f};
+  ctx.buf = calloc(MAX_QUANTUM, sizeof(float));
+  ctx.in = malloc(MAX_QUANTUM * sizeof(float));
+  srand(1);
+  for (uint32_t i = 0; i < MAX_QUANTUM; i++)
+  {
+    ctx.in[i] = (float)rand() / RAND_MAX * 2.0f - 1.0f;
+    ctx.buf[i] = ctx.in[i];
+  }
+
+  /* Loop storage as the engine sets it up, with enough pool for 128 loops */
+  data.memory_mode = rt_memory_mode_from_string(getenv("UPHONOR_MEMORY_MODE"));
+  data.temp_audio_buffer = malloc((RESAMPLER_WORK_FRAMES + RESAMPLER_BLOCK) * sizeof(float)); /* Varispeed work area */
+  if (!data.temp_audio_buffer || init_all_memory_loops(&data, 60, 128 * 2, SAMPLE_RATE) < 0 ||
+      audio_buffer_rt_init(&data.audio_buffer, 1) < 0 ||
+      audio_buffer_rt_init(&ctx.reader, 1) < 0 ||
+      audio_ring_buffer_init(&ctx.ring, 65536) < 0 ||
+      disk_stream_init(&data.disk_stream, SAMPLE_RATE, DISK_STREAM_PREFETCH_MS, &data.rt_bridge.log) < 0 ||
+      message_queue_init(&ctx.queue, 256) < 0)
+  {
+    fprintf(stderr, "Failed to set up the engine state\n");
+    return 1;
+  }
+  mix_kernels_init();
+  resampler_init(RESAMPLER_HIGH);
+  mix_flush_denormals();
+
+  /* Odd loop lengths so loops wrap at different points in the quantum */
+  for (int l = 0; l < 128; l++)
+  {
+    struct memory_loop *loop = &data.memory_loops[l];
+    uint32_t frames = SAMPLE_RATE + (uint32_t)l * 331;
+    acquire_loop_memory(&data, (uint8_t)l);
+    for (uint32_t stored = 0; stored < frames; stored += MAX_QUANTUM)
+      loop_storage_append(&data, loop, ctx.in, SPA_MIN((uint32_t)MAX_QUANTUM, frames - stored));
+    loop->playback_position = (uint32_t)(l * 977) % frames;
+    loop->volume = 0.5f + (float)l / 256.0f;
+    loop->loop_ready = true;
+  }
+
+  char path[] = "/tmp/uphonor-dsp-bench-XXXXXX";
+  data.file = open_test_file(&data.fileinfo, path, ctx.in, MAX_QUANTUM);
+  if (!data.file)
+  {
+    fprintf(stderr, "Could not create the test audio file\n");
+    return 1;
+  }
+
+  struct bench_report report;
+  char variant[48];
+  bench_report_begin(&report, "dsp");
+
+  measure(&report, &ctx, "calculate_rms_rt", "unrolled", quantum, run_rms);
+  measure(&report, &ctx, "calculate_rms_rt", "reference", quantum, run_rms_reference);
+  measure(&report, &ctx, "apply_volume_rt", "unrolled", quantum, run_volume);
+  measure(&report, &ctx, "apply_volume_rt", "reference", quantum, run_volume_reference);
+
+  const int loop_counts[] = {1, 16, 128};
+  for (size_t c = 0; c < sizeof(loop_counts) / sizeof(loop_counts[0]); c++)
+  {
+    for (int l = 0; l < 128; l++)
+      set_loop_playing(&data, &data.memory_loops[l], l < loop_counts[c]);
+    snprintf(variant, sizeof(variant), "loops=%d/%s", loop_counts[c], mix_kernels_name());
+    measure(&report, &ctx, "mix_all_active_loops_rt", variant, quantum, run_mix);
+  }
+
+  /* 16 loops at 1.5x through the resampler - the budget covers 8 at the top tier */
+  for (int l = 0; l < 16; l++)
+  {
+    set_loop_varispeed(&data, (uint8_t)l, true);
+    data.memory_loops[l].speed = 1.5f;
+  }
+  snprintf(variant, sizeof(variant), "varispeed=16/%s", resampler_kernel_name());
+  measure(&report, &ctx, "mix_all_active_loops_rt", variant, quantum, run_mix);
+  for (int l = 0; l < 16; l++)
+  {
+    set_loop_varispeed(&data, (uint8_t)l, false);
+    data.memory_loops[l].speed = 1.0f;
+  }
+
+  measure(&report, &ctx, "store_audio_in_backfill_buffer", "", quantum, run_backfill);
+  measure(&report, &ctx, "audio_ring_buffer_write+read", "", quantum, run_ring);
+  measure(&report, &ctx, "message_queue_push+pop", "", 1, run_queue);
+
+  /* Opened only now so the mixer cases above run without a file voice */
+  int stream_status = disk_stream_open(&data.disk_stream, path, NULL);
+  unlink(path);
+  if (stream_status < 0)
+  {
+    fprintf(stderr, "Could not stream the test audio file\n");
+    return 1;
+  }
+
+  /* Unity is a copy at every tier, so it is timed once */
+  const float speeds[] = {1.0f, 0.75f, 1.5f, 4.0f};
+  for (size_t s = 0; s < sizeof(speeds) / sizeof(speeds[0]); s++)
+  {
+    for (int q = speeds[s] == 1.0f ? RESAMPLER_HIGH : RESAMPLER_LINEAR; q <= RESAMPLER_HIGH; q++)
+    {
+      resampler_set_quality((enum resampler_quality)q);
+      snprintf(variant, sizeof(variant), "speed=%.2f/%s/%s", speeds[s],
+               resampler_quality_name((enum resampler_quality)q), resampler_kernel_name());
+      data.playback_speed = speeds[s];
+      disk_stream_fill(&data.disk_stream);
+      measure(&report, &ctx, "disk_stream_read_rt", variant, quantum, run_disk_stream);
+      if (speeds[s] != 1.0f)
+      {
+        measure(&report, &ctx, "read_audio_frames_from_memory_loop_variable_speed_rt", variant, quantum,
+                run_variable_speed_loop);
+      }
+    }
+  }
+
+  /* The reader file playback used before streaming, for comparison */
+  measure(&report, &ctx, "audio_buffer_rt_read", "", quantum, run_buffered_read);
+
+  bench_report_end(&report);
+  fprintf(stderr, "\n(checksum %g)\n", ctx.sink);
+
+  sf_close(data.file);
+  data.file = NULL;
+  disk_stream_destroy(&data.disk_stream);
+  audio_ring_buffer_destroy(&ctx.ring);
+  message_queue_destroy(&ctx.queue);
+  audio_buffer_rt_cleanup(&ctx.reader);
+  audio_buffer_rt_cleanup(&data.audio_buffer);
+  cleanup_all_memory_loops(&data);
+  free(data.temp_audio_buffer);
+  free(ctx.buf);
+  free(ctx.in);
+  return 0;
+}
@@ -0,0 +1,171 @@
+/* Loop mixer benchmark
+ *
+ * Compares the original mixer (per-sample wrap check into a scratch VLA,
+ * then a second scalar gain/accumulate pass) against the segmented mixer
+ * driven through each available mix kernel, at 1, 16 and 128 loops.
+ *
+ *   meson test --benchmark            or   ./mix_bench [quantum] [cycles]
+ */
+#include "../mix_kernels.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BLOCK_FRAMES 32768 /* Matches LOOP_POOL_BLOCK_FRAMES */
+
+struct bench_loop
+{
+  float *samples;
+  uint32_t frames;
+  uint32_t position;
+  float volume;
+};
+
+static double now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* The mixer as it was: VLA scratch copy with a wrap check per sample */
+static void mix_legacy(struct bench_loop *loops, int n_loops, float *buf, uint32_t n_samples)
+{
+  for (uint32_t i = 0; i < n_samples; i++)
+    buf[i] = 0.0f;
+
+  float temp_buffer[n_samples];
+  for (int l = 0; l < n_loops; l++)
+  {
+    struct bench_loop *loop = &loops[l];
+    for (uint32_t i = 0; i < n_samples; i++)
+    {
+      if (loop->position >= loop->frames)
+        loop->position = 0;
+      temp_buffer[i] = loop->samples[loop->position++];
+    }
+    for (uint32_t i = 0; i < n_samples; i++)
+      buf[i] += temp_buffer[i] * loop->volume;
+  }
+}
+
+/* The segmented mixer: runs split at the loop point and block boundaries */
+static void mix_segmented(struct bench_loop *loops, int n_loops, float *buf, uint32_t n_samples)
+{
+  memset(buf, 0, n_samples * sizeof(float));
+
+  for (int l = 0; l < n_loops; l++)
+  {
+    struct bench_loop *loop = &loops[l];
+    uint32_t mixed = 0;
+    while (mixed < n_samples)
+    {
+      if (loop->position >= loop->frames)
+        loop->position = 0;
+
+      uint32_t run = n_samples - mixed;
+      uint32_t span = BLOCK_FRAMES - loop->position % BLOCK_FRAMES;
+      if (run > span)
+        run = span;
+      if (run > loop->frames - loop->position)
+        run = loop->frames - loop->position;
+
+      mix_gain_accumulate(buf + mixed, loop->samples + loop->position, loop->volume, run);
+      loop->position += run;
+      mixed += run;
+    }
+  }
+}
+
+static void reset_loops(struct bench_loop *loops, int n_loops)
+{
+  for (int l = 0; l < n_loops; l++)
+    loops[l].position = (uint32_t)(l * 977) % loops[l].frames;
+}
+
+static double run_case(void (*mix)(struct bench_loop *, int, float *, uint32_t),
+                       struct bench_loop *loops, int n_loops, float *buf,
+                       uint32_t quantum, int cycles)
+{
+  reset_loops(loops, n_loops);
+  double best = INFINITY;
+
+  /* Best of 5 repetitions to dampen scheduler noise */
+  for (int rep = 0; rep < 5; rep++)
+  {
+    double start = now_ns();
+    for (int c = 0; c < cycles; c++)
+      mix(loops, n_loops, buf, quantum);
+    double elapsed = (now_ns() - start) / cycles;
+    if (elapsed < best)
+      best = elapsed;
+  }
+  return best;
+}
+
+int main(int argc, char *argv[])
+{
+  uint32_t quantum = argc > 1 ? (uint32_t)atoi(argv[1]) : 256;
+  int cycles = argc > 2 ? atoi(argv[2]) : 2000;
+  const int loop_counts[] = {1, 16, 128};
+  const char *kernels[] = {"scalar", "sse2", "avx2-fma"};
+
+  struct bench_loop loops[128];
+  srand(1);
+  for (int l = 0; l < 128; l++)
+  {
+    /* Odd lengths so loops wrap at different points in the quantum */
+    loops[l].frames = 48000 + (uint32_t)l * 331;
+    loops[l].samples = malloc(loops[l].frames * sizeof(float));
+    loops[l].volume = 0.5f + (float)l / 256.0f;
+    for (uint32_t i = 0; i < loops[l].frames; i++)
+      loops[l].samples[i] = (float)rand() / RAND_MAX * 2.0f - 1.0f;
+  }
+
+  float *out = malloc(quantum * sizeof(float));
+  float *ref = malloc(quantum * sizeof(float));
+  mix_flush_denormals();
+
+  printf("Loop mixer benchmark: quantum %u frames, %d cycles\n\n", quantum, cycles);
+  printf("%-8s %-18s %12s %10s %9s\n", "loops", "path", "ns/cycle", "ns/frame", "speedup");
+
+  for (size_t c = 0; c < sizeof(loop_counts) / sizeof(loop_counts[0]); c++)
+  {
+    int n_loops = loop_counts[c];
+    double legacy = run_case(mix_legacy, loops, n_loops, out, quantum, cycles);
+    printf("%-8d %-18s %12.1f %10.3f %8.2fx\n", n_loops, "legacy", legacy, legacy / quantum, 1.0);
+
+    /* Reference output for correctness checks */
+    reset_loops(loops, n_loops);
+    mix_legacy(loops, n_loops, ref, quantum);
+
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++)
+    {
+      if (mix_kernels_select(kernels[k]) < 0)
+        continue;
+
+      reset_loops(loops, n_loops);
+      mix_segmented(loops, n_loops, out, quantum);
+      float max_err = 0.0f;
+      for (uint32_t i = 0; i < quantum; i++)
+        max_err = fmaxf(max_err, fabsf(out[i] - ref[i]));
+
+      double t = run_case(mix_segmented, loops, n_loops, out, quantum, cycles);
+      char label[32];
+      snprintf(label, sizeof(label), "segmented/%s", kernels[k]);
+      printf("%-8d %-18s %12.1f %10.3f %8.2fx%s\n", n_loops, label, t, t / quantum, legacy / t,
+             max_err > 1e-4f ? "  MISMATCH" : "");
+      if (max_err > 1e-4f)
+        return 1;
+    }
+    printf("\n");
+  }
+
+  for (int l = 0; l < 128; l++)
+    free(loops[l].samples);
+  free(out);
+  free(ref);
+  return 0;
+}
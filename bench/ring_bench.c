@@ -0,0 +1,309 @@
+/* RT/non-RT bridge ring benchmark
+ *
+ * Stress-tests the SPSC audio ring buffer and message queue with a
+ * producer and a consumer thread running flat out on different cores.
+ * Every sample and message carries a sequence number which the consumer
+ * checks, so lost, duplicated or torn data (e.g. from missing memory
+ * ordering on weakly ordered CPUs) is reported as an error. The original
+ * volatile-index implementation is run alongside for a throughput
+ * comparison; only errors in the current implementation fail the run.
+ *
+ *   meson test --benchmark            or   ./ring_bench [samples] [messages]
+ */
+#define _GNU_SOURCE
+#include "../rt_nonrt_bridge.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define RING_SIZE 65536 /* Matches the bridge set up in main.c */
+#define QUEUE_SIZE 256
+#define MAX_CHUNK 1024
+
+/* The original implementation: volatile indices, no ordering, shared cache line */
+struct legacy_ring
+{
+  float *data;
+  uint32_t size;
+  uint32_t mask;
+  volatile uint32_t write_idx;
+  volatile uint32_t read_idx;
+};
+
+struct legacy_queue
+{
+  struct rt_message *messages;
+  uint32_t size;
+  uint32_t mask;
+  volatile uint32_t write_idx;
+  volatile uint32_t read_idx;
+};
+
+static uint32_t legacy_ring_write(struct legacy_ring *rb, const float *data, uint32_t samples)
+{
+  uint32_t w = rb->write_idx;
+  uint32_t available = (rb->read_idx - w - 1) & (rb->size - 1);
+  uint32_t to_write = samples < available ? samples : available;
+  if (to_write == 0)
+    return 0;
+
+  uint32_t w_idx = w & rb->mask;
+  uint32_t cnt1 = rb->size - w_idx;
+  if (cnt1 >= to_write)
+  {
+    memcpy(&rb->data[w_idx], data, to_write * sizeof(float));
+  }
+  else
+  {
+    memcpy(&rb->data[w_idx], data, cnt1 * sizeof(float));
+    memcpy(&rb->data[0], &data[cnt1], (to_write - cnt1) * sizeof(float));
+  }
+  rb->write_idx = w + to_write;
+  return to_write;
+}
+
+static uint32_t legacy_ring_read(struct legacy_ring *rb, float *data, uint32_t samples)
+{
+  uint32_t r = rb->read_idx;
+  uint32_t available = (rb->write_idx - r) & (rb->size - 1);
+  uint32_t to_read = samples < available ? samples : available;
+  if (to_read == 0)
+    return 0;
+
+  uint32_t r_idx = r & rb->mask;
+  uint32_t cnt1 = rb->size - r_idx;
+  if (cnt1 >= to_read)
+  {
+    memcpy(data, &rb->data[r_idx], to_read * sizeof(float));
+  }
+  else
+  {
+    memcpy(data, &rb->data[r_idx], cnt1 * sizeof(float));
+    memcpy(&data[cnt1], &rb->data[0], (to_read - cnt1) * sizeof(float));
+  }
+  rb->read_idx = r + to_read;
+  return to_read;
+}
+
+static bool legacy_queue_push(struct legacy_queue *mq, const struct rt_message *msg)
+{
+  uint32_t w = mq->write_idx;
+  if (((w + 1) & (mq->size - 1)) == (mq->read_idx & (mq->size - 1)))
+    return false;
+  mq->messages[w & mq->mask] = *msg;
+  mq->write_idx = w + 1;
+  return true;
+}
+
+static bool legacy_queue_pop(struct legacy_queue *mq, struct rt_message *msg)
+{
+  uint32_t r = mq->read_idx;
+  if ((r & (mq->size - 1)) == (mq->write_idx & (mq->size - 1)))
+    return false;
+  *msg = mq->messages[r & mq->mask];
+  mq->read_idx = r + 1;
+  return true;
+}
+
+/* One producer/consumer run */
+struct stress
+{
+  bool legacy;
+  struct audio_ring_buffer ring;
+  struct message_queue queue;
+  struct legacy_ring old_ring;
+  struct legacy_queue old_queue;
+  uint64_t total;  /* Samples or messages to move */
+  uint64_t errors; /* Sequence mismatches seen by the consumer */
+};
+
+static double now_sec(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void pin_to_cpu(int cpu)
+{
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu % CPU_SETSIZE, &set);
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+/* Sample n of the stream, exact in a float */
+static inline float sample_value(uint64_t n)
+{
+  return (float)(n & 0xffffff);
+}
+
+/* Chunk sizes vary so wrap-around lands at every offset */
+static inline uint32_t chunk_size(uint32_t *state)
+{
+  *state = *state * 1664525u + 1013904223u;
+  return 1 + (*state >> 8) % MAX_CHUNK;
+}
+
+static void *ring_producer(void *arg)
+{
+  struct stress *s = arg;
+  float chunk[MAX_CHUNK];
+  uint32_t rng = 1;
+  uint64_t sent = 0;
+
+  pin_to_cpu(0);
+  while (sent < s->total)
+  {
+    uint32_t n = chunk_size(&rng);
+    if (n > s->total - sent)
+      n = (uint32_t)(s->total - sent);
+    for (uint32_t i = 0; i < n; i++)
+      chunk[i] = sample_value(sent + i);
+
+    uint32_t done = 0;
+    while (done < n)
+    {
+      uint32_t w = s->legacy ? legacy_ring_write(&s->old_ring, chunk + done, n - done)
+                             : audio_ring_buffer_write(&s->ring, chunk + done, n - done);
+      if (w == 0)
+        sched_yield();
+      done += w;
+    }
+    sent += n;
+  }
+  return NULL;
+}
+
+static void *ring_consumer(void *arg)
+{
+  struct stress *s = arg;
+  float chunk[MAX_CHUNK];
+  uint32_t rng = 7;
+  uint64_t received = 0;
+
+  pin_to_cpu(1);
+  while (received < s->total)
+  {
+    uint32_t want = chunk_size(&rng);
+    uint32_t n = s->legacy ? legacy_ring_read(&s->old_ring, chunk, want)
+                           : audio_ring_buffer_read(&s->ring, chunk, want);
+    if (n == 0)
+    {
+      sched_yield();
+      continue;
+    }
+    for (uint32_t i = 0; i < n; i++)
+    {
+      if (chunk[i] != sample_value(received + i))
+        s->errors++;
+    }
+    received += n;
+  }
+  return NULL;
+}
+
+static void *queue_producer(void *arg)
+{
+  struct stress *s = arg;
+  struct rt_message msg = {.type = RT_MSG_START_RECORDING};
+
+  pin_to_cpu(0);
+  for (uint64_t i = 0; i < s->total; i++)
+  {
+    /* Two fields so a torn copy is detected as well as a stale one */
+    msg.data.recording.sample_rate = (uint32_t)i;
+    msg.data.recording.channels = ~(uint32_t)i;
+    while (!(s->legacy ? legacy_queue_push(&s->old_queue, &msg)
+                       : message_queue_push(&s->queue, &msg)))
+      sched_yield();
+  }
+  return NULL;
+}
+
+static void *queue_consumer(void *arg)
+{
+  struct stress *s = arg;
+  struct rt_message msg;
+  uint64_t received = 0;
+
+  pin_to_cpu(1);
+  while (received < s->total)
+  {
+    if (!(s->legacy ? legacy_queue_pop(&s->old_queue, &msg)
+                    : message_queue_pop(&s->queue, &msg)))
+    {
+      sched_yield();
+      continue;
+    }
+    if (msg.data.recording.sample_rate != (uint32_t)received || msg.data.recording.channels != ~(uint32_t)received)
+      s->errors++;
+    received++;
+  }
+  return NULL;
+}
+
+static double run(struct stress *s, void *(*producer)(void *), void *(*consumer)(void *))
+{
+  pthread_t p, c;
+  s->errors = 0;
+
+  double start = now_sec();
+  pthread_create(&c, NULL, consumer, s);
+  pthread_create(&p, NULL, producer, s);
+  pthread_join(p, NULL);
+  pthread_join(c, NULL);
+  return now_sec() - start;
+}
+
+int main(int argc, char *argv[])
+{
+  uint64_t samples = argc > 1 ? strtoull(argv[1], NULL, 10) : 200000000ULL;
+  uint64_t messages = argc > 2 ? strtoull(argv[2], NULL, 10) : 20000000ULL;
+  int failed = 0;
+
+  struct stress s;
+  memset(&s, 0, sizeof(s));
+  if (audio_ring_buffer_init(&s.ring, RING_SIZE) < 0 || message_queue_init(&s.queue, QUEUE_SIZE) < 0)
+    return 1;
+  s.old_ring.data = calloc(RING_SIZE, sizeof(float));
+  s.old_ring.size = RING_SIZE;
+  s.old_ring.mask = RING_SIZE - 1;
+  s.old_queue.messages = calloc(QUEUE_SIZE, sizeof(struct rt_message));
+  s.old_queue.size = QUEUE_SIZE;
+  s.old_queue.mask = QUEUE_SIZE - 1;
+
+  printf("Bridge ring benchmark: %llu samples, %llu messages\n\n",
+         (unsigned long long)samples, (unsigned long long)messages);
+  printf("%-14s %-8s %14s %9s %10s\n", "structure", "impl", "M items/s", "speedup", "errors");
+
+  for (int structure = 0; structure < 2; structure++)
+  {
+    const char *name = structure == 0 ? "audio ring" : "message queue";
+    void *(*producer)(void *) = structure == 0 ? ring_producer : queue_producer;
+    void *(*consumer)(void *) = structure == 0 ? ring_consumer : queue_consumer;
+    s.total = structure == 0 ? samples : messages;
+
+    s.legacy = true;
+    double legacy_time = run(&s, producer, consumer);
+    printf("%-14s %-8s %14.1f %8.2fx %10llu\n", name, "volatile",
+           s.total / legacy_time / 1e6, 1.0, (unsigned long long)s.errors);
+
+    s.legacy = false;
+    double atomic_time = run(&s, producer, consumer);
+    printf("%-14s %-8s %14.1f %8.2fx %10llu%s\n", name, "atomic",
+           s.total / atomic_time / 1e6, legacy_time / atomic_time, (unsigned long long)s.errors,
+           s.errors ? "  FAILED" : "");
+    if (s.errors)
+      failed = 1;
+  }
+
+  audio_ring_buffer_destroy(&s.ring);
+  message_queue_destroy(&s.queue);
+  free(s.old_ring.data);
+  free(s.old_queue.messages);
+  return failed;
+}
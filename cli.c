@@ -17,10 +17,13 @@ static void print_usage(const char *program_name)
   printf("  %s --reset             - Reset to default settings\n", program_name);
   printf("  %s --status            - Show current configuration status\n", program_name);
   printf("  %s --help              - Show this help message\n", program_name);
+  printf("  kill -USR1 <pid>           - Save a running session to the default file\n");
   printf("\nExamples:\n");
   printf("  %s --save mysession    - Save current state as 'mysession.json'\n", program_name);
   printf("  %s --load mysession    - Load state from 'mysession.json'\n", program_name);
   printf("  %s --save-active jam   - Save active loops as 'jam_active.json'\n", program_name);
+  printf("  %s --save set.uphs     - Save state and loop audio to one binary file\n", program_name);
+  printf("  %s --load set.uphs     - Load state and loop audio from a binary file\n", program_name);
   printf("\n");
 }
 
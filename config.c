@@ -7,6 +7,8 @@
 #include <time.h>
 #include <cjson/cJSON.h>
 #include "uphonor.h"
+#include "sync_scheduler.h"
+#include "rate_convert.h"
 
 /* Helper function to convert enum to string */
 static const char *holo_state_to_string(enum holo_state state)
@@ -88,52 +90,45 @@ static enum playback_mode string_to_playback_mode(const char *str)
 }
 
 /* Create JSON object for global state */
-static cJSON *create_global_state_json(struct data *data)
+static cJSON *create_global_state_json(const struct config_snapshot *snapshot)
 {
   cJSON *global = cJSON_CreateObject();
   if (!global)
     return NULL;
 
   cJSON_AddStringToObject(global, "version", CONFIG_VERSION);
-  cJSON_AddNumberToObject(global, "volume", data->volume);
-  cJSON_AddNumberToObject(global, "playback_speed", data->playback_speed);
-  cJSON_AddNumberToObject(global, "pitch_shift", data->pitch_shift);
-  cJSON_AddBoolToObject(global, "rubberband_enabled", data->rubberband_enabled);
-  cJSON_AddStringToObject(global, "current_state", holo_state_to_string(data->current_state));
-  cJSON_AddStringToObject(global, "playback_mode", playback_mode_to_string(data->current_playback_mode));
+  cJSON_AddNumberToObject(global, "volume", snapshot->volume);
+  cJSON_AddNumberToObject(global, "playback_speed", snapshot->playback_speed);
+  cJSON_AddNumberToObject(global, "pitch_shift", snapshot->pitch_shift);
+  cJSON_AddBoolToObject(global, "rubberband_enabled", snapshot->rubberband_enabled);
+  cJSON_AddStringToObject(global, "current_state", holo_state_to_string(snapshot->holo_state));
+  cJSON_AddStringToObject(global, "playback_mode", playback_mode_to_string(snapshot->playback_mode));
 
   /* Sync mode settings */
-  cJSON_AddBoolToObject(global, "sync_mode_enabled", data->sync_mode_enabled);
-  cJSON_AddNumberToObject(global, "pulse_loop_note", data->pulse_loop_note == 255 ? -1 : data->pulse_loop_note);
-  cJSON_AddNumberToObject(global, "pulse_loop_duration", data->pulse_loop_duration);
-  cJSON_AddNumberToObject(global, "sync_cutoff_percentage", data->sync_cutoff_percentage);
-  cJSON_AddNumberToObject(global, "sync_recording_cutoff_percentage", data->sync_recording_cutoff_percentage);
+  cJSON_AddBoolToObject(global, "sync_mode_enabled", snapshot->sync_mode_enabled);
+  cJSON_AddNumberToObject(global, "pulse_loop_note", snapshot->pulse_loop_note == 255 ? -1 : snapshot->pulse_loop_note);
+  cJSON_AddNumberToObject(global, "pulse_loop_duration", snapshot->pulse_loop_duration);
+  cJSON_AddNumberToObject(global, "sync_cutoff_percentage", snapshot->sync_cutoff_percentage);
+  cJSON_AddNumberToObject(global, "sync_recording_cutoff_percentage", snapshot->sync_recording_cutoff_percentage);
 
   /* Global loop management */
-  cJSON_AddNumberToObject(global, "active_loop_count", data->active_loop_count);
+  cJSON_AddNumberToObject(global, "active_loop_count", snapshot->active_loop_count);
   cJSON_AddNumberToObject(global, "currently_recording_note",
-                          data->currently_recording_note == 255 ? -1 : data->currently_recording_note);
+                          snapshot->currently_recording_note == 255 ? -1 : snapshot->currently_recording_note);
 
   return global;
 }
 
 /* Create JSON array for memory loops */
-static cJSON *create_memory_loops_json(struct data *data, bool active_only)
+static cJSON *create_memory_loops_json(const struct config_snapshot *snapshot)
 {
   cJSON *loops_array = cJSON_CreateArray();
   if (!loops_array)
     return NULL;
 
-  for (int i = 0; i < 128; i++)
+  for (uint32_t i = 0; i < snapshot->loop_count; i++)
   {
-    struct memory_loop *loop = &data->memory_loops[i];
-
-    /* Skip loops with no content if active_only is true */
-    if (active_only && !loop->loop_ready && loop->recorded_frames == 0 &&
-        loop->current_state == LOOP_STATE_IDLE)
-    {
-      continue;
-    }
+    const struct config_snapshot_loop *loop = &snapshot->loops[i];
 
     cJSON *loop_obj = cJSON_CreateObject();
     if (!loop_obj)
@@ -142,10 +137,25 @@ static cJSON *create_memory_loops_json(struct data *data, bool active_only)
       return NULL;
     }
 
+    /* A take recorded without a name is named from its start time, as its WAV is */
+    char filename[sizeof(loop->filename)];
+    if (!loop->filename[0] && loop->take_time != 0)
+    {
+      rt_bridge_format_loop_filename(filename, sizeof(filename), loop->midi_note, loop->take_time);
+    }
+    else
+    {
+      memcpy(filename, loop->filename, sizeof(filename));
+      filename[sizeof(filename) - 1] = '\0';
+    }
+
     cJSON_AddNumberToObject(loop_obj, "midi_note", loop->midi_note);
-    cJSON_AddStringToObject(loop_obj, "state", loop_state_to_string(loop->current_state));
+    cJSON_AddStringToObject(loop_obj, "state", loop_state_to_string(loop->state));
     cJSON_AddNumberToObject(loop_obj, "volume", loop->volume);
-    cJSON_AddStringToObject(loop_obj, "filename", loop->loop_filename);
+    cJSON_AddNumberToObject(loop_obj, "speed", loop->speed);
+    cJSON_AddNumberToObject(loop_obj, "pitch", loop->pitch);
+    cJSON_AddBoolToObject(loop_obj, "varispeed", loop->varispeed);
+    cJSON_AddStringToObject(loop_obj, "filename", filename);
     cJSON_AddNumberToObject(loop_obj, "recorded_frames", loop->recorded_frames);
     cJSON_AddNumberToObject(loop_obj, "playback_position", loop->playback_position);
     cJSON_AddNumberToObject(loop_obj, "buffer_size", loop->buffer_size);
@@ -226,6 +236,8 @@ static config_result_t parse_global_state_json(struct data *data, cJSON *global)
   if ((item = cJSON_GetObjectItemCaseSensitive(global, "pulse_loop_duration")) && cJSON_IsNumber(item))
   {
     data->pulse_loop_duration = (uint32_t)item->valuedouble;
+    // The process callback restarts the pulse timeline for the new duration
+    sync_scheduler_reset(data);
   }
   if ((item = cJSON_GetObjectItemCaseSensitive(global, "sync_cutoff_percentage")) && cJSON_IsNumber(item))
   {
@@ -281,22 +293,8 @@ static config_result_t parse_memory_loops_json(struct data *data, cJSON *loops_a
     if (loops_to_restore[i])
       continue; /* Skip loops that will be restored from config */
 
-    struct memory_loop *loop = &data->memory_loops[i];
-    if (loop->buffer)
-    {
-      /* Preserve buffer but reset state */
-      loop->recorded_frames = 0;
-      loop->playback_position = 0;
-      loop->loop_ready = false;
-      loop->recording_to_memory = false;
-      loop->is_playing = false;
-      loop->pending_record = false;
-      loop->pending_stop = false;
-      loop->pending_start = false;
-      loop->current_state = LOOP_STATE_IDLE;
-      loop->volume = 1.0f;
-      memset(loop->loop_filename, 0, sizeof(loop->loop_filename));
-    }
+    /* Reset state and hand the loop's memory back to the pool */
+    clear_memory_loop(data, i);
   }
 
   /* Parse each loop from the JSON array */
@@ -315,8 +313,6 @@ static config_result_t parse_memory_loops_json(struct data *data, cJSON *loops_a
       continue;
 
     struct memory_loop *loop = &data->memory_loops[midi_note];
-    if (!loop->buffer)
-      continue; /* Skip if buffer not allocated */
 
     /* Parse loop properties */
     cJSON *item;
@@ -328,6 +324,23 @@ static config_result_t parse_memory_loops_json(struct data *data, cJSON *loops_a
     {
       loop->volume = (float)item->valuedouble;
     }
+    /* Per-loop stretch and varispeed, unity and off in sessions saved before they existed */
+    float speed = 1.0f, pitch = 0.0f;
+    if ((item = cJSON_GetObjectItemCaseSensitive(loop_json, "speed")) && cJSON_IsNumber(item))
+    {
+      speed = (float)item->valuedouble;
+    }
+    if ((item = cJSON_GetObjectItemCaseSensitive(loop_json, "pitch")) && cJSON_IsNumber(item))
+    {
+      pitch = (float)item->valuedouble;
+    }
+    set_loop_stretch(data, loop->midi_note, speed, pitch);
+    bool varispeed = false;
+    if ((item = cJSON_GetObjectItemCaseSensitive(loop_json, "varispeed")) && cJSON_IsBool(item))
+    {
+      varispeed = cJSON_IsTrue(item);
+    }
+    set_loop_varispeed(data, loop->midi_note, varispeed);
     if ((item = cJSON_GetObjectItemCaseSensitive(loop_json, "filename")) && cJSON_IsString(item))
     {
       strncpy(loop->loop_filename, item->valuestring, sizeof(loop->loop_filename) - 1);
@@ -377,23 +390,37 @@ static config_result_t parse_memory_loops_json(struct data *data, cJSON *loops_a
     }
   }
 
+  /* The loader converts audio saved at another rate to the graph rate, so the
+     pulse it was recorded against has to be converted the same way */
+  uint32_t graph_rate = data->format.info.raw.rate;
+  if (data->pulse_loop_note < 128 && data->pulse_loop_duration > 0)
+  {
+    uint32_t saved_rate = data->memory_loops[data->pulse_loop_note].sample_rate;
+    if (saved_rate != graph_rate && rate_convert_supported(saved_rate, graph_rate))
+    {
+      data->pulse_loop_duration = rate_convert_frames(data->pulse_loop_duration, saved_rate, graph_rate);
+      sync_scheduler_reset(data);
+    }
+  }
+
+  /* Flags were restored directly - bring the active-loop indexes back in step */
+  rebuild_loop_index(data);
+
   return CONFIG_SUCCESS;
 }
 
-config_result_t config_save_state(struct data *data, const char *filename)
+config_result_t config_save_snapshot(const struct config_snapshot *snapshot, const char *filename)
 {
-  if (!data)
+  if (!snapshot || !filename)
     return CONFIG_ERROR_INVALID_DATA;
 
-  const char *config_file = filename ? filename : DEFAULT_CONFIG_FILENAME;
-
   /* Create root JSON object */
   cJSON *root = cJSON_CreateObject();
   if (!root)
     return CONFIG_ERROR_MEMORY;
 
   /* Add global state */
-  cJSON *global_state = create_global_state_json(data);
+  cJSON *global_state = create_global_state_json(snapshot);
   if (!global_state)
   {
     cJSON_Delete(root);
@@ -401,8 +428,8 @@ config_result_t config_save_state(struct data *data, const char *filename)
   }
   cJSON_AddItemToObject(root, "global_state", global_state);
 
-  /* Add memory loops (active only - exclude IDLE loops) */
-  cJSON *memory_loops = create_memory_loops_json(data, true);
+  /* Add memory loops */
+  cJSON *memory_loops = create_memory_loops_json(snapshot);
   if (!memory_loops)
   {
     cJSON_Delete(root);
@@ -411,9 +438,10 @@ config_result_t config_save_state(struct data *data, const char *filename)
   cJSON_AddItemToObject(root, "memory_loops", memory_loops);
 
   /* Add timestamp */
-  time_t now = time(NULL);
   char timestamp[64];
-  strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", localtime(&now));
+  struct tm tm_info;
+  localtime_r(&snapshot->saved_at, &tm_info);
+  strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", &tm_info);
   cJSON_AddStringToObject(root, "saved_at", timestamp);
 
   /* Convert to string and write to file */
@@ -423,7 +451,11 @@ config_result_t config_save_state(struct data *data, const char *filename)
   if (!json_string)
     return CONFIG_ERROR_MEMORY;
 
-  FILE *file = fopen(config_file, "w");
+  /* Write next to the target and rename over it, so an interrupted save
+     never leaves a truncated session behind */
+  char tmp_file[1024];
+  snprintf(tmp_file, sizeof(tmp_file), "%s.tmp", filename);
+  FILE *file = fopen(tmp_file, "w");
   if (!file)
   {
     free(json_string);
@@ -432,10 +464,46 @@ config_result_t config_save_state(struct data *data, const char *filename)
 
   size_t json_length = strlen(json_string);
   size_t written = fwrite(json_string, 1, json_length, file);
-  fclose(file);
+  bool closed = fclose(file) == 0;
   free(json_string);
 
-  return (written == json_length) ? CONFIG_SUCCESS : CONFIG_ERROR_WRITE_FAILED;
+  if (written != json_length || !closed || rename(tmp_file, filename) != 0)
+  {
+    unlink(tmp_file);
+    return CONFIG_ERROR_WRITE_FAILED;
+  }
+  return CONFIG_SUCCESS;
+}
+
+/* Snapshot through the engine's command queue, so a running engine copies
+   its state between two cycles, then write from the calling (non-RT) thread */
+static config_result_t config_save_now(struct data *data, const char *filename)
+{
+  struct config_snapshot *snapshot = malloc(sizeof(*snapshot));
+  if (!snapshot)
+    return CONFIG_ERROR_MEMORY;
+
+  /* Active only - exclude IDLE loops */
+  struct engine_command capture = {
+      .type = ENGINE_CMD_CAPTURE_SESSION,
+      .data.capture = {.snapshot = snapshot, .active_only = true}};
+  if (!engine_command_send(data, &capture))
+  {
+    free(snapshot);
+    return CONFIG_ERROR_WRITE_FAILED;
+  }
+
+  config_result_t result = config_save_snapshot(snapshot, filename);
+  free(snapshot);
+  return result;
+}
+
+config_result_t config_save_state(struct data *data, const char *filename)
+{
+  if (!data)
+    return CONFIG_ERROR_INVALID_DATA;
+
+  return config_save_now(data, filename ? filename : DEFAULT_CONFIG_FILENAME);
 }
 
 config_result_t config_load_state(struct data *data, const char *filename)
@@ -514,57 +582,7 @@ config_result_t config_save_active_loops_only(struct data *data, const char *fil
   if (!data)
     return CONFIG_ERROR_INVALID_DATA;
 
-  const char *config_file = filename ? filename : "uphonor_active_loops.json";
-
-  /* Create root JSON object */
-  cJSON *root = cJSON_CreateObject();
-  if (!root)
-    return CONFIG_ERROR_MEMORY;
-
-  /* Add global state */
-  cJSON *global_state = create_global_state_json(data);
-  if (!global_state)
-  {
-    cJSON_Delete(root);
-    return CONFIG_ERROR_MEMORY;
-  }
-  cJSON_AddItemToObject(root, "global_state", global_state);
-
-  /* Add only active memory loops */
-  cJSON *memory_loops = create_memory_loops_json(data, true);
-  if (!memory_loops)
-  {
-    cJSON_Delete(root);
-    return CONFIG_ERROR_MEMORY;
-  }
-  cJSON_AddItemToObject(root, "memory_loops", memory_loops);
-
-  /* Add timestamp */
-  time_t now = time(NULL);
-  char timestamp[64];
-  strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", localtime(&now));
-  cJSON_AddStringToObject(root, "saved_at", timestamp);
-
-  /* Convert to string and write to file */
-  char *json_string = cJSON_Print(root);
-  cJSON_Delete(root);
-
-  if (!json_string)
-    return CONFIG_ERROR_MEMORY;
-
-  FILE *file = fopen(config_file, "w");
-  if (!file)
-  {
-    free(json_string);
-    return CONFIG_ERROR_WRITE_FAILED;
-  }
-
-  size_t json_length = strlen(json_string);
-  size_t written = fwrite(json_string, 1, json_length, file);
-  fclose(file);
-  free(json_string);
-
-  return (written == json_length) ? CONFIG_SUCCESS : CONFIG_ERROR_WRITE_FAILED;
+  return config_save_now(data, filename ? filename : "uphonor_active_loops.json");
 }
 
 config_result_t config_validate_file(const char *filename)
@@ -688,6 +706,7 @@ void config_reset_to_defaults(struct data *data)
   data->sync_mode_enabled = false;
   data->pulse_loop_note = 255;
   data->pulse_loop_duration = 0;
+  sync_scheduler_reset(data);
   data->sync_cutoff_percentage = 0.5f;
   data->sync_recording_cutoff_percentage = 0.5f;
 
@@ -698,21 +717,7 @@ void config_reset_to_defaults(struct data *data)
   /* Reset all memory loops to idle state */
   for (int i = 0; i < 128; i++)
   {
-    struct memory_loop *loop = &data->memory_loops[i];
-    if (loop->buffer)
-    {
-      loop->recorded_frames = 0;
-      loop->playback_position = 0;
-      loop->loop_ready = false;
-      loop->recording_to_memory = false;
-      loop->is_playing = false;
-      loop->pending_record = false;
-      loop->pending_stop = false;
-      loop->pending_start = false;
-      loop->current_state = LOOP_STATE_IDLE;
-      loop->volume = 1.0f;
-      memset(loop->loop_filename, 0, sizeof(loop->loop_filename));
-    }
+    clear_memory_loop(data, i);
   }
 }
 
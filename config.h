@@ -35,6 +35,15 @@ typedef enum
  */
 config_result_t config_save_state(struct data *data, const char *filename);
 
+/**
+ * Write a state snapshot to a JSON configuration file (non-RT)
+ * The file is written beside filename and renamed over it.
+ * @param snapshot State captured by config_snapshot_capture()
+ * @param filename Path to save the configuration file
+ * @return CONFIG_SUCCESS on success, error code on failure
+ */
+config_result_t config_save_snapshot(const struct config_snapshot *snapshot, const char *filename);
+
 /**
  * Load uphonor state from a JSON configuration file
  * @param data Pointer to the main data structure to populate
@@ -101,19 +110,23 @@ bool config_generate_backup_filename(char *buffer, size_t buffer_size);
 /* Audio file loading functions */
 
 /**
- * Load an audio file into a memory loop buffer
+ * Load an audio file into a memory loop's block chain, growing it as needed
+ * @param data Pointer to the main data structure (owns the loop pool)
  * @param loop Pointer to the memory loop structure
  * @param filename Path to the audio file to load
- * @param sample_rate System sample rate for validation
+ * @param sample_rate Graph sample rate - audio at another rate is converted to it
+ * @param chunk Decode buffer of the calling loader thread (grown as needed)
  * @return true on success, false on failure
  */
-bool load_audio_file_into_loop(struct memory_loop *loop, const char *filename, uint32_t sample_rate);
+bool load_audio_file_into_loop(struct data *data, struct memory_loop *loop, const char *filename,
+                               uint32_t sample_rate, struct session_chunk *chunk);
 
 /**
  * Load all audio files referenced in the configuration
- * This should be called after config_load_state to actually load the audio data
+ * This should be called after config_load_state to actually load the audio data.
+ * The files load in the background; each loop comes online once its file is in.
  * @param data Pointer to the main data structure
- * @return Number of files successfully loaded, or -1 on error
+ * @return Number of files queued for loading, or -1 on error
  */
 int config_load_audio_files(struct data *data);
 
@@ -1,16 +1,61 @@
 #include "config.h"
+#include "rate_convert.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sndfile.h>
 #include <unistd.h>
 
+/* Resampler input: decodes the file a chunk at a time, keeping the first channel */
+struct loop_file_source
+{
+  SNDFILE *file;
+  uint32_t channels;
+  struct session_chunk *chunk;
+};
+
+static uint32_t loop_file_pull(void *ctx, float *buf, uint32_t frames)
+{
+  struct loop_file_source *source = ctx;
+  uint32_t done = 0;
+  while (done < frames)
+  {
+    uint32_t want = frames - done;
+    if (want > SESSION_LOADER_CHUNK_FRAMES)
+    {
+      want = SESSION_LOADER_CHUNK_FRAMES;
+    }
+
+    /* Mono decodes straight into the resampler's buffer */
+    float *dst = source->channels == 1 ? buf + done : source->chunk->samples;
+    sf_count_t got = sf_readf_float(source->file, dst, want);
+    if (got <= 0)
+    {
+      break;
+    }
+    if (source->channels > 1)
+    {
+      for (sf_count_t i = 0; i < got; i++)
+      {
+        buf[done + i] = source->chunk->samples[i * source->channels];
+      }
+    }
+    done += (uint32_t)got;
+  }
+  return done;
+}
+
 /**
- * Load an audio file into a memory loop buffer
+ * Decode an audio file into a memory loop's block chain
+ * Runs on a session loader thread: the loop is not visible to the RT side
+ * until the loader publishes it. A file at another rate than sample_rate is
+ * converted to it, or read from the copy an earlier load converted.
  * Returns true on success, false on failure
  */
-bool load_audio_file_into_loop(struct memory_loop *loop, const char *filename, uint32_t sample_rate)
+bool load_audio_file_into_loop(struct data *data, struct memory_loop *loop, const char *filename,
+                               uint32_t sample_rate, struct session_chunk *chunk)
 {
-  if (!loop || !filename || !loop->buffer)
+  if (!data || !loop || !filename || !chunk || loop->first_block == LOOP_POOL_NONE)
   {
     return false;
   }
@@ -33,49 +78,117 @@ bool load_audio_file_into_loop(struct memory_loop *loop, const char *filename, u
     return false;
   }
 
-  /* Validate sample rate compatibility */
+  /* Audio at another rate is converted to the graph's on the way in */
+  bool convert = false;
+  char cache_path[1024];
+  const char *cache = NULL;
   if (fileinfo.samplerate != (int)sample_rate)
   {
-    printf("Warning: Audio file sample rate (%d Hz) differs from system (%d Hz)\n",
-           fileinfo.samplerate, sample_rate);
-    /* Continue anyway - we'll load what we can */
+    if (!rate_convert_supported(fileinfo.samplerate, sample_rate))
+    {
+      printf("Warning: Audio file sample rate (%d Hz) differs from system (%d Hz) and cannot be converted\n",
+             fileinfo.samplerate, sample_rate);
+      /* Continue anyway - we'll load what we can */
+    }
+    else
+    {
+      convert = true;
+      if (rate_convert_cache_path(filename, sample_rate, cache_path, sizeof(cache_path)))
+      {
+        cache = cache_path;
+
+        /* Converted by an earlier load - read that copy as it is */
+        SF_INFO cached_info;
+        SNDFILE *cached = rate_convert_cache_open(filename, cache_path, sample_rate, &cached_info);
+        if (cached)
+        {
+          printf("Using %u Hz conversion of %s (%d Hz): %s\n", sample_rate, filename, fileinfo.samplerate,
+                 cache_path);
+          sf_close(file);
+          file = cached;
+          fileinfo = cached_info;
+          convert = false;
+        }
+      }
+    }
   }
 
-  /* Calculate how many frames we can load */
-  uint32_t frames_to_load = (uint32_t)fileinfo.frames;
-  if (frames_to_load > loop->buffer_size)
+  /* Grow the chain to fit the file, truncating only if the pool runs out */
+  uint32_t frames_to_load = convert ? rate_convert_frames((uint64_t)fileinfo.frames, fileinfo.samplerate, sample_rate)
+                                    : (uint32_t)fileinfo.frames;
+  if (!loop_storage_reserve(data, loop, frames_to_load))
   {
     frames_to_load = loop->buffer_size;
-    printf("Warning: Audio file too large, truncating to %u frames\n", frames_to_load);
+    cache = NULL; /* A truncated conversion is not worth keeping */
+    printf("Warning: Not enough loop memory, truncating to %u frames\n", frames_to_load);
   }
 
-  /* Load audio data */
-  sf_count_t frames_read;
-  if (fileinfo.channels == 1)
-  {
-    /* Direct read for mono files */
-    frames_read = sf_readf_float(file, loop->buffer, frames_to_load);
-  }
-  else
+  /* The thread's chunk buffer only grows for a file with more channels than
+     any before it */
+  if (!chunk->samples || chunk->channels < (uint32_t)fileinfo.channels)
   {
-    /* Multi-channel file - extract first channel only */
-    float *temp_buffer = malloc(frames_to_load * fileinfo.channels * sizeof(float));
-    if (!temp_buffer)
+    float *samples = realloc(chunk->samples,
+                             (size_t)SESSION_LOADER_CHUNK_FRAMES * fileinfo.channels * sizeof(float));
+    if (!samples)
     {
       sf_close(file);
-      printf("Failed to allocate temporary buffer for multi-channel file\n");
+      printf("Failed to allocate decode buffer for audio file\n");
       return false;
     }
+    chunk->samples = samples;
+    chunk->channels = fileinfo.channels;
+  }
 
-    frames_read = sf_readf_float(file, temp_buffer, frames_to_load);
+  loop->recorded_frames = 0;
+  sf_count_t frames_read = 0;
 
-    /* Extract first channel */
-    for (sf_count_t i = 0; i < frames_read; i++)
+  if (convert)
+  {
+    if (!chunk->scratch)
     {
-      loop->buffer[i] = temp_buffer[i * fileinfo.channels];
+      chunk->scratch = malloc(RATE_CONVERT_SCRATCH_FRAMES * sizeof(float));
+      if (!chunk->scratch)
+      {
+        sf_close(file);
+        printf("Failed to allocate conversion buffer for audio file\n");
+        return false;
+      }
     }
 
-    free(temp_buffer);
+    printf("Converting %s from %d Hz to %u Hz\n", filename, fileinfo.samplerate, sample_rate);
+    struct loop_file_source source = {file, (uint32_t)fileinfo.channels, chunk};
+    frames_read = rate_convert_into_loop(data, loop, loop_file_pull, &source, fileinfo.samplerate, sample_rate,
+                                         frames_to_load, chunk->scratch, cache);
+  }
+  else
+  {
+    /* Decode one chunk at a time, keeping only the first channel */
+    while ((uint32_t)frames_read < frames_to_load)
+    {
+      sf_count_t want = frames_to_load - frames_read;
+      if (want > SESSION_LOADER_CHUNK_FRAMES)
+      {
+        want = SESSION_LOADER_CHUNK_FRAMES;
+      }
+
+      sf_count_t got = sf_readf_float(file, chunk->samples, want);
+      if (got <= 0)
+      {
+        break;
+      }
+
+      if (fileinfo.channels > 1)
+      {
+        /* Extract first channel in place */
+        for (sf_count_t i = 0; i < got; i++)
+        {
+          chunk->samples[i] = chunk->samples[i * fileinfo.channels];
+        }
+      }
+
+      loop_storage_append(data, loop, chunk->samples, (uint32_t)got);
+      frames_read += got;
+    }
   }
 
   sf_close(file);
@@ -86,112 +199,27 @@ bool load_audio_file_into_loop(struct memory_loop *loop, const char *filename, u
     return false;
   }
 
-  /* Update loop state - preserve current_state that was set during JSON parsing */
-  loop->recorded_frames = (uint32_t)frames_read;
-  loop->playback_position = 0;
-  loop->loop_ready = true;
+  /* loop_ready, playback and current_state are applied when the loop is published */
   loop->recording_to_memory = false;
-  /* Don't change current_state - it should preserve the state from JSON parsing */
+  loop->sample_rate = convert ? sample_rate : (uint32_t)fileinfo.samplerate; /* Rate the chain now holds */
 
   printf("Loaded audio file: %s (%u frames, %.2f seconds)\n",
          filename, loop->recorded_frames,
-         (float)loop->recorded_frames / sample_rate);
+         (float)loop->recorded_frames / loop->sample_rate);
 
   return true;
 }
 
 /**
  * Load all audio files referenced in the configuration
- * This should be called after config_load_state to actually load the audio data
+ * This should be called after config_load_state. The files are decoded in
+ * the background and each loop comes online as soon as its file is loaded.
  */
 int config_load_audio_files(struct data *data)
 {
   if (!data)
     return -1;
 
-  int files_loaded = 0;
-  int files_failed = 0;
-
   printf("Loading audio files for configured loops...\n");
-
-  for (int i = 0; i < 128; i++)
-  {
-    struct memory_loop *loop = &data->memory_loops[i];
-
-    /* Skip loops that have no filename */
-    if (strlen(loop->loop_filename) == 0)
-      continue;
-
-    /* Try to load from recordings directory first */
-    char full_path[1024];
-    snprintf(full_path, sizeof(full_path), "recordings/%s", loop->loop_filename);
-
-    if (load_audio_file_into_loop(loop, full_path, loop->sample_rate))
-    {
-      files_loaded++;
-    }
-    else
-    {
-      /* Try loading from current directory */
-      if (load_audio_file_into_loop(loop, loop->loop_filename, loop->sample_rate))
-      {
-        files_loaded++;
-      }
-      else
-      {
-        files_failed++;
-        printf("Failed to load audio for loop %d: %s\n", i, loop->loop_filename);
-      }
-    }
-  }
-
-  printf("Audio loading complete: %d files loaded, %d failed\n", files_loaded, files_failed);
-
-  /* Validate and restore loop states after audio loading */
-  for (int i = 0; i < 128; i++)
-  {
-    struct memory_loop *loop = &data->memory_loops[i];
-
-    /* If loop was supposed to have audio but loading failed, reset to safe state */
-    if (strlen(loop->loop_filename) > 0 && loop->recorded_frames == 0)
-    {
-      printf("Loop %d: Audio file '%s' failed to load, resetting to IDLE\n", i, loop->loop_filename);
-      loop->loop_ready = false;
-      loop->is_playing = false;
-      loop->current_state = LOOP_STATE_IDLE;
-      /* Clear the filename since the file couldn't be loaded */
-      memset(loop->loop_filename, 0, sizeof(loop->loop_filename));
-    }
-    /* If loop has audio data, ensure flags are consistent with current_state */
-    else if (loop->recorded_frames > 0)
-    {
-      loop->loop_ready = true;
-
-      /* Set is_playing flag based on current_state */
-      if (loop->current_state == LOOP_STATE_PLAYING)
-      {
-        loop->is_playing = true;
-        printf("Loop %d: Restored to PLAYING state\n", i);
-      }
-      else if (loop->current_state == LOOP_STATE_STOPPED)
-      {
-        loop->is_playing = false;
-        printf("Loop %d: Restored to STOPPED state\n", i);
-      }
-      else if (loop->current_state == LOOP_STATE_IDLE)
-      {
-        loop->is_playing = false;
-        printf("Loop %d: Restored to IDLE state\n", i);
-      }
-      /* RECORDING state should not be restored - always start fresh */
-      else if (loop->current_state == LOOP_STATE_RECORDING)
-      {
-        loop->current_state = LOOP_STATE_IDLE;
-        loop->is_playing = false;
-        printf("Loop %d: Recording state not restored, set to IDLE\n", i);
-      }
-    }
-  }
-
-  return files_loaded;
+  return session_loader_start(data);
 }
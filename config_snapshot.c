@@ -0,0 +1,137 @@
+#include "config_snapshot.h"
+#include "config.h"
+#include <stdio.h>
+#include <string.h>
+
+void config_snapshot_capture(struct data *data, struct config_snapshot *snapshot, bool active_only)
+{
+  snapshot->volume = data->volume;
+  snapshot->playback_speed = data->playback_speed;
+  snapshot->pitch_shift = data->pitch_shift;
+  snapshot->rubberband_enabled = data->rubberband_enabled;
+  snapshot->holo_state = (uint8_t)data->current_state;
+  snapshot->playback_mode = (uint8_t)data->current_playback_mode;
+  snapshot->sync_mode_enabled = data->sync_mode_enabled;
+  snapshot->pulse_loop_note = data->pulse_loop_note;
+  snapshot->pulse_loop_duration = data->pulse_loop_duration;
+  snapshot->sync_cutoff_percentage = data->sync_cutoff_percentage;
+  snapshot->sync_recording_cutoff_percentage = data->sync_recording_cutoff_percentage;
+  snapshot->active_loop_count = data->active_loop_count;
+  snapshot->currently_recording_note = data->currently_recording_note;
+  snapshot->saved_at = time(NULL); /* vDSO, no syscall */
+
+  uint32_t count = 0;
+  for (int i = 0; i < 128; i++)
+  {
+    struct memory_loop *loop = &data->memory_loops[i];
+
+    /* Skip loops with no content if active_only is true */
+    if (active_only && !loop->loop_ready && loop->recorded_frames == 0 &&
+        loop->current_state == LOOP_STATE_IDLE)
+    {
+      continue;
+    }
+
+    struct config_snapshot_loop *entry = &snapshot->loops[count++];
+    entry->midi_note = loop->midi_note;
+    entry->state = (uint8_t)loop->current_state;
+    entry->volume = loop->volume;
+    entry->speed = loop->speed;
+    entry->pitch = loop->pitch;
+    entry->varispeed = loop->varispeed;
+    entry->recorded_frames = loop->recorded_frames;
+    entry->playback_position = loop->playback_position;
+    entry->buffer_size = loop->buffer_size;
+    entry->sample_rate = loop->sample_rate;
+    entry->loop_ready = loop->loop_ready;
+    entry->recording_to_memory = loop->recording_to_memory;
+    entry->is_playing = loop->is_playing;
+    entry->pending_record = loop->pending_record;
+    entry->pending_stop = loop->pending_stop;
+    entry->pending_start = loop->pending_start;
+    entry->take_time = loop->take_time;
+
+    /* Names are short - copy up to the terminator rather than the whole field */
+    size_t len = strnlen(loop->loop_filename, sizeof(entry->filename) - 1);
+    memcpy(entry->filename, loop->loop_filename, len);
+    entry->filename[len] = '\0';
+  }
+  snapshot->loop_count = count;
+}
+
+/* Runs on the bridge worker: serialize, write and report back */
+static void config_snapshot_save_task(void *arg)
+{
+  struct config_snapshot_saver *saver = arg;
+  const struct config_snapshot *snapshot = &saver->snapshot;
+
+  /* Generate timestamp-based filename */
+  struct tm tm_info;
+  localtime_r(&snapshot->saved_at, &tm_info);
+  char filename[256];
+  strftime(filename, sizeof(filename), "uphonor_session_%Y%m%d_%H%M%S.json", &tm_info);
+
+  config_result_t result = config_save_snapshot(snapshot, filename);
+  if (result == CONFIG_SUCCESS)
+  {
+    pw_log_info("MIDI CC81: Configuration saved to %s (%u loops)", filename, snapshot->loop_count);
+  }
+  else
+  {
+    pw_log_error("MIDI CC81: Failed to save configuration to %s: %s",
+                 filename, config_get_error_message(result));
+  }
+
+  atomic_store_explicit(&saver->last_result, result, memory_order_relaxed);
+  atomic_fetch_add_explicit(&saver->saves, 1, memory_order_release);
+  // Hand the snapshot back to the RT thread
+  atomic_store_explicit(&saver->busy, false, memory_order_release);
+}
+
+bool config_snapshot_save_rt(struct data *data)
+{
+  struct config_snapshot_saver *saver = &data->snapshot_saver;
+
+  if (atomic_load_explicit(&saver->busy, memory_order_acquire))
+  {
+    rt_log_warn(&data->rt_bridge.log, "Configuration save already in progress, ignoring request");
+    return false;
+  }
+
+  saver->data = data;
+  config_snapshot_capture(data, &saver->snapshot, true);
+
+  struct rt_message msg = {
+      .type = RT_MSG_RUN_TASK,
+      .data.task = {.run = config_snapshot_save_task, .arg = saver}};
+
+  // Busy before the send: the worker may finish before it returns
+  atomic_store_explicit(&saver->busy, true, memory_order_release);
+  if (!rt_bridge_send_message(&data->rt_bridge, &msg))
+  {
+    atomic_store_explicit(&saver->busy, false, memory_order_relaxed);
+    rt_log_error(&data->rt_bridge.log, "Message queue full, configuration not saved");
+    return false;
+  }
+  return true;
+}
+
+bool config_snapshot_collect_rt(struct data *data)
+{
+  struct config_snapshot_saver *saver = &data->snapshot_saver;
+
+  uint32_t saves = atomic_load_explicit(&saver->saves, memory_order_acquire);
+  if (saves == saver->saves_seen)
+  {
+    return false;
+  }
+
+  saver->saves_seen = saves;
+  saver->result = atomic_load_explicit(&saver->last_result, memory_order_relaxed);
+  if (saver->result != CONFIG_SUCCESS)
+  {
+    rt_log_warn(&data->rt_bridge.log, "MIDI CC81: save %u failed (result %d), the session on disk is older",
+                saves, saver->result);
+  }
+  return true;
+}
@@ -0,0 +1,90 @@
+#ifndef CONFIG_SNAPSHOT_H
+#define CONFIG_SNAPSHOT_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+/* Everything a JSON session holds, copied out of struct data without
+ * allocating. config_save_state() serializes one of these, so a snapshot
+ * taken by the process callback (MIDI CC 81) can be written by the bridge
+ * worker: the audio thread only copies a few fields per loop and never
+ * touches cJSON or the filesystem. */
+
+struct data;
+
+struct config_snapshot_loop
+{
+  uint8_t midi_note;
+  uint8_t state; /* enum loop_state */
+  float volume;
+  float speed; /* Per-loop time-stretch */
+  float pitch; /* Per-loop pitch shift in semitones */
+  bool varispeed; /* Speed played through the resampler, pitch follows */
+  uint32_t recorded_frames;
+  uint32_t playback_position;
+  uint32_t buffer_size;
+  uint32_t sample_rate;
+  bool loop_ready;
+  bool recording_to_memory;
+  bool is_playing;
+  bool pending_record;
+  bool pending_stop;
+  bool pending_start;
+  time_t take_time;   /* Names the take when filename is empty */
+  char filename[512]; /* memory_loop.loop_filename */
+};
+
+struct config_snapshot
+{
+  /* Global state */
+  float volume;
+  float playback_speed;
+  float pitch_shift;
+  bool rubberband_enabled;
+  uint8_t holo_state;    /* enum holo_state */
+  uint8_t playback_mode; /* enum playback_mode */
+  bool sync_mode_enabled;
+  uint8_t pulse_loop_note;
+  uint32_t pulse_loop_duration;
+  float sync_cutoff_percentage;
+  float sync_recording_cutoff_percentage;
+  uint8_t active_loop_count;
+  uint8_t currently_recording_note;
+  time_t saved_at;
+
+  uint32_t loop_count;
+  struct config_snapshot_loop loops[128];
+};
+
+/* A CC 81 save in flight. The RT thread owns the snapshot while busy is
+   false; setting busy hands it to the worker until the write is done. The
+   worker reports the outcome in last_result and bumps saves; the engine
+   picks it up on its next cycle. */
+struct config_snapshot_saver
+{
+  _Atomic bool busy;
+  _Atomic int last_result; /* config_result_t of the last finished save */
+  _Atomic uint32_t saves;  /* Finished saves, successful or not */
+  struct data *data;
+  struct config_snapshot snapshot;
+
+  /* RT thread side */
+  uint32_t saves_seen; /* saves at the last collect */
+  int result;          /* Outcome of the last save the engine collected */
+};
+
+/* Copy the session state (RT-safe: bounded, no allocation). With active_only,
+   loops that are idle and empty are left out. */
+void config_snapshot_capture(struct data *data, struct config_snapshot *snapshot, bool active_only);
+
+/* RT: snapshot the session and have the worker write it to a timestamped
+   JSON file. Returns false if a save is still in flight or the queue is full. */
+bool config_snapshot_save_rt(struct data *data);
+
+/* RT: take the outcome of a save the worker finished since the last call.
+   Returns true and stores it in snapshot_saver.result if there was one. */
+bool config_snapshot_collect_rt(struct data *data);
+
+#endif /* CONFIG_SNAPSHOT_H */
@@ -14,7 +14,7 @@ int save_current_session(struct data *data, const char *session_name)
 
   if (session_name && strlen(session_name) > 0)
   {
-    if (strstr(session_name, ".json") == NULL)
+    if (strstr(session_name, ".json") == NULL && !session_file_is_binary(session_name))
     {
       snprintf(filename, sizeof(filename), "%s.json", session_name);
     }
@@ -32,6 +32,18 @@ int save_current_session(struct data *data, const char *session_name)
 
   printf("Saving session to: %s\n", filename);
 
+  /* Binary sessions carry the loop audio in the same file */
+  if (session_file_is_binary(filename))
+  {
+    if (session_file_save(data, filename) == 0)
+    {
+      printf("Session saved successfully!\n");
+      return 0;
+    }
+    printf("Error saving session: %s\n", config_get_error_message(CONFIG_ERROR_WRITE_FAILED));
+    return -1;
+  }
+
   config_result_t result = config_save_state(data, filename);
   if (result == CONFIG_SUCCESS)
   {
@@ -54,7 +66,7 @@ int load_session(struct data *data, const char *session_name)
 
   if (session_name && strlen(session_name) > 0)
   {
-    if (strstr(session_name, ".json") == NULL)
+    if (strstr(session_name, ".json") == NULL && !session_file_is_binary(session_name))
     {
       snprintf(filename, sizeof(filename), "%s.json", session_name);
     }
@@ -72,6 +84,18 @@ int load_session(struct data *data, const char *session_name)
 
   printf("Loading session from: %s\n", filename);
 
+  /* Binary sessions load their audio directly - nothing to validate or look up separately */
+  if (session_file_is_binary(filename))
+  {
+    if (session_file_load(data, filename) == 0)
+    {
+      printf("Session loaded successfully!\n");
+      return 0;
+    }
+    printf("Error loading session from %s\n", filename);
+    return -1;
+  }
+
   /* Validate the file first */
   config_result_t validation = config_validate_file(filename);
   if (validation != CONFIG_SUCCESS)
@@ -112,7 +136,7 @@ int load_session(struct data *data, const char *session_name)
 
     if (audio_files_loaded > 0)
     {
-      printf("Successfully loaded %d audio files!\n", audio_files_loaded);
+      printf("Loading %d audio files in the background, loops start as they finish\n", audio_files_loaded);
     }
     else if (audio_files_loaded == 0)
     {
@@ -137,28 +161,15 @@ int load_session(struct data *data, const char *session_name)
     }
 
     int configured_loops = 0;
-    int ready_loops = 0;
     for (int i = 0; i < 128; i++)
     {
-      if (data->memory_loops[i].recorded_frames > 0 ||
-          strlen(data->memory_loops[i].loop_filename) > 0)
+      if (strlen(data->memory_loops[i].loop_filename) > 0)
       {
         configured_loops++;
-        if (data->memory_loops[i].loop_ready)
-        {
-          ready_loops++;
-        }
       }
     }
-    printf("- Configured loop slots: %d\n", configured_loops);
-    printf("- Ready loops with audio: %d\n", ready_loops);
-
-    if (configured_loops > ready_loops)
-    {
-      printf("\nNote: %d loop slots were configured but could not load audio data.\n",
-             configured_loops - ready_loops);
-      printf("Check that the audio files exist in the 'recordings' directory.\n");
-    }
+    printf("- Loop slots with audio files: %d\n", configured_loops);
+    printf("- Loops loading in the background: %d\n", audio_files_loaded > 0 ? audio_files_loaded : 0);
 
     return 0;
   }
@@ -0,0 +1,401 @@
+#include "disk_stream.h"
+#include "mix_kernels.h"
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <pipewire/pipewire.h>
+
+int disk_stream_init(struct disk_stream *ds, uint32_t sample_rate, uint32_t prefetch_ms, struct rt_log *log)
+{
+  memset(ds, 0, sizeof(*ds));
+
+  uint32_t frames = (uint32_t)((uint64_t)sample_rate * prefetch_ms / 1000);
+  if (audio_ring_buffer_init(&ds->ring, frames > DISK_STREAM_CHUNK ? frames : DISK_STREAM_CHUNK) < 0)
+  {
+    return -1;
+  }
+  ds->low_water = ds->ring.size / 2;
+
+  ds->work = malloc(RESAMPLER_WORK_FRAMES * sizeof(float));
+  ds->mix = malloc(DISK_STREAM_BLOCK * sizeof(float));
+  if (!ds->work || !ds->mix)
+  {
+    free(ds->work);
+    free(ds->mix);
+    audio_ring_buffer_destroy(&ds->ring);
+    return -1;
+  }
+
+  pthread_mutex_init(&ds->lock, NULL);
+  ds->loop = true;
+  ds->wake_fd = -1;
+  ds->log = log;
+  resampler_reset(&ds->resampler);
+  atomic_init(&ds->running, false);
+  atomic_init(&ds->wake_requested, false);
+  atomic_init(&ds->active, false);
+  atomic_init(&ds->seek_request, 0);
+  atomic_init(&ds->seek_served, 0);
+  atomic_init(&ds->seek_idx, 0);
+  atomic_init(&ds->finished, false);
+  atomic_init(&ds->underruns, 0);
+
+  return 0;
+}
+
+void disk_stream_destroy(struct disk_stream *ds)
+{
+  disk_stream_stop(ds);
+  disk_stream_close(ds);
+
+  free(ds->work);
+  free(ds->mix);
+  ds->work = NULL;
+  ds->mix = NULL;
+  audio_ring_buffer_destroy(&ds->ring);
+  pthread_mutex_destroy(&ds->lock);
+}
+
+static void disk_stream_wake(struct disk_stream *ds)
+{
+  /* A non-blocking eventfd write is a bounded syscall - safe from the RT thread */
+  if (ds->wake_fd >= 0)
+  {
+    uint64_t one = 1;
+    if (write(ds->wake_fd, &one, sizeof(one)) < 0)
+    {
+      /* EAGAIN - the counter is saturated, the thread is awake anyway */
+    }
+  }
+}
+
+static void *disk_stream_thread(void *arg)
+{
+  struct disk_stream *ds = arg;
+
+  while (atomic_load_explicit(&ds->running, memory_order_acquire))
+  {
+    /* Clear before filling so a request made meanwhile wakes us again */
+    atomic_store_explicit(&ds->wake_requested, false, memory_order_release);
+    disk_stream_fill(ds);
+
+    struct pollfd pfd = {.fd = ds->wake_fd, .events = POLLIN};
+    if (poll(&pfd, 1, DISK_STREAM_POLL_MS) > 0 && (pfd.revents & POLLIN))
+    {
+      uint64_t count;
+      if (read(ds->wake_fd, &count, sizeof(count)) < 0)
+      {
+        /* EAGAIN - already consumed */
+      }
+    }
+  }
+
+  return NULL;
+}
+
+int disk_stream_start(struct disk_stream *ds)
+{
+  if (ds->thread_started)
+  {
+    return 0;
+  }
+
+  /* Without the eventfd the thread still tops up every DISK_STREAM_POLL_MS */
+  ds->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (ds->wake_fd < 0)
+  {
+    pw_log_warn("eventfd failed, disk stream will poll");
+  }
+
+  atomic_store_explicit(&ds->running, true, memory_order_release);
+  if (pthread_create(&ds->thread, NULL, disk_stream_thread, ds) != 0)
+  {
+    atomic_store_explicit(&ds->running, false, memory_order_release);
+    if (ds->wake_fd >= 0)
+    {
+      close(ds->wake_fd);
+      ds->wake_fd = -1;
+    }
+    return -1;
+  }
+  ds->thread_started = true;
+
+  return 0;
+}
+
+void disk_stream_stop(struct disk_stream *ds)
+{
+  if (!ds->thread_started)
+  {
+    return;
+  }
+
+  atomic_store_explicit(&ds->running, false, memory_order_release);
+  disk_stream_wake(ds);
+  pthread_join(ds->thread, NULL);
+  ds->thread_started = false;
+
+  if (ds->wake_fd >= 0)
+  {
+    close(ds->wake_fd);
+    ds->wake_fd = -1;
+  }
+}
+
+int disk_stream_open(struct disk_stream *ds, const char *filename, SF_INFO *info)
+{
+  SF_INFO file_info;
+  memset(&file_info, 0, sizeof(file_info));
+
+  SNDFILE *file = sf_open(filename, SFM_READ, &file_info);
+  if (!file)
+  {
+    pw_log_error("failed to open file: %s", filename);
+    return -1;
+  }
+
+  float *read_buf = malloc((size_t)DISK_STREAM_CHUNK * file_info.channels * sizeof(float));
+  if (!read_buf)
+  {
+    sf_close(file);
+    return -1;
+  }
+
+  pthread_mutex_lock(&ds->lock);
+  SNDFILE *old_file = ds->file;
+  float *old_buf = ds->read_buf;
+  ds->file = file;
+  ds->info = file_info;
+  ds->read_buf = read_buf;
+  atomic_store_explicit(&ds->finished, false, memory_order_relaxed);
+
+  /* The RT side drops whatever the previous file left in the ring */
+  atomic_fetch_add_explicit(&ds->seek_request, 1, memory_order_release);
+  atomic_store_explicit(&ds->active, true, memory_order_release);
+  pthread_mutex_unlock(&ds->lock);
+
+  if (old_file)
+  {
+    sf_close(old_file);
+  }
+  free(old_buf);
+
+  disk_stream_wake(ds);
+
+  pw_log_info("Streaming %s: %d Hz, %d channel(s), %ld frames", filename,
+              file_info.samplerate, file_info.channels, (long)file_info.frames);
+  if (info)
+  {
+    *info = file_info;
+  }
+  return 0;
+}
+
+void disk_stream_close(struct disk_stream *ds)
+{
+  pthread_mutex_lock(&ds->lock);
+  atomic_store_explicit(&ds->active, false, memory_order_release);
+  atomic_fetch_add_explicit(&ds->seek_request, 1, memory_order_release);
+  SNDFILE *file = ds->file;
+  float *read_buf = ds->read_buf;
+  ds->file = NULL;
+  ds->read_buf = NULL;
+  pthread_mutex_unlock(&ds->lock);
+
+  if (file)
+  {
+    sf_close(file);
+  }
+  free(read_buf);
+}
+
+uint32_t disk_stream_fill(struct disk_stream *ds)
+{
+  uint32_t queued = 0;
+
+  pthread_mutex_lock(&ds->lock);
+  if (ds->file)
+  {
+    /* Serve a rewind before queueing anything that follows it */
+    uint32_t request = atomic_load_explicit(&ds->seek_request, memory_order_acquire);
+    if (request != atomic_load_explicit(&ds->seek_served, memory_order_relaxed))
+    {
+      sf_seek(ds->file, 0, SEEK_SET);
+      atomic_store_explicit(&ds->finished, false, memory_order_relaxed);
+      atomic_store_explicit(&ds->seek_idx, atomic_load_explicit(&ds->ring.write_idx, memory_order_relaxed),
+                            memory_order_relaxed);
+      atomic_store_explicit(&ds->seek_served, request, memory_order_release);
+    }
+
+    uint32_t channels = ds->info.channels;
+    bool wrapped = false;
+    while (!atomic_load_explicit(&ds->finished, memory_order_relaxed))
+    {
+      uint32_t space = audio_ring_buffer_write_space(&ds->ring);
+      if (space == 0)
+      {
+        break;
+      }
+
+      sf_count_t got = sf_readf_float(ds->file, ds->read_buf, SPA_MIN(space, (uint32_t)DISK_STREAM_CHUNK));
+      if (got <= 0)
+      {
+        /* End of file - wrap when looping (twice in a row means it is empty) */
+        if (!ds->loop || wrapped)
+        {
+          atomic_store_explicit(&ds->finished, true, memory_order_relaxed);
+          break;
+        }
+        sf_seek(ds->file, 0, SEEK_SET);
+        wrapped = true;
+        continue;
+      }
+      wrapped = false;
+
+      /* First channel only, compacted in place */
+      if (channels > 1)
+      {
+        for (sf_count_t i = 0; i < got; i++)
+        {
+          ds->read_buf[i] = ds->read_buf[i * channels];
+        }
+      }
+
+      queued += audio_ring_buffer_write(&ds->ring, ds->read_buf, (uint32_t)got);
+    }
+  }
+  pthread_mutex_unlock(&ds->lock);
+
+  return queued;
+}
+
+void disk_stream_rewind_rt(struct disk_stream *ds)
+{
+  atomic_fetch_add_explicit(&ds->seek_request, 1, memory_order_release);
+  disk_stream_wake(ds);
+}
+
+/* Drop everything before ring index end (no-op if already past it) */
+static void disk_stream_skip_to_rt(struct disk_stream *ds, uint32_t end)
+{
+  int32_t stale = (int32_t)(end - atomic_load_explicit(&ds->ring.read_idx, memory_order_relaxed));
+  if (stale > 0)
+  {
+    audio_ring_buffer_skip(&ds->ring, (uint32_t)stale);
+  }
+  resampler_reset(&ds->resampler);
+}
+
+/* False while a seek is outstanding; everything queued before it is dropped */
+static bool disk_stream_settled_rt(struct disk_stream *ds)
+{
+  /* Read the fill level first: the disk thread publishes seek_served before
+     it queues new frames, so if the seek still looks unserved afterwards,
+     every frame counted here predates it */
+  uint32_t queued_end = atomic_load_explicit(&ds->ring.write_idx, memory_order_acquire);
+  uint32_t served = atomic_load_explicit(&ds->seek_served, memory_order_acquire);
+
+  // Served since the last read, usually before the reader ever saw it
+  // outstanding - skip what was queued before the seek
+  if (served != ds->seek_seen)
+  {
+    ds->seek_seen = served;
+    disk_stream_skip_to_rt(ds, atomic_load_explicit(&ds->seek_idx, memory_order_relaxed));
+  }
+
+  if (served == atomic_load_explicit(&ds->seek_request, memory_order_relaxed))
+  {
+    return true;
+  }
+
+  disk_stream_skip_to_rt(ds, queued_end);
+  return false;
+}
+
+static uint32_t disk_stream_pull_rt(struct disk_stream *ds, float *dst, uint32_t frames)
+{
+  uint32_t got = audio_ring_buffer_read(&ds->ring, dst, frames);
+  if (got < frames)
+  {
+    if (!ds->underrun && !atomic_load_explicit(&ds->finished, memory_order_relaxed))
+    {
+      atomic_fetch_add_explicit(&ds->underruns, 1, memory_order_relaxed);
+    }
+    ds->underrun = true;
+  }
+  else
+  {
+    ds->underrun = false;
+  }
+  return got;
+}
+
+static uint32_t disk_stream_resampler_pull_rt(void *ctx, float *buf, uint32_t frames)
+{
+  return disk_stream_pull_rt(ctx, buf, frames);
+}
+
+/* Ask the disk thread for more once the ring drops below half */
+static void disk_stream_request_fill_rt(struct disk_stream *ds)
+{
+  if (audio_ring_buffer_read_space(&ds->ring) >= ds->low_water ||
+      atomic_load_explicit(&ds->finished, memory_order_relaxed))
+  {
+    return;
+  }
+  if (!atomic_exchange_explicit(&ds->wake_requested, true, memory_order_acq_rel))
+  {
+    disk_stream_wake(ds);
+  }
+}
+
+uint32_t disk_stream_read_rt(struct disk_stream *ds, float *buf, uint32_t n_samples, float speed)
+{
+  if (!disk_stream_active(ds))
+  {
+    return 0;
+  }
+
+  if (!disk_stream_settled_rt(ds))
+  {
+    memset(buf, 0, n_samples * sizeof(float));
+    disk_stream_request_fill_rt(ds);
+    return n_samples;
+  }
+
+  /* Unity and varispeed alike go through the resampler, so changing speed
+     never shifts the stream by the filter delay */
+  resampler_process_rt(&ds->resampler, buf, n_samples, speed, disk_stream_resampler_pull_rt, ds, ds->work);
+
+  disk_stream_request_fill_rt(ds);
+  return n_samples;
+}
+
+void disk_stream_log_underruns_rt(struct disk_stream *ds)
+{
+  uint32_t underruns = atomic_load_explicit(&ds->underruns, memory_order_relaxed);
+  if (underruns != ds->underruns_logged)
+  {
+    rt_log_warn(ds->log, "Disk stream underrun: %u new, %u total", underruns - ds->underruns_logged, underruns);
+    ds->underruns_logged = underruns;
+  }
+}
+
+uint32_t disk_stream_mix_rt(struct disk_stream *ds, float *buf, uint32_t n_samples, float speed, float gain)
+{
+  if (!disk_stream_active(ds))
+  {
+    return 0;
+  }
+
+  for (uint32_t done = 0; done < n_samples;)
+  {
+    uint32_t block = SPA_MIN(n_samples - done, (uint32_t)DISK_STREAM_BLOCK);
+    disk_stream_read_rt(ds, ds->mix, block, speed);
+    mix_gain_accumulate(buf + done, ds->mix, gain, block);
+    done += block;
+  }
+  return n_samples;
+}
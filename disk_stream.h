@@ -0,0 +1,105 @@
+#ifndef DISK_STREAM_H
+#define DISK_STREAM_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sndfile.h>
+#include "rt_nonrt_bridge.h"
+#include "resampler.h"
+#include "rt_log.h"
+
+/* Streaming file playback.
+ *
+ * A disk thread reads the file, keeps its first channel and queues it in a
+ * lock-free ring that runs DISK_STREAM_PREFETCH_MS ahead of the play head,
+ * seeking back to the start at the end of the file when looping. The RT
+ * thread only ever reads the ring: no sf_seek or sf_readf_float happens in
+ * the process callback.
+ *
+ * Rewinding and replacing the file are requests: the requester bumps
+ * seek_request, and the disk thread seeks and publishes seek_served along
+ * with the ring write index at that moment (seek_idx) before it queues
+ * anything new. The reader skips up to seek_idx whenever seek_served
+ * changes, and drops whatever is queued while a request is still unserved. */
+
+#define DISK_STREAM_PREFETCH_MS 500
+#define DISK_STREAM_CHUNK 4096     /* Frames per disk read */
+#define DISK_STREAM_BLOCK 1024     /* Frames the RT side produces per pass */
+#define DISK_STREAM_POLL_MS 50     /* Disk thread check interval without a wakeup */
+
+struct disk_stream
+{
+  struct audio_ring_buffer ring; /* Disk thread writes, RT thread reads */
+  uint32_t low_water;            /* RT wakes the disk thread below this fill level */
+
+  /* Disk thread side, guarded by lock against open/close */
+  pthread_mutex_t lock;
+  SNDFILE *file;
+  SF_INFO info;
+  float *read_buf;       /* One interleaved chunk */
+  bool loop;             /* Wrap to the start at the end of the file */
+  _Atomic bool finished; /* Not looping and the whole file is queued */
+
+  pthread_t thread;
+  bool thread_started;
+  int wake_fd; /* eventfd, -1 to poll */
+  _Atomic bool running;
+  _Atomic bool wake_requested; /* RT asked for a refill not yet served */
+
+  _Atomic bool active;           /* A file is open and playing */
+  _Atomic uint32_t seek_request; /* Bumped to restart from frame 0 */
+  _Atomic uint32_t seek_served;  /* Last request applied by the disk thread */
+  _Atomic uint32_t seek_idx;     /* Ring write index at that seek - older frames are stale */
+
+  /* Reader side - the RT thread, or a stretch thread while it owns the ring */
+  uint32_t seek_seen;         /* Last seek_served skipped up to */
+  struct resampler resampler; /* Varispeed state, reset on every seek */
+  float *work;                /* Resampler work buffer (RESAMPLER_WORK_FRAMES) */
+  float *mix;                 /* One block of output before it is mixed */
+  bool underrun;              /* Inside an underrun (counted once per run) */
+  _Atomic uint32_t underruns; /* Bumped by the reader, logged by the RT thread */
+
+  /* RT thread side */
+  struct rt_log *log;
+  uint32_t underruns_logged;
+};
+
+/* Allocate the ring for prefetch_ms at sample_rate; the thread starts separately */
+int disk_stream_init(struct disk_stream *ds, uint32_t sample_rate, uint32_t prefetch_ms, struct rt_log *log);
+void disk_stream_destroy(struct disk_stream *ds);
+
+/* Start/stop the disk thread. Without it the owner calls disk_stream_fill() itself. */
+int disk_stream_start(struct disk_stream *ds);
+void disk_stream_stop(struct disk_stream *ds);
+
+/* Non-RT: stream filename from its start, replacing the current file */
+int disk_stream_open(struct disk_stream *ds, const char *filename, SF_INFO *info);
+void disk_stream_close(struct disk_stream *ds);
+
+/* Non-RT: top the ring up from the file; returns frames queued */
+uint32_t disk_stream_fill(struct disk_stream *ds);
+
+/* RT-safe functions */
+static inline bool disk_stream_active(struct disk_stream *ds)
+{
+  return atomic_load_explicit(&ds->active, memory_order_acquire);
+}
+
+/* Restart playback from the beginning of the file */
+void disk_stream_rewind_rt(struct disk_stream *ds);
+
+/* Produce n_samples frames at speed (1.0 = as recorded, up to
+   RESAMPLER_MAX_SPEED) into buf, band-limited by the resampler. Missing
+   data reads as silence. Returns 0 when no file is playing, else n_samples.
+   Also called by a stretch thread that owns the ring, so it never logs. */
+uint32_t disk_stream_read_rt(struct disk_stream *ds, float *buf, uint32_t n_samples, float speed);
+
+/* RT thread only: log underruns counted since the last call */
+void disk_stream_log_underruns_rt(struct disk_stream *ds);
+
+/* Same, but added into buf scaled by gain */
+uint32_t disk_stream_mix_rt(struct disk_stream *ds, float *buf, uint32_t n_samples, float speed, float gain);
+
+#endif /* DISK_STREAM_H */
@@ -0,0 +1,174 @@
+#include "uphonor.h"
+#include "mix_kernels.h"
+#include <stdlib.h>
+
+/* Engine setup shared by the PipeWire client and the offline renderer.
+   Everything on_process() touches is allocated here; ports, the filter
+   and the main loop are left to the caller. */
+int engine_init(struct data *data, uint32_t sample_rate)
+{
+  // Initialize recording fields
+  data->recording_enabled = false;
+  data->record_file = NULL;
+  data->record_filename = NULL;
+
+  // Expected graph rate - on_param_changed() replaces it with the negotiated one
+  data->format.info.raw.rate = sample_rate;
+  data->format.info.raw.channels = 1;
+
+  data->volume = 1.0f;         // Default volume level
+  data->playback_speed = 1.0f; // Default normal speed
+  data->sample_position = 0.0; // Initialize fractional sample position
+
+  // Initialize performance buffers
+  data->max_buffer_size = 2048 * 8; // Support up to 8 channels at 2048 samples
+  data->silence_buffer = calloc(data->max_buffer_size, sizeof(float));
+  data->temp_audio_buffer = malloc(data->max_buffer_size * sizeof(float)); // Also the RT resampler's work area
+  if (!data->silence_buffer || !data->temp_audio_buffer)
+  {
+    fprintf(stderr, "Failed to allocate audio buffers\n");
+    free(data->silence_buffer);
+    free(data->temp_audio_buffer);
+    return -1;
+  }
+
+  // Initialize RT/Non-RT bridge for performance-critical operations
+  if (rt_nonrt_bridge_init(&data->rt_bridge,
+                           65536, // 64K sample ring buffer (~1.3 seconds at 48kHz)
+                           256    // 256 message queue slots
+                           ) < 0)
+  {
+    fprintf(stderr, "Failed to initialize RT/Non-RT bridge\n");
+    free(data->silence_buffer);
+    free(data->temp_audio_buffer);
+    return -1;
+  }
+
+  data->rt_bridge.rt_sample_rate = sample_rate; // Stamped into session saves
+
+  // Non-RT threads drive the running engine through this queue
+  engine_command_queue_init(&data->commands);
+
+  // Initialize audio buffer system for RT-optimized file reading
+  if (audio_buffer_rt_init(&data->audio_buffer, 8) < 0) // Support up to 8 channels
+  {
+    fprintf(stderr, "Failed to initialize audio buffer system\n");
+    rt_nonrt_bridge_destroy(&data->rt_bridge);
+    free(data->silence_buffer);
+    free(data->temp_audio_buffer);
+    return -1;
+  }
+
+  // File playback is streamed from disk by its own thread
+  if (disk_stream_init(&data->disk_stream, sample_rate, DISK_STREAM_PREFETCH_MS, &data->rt_bridge.log) < 0)
+  {
+    fprintf(stderr, "Failed to initialize disk streaming\n");
+    audio_buffer_rt_cleanup(&data->audio_buffer);
+    rt_nonrt_bridge_destroy(&data->rt_bridge);
+    free(data->silence_buffer);
+    free(data->temp_audio_buffer);
+    return -1;
+  }
+  if (disk_stream_start(&data->disk_stream) < 0)
+  {
+    fprintf(stderr, "Failed to start the disk streaming thread\n");
+    disk_stream_destroy(&data->disk_stream);
+    audio_buffer_rt_cleanup(&data->audio_buffer);
+    rt_nonrt_bridge_destroy(&data->rt_bridge);
+    free(data->silence_buffer);
+    free(data->temp_audio_buffer);
+    return -1;
+  }
+
+  // Initialize multi-loop memory system (60 second backfill). Loop memory
+  // comes from a shared block pool sized by UPHONOR_LOOP_MEMORY_SECONDS and loops
+  // grow through it block by block while recording.
+  uint32_t loop_budget_seconds = LOOP_POOL_DEFAULT_SECONDS;
+  const char *budget_env = getenv("UPHONOR_LOOP_MEMORY_SECONDS");
+  if (budget_env && *budget_env)
+  {
+    unsigned long seconds = strtoul(budget_env, NULL, 10);
+    if (seconds > 0)
+      loop_budget_seconds = (uint32_t)seconds;
+  }
+
+  // Loop and backfill storage is prefaulted and locked by default so first takes
+  // never page fault in the RT thread; UPHONOR_MEMORY_MODE=lazy|locked|hugetlb
+  data->memory_mode = rt_memory_mode_from_string(getenv("UPHONOR_MEMORY_MODE"));
+
+  if (init_all_memory_loops(data, 60, loop_budget_seconds, sample_rate) < 0)
+  {
+    fprintf(stderr, "Failed to initialize multi-loop memory system\n");
+    disk_stream_destroy(&data->disk_stream);
+    audio_buffer_rt_cleanup(&data->audio_buffer);
+    rt_nonrt_bridge_destroy(&data->rt_bridge);
+    free(data->silence_buffer);
+    free(data->temp_audio_buffer);
+    return -1;
+  }
+  rt_memory_report("Loop memory", &data->loop_pool.region);
+  rt_memory_report("Backfill buffer", &data->backfill_memory);
+
+  // Pick the loop mixing kernel for this CPU
+  mix_kernels_init();
+  printf("Mixer kernel: %s\n", mix_kernels_name());
+
+  // Varispeed filter banks; UPHONOR_RESAMPLER_QUALITY=linear|low|medium|high
+  resampler_init(RESAMPLER_HIGH);
+  printf("Resampler: %s (%s)\n", resampler_quality_name(resampler_get_quality()), resampler_kernel_name());
+
+  // Create recordings directory if it doesn't exist
+  struct stat st = {0};
+  if (stat("recordings", &st) == -1)
+  {
+    mkdir("recordings", 0755);
+  }
+
+  /* Rubberband is initialized later, once the format is known */
+  data->pitch_shift = 0.0f;
+  data->rubberband_enabled = true;
+  data->stretch.wake_fd = -1;
+
+  return 0;
+}
+
+void engine_cleanup(struct data *data)
+{
+  // Session loader threads write into loop memory - let them finish first
+  session_loader_wait(data);
+
+  // Clean up recording resources
+  if (data->recording_enabled && stop_recording(data) == 0 &&
+      !rt_bridge_wait_recording_stopped(&data->rt_bridge))
+  {
+    fprintf(stderr, "Warning: recording did not finish flushing before shutdown\n");
+  }
+
+  // Free allocated filename string
+  if (data->record_filename)
+  {
+    free(data->record_filename);
+    data->record_filename = NULL;
+  }
+
+  // Destroy RT/Non-RT bridge - the worker flushes pending loop writes first
+  rt_nonrt_bridge_destroy(&data->rt_bridge);
+
+  // The stretch thread reads the disk stream - stop it first
+  cleanup_rubberband(data);
+
+  // Stop the disk thread and close the streamed file
+  disk_stream_destroy(&data->disk_stream);
+
+  // Cleanup audio buffer system
+  audio_buffer_rt_cleanup(&data->audio_buffer);
+
+  // Cleanup multi-loop memory system
+  cleanup_all_memory_loops(data);
+
+  // Free performance buffers
+  free(data->silence_buffer);
+  free(data->temp_audio_buffer);
+  data->silence_buffer = NULL;
+  data->temp_audio_buffer = NULL;
+}
@@ -0,0 +1,240 @@
+#include "engine_command.h"
+#include "uphonor.h"
+#include <time.h>
+
+_Static_assert((ENGINE_COMMAND_QUEUE_SIZE & (ENGINE_COMMAND_QUEUE_SIZE - 1)) == 0,
+               "ENGINE_COMMAND_QUEUE_SIZE must be a power of 2");
+
+#define ENGINE_COMMAND_MASK (ENGINE_COMMAND_QUEUE_SIZE - 1)
+
+void engine_command_queue_init(struct engine_command_queue *queue)
+{
+  // A cell is free for the producer at position pos while its sequence is pos
+  for (uint32_t i = 0; i < ENGINE_COMMAND_QUEUE_SIZE; i++)
+  {
+    atomic_store_explicit(&queue->cells[i].sequence, i, memory_order_relaxed);
+    atomic_store_explicit(&queue->cells[i].claim, i, memory_order_relaxed);
+  }
+  atomic_store_explicit(&queue->enqueue_pos, 0, memory_order_relaxed);
+  atomic_store_explicit(&queue->dequeue_pos, 0, memory_order_release);
+}
+
+bool engine_command_push(struct engine_command_queue *queue, const struct engine_command *command,
+                         uint32_t *ticket)
+{
+  struct engine_command_cell *cell;
+  uint32_t pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+
+  for (;;)
+  {
+    cell = &queue->cells[pos & ENGINE_COMMAND_MASK];
+    uint32_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+    int32_t diff = (int32_t)(sequence - pos);
+
+    if (diff == 0)
+    {
+      // Free cell - claim it, or retry from wherever another producer left pos
+      if (atomic_compare_exchange_weak_explicit(&queue->enqueue_pos, &pos, pos + 1,
+                                                memory_order_relaxed, memory_order_relaxed))
+        break;
+    }
+    else if (diff < 0)
+    {
+      // The RT thread has not consumed this cell's previous lap yet
+      return false;
+    }
+    else
+    {
+      pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+    }
+  }
+
+  cell->command = *command;
+  atomic_store_explicit(&cell->claim, pos, memory_order_relaxed);
+  atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+
+  if (ticket)
+    *ticket = pos;
+  return true;
+}
+
+bool engine_command_done(struct engine_command_queue *queue, uint32_t ticket)
+{
+  uint32_t consumed = atomic_load_explicit(&queue->dequeue_pos, memory_order_acquire);
+  return (int32_t)(consumed - ticket) > 0;
+}
+
+bool engine_command_wait(struct engine_command_queue *queue, uint32_t ticket, uint32_t timeout_ms)
+{
+  struct timespec pause = {0, 1000000}; // 1 ms, a fraction of a cycle at common quanta
+  for (uint32_t waited = 0; !engine_command_done(queue, ticket); waited++)
+  {
+    if (waited >= timeout_ms)
+      return false;
+    nanosleep(&pause, NULL);
+  }
+  return true;
+}
+
+/* Move the claim of the cell at pos on - whoever does runs the command. A
+   cell reused for a later lap holds that lap's position, so a stale claim fails */
+static bool engine_command_claim(struct engine_command_cell *cell, uint32_t pos)
+{
+  uint32_t expected = pos;
+  return atomic_compare_exchange_strong_explicit(&cell->claim, &expected, pos + 1, memory_order_acq_rel,
+                                                 memory_order_relaxed);
+}
+
+bool engine_command_reclaim(struct engine_command_queue *queue, uint32_t ticket)
+{
+  return engine_command_claim(&queue->cells[ticket & ENGINE_COMMAND_MASK], ticket);
+}
+
+static void engine_command_run(struct data *data, const struct engine_command *command)
+{
+  switch (command->type)
+  {
+  case ENGINE_CMD_NOTE_ON:
+    handle_note_on(data, command->data.note.channel, command->data.note.note & 0x7f,
+                   command->data.note.velocity & 0x7f);
+    break;
+
+  case ENGINE_CMD_NOTE_OFF:
+    handle_note_off(data, command->data.note.channel, command->data.note.note & 0x7f,
+                    command->data.note.velocity & 0x7f);
+    break;
+
+  case ENGINE_CMD_CONTROL_CHANGE:
+    handle_control_change(data, command->data.control.channel, command->data.control.controller & 0x7f,
+                          command->data.control.value & 0x7f);
+    break;
+
+  case ENGINE_CMD_LOOP_VOLUME:
+    if (command->data.loop_volume.note < 128)
+    {
+      data->memory_loops[command->data.loop_volume.note].volume = command->data.loop_volume.volume;
+    }
+    break;
+
+  case ENGINE_CMD_LOOP_STRETCH:
+    set_loop_stretch(data, command->data.loop_stretch.note, command->data.loop_stretch.speed,
+                     command->data.loop_stretch.pitch);
+    break;
+
+  case ENGINE_CMD_LOOP_VARISPEED:
+    set_loop_varispeed(data, command->data.loop_varispeed.note, command->data.loop_varispeed.enabled);
+    break;
+
+  case ENGINE_CMD_VOLUME:
+    set_volume(data, command->data.value);
+    break;
+
+  case ENGINE_CMD_PLAYBACK_SPEED:
+    set_playback_speed(data, command->data.value);
+    break;
+
+  case ENGINE_CMD_PITCH_SHIFT:
+    set_pitch_shift(data, command->data.value);
+    break;
+
+  case ENGINE_CMD_PLAYBACK_MODE:
+    if (command->data.mode == PLAYBACK_MODE_TRIGGER)
+      set_playback_mode_trigger(data);
+    else
+      set_playback_mode_normal(data);
+    break;
+
+  case ENGINE_CMD_SYNC_MODE:
+    if (command->data.enabled)
+      enable_sync_mode(data);
+    else
+      disable_sync_mode(data);
+    break;
+
+  case ENGINE_CMD_SYNC_CUTOFF:
+    if (command->data.sync_cutoff.playback >= 0.0f)
+      data->sync_cutoff_percentage = SPA_MIN(command->data.sync_cutoff.playback, 1.0f);
+    if (command->data.sync_cutoff.recording >= 0.0f)
+      data->sync_recording_cutoff_percentage = SPA_MIN(command->data.sync_cutoff.recording, 1.0f);
+    break;
+
+  case ENGINE_CMD_CAPTURE_SESSION:
+    if (command->data.capture.snapshot)
+      config_snapshot_capture(data, command->data.capture.snapshot, command->data.capture.active_only);
+    break;
+
+  default:
+    rt_log_warn(&data->rt_bridge.log, "Unknown engine command %d", command->type);
+    break;
+  }
+}
+
+bool engine_command_send(struct data *data, const struct engine_command *command)
+{
+  uint32_t ticket;
+  if (!engine_command_push(&data->commands, command, &ticket))
+    return false;
+
+  if (engine_command_wait(&data->commands, ticket, ENGINE_COMMAND_TIMEOUT_MS))
+    return true;
+
+  // No cycle ran (not connected yet, or suspended) - nothing else touches
+  // the engine, so run the command from here
+  if (engine_command_reclaim(&data->commands, ticket))
+  {
+    engine_command_run(data, command);
+    return true;
+  }
+
+  // The RT thread took it just now and finishes it within the cycle
+  struct timespec pause = {0, 1000000};
+  while (!engine_command_done(&data->commands, ticket))
+    nanosleep(&pause, NULL);
+  return true;
+}
+
+const struct engine_command *engine_command_peek_rt(struct engine_command_queue *queue)
+{
+  uint32_t pos = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
+
+  for (;;)
+  {
+    struct engine_command_cell *cell = &queue->cells[pos & ENGINE_COMMAND_MASK];
+
+    // Not published yet (empty, or a producer is still filling it in)
+    if (atomic_load_explicit(&cell->sequence, memory_order_acquire) != pos + 1)
+      return NULL;
+
+    if (engine_command_claim(cell, pos))
+      return &cell->command;
+
+    // Taken back by its producer, which ran it itself
+    engine_command_release_rt(queue);
+    pos++;
+  }
+}
+
+void engine_command_release_rt(struct engine_command_queue *queue)
+{
+  uint32_t pos = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
+
+  // Hand the cell to the producers' next lap, then mark the command done
+  atomic_store_explicit(&queue->cells[pos & ENGINE_COMMAND_MASK].sequence, pos + ENGINE_COMMAND_QUEUE_SIZE,
+                        memory_order_release);
+  atomic_store_explicit(&queue->dequeue_pos, pos + 1, memory_order_release);
+}
+
+uint32_t engine_command_drain_rt(struct data *data)
+{
+  const struct engine_command *command;
+  uint32_t ran = 0;
+
+  while (ran < ENGINE_COMMAND_CYCLE_BUDGET && (command = engine_command_peek_rt(&data->commands)) != NULL)
+  {
+    engine_command_run(data, command);
+    engine_command_release_rt(&data->commands);
+    ran++;
+  }
+
+  return ran;
+}
@@ -0,0 +1,158 @@
+#ifndef ENGINE_COMMAND_H
+#define ENGINE_COMMAND_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Command queue from non-RT threads into the engine.
+ *
+ * MIDI is handled on the RT thread, so anything else that wants to change
+ * a running engine - a control surface, a script, the CLI - queues a
+ * typed command here instead of writing to struct data. The process
+ * callback drains the queue at the top of each cycle and runs at most
+ * ENGINE_COMMAND_CYCLE_BUDGET commands, leaving the rest for the next one.
+ *
+ * The queue is a bounded multi-producer ring with a sequence number per
+ * cell (Vyukov). A producer claims a cell by advancing enqueue_pos with a
+ * CAS, fills it in and publishes it by storing the cell's sequence with
+ * release ordering; the RT thread is the only consumer and never blocks or
+ * retries. A producer preempted between claiming and publishing holds back
+ * the commands queued after it until it resumes, so producers should not
+ * run at a lower priority than they can tolerate.
+ *
+ * Each cell also has a claim word that the RT thread moves on with one CAS
+ * before it runs the command. A producer that finds no cycle has run (not
+ * connected yet, or suspended) can win that CAS instead and run the command
+ * itself, as session_file_save() does with its snapshot - see
+ * engine_command_send(). */
+
+#define ENGINE_COMMAND_QUEUE_SIZE 256  /* Cells, power of 2 */
+#define ENGINE_COMMAND_CYCLE_BUDGET 32 /* Commands run per cycle at most */
+#define ENGINE_COMMAND_TIMEOUT_MS 200  /* Without a cycle by then the sender runs the command itself */
+
+struct data;
+struct config_snapshot;
+
+enum engine_command_type
+{
+  ENGINE_CMD_NOTE_ON,        /* Loop transition, as a MIDI Note On */
+  ENGINE_CMD_NOTE_OFF,       /* Loop transition, as a MIDI Note Off */
+  ENGINE_CMD_CONTROL_CHANGE, /* Any MIDI CC the engine maps */
+  ENGINE_CMD_LOOP_VOLUME,    /* Volume of one loop */
+  ENGINE_CMD_LOOP_STRETCH,   /* Speed and pitch of one loop */
+  ENGINE_CMD_LOOP_VARISPEED, /* Whether one loop plays its speed as varispeed */
+  ENGINE_CMD_VOLUME,         /* Global volume */
+  ENGINE_CMD_PLAYBACK_SPEED,
+  ENGINE_CMD_PITCH_SHIFT,    /* Semitones */
+  ENGINE_CMD_PLAYBACK_MODE,  /* enum playback_mode */
+  ENGINE_CMD_SYNC_MODE,      /* Enable or disable sync mode */
+  ENGINE_CMD_SYNC_CUTOFF,    /* Playback and recording cutoff percentages */
+  ENGINE_CMD_CAPTURE_SESSION /* Copy the session into the sender's snapshot */
+};
+
+struct engine_command
+{
+  enum engine_command_type type;
+  union
+  {
+    struct
+    {
+      uint8_t channel;
+      uint8_t note;
+      uint8_t velocity;
+    } note;
+    struct
+    {
+      uint8_t channel;
+      uint8_t controller;
+      uint8_t value;
+    } control;
+    struct
+    {
+      uint8_t note;
+      float volume;
+    } loop_volume;
+    struct
+    {
+      uint8_t note;
+      float speed;
+      float pitch; /* Semitones */
+    } loop_stretch;
+    struct
+    {
+      uint8_t note;
+      bool enabled;
+    } loop_varispeed;
+    float value; /* Volume, speed or pitch */
+    int mode;    /* Playback mode */
+    bool enabled;
+    struct
+    {
+      float playback;  /* 0.0-1.0, negative leaves it unchanged */
+      float recording; /* 0.0-1.0, negative leaves it unchanged */
+    } sync_cutoff;
+    /* Written by the RT thread: must stay valid until the command has run
+       (see engine_command_wait) */
+    struct
+    {
+      struct config_snapshot *snapshot;
+      bool active_only; /* Leave out loops that are idle and empty */
+    } capture;
+  } data;
+};
+
+struct engine_command_cell
+{
+  _Atomic uint32_t sequence;
+  _Atomic uint32_t claim; /* The cell's position until the RT thread or the producer takes it */
+  struct engine_command command;
+};
+
+struct engine_command_queue
+{
+  /* Producers (any non-RT thread) */
+  _Alignas(64) _Atomic uint32_t enqueue_pos;
+
+  /* Consumer (RT thread) - published so producers can wait for a command */
+  _Alignas(64) _Atomic uint32_t dequeue_pos;
+
+  _Alignas(64) struct engine_command_cell cells[ENGINE_COMMAND_QUEUE_SIZE];
+};
+
+/* Reset the queue (before the engine runs) */
+void engine_command_queue_init(struct engine_command_queue *queue);
+
+/* Queue a command from any non-RT thread. Returns false if the queue is
+   full. If ticket is not NULL it receives the command's position, for
+   engine_command_done()/engine_command_wait(). */
+bool engine_command_push(struct engine_command_queue *queue, const struct engine_command *command,
+                         uint32_t *ticket);
+
+/* True once the command with this ticket has run */
+bool engine_command_done(struct engine_command_queue *queue, uint32_t ticket);
+
+/* Non-RT: wait up to timeout_ms for the command with this ticket to run */
+bool engine_command_wait(struct engine_command_queue *queue, uint32_t ticket, uint32_t timeout_ms);
+
+/* Non-RT: take back a queued command the RT thread has not started. Returns
+   true if it will not run; false if it already ran or is running. */
+bool engine_command_reclaim(struct engine_command_queue *queue, uint32_t ticket);
+
+/* Non-RT: queue a command and wait for the engine to run it. If no cycle
+   takes it within ENGINE_COMMAND_TIMEOUT_MS, nothing else is touching the
+   engine and the command runs on the calling thread instead. Returns false
+   only if the queue is full. */
+bool engine_command_send(struct data *data, const struct engine_command *command);
+
+/* RT: the next queued command, or NULL. Commands taken back by their
+   producer are skipped. Call engine_command_release_rt() once it has run. */
+const struct engine_command *engine_command_peek_rt(struct engine_command_queue *queue);
+
+/* RT: hand the peeked cell back to the producers and mark its command done */
+void engine_command_release_rt(struct engine_command_queue *queue);
+
+/* RT: run up to ENGINE_COMMAND_CYCLE_BUDGET queued commands, returns how many ran */
+uint32_t engine_command_drain_rt(struct data *data);
+
+#endif /* ENGINE_COMMAND_H */
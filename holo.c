@@ -1,17 +1,16 @@
 #include "uphonor.h"
 #include "rt_nonrt_bridge.h"
 #include "audio_processing_rt.h"
+#include "sync_scheduler.h"
 #include <string.h>
 #include <stdlib.h>
-#include <unistd.h>
-#include <time.h>
 
 // Get the memory loop for a specific MIDI note
 struct memory_loop *get_loop_by_note(struct data *data, uint8_t midi_note)
 {
   if (midi_note > 127)
   {
-    pw_log_warn("Invalid MIDI note: %d", midi_note);
+    rt_log_warn(&data->rt_bridge.log, "Invalid MIDI note: %d", midi_note);
     return NULL;
   }
   return &data->memory_loops[midi_note];
@@ -25,7 +24,7 @@ void stop_all_recordings(struct data *data)
     struct memory_loop *loop = &data->memory_loops[i];
     if (loop->current_state == LOOP_STATE_RECORDING)
     {
-      pw_log_info("Emergency stop recording for note %d", i);
+      rt_log_info(&data->rt_bridge.log, "Emergency stop recording for note %d", i);
       loop->current_state = LOOP_STATE_STOPPED;
       loop->recording_to_memory = false;
     }
@@ -36,20 +35,19 @@ void stop_all_recordings(struct data *data)
 // Stop all playback (utility function)
 void stop_all_playback(struct data *data)
 {
-  for (int i = 0; i < 128; i++)
+  // Removing a voice moves the last one into its slot, so drain from the end
+  while (data->playing_voices.count > 0)
   {
-    struct memory_loop *loop = &data->memory_loops[i];
-    if (loop->is_playing)
-    {
-      pw_log_info("Stopping playback for note %d", i);
-      loop->is_playing = false;
-      loop->current_state = LOOP_STATE_STOPPED;
-    }
+    uint8_t note = data->playing_voices.notes[data->playing_voices.count - 1];
+    struct memory_loop *loop = &data->memory_loops[note];
+    rt_log_info(&data->rt_bridge.log, "Stopping playback for note %d", note);
+    set_loop_playing(data, loop, false);
+    loop->current_state = LOOP_STATE_STOPPED;
   }
 }
 
 // Initialize all memory loops
-int init_all_memory_loops(struct data *data, uint32_t max_seconds, uint32_t sample_rate)
+int init_all_memory_loops(struct data *data, uint32_t max_seconds, uint32_t budget_seconds, uint32_t sample_rate)
 {
   pw_log_info("Initializing %d memory loops for MIDI notes 0-127", 128);
 
@@ -63,27 +61,32 @@ int init_all_memory_loops(struct data *data, uint32_t max_seconds, uint32_t samp
   data->pulse_loop_duration = 0;
   data->waiting_for_pulse_reset = false;
   data->longest_loop_duration = 0;
+  sync_scheduler_reset(data);
   data->sync_cutoff_percentage = 0.5f;           // Default to 50% cutoff for playback
   data->sync_recording_cutoff_percentage = 0.5f; // Default to 50% cutoff for recording
 
+  // Reserve the loop memory budget once - loops grow block by block from it
+  uint64_t budget_frames = (uint64_t)budget_seconds * sample_rate;
+  uint32_t block_count = (uint32_t)((budget_frames + LOOP_POOL_BLOCK_FRAMES - 1) / LOOP_POOL_BLOCK_FRAMES);
+  if (loop_pool_init(&data->loop_pool, LOOP_POOL_BLOCK_FRAMES, block_count, data->memory_mode) < 0)
+  {
+    pw_log_error("Failed to reserve loop memory pool (%u blocks of %u frames)",
+                 block_count, LOOP_POOL_BLOCK_FRAMES);
+    return -1;
+  }
+
   // Initialize recording backfill buffer (60 seconds worth - enough for any pulse loop)
   data->backfill_buffer_size = max_seconds * sample_rate;
-  data->recording_backfill_buffer = calloc(data->backfill_buffer_size, sizeof(float));
+  data->recording_backfill_buffer = rt_memory_alloc(&data->backfill_memory,
+                                                    data->backfill_buffer_size * sizeof(float),
+                                                    data->memory_mode);
   data->backfill_write_position = 0;
   data->backfill_available_frames = 0;
 
   if (!data->recording_backfill_buffer)
   {
     pw_log_error("Failed to allocate recording backfill buffer");
-    // Clean up memory loops if backfill buffer allocation fails
-    for (int j = 0; j < 128; j++)
-    {
-      if (data->memory_loops[j].buffer)
-      {
-        free(data->memory_loops[j].buffer);
-        data->memory_loops[j].buffer = NULL;
-      }
-    }
+    loop_pool_destroy(&data->loop_pool);
     return -1;
   }
 
@@ -91,35 +94,29 @@ int init_all_memory_loops(struct data *data, uint32_t max_seconds, uint32_t samp
   {
     struct memory_loop *loop = &data->memory_loops[i];
 
-    // Initialize the loop structure
+    // Initialize the loop structure - storage is taken from the pool when armed
     memset(loop, 0, sizeof(struct memory_loop));
     loop->midi_note = i;
     loop->current_state = LOOP_STATE_IDLE;
     loop->sample_rate = sample_rate;
     loop->volume = 1.0f;          // Default volume
+    loop->speed = 1.0f;           // Not stretched
+    loop->pitch = 0.0f;
+    loop->stretch_slot = STRETCH_SLOT_NONE;
+    loop->freeze_slot = LOOP_FREEZE_SLOT_NONE;
     loop->pending_record = false; // Not waiting to record
     loop->pending_stop = false;   // Not waiting to stop recording
     loop->pending_start = false;  // Not waiting to start playing
-
-    // Allocate buffer (60 seconds worth of audio)
-    loop->buffer_size = max_seconds * sample_rate; // frames (mono)
-    loop->buffer = calloc(loop->buffer_size, sizeof(float));
-    if (!loop->buffer)
-    {
-      pw_log_error("Failed to allocate memory loop buffer for note %d", i);
-      // Clean up previously allocated loops
-      for (int j = 0; j < i; j++)
-      {
-        free(data->memory_loops[j].buffer);
-        data->memory_loops[j].buffer = NULL;
-      }
-      return -1;
-    }
-
-    pw_log_debug("Initialized memory loop for note %d: %u frames", i, loop->buffer_size);
+    loop->first_block = LOOP_POOL_NONE;
+    loop->last_block = LOOP_POOL_NONE;
+    loop->read_cursor.block = LOOP_POOL_NONE;
+    loop->write_cursor.block = LOOP_POOL_NONE;
   }
 
-  pw_log_info("Successfully initialized all %d memory loops", 128);
+  rebuild_loop_index(data);
+
+  pw_log_info("Successfully initialized all %d memory loops (%u seconds of loop memory in %u blocks)",
+              128, budget_seconds, block_count);
   return 0;
 }
 
@@ -130,18 +127,14 @@ void cleanup_all_memory_loops(struct data *data)
 
   for (int i = 0; i < 128; i++)
   {
-    struct memory_loop *loop = &data->memory_loops[i];
-    if (loop->buffer)
-    {
-      free(loop->buffer);
-      loop->buffer = NULL;
-    }
+    release_loop_memory(data, i);
   }
+  loop_pool_destroy(&data->loop_pool);
 
   // Cleanup backfill buffer
   if (data->recording_backfill_buffer)
   {
-    free(data->recording_backfill_buffer);
+    rt_memory_free(&data->backfill_memory);
     data->recording_backfill_buffer = NULL;
   }
 
@@ -151,27 +144,114 @@ void cleanup_all_memory_loops(struct data *data)
   pw_log_info("All memory loops cleaned up");
 }
 
+// Reset a loop to its empty IDLE state and hand its memory back to the pool
+void clear_memory_loop(struct data *data, uint8_t midi_note)
+{
+  if (midi_note > 127)
+    return;
+
+  struct memory_loop *loop = &data->memory_loops[midi_note];
+  loop->recorded_frames = 0;
+  loop_storage_seek(data, loop, 0);
+  loop->loop_ready = false;
+  loop->recording_to_memory = false;
+  set_loop_playing(data, loop, false);
+  set_loop_pending_record(data, loop, false);
+  set_loop_pending_stop(data, loop, false);
+  set_loop_pending_start(data, loop, false);
+  loop->current_state = LOOP_STATE_IDLE;
+  loop->volume = 1.0f;
+  loop->speed = 1.0f;
+  loop->pitch = 0.0f;
+  loop->varispeed = false;
+  resampler_reset(&loop->resampler);
+  memset(loop->loop_filename, 0, sizeof(loop->loop_filename));
+  loop->take_time = 0;
+
+  release_loop_memory(data, midi_note);
+}
+
+// Flag setters - every is_playing/pending_* transition goes through these so
+// the active-voice list and pending sets stay in step with the loops
+void set_loop_playing(struct data *data, struct memory_loop *loop, bool playing)
+{
+  loop->is_playing = playing;
+  if (playing)
+  {
+    // Anchor to the clock from wherever the loop resumes
+    loop->anchor_frame = data->current_sample_frame - loop->playback_position;
+    voice_list_add(&data->playing_voices, loop->midi_note);
+  }
+  else
+    voice_list_remove(&data->playing_voices, loop->midi_note);
+}
+
+void set_loop_pending_record(struct data *data, struct memory_loop *loop, bool pending)
+{
+  loop->pending_record = pending;
+  if (pending)
+    note_set_add(&data->pending_record_set, loop->midi_note);
+  else
+    note_set_remove(&data->pending_record_set, loop->midi_note);
+}
+
+void set_loop_pending_stop(struct data *data, struct memory_loop *loop, bool pending)
+{
+  loop->pending_stop = pending;
+  if (pending)
+    note_set_add(&data->pending_stop_set, loop->midi_note);
+  else
+    note_set_remove(&data->pending_stop_set, loop->midi_note);
+}
+
+void set_loop_pending_start(struct data *data, struct memory_loop *loop, bool pending)
+{
+  loop->pending_start = pending;
+  if (pending)
+    note_set_add(&data->pending_start_set, loop->midi_note);
+  else
+    note_set_remove(&data->pending_start_set, loop->midi_note);
+}
+
+// Rebuild the indexes from the per-loop flags (after bulk changes such as config load)
+void rebuild_loop_index(struct data *data)
+{
+  voice_list_init(&data->playing_voices);
+  memset(&data->pending_record_set, 0, sizeof(data->pending_record_set));
+  memset(&data->pending_stop_set, 0, sizeof(data->pending_stop_set));
+  memset(&data->pending_start_set, 0, sizeof(data->pending_start_set));
+
+  for (int i = 0; i < 128; i++)
+  {
+    struct memory_loop *loop = &data->memory_loops[i];
+    set_loop_playing(data, loop, loop->is_playing);
+    set_loop_pending_record(data, loop, loop->pending_record);
+    set_loop_pending_stop(data, loop, loop->pending_stop);
+    set_loop_pending_start(data, loop, loop->pending_start);
+  }
+}
+
 // This function processes the loops based on the current state for a specific MIDI note
 void process_loops(struct data *data, struct spa_io_position *position, uint8_t midi_note, float volume)
 {
   // Validate inputs
   if (midi_note > 127)
   {
-    pw_log_warn("Invalid MIDI note: %d, ignoring", midi_note);
+    rt_log_warn(&data->rt_bridge.log, "Invalid MIDI note: %d, ignoring", midi_note);
     return;
   }
 
   // Ensure volume is within valid range
   if (volume < 0.0f || volume > 1.0f)
   {
-    pw_log_warn("Invalid volume level: %.2f, clamping to [0.0, 1.0]", volume);
+    rt_log_warn(&data->rt_bridge.log, "Invalid volume level: %.2f, clamping to [0.0, 1.0]", volume);
     volume = (volume < 0.0f) ? 0.0f : 1.0f;
   }
 
   struct memory_loop *loop = get_loop_by_note(data, midi_note);
   if (!loop)
   {
-    pw_log_error("Failed to get loop for note %d", midi_note);
+    rt_log_error(&data->rt_bridge.log, "Failed to get loop for note %d", midi_note);
     return;
   }
 
@@ -179,8 +259,8 @@ void process_loops(struct data *data, struct spa_io_position *position, uint8_t
   loop->volume = volume;
 
   // Log the current state and volume
-  pw_log_info("Processing loop for note %d in state %d with volume %.2f",
-              midi_note, loop->current_state, volume);
+  rt_log_info(&data->rt_bridge.log, "Processing loop for note %d in state %d with volume %.2f",
+                                    midi_note, loop->current_state, volume);
 
   switch (loop->current_state)
   {
@@ -197,17 +277,17 @@ void process_loops(struct data *data, struct spa_io_position *position, uint8_t
       else
       {
         // After cutoff - mark as pending for next pulse reset
-        pw_log_info("Sync mode active - recording for note %d will wait for pulse loop sync", midi_note);
+        rt_log_info(&data->rt_bridge.log, "Sync mode active - recording for note %d will wait for pulse loop sync", midi_note);
 
         // Only mark as pending if not already pending
         if (!loop->pending_record)
         {
-          loop->pending_record = true;
-          pw_log_info("Marking note %d as pending for sync recording", midi_note);
+          set_loop_pending_record(data, loop, true);
+          rt_log_info(&data->rt_bridge.log, "Marking note %d as pending for sync recording", midi_note);
         }
         else
         {
-          pw_log_info("Note %d already pending for sync recording", midi_note);
+          rt_log_info(&data->rt_bridge.log, "Note %d already pending for sync recording", midi_note);
         }
 
         // Also check if we can start recording immediately (if pulse loop just reset)
@@ -222,11 +302,11 @@ void process_loops(struct data *data, struct spa_io_position *position, uint8_t
       struct memory_loop *recording_loop = get_loop_by_note(data, data->currently_recording_note);
       if (recording_loop && recording_loop->current_state == LOOP_STATE_RECORDING)
       {
-        pw_log_info("Stopping recording for note %d to start recording note %d",
-                    data->currently_recording_note, midi_note);
+        rt_log_info(&data->rt_bridge.log, "Stopping recording for note %d to start recording note %d",
+                                          data->currently_recording_note, midi_note);
         stop_loop_recording_rt(data, data->currently_recording_note);
         recording_loop->current_state = LOOP_STATE_PLAYING;
-        recording_loop->is_playing = true;
+        set_loop_playing(data, recording_loop, true);
       }
     }
 
@@ -234,22 +314,15 @@ void process_loops(struct data *data, struct spa_io_position *position, uint8_t
     if (data->pulse_loop_note == 255)
     {
       data->pulse_loop_note = midi_note;
-      pw_log_info("Setting note %d as pulse loop", midi_note);
+      rt_log_info(&data->rt_bridge.log, "Setting note %d as pulse loop", midi_note);
     }
 
-    pw_log_info("Starting memory loop recording for note %d", midi_note);
-    /* Generate timestamp-based filename for the loop */
+    rt_log_info(&data->rt_bridge.log, "Starting memory loop recording for note %d", midi_note);
+    /* The take is named from its timestamp off the RT thread */
+    if (start_loop_recording_rt(data, midi_note, NULL) < 0)
     {
-      time_t now;
-      time(&now);
-      struct tm *tm_info = localtime(&now);
-      snprintf(loop->loop_filename, sizeof(loop->loop_filename),
-               "loop_note_%03d_%04d-%02d-%02d_%02d-%02d-%02d.wav",
-               midi_note,
-               tm_info->tm_year + 1900, tm_info->tm_mon + 1, tm_info->tm_mday,
-               tm_info->tm_hour, tm_info->tm_min, tm_info->tm_sec);
-
-      start_loop_recording_rt(data, midi_note, loop->loop_filename);
+      rt_log_warn(&data->rt_bridge.log, "No loop memory available - cannot record note %d", midi_note);
+      return;
     }
     loop->current_state = LOOP_STATE_RECORDING;
     data->currently_recording_note = midi_note;
@@ -266,24 +339,21 @@ void process_loops(struct data *data, struct spa_io_position *position, uint8_t
       {
         if (!loop->pending_stop)
         {
-          loop->pending_stop = true;
-          pw_log_info("SYNC mode: Marking recording for note %d to stop at next pulse reset", midi_note);
+          set_loop_pending_stop(data, loop, true);
+          rt_log_info(&data->rt_bridge.log, "SYNC mode: Marking recording for note %d to stop at next pulse reset", midi_note);
         }
         else
         {
-          pw_log_info("SYNC mode: Note %d already marked to stop at next pulse reset", midi_note);
+          rt_log_info(&data->rt_bridge.log, "SYNC mode: Note %d already marked to stop at next pulse reset", midi_note);
         }
         return; // Don't stop immediately for non-pulse loops
       }
       // Fall through for pulse loop to stop normally and set duration
     }
 
-    pw_log_info("Stopping memory loop recording for note %d", midi_note);
+    rt_log_info(&data->rt_bridge.log, "Stopping memory loop recording for note %d", midi_note);
     stop_loop_recording_rt(data, midi_note);
 
-    /* Give the system a moment to process the stop command */
-    usleep(1000); // 1ms
-
     loop->current_state = LOOP_STATE_PLAYING;
     data->currently_recording_note = 255; // No longer recording
 
@@ -291,10 +361,14 @@ void process_loops(struct data *data, struct spa_io_position *position, uint8_t
     if (data->sync_mode_enabled && midi_note == data->pulse_loop_note)
     {
       // Pulse loop always starts playing immediately
-      loop->is_playing = true;
+      set_loop_playing(data, loop, true);
       data->pulse_loop_duration = loop->recorded_frames;
-      pw_log_info("SYNC mode: Pulse loop (note %d) recorded with %u frames, now playing",
-                  midi_note, data->pulse_loop_duration);
+      if (!data->pulse_scheduled)
+      {
+        sync_scheduler_start(data, data->current_sample_frame);
+      }
+      rt_log_info(&data->rt_bridge.log, "SYNC mode: Pulse loop (note %d) recorded with %u frames, now playing",
+                                        midi_note, data->pulse_loop_duration);
       // Check for any pending recordings that can now start
       check_sync_pending_recordings(data);
     }
@@ -315,72 +389,72 @@ void process_loops(struct data *data, struct spa_io_position *position, uint8_t
           if (pulse_position < loop->recorded_frames)
           {
             // Pulse position fits within this loop - start there
-            loop->playback_position = pulse_position;
+            loop_storage_seek(data, loop, pulse_position);
           }
           else
           {
             // Pulse position is beyond this loop's length - use modulo
-            loop->playback_position = pulse_position % loop->recorded_frames;
+            loop_storage_seek(data, loop, pulse_position % loop->recorded_frames);
           }
 
-          loop->is_playing = true;
-          loop->pending_start = false;
+          set_loop_playing(data, loop, true);
+          set_loop_pending_start(data, loop, false);
 
-          pw_log_info("SYNC mode: Starting recorded loop %d at current pulse position %u (pulse at %u, cutoff at %u)",
-                      midi_note, loop->playback_position, pulse_position, cutoff_position);
+          rt_log_info(&data->rt_bridge.log, "SYNC mode: Starting recorded loop %d at current pulse position %u (pulse at %u, cutoff at %u)",
+                                            midi_note, loop->playback_position, pulse_position, cutoff_position);
         }
         else
         {
           // After cutoff - mark as pending start and wait for next pulse cycle
-          loop->playback_position = 0;
-          loop->is_playing = false;
-          loop->pending_start = true;
+          loop_storage_seek(data, loop, 0);
+          set_loop_playing(data, loop, false);
+          set_loop_pending_start(data, loop, true);
 
-          pw_log_info("SYNC mode: Loop %d marked as pending start - waiting for next pulse cycle (pulse at %u, cutoff at %u)",
-                      midi_note, pulse_position, cutoff_position);
+          rt_log_info(&data->rt_bridge.log, "SYNC mode: Loop %d marked as pending start - waiting for next pulse cycle (pulse at %u, cutoff at %u)",
+                                            midi_note, pulse_position, cutoff_position);
         }
       }
       else
       {
         // No pulse loop or pulse not playing - start immediately
-        loop->is_playing = true;
-        loop->pending_start = false;
+        set_loop_playing(data, loop, true);
+        set_loop_pending_start(data, loop, false);
       }
     }
     else
     {
       // Not in sync mode - start playing immediately
-      loop->is_playing = true;
-      loop->pending_start = false;
+      set_loop_playing(data, loop, true);
+      set_loop_pending_start(data, loop, false);
     }
 
-    pw_log_info("Starting playback from memory loop for note %d", midi_note);
+    rt_log_info(&data->rt_bridge.log, "Starting playback from memory loop for note %d", midi_note);
     break;
 
   case LOOP_STATE_PLAYING:
-    pw_log_info("Stopping playback for note %d", midi_note);
+    rt_log_info(&data->rt_bridge.log, "Stopping playback for note %d", midi_note);
     loop->current_state = LOOP_STATE_STOPPED;
-    loop->is_playing = false;
-    loop->pending_start = false; // Clear pending start if stopping manually
+    set_loop_playing(data, loop, false);
+    set_loop_pending_start(data, loop, false); // Clear pending start if stopping manually
     break;
 
   case LOOP_STATE_STOPPED:
-    pw_log_info("Restarting playback for note %d", midi_note);
+    rt_log_info(&data->rt_bridge.log, "Restarting playback for note %d", midi_note);
     loop->current_state = LOOP_STATE_PLAYING;
-    loop->pending_start = false; // Clear pending start when manually starting
-    loop->is_playing = true;
+    set_loop_pending_start(data, loop, false); // Clear pending start when manually starting
+    set_loop_playing(data, loop, true);
     /* Reset memory loop playback position */
     reset_memory_loop_playback_rt(data, midi_note);
     break;
 
   default:
-    pw_log_warn("Unknown state %d for note %d, ignoring",
-                loop->current_state, midi_note);
+    rt_log_warn(&data->rt_bridge.log, "Unknown state %d for note %d, ignoring",
+                                      loop->current_state, midi_note);
     break;
   }
 
-  pw_log_info("Loop state changed for note %d: state=%d, playing=%s",
-              midi_note, loop->current_state, loop->is_playing ? "yes" : "no");
+  rt_log_info(&data->rt_bridge.log, "Loop state changed for note %d: state=%d, playing=%s",
+                                    midi_note, loop->current_state, loop->is_playing ? "yes" : "no");
 
   // Reset audio only when sync mode is disabled or when this is a new recording
   if (!data->sync_mode_enabled || loop->current_state == LOOP_STATE_RECORDING)
@@ -393,13 +467,13 @@ void process_loops(struct data *data, struct spa_io_position *position, uint8_t
 void set_playback_mode_normal(struct data *data)
 {
   data->current_playback_mode = PLAYBACK_MODE_NORMAL;
-  pw_log_info("Playback mode set to NORMAL (Note On toggles play/stop, Note Off ignored)");
+  rt_log_info(&data->rt_bridge.log, "Playback mode set to NORMAL (Note On toggles play/stop, Note Off ignored)");
 }
 
 void set_playback_mode_trigger(struct data *data)
 {
   data->current_playback_mode = PLAYBACK_MODE_TRIGGER;
-  pw_log_info("Playback mode set to TRIGGER (Note On starts, Note Off stops)");
+  rt_log_info(&data->rt_bridge.log, "Playback mode set to TRIGGER (Note On starts, Note Off stops)");
 }
 
 void toggle_playback_mode(struct data *data)
@@ -432,7 +506,7 @@ void enable_sync_mode(struct data *data)
 {
   data->sync_mode_enabled = true;
   init_sync_mode(data);
-  pw_log_info("Sync mode ENABLED - waiting for first loop to set pulse");
+  rt_log_info(&data->rt_bridge.log, "Sync mode ENABLED - waiting for first loop to set pulse");
 }
 
 void disable_sync_mode(struct data *data)
@@ -442,34 +516,41 @@ void disable_sync_mode(struct data *data)
   data->pulse_loop_duration = 0;
   data->waiting_for_pulse_reset = false;
   data->longest_loop_duration = 0;
+  sync_scheduler_reset(data);
 
   // Clear any pending recordings and allow them to start immediately
-  for (int i = 0; i < 128; i++)
-  {
+  struct note_set pending = data->pending_record_set;
+  pending.bits[0] |= data->pending_stop_set.bits[0] | data->pending_start_set.bits[0];
+  pending.bits[1] |= data->pending_stop_set.bits[1] | data->pending_start_set.bits[1];
+  uint8_t notes[128];
+  uint8_t count = note_set_collect(&pending, notes);
+  for (uint8_t n = 0; n < count; n++)
+  {
+    uint8_t i = notes[n];
     struct memory_loop *loop = &data->memory_loops[i];
     if (loop->pending_record)
     {
-      loop->pending_record = false;
-      pw_log_info("Clearing pending recording for note %d due to sync mode disable", i);
+      set_loop_pending_record(data, loop, false);
+      rt_log_info(&data->rt_bridge.log, "Clearing pending recording for note %d due to sync mode disable", i);
     }
     if (loop->pending_stop)
     {
-      loop->pending_stop = false;
-      pw_log_info("Clearing pending stop for note %d due to sync mode disable", i);
+      set_loop_pending_stop(data, loop, false);
+      rt_log_info(&data->rt_bridge.log, "Clearing pending stop for note %d due to sync mode disable", i);
     }
     if (loop->pending_start)
     {
       // If a loop was pending start, make it start playing immediately
-      loop->pending_start = false;
+      set_loop_pending_start(data, loop, false);
       if (loop->current_state == LOOP_STATE_PLAYING && loop->loop_ready)
       {
-        loop->is_playing = true;
-        pw_log_info("Starting pending loop %d due to sync mode disable", i);
+        set_loop_playing(data, loop, true);
+        rt_log_info(&data->rt_bridge.log, "Starting pending loop %d due to sync mode disable", i);
       }
     }
   }
 
-  pw_log_info("Sync mode DISABLED - all loops now independent");
+  rt_log_info(&data->rt_bridge.log, "Sync mode DISABLED - all loops now independent");
 }
 
 void toggle_sync_mode(struct data *data)
@@ -495,6 +576,7 @@ void init_sync_mode(struct data *data)
   data->pulse_loop_duration = 0;
   data->waiting_for_pulse_reset = false;
   data->longest_loop_duration = 0;
+  sync_scheduler_reset(data);
 
   // Reset backfill buffer
   data->backfill_write_position = 0;
@@ -504,7 +586,7 @@ void init_sync_mode(struct data *data)
     memset(data->recording_backfill_buffer, 0, data->backfill_buffer_size * sizeof(float));
   }
 
-  pw_log_info("Sync mode initialized - waiting for first loop to set pulse");
+  rt_log_info(&data->rt_bridge.log, "Sync mode initialized - waiting for first loop to set pulse");
 }
 
 bool can_start_recording_sync(struct data *data, uint8_t midi_note)
@@ -530,65 +612,7 @@ void set_pulse_loop(struct data *data, uint8_t midi_note)
   if (data->pulse_loop_note == 255)
   {
     data->pulse_loop_note = midi_note;
-    pw_log_info("SYNC mode: Note %d set as pulse loop", midi_note);
-  }
-}
-
-void check_sync_playback_reset(struct data *data)
-{
-  if (!data->sync_mode_enabled)
-    return;
-
-  // Find the longest currently playing loop
-  uint32_t longest_duration = 0;
-  bool any_playing = false;
-
-  for (int i = 0; i < 128; i++)
-  {
-    struct memory_loop *loop = &data->memory_loops[i];
-    if (loop->is_playing && loop->recorded_frames > 0)
-    {
-      any_playing = true;
-      if (loop->recorded_frames > longest_duration)
-      {
-        longest_duration = loop->recorded_frames;
-      }
-    }
-  }
-
-  if (!any_playing)
-    return;
-
-  // Check if any loop has reached the end of the longest loop
-  for (int i = 0; i < 128; i++)
-  {
-    struct memory_loop *loop = &data->memory_loops[i];
-    if (loop->is_playing && loop->playback_position >= longest_duration)
-    {
-      // Reset all playing loops to the beginning
-      for (int j = 0; j < 128; j++)
-      {
-        struct memory_loop *reset_loop = &data->memory_loops[j];
-        if (reset_loop->is_playing)
-        {
-          reset_loop->playback_position = 0;
-        }
-      }
-
-      // Allow new recordings to start
-      data->waiting_for_pulse_reset = false;
-      pw_log_info("SYNC mode: All loops reset to beginning, new recordings allowed");
-
-      // Handle pending stops first (recordings that should end at pulse boundary)
-      stop_sync_pending_recordings_on_pulse_reset(data);
-
-      // Then start any pending recordings
-      start_sync_pending_recordings_on_pulse_reset(data);
-
-      // Finally start any pending playback
-      start_sync_pending_playback_on_pulse_reset(data);
-      break;
-    }
+    rt_log_info(&data->rt_bridge.log, "SYNC mode: Note %d set as pulse loop", midi_note);
   }
 }
 
@@ -621,17 +645,18 @@ void check_sync_pending_recordings(struct data *data)
   struct memory_loop *pulse_loop = get_loop_by_note(data, data->pulse_loop_note);
   if (!pulse_loop || !pulse_loop->is_playing)
   {
-    pw_log_debug("SYNC check: Pulse loop (note %d) not playing - cannot sync",
-                 data->pulse_loop_note);
+    rt_log_debug(&data->rt_bridge.log, "SYNC check: Pulse loop (note %d) not playing - cannot sync",
+                                       data->pulse_loop_note);
     return;
   }
 
   // Count pending recordings
   int pending_count = 0;
-  for (int i = 0; i < 128; i++)
+  uint8_t notes[128];
+  uint8_t count = note_set_collect(&data->pending_record_set, notes);
+  for (uint8_t n = 0; n < count; n++)
   {
-    struct memory_loop *loop = &data->memory_loops[i];
-    if (loop->pending_record && loop->current_state == LOOP_STATE_IDLE)
+    if (data->memory_loops[notes[n]].current_state == LOOP_STATE_IDLE)
     {
       pending_count++;
     }
@@ -639,7 +664,7 @@ void check_sync_pending_recordings(struct data *data)
 
   if (pending_count > 0)
   {
-    pw_log_debug("SYNC check: %d recordings pending for next pulse reset", pending_count);
+    rt_log_debug(&data->rt_bridge.log, "SYNC check: %d recordings pending for next pulse reset", pending_count);
   }
 }
 
@@ -653,45 +678,44 @@ void start_sync_pending_recordings_on_pulse_reset(struct data *data)
   // Only start one pending recording at a time
   if (data->currently_recording_note != 255)
   {
-    pw_log_debug("SYNC pulse reset: Currently recording note %d - cannot start new recording",
-                 data->currently_recording_note);
+    rt_log_debug(&data->rt_bridge.log, "SYNC pulse reset: Currently recording note %d - cannot start new recording",
+                                       data->currently_recording_note);
     return;
   }
 
   // This function is only called when pulse loop resets, so we know it's playing
-  pw_log_debug("SYNC pulse reset detected: checking for pending recordings");
+  rt_log_debug(&data->rt_bridge.log, "SYNC pulse reset detected: checking for pending recordings");
 
   // Find the first pending recording and start it
-  for (int i = 0; i < 128; i++)
+  uint8_t notes[128];
+  uint8_t count = note_set_collect(&data->pending_record_set, notes);
+  for (uint8_t n = 0; n < count; n++)
   {
+    uint8_t i = notes[n];
     struct memory_loop *loop = &data->memory_loops[i];
-    if (loop->pending_record && loop->current_state == LOOP_STATE_IDLE)
+    if (loop->current_state == LOOP_STATE_IDLE)
     {
-      pw_log_info("SYNC PULSE RESET: Starting sync'd recording for note %d", i);
-
-      // Generate timestamp-based filename
-      time_t now;
-      time(&now);
-      struct tm *tm_info = localtime(&now);
-      snprintf(loop->loop_filename, sizeof(loop->loop_filename),
-               "loop_note_%03d_%04d-%02d-%02d_%02d-%02d-%02d.wav",
-               i,
-               tm_info->tm_year + 1900, tm_info->tm_mon + 1, tm_info->tm_mday,
-               tm_info->tm_hour, tm_info->tm_min, tm_info->tm_sec);
-
-      start_loop_recording_rt(data, i, loop->loop_filename);
+      rt_log_info(&data->rt_bridge.log, "SYNC PULSE RESET: Starting sync'd recording for note %d", i);
+
+      // The take is named from its timestamp off the RT thread
+      if (start_loop_recording_rt(data, i, NULL) < 0)
+      {
+        rt_log_warn(&data->rt_bridge.log, "SYNC PULSE RESET: No loop memory available - dropping pending recording for note %d", i);
+        set_loop_pending_record(data, loop, false);
+        continue;
+      }
       loop->current_state = LOOP_STATE_RECORDING;
-      loop->pending_record = false;
+      set_loop_pending_record(data, loop, false);
       data->currently_recording_note = i;
       data->active_loop_count++;
 
       // Only start one recording per sync cycle
-      pw_log_info("SYNC PULSE RESET: Started recording for note %d, now recording note %d", i, data->currently_recording_note);
+      rt_log_info(&data->rt_bridge.log, "SYNC PULSE RESET: Started recording for note %d, now recording note %d", i, data->currently_recording_note);
       break;
     }
-    else if (loop->pending_record)
+    else
     {
-      pw_log_debug("SYNC pulse reset: Note %d pending but state=%d (not IDLE)", i, loop->current_state);
+      rt_log_debug(&data->rt_bridge.log, "SYNC pulse reset: Note %d pending but state=%d (not IDLE)", i, loop->current_state);
     }
   }
 }
@@ -703,15 +727,18 @@ void stop_sync_pending_recordings_on_pulse_reset(struct data *data)
     return;
   }
 
-  pw_log_debug("SYNC pulse reset detected: checking for pending stops");
+  rt_log_debug(&data->rt_bridge.log, "SYNC pulse reset detected: checking for pending stops");
 
   // Stop all recordings that are marked as pending stop
-  for (int i = 0; i < 128; i++)
+  uint8_t notes[128];
+  uint8_t count = note_set_collect(&data->pending_stop_set, notes);
+  for (uint8_t n = 0; n < count; n++)
   {
+    uint8_t i = notes[n];
     struct memory_loop *loop = &data->memory_loops[i];
-    if (loop->pending_stop && loop->current_state == LOOP_STATE_RECORDING)
+    if (loop->current_state == LOOP_STATE_RECORDING)
     {
-      pw_log_info("SYNC PULSE RESET: Stopping sync'd recording for note %d (extending to pulse boundary)", i);
+      rt_log_info(&data->rt_bridge.log, "SYNC PULSE RESET: Stopping sync'd recording for note %d (extending to pulse boundary)", i);
 
       // Calculate the target duration (multiple of pulse loop duration)
       uint32_t target_duration = loop->recorded_frames;
@@ -726,36 +753,35 @@ void stop_sync_pending_recordings_on_pulse_reset(struct data *data)
         {
           multiple = 1;
           target_duration = multiple * data->pulse_loop_duration;
-          pw_log_info("SYNC mode: Extending short recording to %u frames (%ux pulse loop), was %u frames",
-                      target_duration, multiple, loop->recorded_frames);
+          rt_log_info(&data->rt_bridge.log, "SYNC mode: Extending short recording to %u frames (%ux pulse loop), was %u frames",
+                                            target_duration, multiple, loop->recorded_frames);
         }
         else if (remainder == 0)
         {
           // Exact multiple - keep current length
           target_duration = loop->recorded_frames;
-          pw_log_info("SYNC mode: Recording is exact multiple - keeping %u frames (%ux pulse loop)",
-                      target_duration, multiple);
+          rt_log_info(&data->rt_bridge.log, "SYNC mode: Recording is exact multiple - keeping %u frames (%ux pulse loop)",
+                                            target_duration, multiple);
         }
         else
         {
           // Partial pulse recorded - truncate to last complete pulse
           target_duration = multiple * data->pulse_loop_duration;
-          pw_log_info("SYNC mode: Truncating to last complete pulse: %u frames (%ux pulse loop), was %u frames",
-                      target_duration, multiple, loop->recorded_frames);
+          rt_log_info(&data->rt_bridge.log, "SYNC mode: Truncating to last complete pulse: %u frames (%ux pulse loop), was %u frames",
+                                            target_duration, multiple, loop->recorded_frames);
         }
       }
 
       // Stop the recording
       stop_loop_recording_rt(data, i);
-      usleep(1000); // 1ms
 
       // Set the final duration to be a multiple of pulse duration
-      loop->recorded_frames = target_duration;
+      target_duration = loop_storage_set_length(data, loop, target_duration);
       loop->loop_ready = true; // Mark loop as ready for playback
 
       loop->current_state = LOOP_STATE_PLAYING;
-      loop->is_playing = true;
-      loop->pending_stop = false;
+      set_loop_playing(data, loop, true);
+      set_loop_pending_stop(data, loop, false);
 
       // Clear the currently recording note if this was it
       if (data->currently_recording_note == i)
@@ -763,11 +789,11 @@ void stop_sync_pending_recordings_on_pulse_reset(struct data *data)
         data->currently_recording_note = 255;
       }
 
-      pw_log_info("SYNC PULSE RESET: Recording for note %d stopped and set to %u frames, now playing", i, target_duration);
+      rt_log_info(&data->rt_bridge.log, "SYNC PULSE RESET: Recording for note %d stopped and set to %u frames, now playing", i, target_duration);
     }
-    else if (loop->pending_stop)
+    else
     {
-      pw_log_debug("SYNC pulse reset: Note %d pending stop but state=%d (not RECORDING)", i, loop->current_state);
+      rt_log_debug(&data->rt_bridge.log, "SYNC pulse reset: Note %d pending stop but state=%d (not RECORDING)", i, loop->current_state);
     }
   }
 }
@@ -777,26 +803,29 @@ void start_sync_pending_playback_on_pulse_reset(struct data *data)
   if (!data->sync_mode_enabled)
     return;
 
-  pw_log_debug("SYNC pulse reset detected: checking for pending playback starts");
+  rt_log_debug(&data->rt_bridge.log, "SYNC pulse reset detected: checking for pending playback starts");
 
   // Start any loops that were waiting for the next pulse cycle
-  for (int i = 0; i < 128; i++)
+  uint8_t notes[128];
+  uint8_t count = note_set_collect(&data->pending_start_set, notes);
+  for (uint8_t n = 0; n < count; n++)
   {
+    uint8_t i = notes[n];
     struct memory_loop *loop = &data->memory_loops[i];
 
-    if (loop->pending_start && loop->current_state == LOOP_STATE_PLAYING && loop->loop_ready)
+    if (loop->current_state == LOOP_STATE_PLAYING && loop->loop_ready)
     {
       // Start playing the loop
-      loop->is_playing = true;
-      loop->pending_start = false;
-      loop->playback_position = 0; // Start from beginning
+      set_loop_playing(data, loop, true);
+      set_loop_pending_start(data, loop, false);
+      loop_storage_seek(data, loop, 0); // Start from beginning
 
-      pw_log_info("SYNC PULSE RESET: Starting pending playback for loop %d", i);
+      rt_log_info(&data->rt_bridge.log, "SYNC PULSE RESET: Starting pending playback for loop %d", i);
     }
-    else if (loop->pending_start)
+    else
     {
-      pw_log_debug("SYNC pulse reset: Note %d pending start but state=%d or loop_ready=%s",
-                   i, loop->current_state, loop->loop_ready ? "true" : "false");
+      rt_log_debug(&data->rt_bridge.log, "SYNC pulse reset: Note %d pending start but state=%d or loop_ready=%s",
+                                         i, loop->current_state, loop->loop_ready ? "true" : "false");
     }
   }
 }
@@ -818,18 +847,17 @@ void check_sync_recording_target_length(struct data *data, uint8_t midi_note)
   // Check if we've reached or exceeded the target length
   if (loop->recorded_frames >= target_frames)
   {
-    pw_log_info("SYNC: Recording for note %d reached target length %u frames (%ux pulse), stopping",
-                midi_note, target_frames, current_multiple);
+    rt_log_info(&data->rt_bridge.log, "SYNC: Recording for note %d reached target length %u frames (%ux pulse), stopping",
+                                      midi_note, target_frames, current_multiple);
 
     // Stop the recording immediately
     stop_loop_recording_rt(data, midi_note);
-    usleep(1000); // 1ms
 
     // Set the exact target duration
-    loop->recorded_frames = target_frames;
+    target_frames = loop_storage_set_length(data, loop, target_frames);
     loop->current_state = LOOP_STATE_PLAYING;
-    loop->is_playing = true;
-    loop->pending_stop = false;
+    set_loop_playing(data, loop, true);
+    set_loop_pending_stop(data, loop, false);
 
     // Clear the currently recording note
     if (data->currently_recording_note == midi_note)
@@ -837,8 +865,8 @@ void check_sync_recording_target_length(struct data *data, uint8_t midi_note)
       data->currently_recording_note = 255;
     }
 
-    pw_log_info("SYNC: Recording for note %d completed at %u frames, now playing",
-                midi_note, target_frames);
+    rt_log_info(&data->rt_bridge.log, "SYNC: Recording for note %d completed at %u frames, now playing",
+                                      midi_note, target_frames);
   }
 }
 
@@ -881,25 +909,20 @@ bool start_sync_recording_with_backfill(struct data *data, uint8_t midi_note)
   // Check if we're before the recording cutoff
   if (pulse_position <= recording_cutoff_position)
   {
-    pw_log_info("SYNC: Starting immediate recording for note %d with backfill (pulse at %u, cutoff at %u)",
-                midi_note, pulse_position, recording_cutoff_position);
+    rt_log_info(&data->rt_bridge.log, "SYNC: Starting immediate recording for note %d with backfill (pulse at %u, cutoff at %u)",
+                                      midi_note, pulse_position, recording_cutoff_position);
 
     struct memory_loop *loop = &data->memory_loops[midi_note];
 
-    // Generate timestamp-based filename
-    time_t now;
-    time(&now);
-    struct tm *tm_info = localtime(&now);
-    snprintf(loop->loop_filename, sizeof(loop->loop_filename),
-             "loop_note_%03d_%04d-%02d-%02d_%02d-%02d-%02d.wav",
-             midi_note,
-             tm_info->tm_year + 1900, tm_info->tm_mon + 1, tm_info->tm_mday,
-             tm_info->tm_hour, tm_info->tm_min, tm_info->tm_sec);
-
-    // Start recording
-    start_loop_recording_rt(data, midi_note, loop->loop_filename);
+    // Start recording (named from its timestamp off the RT thread) -
+    // if the pool is exhausted fall back to the pending path
+    if (start_loop_recording_rt(data, midi_note, NULL) < 0)
+    {
+      rt_log_warn(&data->rt_bridge.log, "SYNC: No loop memory available for note %d", midi_note);
+      return false;
+    }
     loop->current_state = LOOP_STATE_RECORDING;
-    loop->pending_record = false;
+    set_loop_pending_record(data, loop, false);
     data->currently_recording_note = midi_note;
     data->active_loop_count++;
 
@@ -918,27 +941,28 @@ bool start_sync_recording_with_backfill(struct data *data, uint8_t midi_note)
         backfill_start_pos = data->backfill_buffer_size - (backfill_frames - data->backfill_write_position);
       }
 
-      // Copy backfill data to loop buffer
-      for (uint32_t i = 0; i < backfill_frames; i++)
+      // Copy backfill data to the loop in at most two contiguous runs
+      uint32_t first_run = data->backfill_buffer_size - backfill_start_pos;
+      if (first_run > backfill_frames)
       {
-        uint32_t read_pos = (backfill_start_pos + i) % data->backfill_buffer_size;
-        if (loop->recorded_frames < loop->buffer_size)
-        {
-          loop->buffer[loop->recorded_frames] = data->recording_backfill_buffer[read_pos];
-          loop->recorded_frames++;
-        }
+        first_run = backfill_frames;
+      }
+      loop_storage_append(data, loop, data->recording_backfill_buffer + backfill_start_pos, first_run);
+      if (backfill_frames > first_run)
+      {
+        loop_storage_append(data, loop, data->recording_backfill_buffer, backfill_frames - first_run);
       }
 
-      pw_log_info("SYNC: Backfilled %u frames for note %d from pulse start",
-                  backfill_frames, midi_note);
+      rt_log_info(&data->rt_bridge.log, "SYNC: Backfilled %u frames for note %d from pulse start",
+                                        backfill_frames, midi_note);
     }
 
     return true;
   }
   else
   {
-    pw_log_info("SYNC: Recording for note %d after cutoff - marking as pending (pulse at %u, cutoff at %u)",
-                midi_note, pulse_position, recording_cutoff_position);
+    rt_log_info(&data->rt_bridge.log, "SYNC: Recording for note %d after cutoff - marking as pending (pulse at %u, cutoff at %u)",
+                                      midi_note, pulse_position, recording_cutoff_position);
     return false;
   }
 }
@@ -0,0 +1,593 @@
+#include "loop_freeze.h"
+#include "uphonor.h"
+#include "mix_kernels.h"
+#include <math.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+static bool loop_freeze_cancelled(struct loop_freeze *fz, struct loop_freeze_entry *e)
+{
+  return atomic_load_explicit(&e->cancel, memory_order_acquire) ||
+         !atomic_load_explicit(&fz->running, memory_order_acquire);
+}
+
+/* Copy n frames of the take from position, wrapping at the loop point.
+   Returns the position after them. */
+static uint32_t loop_freeze_read_source(struct loop_freeze *fz, const struct loop_freeze_entry *e,
+                                        struct loop_pool_cursor *cursor, uint32_t position,
+                                        float *buf, uint32_t n)
+{
+  uint32_t got = 0;
+  while (got < n)
+  {
+    if (position >= e->source_frames)
+    {
+      position = 0;
+    }
+
+    uint32_t span;
+    const float *src = loop_pool_seek(fz->pool, e->source_first, cursor, position, &span);
+    uint32_t run = SPA_MIN(n - got, span);
+    run = SPA_MIN(run, e->source_frames - position);
+
+    memcpy(buf + got, src, run * sizeof(float));
+    position += run;
+    got += run;
+  }
+  return position;
+}
+
+/* Append n rendered frames, growing the render's chain from the pool */
+static bool loop_freeze_append(struct loop_freeze *fz, struct loop_freeze_entry *e, const float *src, uint32_t n)
+{
+  struct loop_pool *pool = fz->pool;
+
+  while (n > 0)
+  {
+    uint32_t offset = e->frames % pool->block_frames;
+    if (offset == 0 && e->frames / pool->block_frames == e->block_count)
+    {
+      // Recording has first claim on the reserve
+      if (loop_pool_free_blocks(pool) <= fz->reserve_blocks)
+        return false;
+
+      uint32_t block = loop_pool_acquire(pool);
+      if (block == LOOP_POOL_NONE)
+        return false;
+
+      if (e->block_count == 0)
+        e->first_block = block;
+      else
+        pool->chain[e->last_block] = block;
+      e->last_block = block;
+      e->block_count++;
+    }
+
+    uint32_t run = SPA_MIN(n, pool->block_frames - offset);
+    memcpy(loop_pool_block(pool, e->last_block) + offset, src, run * sizeof(float));
+    e->frames += run;
+    src += run;
+    n -= run;
+  }
+  return true;
+}
+
+/* Retrieve what RubberBand has ready, keeping output frames [skip, skip + want) */
+static bool loop_freeze_drain(struct loop_freeze *fz, struct loop_freeze_entry *e, RubberBandState state,
+                              float *out, uint64_t *produced, uint64_t skip, uint64_t want)
+{
+  int available;
+  while ((available = rubberband_available(state)) > 0)
+  {
+    uint32_t n = rubberband_retrieve(state, &out, SPA_MIN((uint32_t)available, (uint32_t)LOOP_FREEZE_CHUNK));
+    if (n == 0)
+      break;
+
+    uint64_t begin = *produced;
+    uint64_t end = begin + n;
+    *produced = end;
+
+    uint64_t from = SPA_MAX(begin, skip);
+    uint64_t to = SPA_MIN(end, skip + want);
+    if (from < to && !loop_freeze_append(fz, e, out + (from - begin), (uint32_t)(to - from)))
+      return false;
+  }
+  return true;
+}
+
+/* Render the take at the entry's speed and pitch into a new chain (freeze thread).
+ * The take is fed with LOOP_FREEZE_PAD_MS from across the loop point on either
+ * side and only the middle is kept, so the render wraps without a click. */
+static bool loop_freeze_render(struct loop_freeze *fz, struct loop_freeze_entry *e)
+{
+  uint32_t frames = e->source_frames;
+  uint32_t pad = SPA_MIN(frames, (uint32_t)((uint64_t)fz->sample_rate * LOOP_FREEZE_PAD_MS / 1000));
+  uint32_t total = frames + 2 * pad;
+  double ratio = 1.0 / e->speed; /* Time ratio is the inverse of playback speed */
+  uint64_t skip = (uint64_t)llround(pad * ratio);
+  uint64_t want = (uint64_t)llround(frames * ratio);
+  uint32_t start = (frames - pad) % frames;
+  bool ok = false;
+
+  if (want == 0)
+    return false;
+
+  /* Offline mode sees the whole take before stretching it, so it can
+     afford the standard window and the high-quality pitch path */
+  RubberBandOptions options = RubberBandOptionProcessOffline |
+                              RubberBandOptionThreadingNever |
+                              RubberBandOptionWindowStandard |
+                              RubberBandOptionFormantShifted |
+                              RubberBandOptionPitchHighQuality;
+#if defined(RUBBERBAND_API_MAJOR_VERSION) && defined(RUBBERBAND_API_MINOR_VERSION) && \
+    (RUBBERBAND_API_MAJOR_VERSION > 2 || RUBBERBAND_API_MINOR_VERSION >= 7)
+  options |= RubberBandOptionEngineFiner; /* RubberBand 3 */
+#endif
+
+  RubberBandState state = rubberband_new(fz->sample_rate, 1, options, ratio,
+                                         e->pitch == 0.0f ? 1.0 : pow(2.0, e->pitch / 12.0));
+  float *in = malloc(LOOP_FREEZE_CHUNK * sizeof(float));
+  float *out = malloc(LOOP_FREEZE_CHUNK * sizeof(float));
+  if (!state || !in || !out)
+    goto done;
+
+  rubberband_set_expected_input_duration(state, total);
+  rubberband_set_max_process_size(state, LOOP_FREEZE_CHUNK);
+
+  // First pass: study the whole input
+  struct loop_pool_cursor cursor = {LOOP_POOL_NONE, 0};
+  uint32_t position = start;
+  for (uint32_t done = 0; done < total;)
+  {
+    uint32_t n = SPA_MIN(total - done, (uint32_t)LOOP_FREEZE_CHUNK);
+    position = loop_freeze_read_source(fz, e, &cursor, position, in, n);
+    done += n;
+    const float *input = in;
+    rubberband_study(state, &input, n, done == total);
+    if (loop_freeze_cancelled(fz, e))
+      goto done;
+  }
+
+  // Second pass: stretch it
+  cursor.block = LOOP_POOL_NONE;
+  cursor.start = 0;
+  position = start;
+  uint64_t produced = 0;
+  for (uint32_t done = 0; done < total;)
+  {
+    uint32_t n = SPA_MIN(total - done, (uint32_t)LOOP_FREEZE_CHUNK);
+    position = loop_freeze_read_source(fz, e, &cursor, position, in, n);
+    done += n;
+    const float *input = in;
+    rubberband_process(state, &input, n, done == total);
+    if (!loop_freeze_drain(fz, e, state, out, &produced, skip, want) || loop_freeze_cancelled(fz, e))
+      goto done;
+  }
+
+  // RubberBand may come up a few frames short of the exact length
+  memset(out, 0, LOOP_FREEZE_CHUNK * sizeof(float));
+  while (e->frames < want)
+  {
+    uint32_t n = (uint32_t)SPA_MIN(want - e->frames, (uint64_t)LOOP_FREEZE_CHUNK);
+    if (!loop_freeze_append(fz, e, out, n))
+      goto done;
+  }
+  ok = true;
+
+done:
+  if (state)
+  {
+    rubberband_delete(state);
+  }
+  free(in);
+  free(out);
+
+  if (!ok && e->block_count > 0)
+  {
+    loop_pool_chain_unref(fz->pool, e->first_block, e->last_block, e->block_count);
+    e->first_block = LOOP_POOL_NONE;
+    e->block_count = 0;
+    e->frames = 0;
+  }
+  return ok;
+}
+
+static void loop_freeze_wake(struct loop_freeze *fz)
+{
+  /* A non-blocking eventfd write is a bounded syscall - safe from the RT thread */
+  if (fz->wake_fd >= 0)
+  {
+    uint64_t one = 1;
+    if (write(fz->wake_fd, &one, sizeof(one)) < 0)
+    {
+      /* EAGAIN - the counter is saturated, the thread is awake anyway */
+    }
+  }
+}
+
+static void *loop_freeze_thread(void *arg)
+{
+  struct loop_freeze *fz = arg;
+
+  while (atomic_load_explicit(&fz->running, memory_order_acquire))
+  {
+    /* Clear before looking so a render queued meanwhile wakes us again */
+    atomic_store_explicit(&fz->wake_requested, false, memory_order_release);
+
+    for (uint32_t i = 0; i < LOOP_FREEZE_MAX; i++)
+    {
+      struct loop_freeze_entry *e = &fz->entries[i];
+      int expected = LOOP_FREEZE_QUEUED;
+      if (!atomic_compare_exchange_strong_explicit(&e->state, &expected, LOOP_FREEZE_RENDERING,
+                                                   memory_order_acq_rel, memory_order_acquire))
+        continue;
+
+      e->first_block = LOOP_POOL_NONE;
+      e->last_block = LOOP_POOL_NONE;
+      e->block_count = 0;
+      e->frames = 0;
+
+      bool ok = !loop_freeze_cancelled(fz, e) && loop_freeze_render(fz, e);
+      if (ok)
+      {
+        atomic_fetch_add_explicit(&fz->renders, 1, memory_order_relaxed);
+        pw_log_info("Froze loop %u at %.2fx, %+.1f semitones (%u frames)", e->loop->midi_note, e->speed,
+                    e->pitch, e->frames);
+      }
+      atomic_store_explicit(&e->state, ok ? LOOP_FREEZE_READY : LOOP_FREEZE_FAILED, memory_order_release);
+    }
+
+    struct pollfd pfd = {.fd = fz->wake_fd, .events = POLLIN};
+    if (poll(&pfd, 1, LOOP_FREEZE_POLL_MS) > 0 && (pfd.revents & POLLIN))
+    {
+      uint64_t count;
+      if (read(fz->wake_fd, &count, sizeof(count)) < 0)
+      {
+        /* EAGAIN - already consumed */
+      }
+    }
+  }
+
+  return NULL;
+}
+
+int loop_freeze_start(struct loop_freeze *fz, struct loop_pool *pool, uint32_t sample_rate, struct rt_log *log)
+{
+  if (fz->thread_started)
+  {
+    return 0;
+  }
+
+  for (uint32_t i = 0; i < LOOP_FREEZE_MAX; i++)
+  {
+    struct loop_freeze_entry *e = &fz->entries[i];
+    memset(e, 0, sizeof(*e));
+    e->source_first = LOOP_POOL_NONE;
+    e->first_block = LOOP_POOL_NONE;
+    atomic_init(&e->state, LOOP_FREEZE_FREE);
+    atomic_init(&e->cancel, false);
+  }
+  fz->pool = pool;
+  fz->sample_rate = sample_rate;
+  fz->reserve_blocks = (uint32_t)((uint64_t)sample_rate * LOOP_FREEZE_RESERVE_SECONDS / pool->block_frames);
+  fz->log = log;
+  fz->evictions = 0;
+  atomic_store_explicit(&fz->renders, 0, memory_order_relaxed);
+
+  /* Without the eventfd the thread still looks for work every LOOP_FREEZE_POLL_MS */
+  fz->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (fz->wake_fd < 0)
+  {
+    pw_log_warn("eventfd failed, the freeze thread will poll");
+  }
+  atomic_store_explicit(&fz->wake_requested, false, memory_order_relaxed);
+
+  atomic_store_explicit(&fz->running, true, memory_order_release);
+  if (pthread_create(&fz->thread, NULL, loop_freeze_thread, fz) != 0)
+  {
+    atomic_store_explicit(&fz->running, false, memory_order_release);
+    if (fz->wake_fd >= 0)
+    {
+      close(fz->wake_fd);
+      fz->wake_fd = -1;
+    }
+    pw_log_warn("freeze: failed to start the thread, stretched loops stay live");
+    return -1;
+  }
+  fz->thread_started = true;
+  atomic_store_explicit(&fz->ready, true, memory_order_release);
+  return 0;
+}
+
+void loop_freeze_stop(struct loop_freeze *fz)
+{
+  if (!fz->thread_started)
+  {
+    return;
+  }
+
+  atomic_store_explicit(&fz->ready, false, memory_order_release);
+  atomic_store_explicit(&fz->running, false, memory_order_release);
+  loop_freeze_wake(fz);
+  pthread_join(fz->thread, NULL);
+  fz->thread_started = false;
+  if (fz->wake_fd >= 0)
+  {
+    close(fz->wake_fd);
+    fz->wake_fd = -1;
+  }
+
+  for (uint32_t i = 0; i < LOOP_FREEZE_MAX; i++)
+  {
+    struct loop_freeze_entry *e = &fz->entries[i];
+    if (e->source_first != LOOP_POOL_NONE)
+    {
+      loop_pool_chain_unref(fz->pool, e->source_first, e->source_last, e->source_count);
+      e->source_first = LOOP_POOL_NONE;
+    }
+    if (e->block_count > 0)
+    {
+      loop_pool_chain_unref(fz->pool, e->first_block, e->last_block, e->block_count);
+      e->block_count = 0;
+    }
+    if (e->loop)
+    {
+      e->loop->freeze_slot = LOOP_FREEZE_SLOT_NONE;
+      e->loop = NULL;
+    }
+    atomic_store_explicit(&e->state, LOOP_FREEZE_FREE, memory_order_relaxed);
+  }
+
+  pw_log_info("Loop freeze: %llu renders, %llu evicted",
+              (unsigned long long)atomic_load_explicit(&fz->renders, memory_order_relaxed),
+              (unsigned long long)fz->evictions);
+}
+
+void loop_freeze_wait_idle(struct loop_freeze *fz)
+{
+  struct timespec pause = {0, 1000000L};
+
+  for (uint32_t i = 0; i < LOOP_FREEZE_MAX && atomic_load_explicit(&fz->ready, memory_order_acquire);)
+  {
+    int state = atomic_load_explicit(&fz->entries[i].state, memory_order_acquire);
+    if (state == LOOP_FREEZE_QUEUED || state == LOOP_FREEZE_RENDERING)
+    {
+      nanosleep(&pause, NULL);
+      continue;
+    }
+    i++;
+  }
+}
+
+/* RT: whether the render still matches its loop's take and settings */
+static bool loop_freeze_valid(const struct loop_freeze_entry *e)
+{
+  const struct memory_loop *loop = e->loop;
+  return loop->take_generation == e->generation && loop->first_block != LOOP_POOL_NONE &&
+         loop->loop_ready && loop->recorded_frames == e->source_frames &&
+         loop->speed == e->speed && loop->pitch == e->pitch && !loop->varispeed;
+}
+
+/* RT: give an entry the freeze thread is done with back, with its chains */
+static void loop_freeze_drop_rt(struct loop_freeze *fz, struct loop_freeze_entry *e)
+{
+  if (e->source_first != LOOP_POOL_NONE)
+  {
+    loop_pool_chain_unref(fz->pool, e->source_first, e->source_last, e->source_count);
+    e->source_first = LOOP_POOL_NONE;
+  }
+  if (e->block_count > 0)
+  {
+    loop_pool_chain_unref(fz->pool, e->first_block, e->last_block, e->block_count);
+    e->first_block = LOOP_POOL_NONE;
+    e->block_count = 0;
+  }
+  e->loop->freeze_slot = LOOP_FREEZE_SLOT_NONE;
+  e->loop = NULL;
+  atomic_store_explicit(&e->state, LOOP_FREEZE_FREE, memory_order_relaxed);
+}
+
+void loop_freeze_update_rt(struct data *data)
+{
+  struct loop_freeze *fz = &data->freeze;
+  if (!atomic_load_explicit(&fz->ready, memory_order_acquire))
+  {
+    return;
+  }
+
+  struct loop_pool *pool = fz->pool;
+  uint32_t free_blocks = loop_pool_free_blocks(pool);
+  bool pressure = free_blocks < fz->reserve_blocks;
+  struct loop_freeze_entry *victim = NULL;
+
+  for (uint32_t i = 0; i < LOOP_FREEZE_MAX; i++)
+  {
+    struct loop_freeze_entry *e = &fz->entries[i];
+    int state = atomic_load_explicit(&e->state, memory_order_acquire);
+
+    switch (state)
+    {
+    case LOOP_FREEZE_QUEUED:
+    case LOOP_FREEZE_RENDERING:
+      // The freeze thread notices and gives the entry back as failed
+      if (!loop_freeze_valid(e))
+        atomic_store_explicit(&e->cancel, true, memory_order_release);
+      break;
+
+    case LOOP_FREEZE_FAILED:
+      // Try again once the settings have held for another cycle
+      e->loop->stretch_since = data->current_sample_frame;
+      loop_freeze_drop_rt(fz, e);
+      break;
+
+    case LOOP_FREEZE_READY:
+    case LOOP_FREEZE_LIVE:
+      if (e->source_first != LOOP_POOL_NONE)
+      {
+        /* Rendered - the key keeps the take apart from later ones */
+        loop_pool_chain_unref(pool, e->source_first, e->source_last, e->source_count);
+        e->source_first = LOOP_POOL_NONE;
+      }
+      if (atomic_load_explicit(&e->cancel, memory_order_relaxed) || !loop_freeze_valid(e))
+      {
+        loop_freeze_drop_rt(fz, e);
+      }
+      else if (pressure && (!victim || (victim->loop->is_playing && !e->loop->is_playing)))
+      {
+        victim = e; /* Stopped loops go first */
+      }
+      break;
+
+    default:
+      break;
+    }
+  }
+
+  if (victim)
+  {
+    // Recording needs the memory more than the loop needs its render
+    fz->evictions++;
+    rt_log_info(fz->log, "Loop memory low, loop %u is stretched live again", victim->loop->midi_note);
+    loop_freeze_drop_rt(fz, victim);
+  }
+
+  if (pressure)
+  {
+    return;
+  }
+
+  /* Queue renders for stretched loops whose settings held for a whole cycle */
+  for (uint8_t v = 0; v < data->playing_voices.count; v++)
+  {
+    struct memory_loop *loop = &data->memory_loops[data->playing_voices.notes[v]];
+
+    if (loop->freeze_slot != LOOP_FREEZE_SLOT_NONE || (loop->speed == 1.0f && loop->pitch == 0.0f) ||
+        loop->varispeed || !loop->loop_ready || loop->recorded_frames == 0 || loop->first_block == LOOP_POOL_NONE)
+      continue;
+
+    if (data->current_sample_frame - loop->stretch_since <= loop->recorded_frames)
+      continue;
+
+    /* Leave the reserve intact even once the render is done */
+    uint64_t render_frames = (uint64_t)(loop->recorded_frames / loop->speed) + 1;
+    uint32_t blocks = (uint32_t)(render_frames / pool->block_frames) + 1;
+    if (free_blocks < fz->reserve_blocks + blocks)
+      continue;
+
+    struct loop_freeze_entry *e = NULL;
+    uint32_t slot;
+    for (slot = 0; slot < LOOP_FREEZE_MAX; slot++)
+    {
+      if (atomic_load_explicit(&fz->entries[slot].state, memory_order_relaxed) == LOOP_FREEZE_FREE)
+      {
+        e = &fz->entries[slot];
+        break;
+      }
+    }
+    if (!e)
+      return; /* Every entry in use */
+
+    // The take stays referenced until the freeze thread is done reading it
+    loop_pool_chain_ref(pool, loop->first_block);
+    e->loop = loop;
+    e->generation = loop->take_generation;
+    e->speed = loop->speed;
+    e->pitch = loop->pitch;
+    e->source_first = loop->first_block;
+    e->source_last = loop->last_block;
+    e->source_count = loop->block_count;
+    e->source_frames = loop->recorded_frames;
+    atomic_store_explicit(&e->cancel, false, memory_order_relaxed);
+    atomic_store_explicit(&e->state, LOOP_FREEZE_QUEUED, memory_order_release);
+    if (!atomic_exchange_explicit(&fz->wake_requested, true, memory_order_acq_rel))
+    {
+      loop_freeze_wake(fz);
+    }
+
+    loop->freeze_slot = (uint8_t)slot;
+    free_blocks -= blocks;
+  }
+}
+
+bool loop_freeze_mix_rt(struct data *data, struct memory_loop *loop, float *buf, uint32_t n_samples)
+{
+  if (loop->freeze_slot == LOOP_FREEZE_SLOT_NONE)
+  {
+    return false;
+  }
+
+  struct loop_freeze *fz = &data->freeze;
+  struct loop_freeze_entry *e = &fz->entries[loop->freeze_slot];
+  int state = atomic_load_explicit(&e->state, memory_order_acquire);
+
+  if (state == LOOP_FREEZE_READY)
+  {
+    /* Swap in when the live stretch reaches the loop point inside this
+       block. The position counts frames of the take, as the render does at
+       its own length, so the render picks up where the live stretch is;
+       the live stretcher goes back to the pool. */
+    double position = loop->playback_position + loop->position_frac / 4294967296.0;
+    if (position + (double)loop->speed * n_samples < loop->recorded_frames)
+    {
+      return false;
+    }
+    e->position = (uint32_t)llround(position * e->frames / loop->recorded_frames) % e->frames;
+    e->cursor.block = LOOP_POOL_NONE;
+    e->cursor.start = 0;
+    atomic_store_explicit(&e->state, LOOP_FREEZE_LIVE, memory_order_relaxed);
+    stretch_loop_release_rt(&data->stretch, loop);
+    state = LOOP_FREEZE_LIVE;
+  }
+
+  if (state != LOOP_FREEZE_LIVE)
+  {
+    return false;
+  }
+
+  uint32_t mixed = 0;
+  while (mixed < n_samples)
+  {
+    if (e->position >= e->frames)
+    {
+      e->position = 0;
+    }
+
+    uint32_t span;
+    const float *src = loop_pool_seek(fz->pool, e->first_block, &e->cursor, e->position, &span);
+    uint32_t run = SPA_MIN(n_samples - mixed, span);
+    run = SPA_MIN(run, e->frames - e->position);
+
+    mix_gain_accumulate(buf + mixed, src, loop->volume, run);
+    e->position += run;
+    mixed += run;
+  }
+
+  /* Back in frames of the take, for when the loop is stretched live again */
+  loop->playback_position = (uint32_t)((uint64_t)e->position * loop->recorded_frames / e->frames);
+  loop->position_frac = 0;
+  return true;
+}
+
+bool loop_freeze_live_rt(struct data *data, struct memory_loop *loop)
+{
+  return loop->freeze_slot != LOOP_FREEZE_SLOT_NONE &&
+         atomic_load_explicit(&data->freeze.entries[loop->freeze_slot].state, memory_order_acquire) ==
+             LOOP_FREEZE_LIVE;
+}
+
+void loop_freeze_seek_rt(struct data *data, struct memory_loop *loop)
+{
+  if (!loop_freeze_live_rt(data, loop))
+  {
+    return;
+  }
+
+  struct loop_freeze_entry *e = &data->freeze.entries[loop->freeze_slot];
+  e->position = (uint32_t)((uint64_t)loop->playback_position * e->frames / loop->recorded_frames) % e->frames;
+  e->cursor.block = LOOP_POOL_NONE;
+  e->cursor.start = 0;
+}
@@ -0,0 +1,125 @@
+#ifndef LOOP_FREEZE_H
+#define LOOP_FREEZE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "loop_pool.h"
+#include "rt_log.h"
+
+struct data;
+struct memory_loop;
+
+/* Rendered-stretch cache ("freeze") for loops whose speed and pitch have settled.
+ *
+ * A loop stretched live keeps a pooled RubberBand instance busy for as long
+ * as it plays. Once its speed and pitch have stayed put for a whole loop
+ * cycle, the freeze thread renders the take once, with RubberBand's offline
+ * high-quality mode, into a new chain from the loop pool. The mixer swaps
+ * the render in at the loop's next boundary; from then on the loop plays as
+ * a plain copy and its live stretcher goes back to the pool.
+ *
+ * An entry is keyed by the take (memory_loop.take_generation) and the speed
+ * and pitch it was rendered at. Any change drops it, and the loop is
+ * stretched live again until the new settings have settled for a cycle.
+ * Renders come out of the same block budget as recordings. They only start
+ * while LOOP_FREEZE_RESERVE_SECONDS of loop memory stays free, and the mixer
+ * evicts them, one per cycle, when recording eats into that reserve.
+ *
+ * Entries change hands through their state word: the RT thread fills one in
+ * and queues it, the freeze thread renders it and marks it ready or failed,
+ * and everything after that is the RT thread's again. */
+
+#define LOOP_FREEZE_MAX 16             /* Frozen loops at most */
+#define LOOP_FREEZE_RESERVE_SECONDS 30 /* Loop memory renders leave free for recording */
+#define LOOP_FREEZE_PAD_MS 250         /* Audio from across the loop point rendered around the take */
+#define LOOP_FREEZE_CHUNK 4096         /* Frames per RubberBand study/process call */
+#define LOOP_FREEZE_POLL_MS 100        /* Freeze thread check interval without a wakeup */
+#define LOOP_FREEZE_SLOT_NONE 0xff     /* memory_loop.freeze_slot without an entry */
+
+enum loop_freeze_state
+{
+  LOOP_FREEZE_FREE,      /* Unused (RT) */
+  LOOP_FREEZE_QUEUED,    /* Filled in by RT, waiting for the freeze thread */
+  LOOP_FREEZE_RENDERING, /* The freeze thread is rendering it */
+  LOOP_FREEZE_READY,     /* Rendered - RT swaps it in at the next loop boundary */
+  LOOP_FREEZE_FAILED,    /* Cancelled or out of loop memory - RT frees it */
+  LOOP_FREEZE_LIVE       /* RT plays the render */
+};
+
+struct loop_freeze_entry
+{
+  _Atomic int state;   /* enum loop_freeze_state */
+  _Atomic bool cancel; /* RT no longer wants the render */
+
+  /* Key, set by RT before queueing */
+  struct memory_loop *loop; /* Loop the entry belongs to, NULL while free */
+  uint32_t generation;      /* memory_loop.take_generation */
+  float speed;
+  float pitch; /* Semitones */
+
+  /* The take, referenced by the entry until the render is done */
+  uint32_t source_first;
+  uint32_t source_last;
+  uint32_t source_count;
+  uint32_t source_frames;
+
+  /* Rendered chain, written by the freeze thread before READY */
+  uint32_t first_block;
+  uint32_t last_block;
+  uint32_t block_count;
+  uint32_t frames;
+
+  /* RT playback */
+  uint32_t position;
+  struct loop_pool_cursor cursor;
+};
+
+struct loop_freeze
+{
+  struct loop_freeze_entry entries[LOOP_FREEZE_MAX];
+  struct loop_pool *pool;
+  uint32_t sample_rate;
+  uint32_t reserve_blocks; /* Free blocks below which renders are evicted */
+  struct rt_log *log;
+
+  _Atomic bool ready; /* Thread running */
+  pthread_t thread;
+  bool thread_started;
+  _Atomic bool running;
+  int wake_fd;                 /* eventfd signalled when a render is queued, -1 to poll */
+  _Atomic bool wake_requested; /* RT queued a render the thread has not looked for yet */
+
+  /* Statistics */
+  _Atomic uint64_t renders;
+  uint64_t evictions; /* RT */
+};
+
+/* Non-RT: start the freeze thread */
+int loop_freeze_start(struct loop_freeze *fz, struct loop_pool *pool, uint32_t sample_rate, struct rt_log *log);
+
+/* Non-RT: stop the thread and drop every render */
+void loop_freeze_stop(struct loop_freeze *fz);
+
+/* Non-RT: wait until no render is queued or in progress. The offline
+   renderer calls this between cycles, so renders land on the same cycle
+   every run. */
+void loop_freeze_wait_idle(struct loop_freeze *fz);
+
+/* RT, once per cycle before mixing: drop stale renders, evict under memory
+   pressure and queue renders for loops that settled */
+void loop_freeze_update_rt(struct data *data);
+
+/* RT: mix the loop from its render, swapping a finished one in at the loop
+   boundary. Returns false if the loop has to be stretched live. */
+bool loop_freeze_mix_rt(struct data *data, struct memory_loop *loop, float *buf, uint32_t n_samples);
+
+/* RT: true if the loop plays its render rather than the take */
+bool loop_freeze_live_rt(struct data *data, struct memory_loop *loop);
+
+/* RT: move a playing render to the loop's playback_position, after the
+   position was re-derived from the clock */
+void loop_freeze_seek_rt(struct data *data, struct memory_loop *loop);
+
+#endif /* LOOP_FREEZE_H */
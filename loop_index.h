@@ -0,0 +1,95 @@
+#ifndef LOOP_INDEX_H
+#define LOOP_INDEX_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Compact indexes over the 128 memory loops.
+ *
+ * The RT cycle used to scan every loop several times to find the few that
+ * are playing or have a pending sync action. These structures are kept in
+ * step with the per-loop flags on every state transition so per-cycle work
+ * scales with the number of active loops instead of 128. */
+
+#define LOOP_INDEX_NONE 255
+
+/* Set of MIDI notes (0-127) as a 128-bit mask */
+struct note_set
+{
+  uint64_t bits[2];
+};
+
+static inline void note_set_add(struct note_set *set, uint8_t note)
+{
+  set->bits[note >> 6] |= UINT64_C(1) << (note & 63);
+}
+
+static inline void note_set_remove(struct note_set *set, uint8_t note)
+{
+  set->bits[note >> 6] &= ~(UINT64_C(1) << (note & 63));
+}
+
+static inline bool note_set_contains(const struct note_set *set, uint8_t note)
+{
+  return (set->bits[note >> 6] >> (note & 63)) & 1;
+}
+
+static inline bool note_set_empty(const struct note_set *set)
+{
+  return (set->bits[0] | set->bits[1]) == 0;
+}
+
+/* Copy the members into notes[] in ascending order and return how many.
+ * Callers iterate the snapshot so they may modify the set while doing so. */
+static inline uint8_t note_set_collect(const struct note_set *set, uint8_t notes[128])
+{
+  uint8_t count = 0;
+  for (int word = 0; word < 2; word++)
+  {
+    uint64_t bits = set->bits[word];
+    while (bits)
+    {
+      notes[count++] = (uint8_t)(word * 64 + __builtin_ctzll(bits));
+      bits &= bits - 1;
+    }
+  }
+  return count;
+}
+
+/* Unordered list of playing loops with O(1) add and remove */
+struct voice_list
+{
+  uint8_t notes[128]; /* Playing notes, first count entries are valid */
+  uint8_t slot[128];  /* Index of each note in notes[] (LOOP_INDEX_NONE if absent) */
+  uint8_t count;
+};
+
+static inline void voice_list_init(struct voice_list *list)
+{
+  memset(list->slot, LOOP_INDEX_NONE, sizeof(list->slot));
+  list->count = 0;
+}
+
+static inline void voice_list_add(struct voice_list *list, uint8_t note)
+{
+  if (list->slot[note] != LOOP_INDEX_NONE)
+    return;
+  list->slot[note] = list->count;
+  list->notes[list->count++] = note;
+}
+
+static inline void voice_list_remove(struct voice_list *list, uint8_t note)
+{
+  uint8_t slot = list->slot[note];
+  if (slot == LOOP_INDEX_NONE)
+    return;
+
+  /* Move the last voice into the hole */
+  uint8_t last = list->notes[--list->count];
+  list->notes[slot] = last;
+  list->slot[last] = slot;
+  list->slot[note] = LOOP_INDEX_NONE;
+}
+
+#endif /* LOOP_INDEX_H */
@@ -0,0 +1,168 @@
+#include "loop_pool.h"
+#include <stdlib.h>
+#include <string.h>
+
+static inline uint64_t pack_head(uint64_t old_head, uint32_t index)
+{
+  /* Bump the tag on every update so a stale head can never win a CAS */
+  return (((old_head >> 32) + 1) << 32) | index;
+}
+
+int loop_pool_init(struct loop_pool *pool, uint32_t block_frames, uint32_t block_count,
+                   enum rt_memory_mode mode)
+{
+  memset(pool, 0, sizeof(*pool));
+
+  if (block_frames == 0 || block_count == 0)
+  {
+    return -1;
+  }
+
+  /* Recording writes into this from the RT thread, so back it up front
+   * unless lazy mode was asked for */
+  pool->memory = rt_memory_alloc(&pool->region, (size_t)block_frames * block_count * sizeof(float), mode);
+  pool->chain = malloc(block_count * sizeof(*pool->chain));
+  pool->next = calloc(block_count, sizeof(*pool->next));
+  pool->refs = calloc(block_count, sizeof(*pool->refs));
+  if (!pool->memory || !pool->chain || !pool->next || !pool->refs)
+  {
+    rt_memory_free(&pool->region);
+    free(pool->chain);
+    free((void *)pool->next);
+    free((void *)pool->refs);
+    memset(pool, 0, sizeof(*pool));
+    return -1;
+  }
+
+  pool->block_frames = block_frames;
+  pool->block_count = block_count;
+
+  /* Chain every block into the free list in ascending order */
+  for (uint32_t i = 0; i < block_count; i++)
+  {
+    pool->chain[i] = LOOP_POOL_NONE;
+    atomic_init(&pool->next[i], (i + 1 < block_count) ? i + 1 : LOOP_POOL_NONE);
+    atomic_init(&pool->refs[i], 0);
+  }
+  atomic_init(&pool->free_head, (uint64_t)0);
+  atomic_init(&pool->free_count, block_count);
+
+  return 0;
+}
+
+void loop_pool_destroy(struct loop_pool *pool)
+{
+  rt_memory_free(&pool->region);
+  free(pool->chain);
+  free((void *)pool->next);
+  free((void *)pool->refs);
+  pool->memory = NULL;
+  pool->chain = NULL;
+  pool->next = NULL;
+  pool->refs = NULL;
+  pool->block_frames = 0;
+  pool->block_count = 0;
+}
+
+uint32_t loop_pool_acquire(struct loop_pool *pool)
+{
+  if (!pool->next)
+  {
+    return LOOP_POOL_NONE;
+  }
+
+  uint64_t head = atomic_load_explicit(&pool->free_head, memory_order_acquire);
+
+  for (;;)
+  {
+    uint32_t block = (uint32_t)head;
+    if (block == LOOP_POOL_NONE)
+    {
+      return LOOP_POOL_NONE; /* Budget exhausted */
+    }
+
+    uint32_t next = atomic_load_explicit(&pool->next[block], memory_order_relaxed);
+    if (atomic_compare_exchange_weak_explicit(&pool->free_head, &head,
+                                              pack_head(head, next),
+                                              memory_order_acquire,
+                                              memory_order_acquire))
+    {
+      atomic_fetch_sub_explicit(&pool->free_count, 1, memory_order_relaxed);
+      pool->chain[block] = LOOP_POOL_NONE;
+      atomic_store_explicit(&pool->refs[block], 1, memory_order_relaxed);
+      return block;
+    }
+  }
+}
+
+void loop_pool_release_chain(struct loop_pool *pool, uint32_t first, uint32_t last, uint32_t count)
+{
+  if (!pool->next || first >= pool->block_count || last >= pool->block_count || count == 0)
+  {
+    return;
+  }
+
+  /* Thread the free-list links through the chain so it can be pushed whole */
+  for (uint32_t block = first; block != last; block = pool->chain[block])
+  {
+    atomic_store_explicit(&pool->next[block], pool->chain[block], memory_order_relaxed);
+  }
+
+  uint64_t head = atomic_load_explicit(&pool->free_head, memory_order_relaxed);
+
+  do
+  {
+    atomic_store_explicit(&pool->next[last], (uint32_t)head, memory_order_relaxed);
+  } while (!atomic_compare_exchange_weak_explicit(&pool->free_head, &head,
+                                                  pack_head(head, first),
+                                                  memory_order_release,
+                                                  memory_order_relaxed));
+
+  atomic_fetch_add_explicit(&pool->free_count, count, memory_order_relaxed);
+}
+
+void loop_pool_release(struct loop_pool *pool, uint32_t block)
+{
+  loop_pool_release_chain(pool, block, block, 1);
+}
+
+void loop_pool_chain_ref(struct loop_pool *pool, uint32_t first)
+{
+  if (!pool->refs || first >= pool->block_count)
+  {
+    return;
+  }
+  atomic_fetch_add_explicit(&pool->refs[first], 1, memory_order_relaxed);
+}
+
+bool loop_pool_chain_unref(struct loop_pool *pool, uint32_t first, uint32_t last, uint32_t count)
+{
+  if (!pool->refs || first >= pool->block_count)
+  {
+    return false;
+  }
+
+  /* acq_rel: the last user must see every write the others made to the chain */
+  if (atomic_fetch_sub_explicit(&pool->refs[first], 1, memory_order_acq_rel) != 1)
+  {
+    return false;
+  }
+
+  if (last == LOOP_POOL_NONE)
+  {
+    /* Nobody else can touch the chain any more, walk it to find the tail */
+    count = 1;
+    for (last = first; pool->chain[last] != LOOP_POOL_NONE; last = pool->chain[last])
+    {
+      count++;
+    }
+  }
+
+  loop_pool_release_chain(pool, first, last, count);
+  return true;
+}
+
+uint32_t loop_pool_free_blocks(struct loop_pool *pool)
+{
+  return atomic_load_explicit(&pool->free_count, memory_order_relaxed);
+}
@@ -0,0 +1,113 @@
+#ifndef LOOP_POOL_H
+#define LOOP_POOL_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "rt_memory.h"
+
+/* Preallocated block pool for memory loop storage.
+ *
+ * A single loop memory budget is reserved at startup and divided into
+ * small fixed-size blocks. A loop is stored as a chain of blocks that
+ * grows one block at a time while recording, so loop length is bounded
+ * only by the total budget and idle MIDI notes cost no audio memory.
+ *
+ * The free list is a tagged lock-free stack: acquire and release never
+ * block or allocate and may be called from the RT thread and from non-RT
+ * threads at the same time. Chain links belong to the owner of the chain
+ * and are only written before a block becomes reachable by readers.
+ *
+ * Each chain carries a reference count on its first block. The loop that
+ * records into a chain holds one reference; anyone reading it off the RT
+ * thread (e.g. the file writer) takes another, so a chain is only returned
+ * to the free list once the last user is done with it. A new take always
+ * starts a fresh chain rather than overwriting one that may still be read. */
+
+#define LOOP_POOL_NONE UINT32_MAX
+
+/* Default loop memory budget in seconds of mono audio */
+#define LOOP_POOL_DEFAULT_SECONDS 960
+
+/* Block size in frames (~0.68 s at 48kHz) */
+#define LOOP_POOL_BLOCK_FRAMES 32768
+
+struct loop_pool
+{
+  float *memory;                  /* Single reservation backing all blocks */
+  struct rt_memory_region region; /* Mapping behind memory (prefaulted/locked) */
+  uint32_t block_frames;          /* Size of one block in frames (mono) */
+  uint32_t block_count;           /* Number of blocks in the budget */
+  uint32_t *chain;                /* Link to the next block of the owning loop */
+  _Atomic uint32_t *next;         /* Free-list link for each block */
+  _Atomic uint32_t *refs;         /* Reference count of the chain starting at each block */
+  _Atomic uint64_t free_head;     /* (ABA tag << 32) | index of first free block */
+  _Atomic uint32_t free_count;
+};
+
+/* Position of a reader or writer inside a block chain */
+struct loop_pool_cursor
+{
+  uint32_t block; /* Block holding the cursor (LOOP_POOL_NONE if unset) */
+  uint32_t start; /* Frame index of the first frame in that block */
+};
+
+/* Reserve block_count blocks of block_frames frames each (non-RT) */
+int loop_pool_init(struct loop_pool *pool, uint32_t block_frames, uint32_t block_count,
+                   enum rt_memory_mode mode);
+void loop_pool_destroy(struct loop_pool *pool);
+
+/* Take a block from the pool, LOOP_POOL_NONE if the budget is exhausted (RT-safe).
+ * The returned block is unlinked (its chain link is LOOP_POOL_NONE) and, as
+ * the head of a new chain, holds one reference for the caller. */
+uint32_t loop_pool_acquire(struct loop_pool *pool);
+
+/* Return a single block to the pool (RT-safe) */
+void loop_pool_release(struct loop_pool *pool, uint32_t block);
+
+/* Return a whole chain of count blocks from first to last in one step (RT-safe) */
+void loop_pool_release_chain(struct loop_pool *pool, uint32_t first, uint32_t last, uint32_t count);
+
+/* Take another reference on the chain starting at first (RT-safe) */
+void loop_pool_chain_ref(struct loop_pool *pool, uint32_t first);
+
+/* Drop a reference on the chain starting at first and return it to the pool
+ * if that was the last one (RT-safe). last and count describe the chain; pass
+ * LOOP_POOL_NONE and 0 to have them found by walking it (non-RT callers).
+ * Returns true if the chain was released. */
+bool loop_pool_chain_unref(struct loop_pool *pool, uint32_t first, uint32_t last, uint32_t count);
+
+/* Number of blocks currently available */
+uint32_t loop_pool_free_blocks(struct loop_pool *pool);
+
+static inline float *loop_pool_block(const struct loop_pool *pool, uint32_t block)
+{
+  return pool->memory + (uint64_t)block * pool->block_frames;
+}
+
+/* Move cursor to the block holding frame position of the chain starting at
+ * first and return a pointer to that frame. *span receives the number of
+ * contiguous frames available from there to the end of the block. The
+ * position must lie inside the chain. Moving forward is O(blocks skipped),
+ * moving backwards restarts from the first block. */
+static inline float *loop_pool_seek(const struct loop_pool *pool, uint32_t first,
+                                    struct loop_pool_cursor *cursor,
+                                    uint32_t position, uint32_t *span)
+{
+  if (cursor->block == LOOP_POOL_NONE || position < cursor->start)
+  {
+    cursor->block = first;
+    cursor->start = 0;
+  }
+  while (position - cursor->start >= pool->block_frames)
+  {
+    cursor->block = pool->chain[cursor->block];
+    cursor->start += pool->block_frames;
+  }
+
+  uint32_t offset = position - cursor->start;
+  *span = pool->block_frames - offset;
+  return loop_pool_block(pool, cursor->block) + offset;
+}
+
+#endif /* LOOP_POOL_H */
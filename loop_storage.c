@@ -0,0 +1,210 @@
+#include "loop_storage.h"
+#include <math.h>
+#include <string.h>
+
+static void reset_cursors(struct memory_loop *loop)
+{
+  loop->read_cursor.block = LOOP_POOL_NONE;
+  loop->read_cursor.start = 0;
+  loop->write_cursor.block = LOOP_POOL_NONE;
+  loop->write_cursor.start = 0;
+}
+
+bool acquire_loop_memory(struct data *data, uint8_t midi_note)
+{
+  if (midi_note > 127)
+    return false;
+
+  struct memory_loop *loop = &data->memory_loops[midi_note];
+  if (loop->first_block != LOOP_POOL_NONE)
+    return true; /* Already armed */
+
+  uint32_t block = loop_pool_acquire(&data->loop_pool);
+  if (block == LOOP_POOL_NONE)
+    return false; /* Loop memory budget exhausted */
+
+  loop->first_block = block;
+  loop->last_block = block;
+  loop->block_count = 1;
+  loop->take_generation++;
+  loop->buffer_size = data->loop_pool.block_frames;
+  reset_cursors(loop);
+  return true;
+}
+
+void release_loop_memory(struct data *data, uint8_t midi_note)
+{
+  if (midi_note > 127)
+    return;
+
+  struct memory_loop *loop = &data->memory_loops[midi_note];
+  if (loop->first_block != LOOP_POOL_NONE)
+  {
+    /* Drop the loop's reference - a writer still holding one keeps the chain alive */
+    loop_pool_chain_unref(&data->loop_pool, loop->first_block, loop->last_block, loop->block_count);
+  }
+  loop->first_block = LOOP_POOL_NONE;
+  loop->last_block = LOOP_POOL_NONE;
+  loop->block_count = 0;
+  loop->buffer_size = 0;
+  reset_cursors(loop);
+}
+
+bool loop_storage_reserve(struct data *data, struct memory_loop *loop, uint32_t frames)
+{
+  struct loop_pool *pool = &data->loop_pool;
+
+  if (loop->first_block == LOOP_POOL_NONE && frames > 0)
+  {
+    if (!acquire_loop_memory(data, loop->midi_note))
+      return false;
+  }
+
+  while (loop->buffer_size < frames)
+  {
+    uint32_t block = loop_pool_acquire(pool);
+    if (block == LOOP_POOL_NONE)
+      return false;
+
+    /* Link the new block before anything can seek into it */
+    pool->chain[loop->last_block] = block;
+    loop->last_block = block;
+    loop->block_count++;
+    loop->buffer_size += pool->block_frames;
+  }
+
+  return true;
+}
+
+uint32_t loop_storage_append(struct data *data, struct memory_loop *loop,
+                             const float *input, uint32_t n_samples)
+{
+  struct loop_pool *pool = &data->loop_pool;
+
+  /* Grow as far as the pool allows, then store what fits */
+  loop_storage_reserve(data, loop, loop->recorded_frames + n_samples);
+
+  uint32_t to_store = n_samples;
+  if (to_store > loop->buffer_size - loop->recorded_frames)
+  {
+    to_store = loop->buffer_size - loop->recorded_frames;
+  }
+
+  uint32_t stored = 0;
+  while (stored < to_store)
+  {
+    uint32_t span;
+    float *dest = loop_pool_seek(pool, loop->first_block, &loop->write_cursor,
+                                 loop->recorded_frames, &span);
+    uint32_t run = to_store - stored;
+    if (run > span)
+    {
+      run = span;
+    }
+
+    if (input)
+    {
+      memcpy(dest, input + stored, run * sizeof(float));
+    }
+    else
+    {
+      memset(dest, 0, run * sizeof(float));
+    }
+
+    loop->recorded_frames += run;
+    stored += run;
+  }
+
+  return stored;
+}
+
+uint32_t loop_storage_set_length(struct data *data, struct memory_loop *loop, uint32_t frames)
+{
+  if (frames > loop->recorded_frames)
+  {
+    /* Extending (e.g. to a whole number of pulses) pads with silence */
+    loop_storage_append(data, loop, NULL, frames - loop->recorded_frames);
+  }
+  else
+  {
+    loop->recorded_frames = frames;
+  }
+
+  if (loop->playback_position >= loop->recorded_frames)
+  {
+    loop->playback_position = 0;
+  }
+
+  /* Positions now wrap at the new length, keep the anchor consistent with it */
+  loop_storage_seek(data, loop, loop->playback_position);
+
+  return loop->recorded_frames;
+}
+
+void loop_storage_resync(struct memory_loop *loop, uint64_t frame, float speed)
+{
+  if (loop->recorded_frames == 0)
+    return;
+
+  loop->position_frac = 0;
+  if (speed == 1.0f)
+  {
+    /* Unsigned wrap keeps frame - anchor exact even if the anchor is "before" frame 0 */
+    loop->playback_position = (uint32_t)((frame - loop->anchor_frame) % loop->recorded_frames);
+    return;
+  }
+
+  /* Loops at speed move their anchor along after every block, so the frames
+   * missed since then are the ones past playback_position (negative if the
+   * graph repeated some) */
+  int64_t elapsed = (int64_t)(frame - loop->anchor_frame - loop->playback_position);
+  double position = fmod(loop->playback_position + (double)speed * (double)elapsed, loop->recorded_frames);
+  if (position < 0.0)
+  {
+    position += loop->recorded_frames;
+  }
+  loop->playback_position = (uint32_t)position % loop->recorded_frames;
+  loop->anchor_frame = frame - loop->playback_position;
+}
+
+uint32_t loop_storage_read(struct data *data, struct memory_loop *loop, float *buf, uint32_t n_samples)
+{
+  uint32_t total_frames = loop->recorded_frames;
+  if (loop->first_block == LOOP_POOL_NONE || total_frames == 0 || total_frames > loop->buffer_size)
+    return 0;
+
+  uint32_t copied = 0;
+  while (copied < n_samples)
+  {
+    if (loop->playback_position >= total_frames)
+    {
+      loop->playback_position = 0; /* Loop back to beginning */
+    }
+
+    uint32_t span;
+    const float *src = loop_storage_span(data, loop, loop->playback_position, &span);
+
+    /* Copy up to the nearest of block end, loop end and request end */
+    uint32_t run = n_samples - copied;
+    if (run > span)
+    {
+      run = span;
+    }
+    if (run > total_frames - loop->playback_position)
+    {
+      run = total_frames - loop->playback_position;
+    }
+
+    memcpy(buf + copied, src, run * sizeof(float));
+    loop->playback_position += run;
+    copied += run;
+  }
+
+  return copied;
+}
+
+uint32_t loop_storage_pull_rt(void *ctx, float *buf, uint32_t frames)
+{
+  struct loop_storage_reader *reader = ctx;
+  return loop_storage_read(reader->data, reader->loop, buf, frames);
+}
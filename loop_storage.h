@@ -0,0 +1,87 @@
+#ifndef LOOP_STORAGE_H
+#define LOOP_STORAGE_H
+
+#include "uphonor.h"
+
+/* Block-chain storage for memory loops.
+ *
+ * Each loop owns a chain of blocks from data->loop_pool. Recording appends
+ * to the chain and grows it one block at a time from the lock-free free
+ * list, readers walk it with a cursor and copy whole contiguous runs. All
+ * functions here are RT-safe: they never allocate, block or take locks. */
+
+/* Arm a loop with its first block if it has none yet */
+bool acquire_loop_memory(struct data *data, uint8_t midi_note);
+
+/* Detach a loop from its chain, returning it to the pool unless it is still referenced */
+void release_loop_memory(struct data *data, uint8_t midi_note);
+
+/* Grow the chain until it can hold at least frames frames.
+ * Returns false if the pool ran out first (the chain keeps what it got). */
+bool loop_storage_reserve(struct data *data, struct memory_loop *loop, uint32_t frames);
+
+/* Append n_samples frames at recorded_frames, growing the chain as needed.
+ * Returns the number of frames stored (short only when the pool is exhausted). */
+uint32_t loop_storage_append(struct data *data, struct memory_loop *loop,
+                             const float *input, uint32_t n_samples);
+
+/* Set recorded_frames, zero-filling any newly exposed frames.
+ * Returns the length actually set, clamped to what the pool could provide. */
+uint32_t loop_storage_set_length(struct data *data, struct memory_loop *loop, uint32_t frames);
+
+/* Copy n_samples frames from playback_position into buf, wrapping at
+ * recorded_frames and advancing playback_position. Returns frames copied. */
+uint32_t loop_storage_read(struct data *data, struct memory_loop *loop, float *buf, uint32_t n_samples);
+
+/* Reader for resampler_process_rt(): pulls from a loop like loop_storage_read() */
+struct loop_storage_reader
+{
+  struct data *data;
+  struct memory_loop *loop;
+};
+
+/* ctx is a struct loop_storage_reader. A loop with nothing recorded reads as silence. */
+uint32_t loop_storage_pull_rt(void *ctx, float *buf, uint32_t frames);
+
+/* Move playback to position at the current engine frame. The loop's anchor
+ * is updated with it, so loop_storage_resync() can later put the loop back
+ * where it would be had it played every frame since. */
+static inline void loop_storage_seek(struct data *data, struct memory_loop *loop, uint32_t position)
+{
+  loop->playback_position = position;
+  loop->anchor_frame = data->current_sample_frame - position;
+}
+
+/* Re-derive playback_position from the anchor at engine frame frame, for a
+ * loop that goes round its take at speed (1.0 unless it is varispeed or
+ * stretched). Drops the fraction of a frame it had. */
+void loop_storage_resync(struct memory_loop *loop, uint64_t frame, float speed);
+
+/* Move playback_position on by the frames of the take that n_samples output
+ * frames cover at the loop's speed. A stretched loop goes round its take at
+ * that pace, so its position means the same point in the take whether it is
+ * stretched live or plays a render. */
+static inline void loop_storage_advance_at_speed(struct memory_loop *loop, uint32_t n_samples)
+{
+  uint64_t position = ((uint64_t)loop->playback_position << 32 | loop->position_frac) +
+                      (uint64_t)((double)loop->speed * n_samples * 4294967296.0);
+  loop->playback_position = (uint32_t)((position >> 32) % loop->recorded_frames);
+  loop->position_frac = (uint32_t)position;
+}
+
+/* Contiguous run of the loop starting at position (position < buffer_size).
+ * *span receives the run length up to the end of the containing block. */
+static inline float *loop_storage_span(struct data *data, struct memory_loop *loop,
+                                       uint32_t position, uint32_t *span)
+{
+  return loop_pool_seek(&data->loop_pool, loop->first_block, &loop->read_cursor, position, span);
+}
+
+/* Single sample access for interpolating readers (position < buffer_size) */
+static inline float loop_storage_sample(struct data *data, struct memory_loop *loop, uint32_t position)
+{
+  uint32_t span;
+  return *loop_storage_span(data, loop, position, &span);
+}
+
+#endif /* LOOP_STORAGE_H */
@@ -1,9 +1,6 @@
 #include "uphonor.h"
 #include "cli.c"
 #include "pipe.c"
-#include "process.c"
-#include "audio_processing_rt.h"
-#include "audio_buffer_rt.h"
 
 struct pw_filter_events filter_events = {
     PW_VERSION_FILTER_EVENTS,
@@ -14,80 +11,22 @@ struct pw_filter_events filter_events = {
     //  .process = tone,
 };
 
+/* The graph's clock rate as configured for this client, until the format
+   negotiated with the graph confirms or replaces it */
+static uint32_t graph_clock_rate(struct pw_context *context)
+{
+  const struct pw_properties *props = pw_context_get_properties(context);
+  const char *rate = props ? pw_properties_get(props, "default.clock.rate") : NULL;
+  unsigned long value = rate ? strtoul(rate, NULL, 10) : 0;
+  return value > 0 && value <= UINT32_MAX ? (uint32_t)value : ENGINE_DEFAULT_RATE;
+}
+
 int main(int argc, char *argv[])
 {
   struct data data = {
       0,
   };
 
-  // Initialize recording fields
-  data.recording_enabled = false;
-  data.record_file = NULL;
-  data.record_filename = NULL;
-
-  data.volume = 1.0f;         // Default volume level
-  data.playback_speed = 1.0f; // Default normal speed
-  data.sample_position = 0.0; // Initialize fractional sample position
-
-  // Initialize performance buffers (add after data initialization)
-  data.max_buffer_size = 2048 * 8; // Support up to 8 channels at 2048 samples
-  data.silence_buffer = calloc(data.max_buffer_size, sizeof(float));
-  data.temp_audio_buffer = malloc(data.max_buffer_size * sizeof(float));
-
-  // Initialize RT/Non-RT bridge for performance-critical operations
-  if (rt_nonrt_bridge_init(&data.rt_bridge,
-                           65536, // 64K sample ring buffer (~1.3 seconds at 48kHz)
-                           256    // 256 message queue slots
-                           ) < 0)
-  {
-    fprintf(stderr, "Failed to initialize RT/Non-RT bridge\n");
-    free(data.silence_buffer);
-    free(data.temp_audio_buffer);
-    return -1;
-  }
-
-  // Initialize audio buffer system for RT-optimized file reading
-  if (audio_buffer_rt_init(&data.audio_buffer, 8) < 0) // Support up to 8 channels
-  {
-    fprintf(stderr, "Failed to initialize audio buffer system\n");
-    rt_nonrt_bridge_destroy(&data.rt_bridge);
-    free(data.silence_buffer);
-    free(data.temp_audio_buffer);
-    return -1;
-  }
-
-  // Initialize multi-loop memory system (60 seconds max loop at 48kHz for each of 128 MIDI notes)
-  if (init_all_memory_loops(&data, 60, 48000) < 0)
-  {
-    fprintf(stderr, "Failed to initialize multi-loop memory system\n");
-    audio_buffer_rt_cleanup(&data.audio_buffer);
-    rt_nonrt_bridge_destroy(&data.rt_bridge);
-    free(data.silence_buffer);
-    free(data.temp_audio_buffer);
-    return -1;
-  }
-
-  // Create recordings directory if it doesn't exist
-  struct stat st = {0};
-  if (stat("recordings", &st) == -1)
-  {
-    mkdir("recordings", 0755);
-  }
-
-  if (!data.silence_buffer || !data.temp_audio_buffer)
-  {
-    fprintf(stderr, "Failed to allocate audio buffers\n");
-    return -1;
-  }
-
-  /* Initialize rubberband after we have format information */
-  /* Note: We'll initialize this later when we have proper format info */
-  data.rubberband_state = NULL;
-  data.pitch_shift = 0.0f;
-  data.rubberband_enabled = true;
-  data.rubberband_input_buffer = NULL;
-  data.rubberband_output_buffer = NULL;
-  data.rubberband_buffer_size = 0;
   /* Set up buffer parameters for audio */
   const struct spa_pod *params[1];
   uint8_t buffer[1024];
@@ -111,6 +50,18 @@ int main(int argc, char *argv[])
     return 1;
   }
 
+  // Buffers, RT bridge, loop memory and mixer - shared with uphonor-render.
+  // Sized for the graph's clock rate, which session audio is converted to
+  if (engine_init(&data, graph_clock_rate(context)) < 0)
+  {
+    return -1;
+  }
+
+  /* RT thread messages go through the bridge log ring - follow PipeWire's
+     log level unless UPHONOR_RT_LOG_LEVEL overrides it */
+  rt_log_set_level(&data.rt_bridge.log,
+                   rt_log_level_from_string(getenv("UPHONOR_RT_LOG_LEVEL"), pw_log_level));
+
   /* Connect the context, which returns us a proxy to the core
      object. */
   data.core = pw_context_connect(context, NULL, 0);
@@ -125,6 +76,8 @@ int main(int argc, char *argv[])
                      do_quit, &data);
   pw_loop_add_signal(pw_main_loop_get_loop(data.loop), SIGTERM,
                      do_quit, &data);
+  pw_loop_add_signal(pw_main_loop_get_loop(data.loop), SIGUSR1,
+                     do_save_session, &data);
   char rate_str[64];
   snprintf(rate_str, sizeof(rate_str), "1/%u",
            data.fileinfo.samplerate);
@@ -225,35 +178,8 @@ int main(int argc, char *argv[])
   pw_filter_destroy(data.filter);
   pw_main_loop_destroy(data.loop);
   pw_deinit();
-  sf_close(data.file);
-
-  // Clean up recording resources
-  if (data.recording_enabled)
-  {
-    stop_recording(&data);
-  }
 
-  // Free allocated filename string
-  if (data.record_filename)
-  {
-    free(data.record_filename);
-  }
-
-  // Destroy RT/Non-RT bridge
-  rt_nonrt_bridge_destroy(&data.rt_bridge);
-
-  // Cleanup audio buffer system
-  audio_buffer_rt_cleanup(&data.audio_buffer);
-
-  // Cleanup multi-loop memory system
-  cleanup_all_memory_loops(&data);
-
-  // Free performance buffers
-  free(data.silence_buffer);
-  free(data.temp_audio_buffer);
-
-  // Clean up rubberband
-  cleanup_rubberband(&data);
+  engine_cleanup(&data);
 
   return 0;
 }
@@ -289,4 +215,13 @@ void do_quit(void *userdata, int signal_number)
 {
   struct data *data = userdata;
   pw_main_loop_quit(data->loop);
+}
+
+/* do_save_session gets called on SIGUSR1 and saves the running session to
+   the default file. The engine copies its state through the command queue
+   between two cycles, so the main loop only waits for one cycle. */
+void do_save_session(void *userdata, int signal_number)
+{
+  struct data *data = userdata;
+  save_current_session(data, NULL);
 }
\ No newline at end of file
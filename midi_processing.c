@@ -1,4 +1,5 @@
 #include "midi_processing.h"
+#include "sync_scheduler.h"
 
 #define PERIOD_NSEC (SPA_NSEC_PER_SEC / 8)
 #define SPEED_CC_NUMBER 74                 /* MIDI CC 74 for playback speed control */
@@ -11,80 +12,6 @@
 #define SYNC_RECORDING_CUTOFF_CC_NUMBER 80 /* MIDI CC 80 for sync recording cutoff point (0-100% of pulse duration) */
 #define SAVE_CONFIG_CC_NUMBER 81           /* MIDI CC 81 for saving configuration (trigger on any value > 0) */
 
-/* Update the pulse timeline based on current sample frame */
-void update_pulse_timeline(struct data *data, uint64_t current_frame)
-{
-  data->current_sample_frame = current_frame;
-}
-
-/* Check for theoretical pulse reset and trigger pending actions */
-void check_theoretical_pulse_reset(struct data *data)
-{
-  if (!data->sync_mode_enabled || data->pulse_loop_duration == 0)
-  {
-    return;
-  }
-
-  uint32_t current_pulse_position = get_theoretical_pulse_position(data);
-
-  // Detect pulse reset: current position is smaller than previous position
-  // This happens when the modulo operation wraps around from pulse_loop_duration-1 to 0
-  if (current_pulse_position < data->previous_pulse_position)
-  {
-    pw_log_info("Theoretical pulse reset detected: position %u -> %u",
-                data->previous_pulse_position, current_pulse_position);
-
-    // if debug log
-    if (pw_log_level >= SPA_LOG_LEVEL_DEBUG)
-    {
-      for (int i = 0; i < 127; i++)
-      {
-        if (data->memory_loops[i].is_playing)
-        {
-          pw_log_debug("Loop %d is currently playing", i);
-        }
-      }
-    }
-
-    // Clear waiting for pulse reset
-    data->waiting_for_pulse_reset = false;
-
-    // Handle pending stops first (recordings that should end at pulse boundary)
-    stop_sync_pending_recordings_on_pulse_reset(data);
-
-    // Then start any pending recordings
-    start_sync_pending_recordings_on_pulse_reset(data);
-
-    // Finally start any pending playback
-    start_sync_pending_playback_on_pulse_reset(data);
-  }
-
-  // Update previous position for next check
-  data->previous_pulse_position = current_pulse_position;
-}
-
-/* Get the theoretical pulse position based on timeline, even when no loops are playing */
-uint32_t get_theoretical_pulse_position(struct data *data)
-{
-  if (data->pulse_loop_duration == 0)
-  {
-    return 0;
-  }
-
-  // If pulse timeline hasn't been started yet, start it now
-  if (data->pulse_timeline_start_frame == 0)
-  {
-    data->pulse_timeline_start_frame = data->current_sample_frame;
-    data->previous_pulse_position = 0;
-  }
-
-  // Calculate how many frames have elapsed since pulse timeline started
-  uint64_t elapsed_frames = data->current_sample_frame - data->pulse_timeline_start_frame;
-
-  // Return the position within the current pulse cycle
-  return (uint32_t)(elapsed_frames % data->pulse_loop_duration);
-}
-
 void handle_midi_message(struct data *data, uint8_t *midi_data)
 {
   uint8_t message_type = *midi_data & 0xf0;
@@ -93,7 +20,7 @@ void handle_midi_message(struct data *data, uint8_t *midi_data)
   switch (message_type)
   {
   case 0x80: // Note Off
-    pw_log_debug("Note Off message received: 0x%02x", *midi_data);
+    rt_log_debug(&data->rt_bridge.log, "Note Off message received: 0x%02x", *midi_data);
     // Note: MIDI messages are typically 3 bytes for note on/off
     {
       uint8_t note = *(midi_data + 1);
@@ -103,7 +30,7 @@ void handle_midi_message(struct data *data, uint8_t *midi_data)
     break;
 
   case 0x90: // Note On
-    pw_log_info("Note On message received: 0x%02x", *midi_data);
+    rt_log_info(&data->rt_bridge.log, "Note On message received: 0x%02x", *midi_data);
     // Note: MIDI messages are typically 3 bytes for note on/off
     {
       uint8_t note = *(midi_data + 1);
@@ -113,11 +40,11 @@ void handle_midi_message(struct data *data, uint8_t *midi_data)
     break;
 
   case 0xA0: // Polyphonic Aftertouch
-    pw_log_debug("Polyphonic Aftertouch message received: 0x%02x", *midi_data);
+    rt_log_debug(&data->rt_bridge.log, "Polyphonic Aftertouch message received: 0x%02x", *midi_data);
     break;
 
   case 0xB0: // Control Change
-    pw_log_debug("Control Change message received: 0x%02x", *midi_data);
+    rt_log_debug(&data->rt_bridge.log, "Control Change message received: 0x%02x", *midi_data);
     {
       uint8_t controller = *(midi_data + 1);
       uint8_t value = *(midi_data + 2);
@@ -126,47 +53,47 @@ void handle_midi_message(struct data *data, uint8_t *midi_data)
     break;
 
   case 0xC0: // Program Change
-    pw_log_debug("Program Change message received: 0x%02x", *midi_data);
+    rt_log_debug(&data->rt_bridge.log, "Program Change message received: 0x%02x", *midi_data);
     break;
 
   case 0xD0: // Channel Pressure
-    pw_log_debug("Channel Pressure message received: 0x%02x", *midi_data);
+    rt_log_debug(&data->rt_bridge.log, "Channel Pressure message received: 0x%02x", *midi_data);
     break;
 
   case 0xE0: // Pitch Bend
-    pw_log_debug("Pitch Bend message received: 0x%02x", *midi_data);
+    rt_log_debug(&data->rt_bridge.log, "Pitch Bend message received: 0x%02x", *midi_data);
     break;
 
   case 0xF0: // System messages
     switch (*midi_data)
     {
     case 0xF8:
-      pw_log_debug("Timing Clock message received");
+      rt_log_debug(&data->rt_bridge.log, "Timing Clock message received");
       break;
     case 0xFA:
-      pw_log_debug("Start message received");
+      rt_log_debug(&data->rt_bridge.log, "Start message received");
       break;
     case 0xFB:
-      pw_log_debug("Continue message received");
+      rt_log_debug(&data->rt_bridge.log, "Continue message received");
       break;
     case 0xFC:
-      pw_log_debug("Stop message received");
+      rt_log_debug(&data->rt_bridge.log, "Stop message received");
       break;
     case 0xFE:
-      pw_log_debug("Active Sensing message received");
+      rt_log_debug(&data->rt_bridge.log, "Active Sensing message received");
       break;
     case 0xFF:
-      pw_log_debug("System Reset message received");
+      rt_log_debug(&data->rt_bridge.log, "System Reset message received");
       break;
     default:
       if ((*midi_data & 0xF0) == 0xF0)
-        pw_log_debug("System Exclusive message received");
+        rt_log_debug(&data->rt_bridge.log, "System Exclusive message received");
       break;
     }
     break;
 
   default:
-    pw_log_trace("Unknown MIDI message type: 0x%02x", *midi_data);
+    rt_log_trace(&data->rt_bridge.log, "Unknown MIDI message type: 0x%02x", *midi_data);
     break;
   }
 }
@@ -176,9 +103,16 @@ void handle_note_on(struct data *data, uint8_t channel, uint8_t note, uint8_t ve
   // Convert MIDI velocity to volume (0.0-1.0)
   float volume = (float)(velocity & 0x7f) / 127.0f;
 
-  pw_log_info("Note On: channel=%d, note=%d, velocity=%d, volume=%.2f, mode=%s, sync=%s",
-              channel, note, velocity, volume, get_playback_mode_name(data),
-              is_sync_mode_enabled(data) ? "ON" : "OFF");
+  rt_log_info(&data->rt_bridge.log, "Note On: channel=%d, note=%d, velocity=%d, volume=%.2f, mode=%s, sync=%s",
+                                    channel, note, velocity, volume, get_playback_mode_name(data),
+                                    is_sync_mode_enabled(data) ? "ON" : "OFF");
+
+  // The loop's session audio is still being loaded into it
+  if (session_loader_loading(&data->session_loader, note))
+  {
+    rt_log_info(&data->rt_bridge.log, "Loop %d is still loading, ignoring Note On", note);
+    return;
+  }
 
   // Check sync mode constraints before processing
   if (is_sync_mode_enabled(data))
@@ -186,7 +120,7 @@ void handle_note_on(struct data *data, uint8_t channel, uint8_t note, uint8_t ve
     struct memory_loop *loop = get_loop_by_note(data, note);
     if (!loop)
     {
-      pw_log_error("Failed to get loop for note %d", note);
+      rt_log_error(&data->rt_bridge.log, "Failed to get loop for note %d", note);
       return;
     }
 
@@ -194,7 +128,7 @@ void handle_note_on(struct data *data, uint8_t channel, uint8_t note, uint8_t ve
     if ((!loop->loop_ready || loop->recorded_frames == 0) && loop->current_state != LOOP_STATE_RECORDING && loop->current_state != LOOP_STATE_PLAYING)
     {
       // This is a new recording request in sync mode
-      pw_log_info("SYNC mode: Marking note %d for pending recording", note);
+      rt_log_info(&data->rt_bridge.log, "SYNC mode: Marking note %d for pending recording", note);
       loop->volume = volume;
       process_loops(data, NULL, note, volume);
       return; // Exit early - don't go through normal playback mode logic
@@ -208,7 +142,7 @@ void handle_note_on(struct data *data, uint8_t channel, uint8_t note, uint8_t ve
     struct memory_loop *loop = get_loop_by_note(data, note);
     if (!loop)
     {
-      pw_log_error("Failed to get loop for note %d", note);
+      rt_log_error(&data->rt_bridge.log, "Failed to get loop for note %d", note);
       return;
     }
 
@@ -218,20 +152,20 @@ void handle_note_on(struct data *data, uint8_t channel, uint8_t note, uint8_t ve
     if (loop->current_state == LOOP_STATE_PLAYING)
     {
       // Currently playing, so stop it
-      pw_log_info("NORMAL mode: Stopping playback for note %d", note);
+      rt_log_info(&data->rt_bridge.log, "NORMAL mode: Stopping playback for note %d", note);
       loop->current_state = LOOP_STATE_STOPPED;
-      loop->is_playing = false;
+      set_loop_playing(data, loop, false);
 
       // In sync mode, clear any pending record flag
       if (data->sync_mode_enabled)
       {
-        loop->pending_record = false;
+        set_loop_pending_record(data, loop, false);
       }
     }
     else if (loop->current_state == LOOP_STATE_RECORDING)
     {
       // Currently recording, so stop it - apply recording cutoff logic in sync mode
-      pw_log_info("NORMAL mode: Stopping recording for note %d", note);
+      rt_log_info(&data->rt_bridge.log, "NORMAL mode: Stopping recording for note %d", note);
 
       if (is_sync_mode_enabled(data))
       {
@@ -247,12 +181,11 @@ void handle_note_on(struct data *data, uint8_t channel, uint8_t note, uint8_t ve
           if (pulse_position <= recording_cutoff_position)
           {
             // Before cutoff - stop immediately and align to pulse boundary
-            pw_log_info("NORMAL mode SYNC: Stopping recording for note %d immediately (pulse at %u, cutoff at %u)",
-                        note, pulse_position, recording_cutoff_position);
+            rt_log_info(&data->rt_bridge.log, "NORMAL mode SYNC: Stopping recording for note %d immediately (pulse at %u, cutoff at %u)",
+                                              note, pulse_position, recording_cutoff_position);
 
             // Stop the recording immediately
             stop_loop_recording_rt(data, note);
-            usleep(1000); // 1ms
 
             // Calculate target duration to be a multiple of pulse duration
             uint32_t target_duration = loop->recorded_frames;
@@ -290,38 +223,38 @@ void handle_note_on(struct data *data, uint8_t channel, uint8_t note, uint8_t ve
             }
 
             // Set the aligned duration and start playback in sync
-            loop->recorded_frames = target_duration;
+            target_duration = loop_storage_set_length(data, loop, target_duration);
             loop->loop_ready = true; // Mark loop as ready for playback
             loop->current_state = LOOP_STATE_PLAYING;
 
             // Start playing in sync with current pulse position
             if (pulse_position < loop->recorded_frames)
             {
-              loop->playback_position = pulse_position;
+              loop_storage_seek(data, loop, pulse_position);
             }
             else
             {
-              loop->playback_position = pulse_position % loop->recorded_frames;
+              loop_storage_seek(data, loop, pulse_position % loop->recorded_frames);
             }
 
-            loop->is_playing = true;
-            loop->pending_stop = false;
+            set_loop_playing(data, loop, true);
+            set_loop_pending_stop(data, loop, false);
 
             if (data->currently_recording_note == note)
             {
               data->currently_recording_note = 255;
             }
 
-            pw_log_info("NORMAL mode SYNC: Recording for note %d stopped at %u frames, playing in sync at position %u",
-                        note, target_duration, loop->playback_position);
+            rt_log_info(&data->rt_bridge.log, "NORMAL mode SYNC: Recording for note %d stopped at %u frames, playing in sync at position %u",
+                                              note, target_duration, loop->playback_position);
             return;
           }
           else
           {
             // After cutoff - mark for stopping at next pulse reset
-            loop->pending_stop = true;
-            pw_log_info("NORMAL mode SYNC: Marking recording for note %d to stop at next pulse reset (pulse at %u, cutoff at %u)",
-                        note, pulse_position, recording_cutoff_position);
+            set_loop_pending_stop(data, loop, true);
+            rt_log_info(&data->rt_bridge.log, "NORMAL mode SYNC: Marking recording for note %d to stop at next pulse reset (pulse at %u, cutoff at %u)",
+                                              note, pulse_position, recording_cutoff_position);
             return; // Don't stop immediately
           }
         }
@@ -329,7 +262,6 @@ void handle_note_on(struct data *data, uint8_t channel, uint8_t note, uint8_t ve
 
       // Non-sync mode or no pulse loop - stop recording immediately
       stop_loop_recording_rt(data, note);
-      usleep(1000);            // 1ms
       loop->loop_ready = true; // Mark loop as ready for playback
 
       // In sync mode, set pulse loop duration if this is the first loop recorded
@@ -337,30 +269,29 @@ void handle_note_on(struct data *data, uint8_t channel, uint8_t note, uint8_t ve
       {
         data->pulse_loop_duration = loop->recorded_frames;
         data->pulse_loop_note = note;
-        // Initialize pulse timeline
-        data->pulse_timeline_start_frame = data->current_sample_frame;
-        data->previous_pulse_position = 0;
-        pw_log_info("SYNC mode: Setting pulse loop duration to %u frames from note %d, starting timeline at frame %lu",
-                    data->pulse_loop_duration, note, data->pulse_timeline_start_frame);
+        // Pulse boundaries are scheduled from this frame
+        sync_scheduler_start(data, data->current_sample_frame);
+        rt_log_info(&data->rt_bridge.log, "SYNC mode: Setting pulse loop duration to %u frames from note %d, starting timeline at frame %lu",
+                                          data->pulse_loop_duration, note, data->pulse_timeline_start_frame);
       }
 
       // Apply pulse duration alignment in sync mode even without active pulse loop
       if (is_sync_mode_enabled(data) && data->pulse_loop_duration > 0)
       {
-        pw_log_info("SYNC mode: Checking alignment for note %d - recorded %u frames, pulse duration %u",
-                    note, loop->recorded_frames, data->pulse_loop_duration);
+        rt_log_info(&data->rt_bridge.log, "SYNC mode: Checking alignment for note %d - recorded %u frames, pulse duration %u",
+                                          note, loop->recorded_frames, data->pulse_loop_duration);
 
         // Calculate target duration to be a multiple of pulse duration
         uint32_t multiple = loop->recorded_frames / data->pulse_loop_duration;
         uint32_t remainder = loop->recorded_frames % data->pulse_loop_duration;
 
-        pw_log_info("SYNC mode: multiple=%u, remainder=%u", multiple, remainder);
+        rt_log_info(&data->rt_bridge.log, "SYNC mode: multiple=%u, remainder=%u", multiple, remainder);
 
         // If we have recorded less than one pulse, extend to one pulse
         if (multiple == 0)
         {
           multiple = 1;
-          pw_log_info("SYNC mode: Extending to 1 pulse (was less than one pulse)");
+          rt_log_info(&data->rt_bridge.log, "SYNC mode: Extending to 1 pulse (was less than one pulse)");
         }
         else if (remainder > 0)
         {
@@ -369,52 +300,52 @@ void handle_note_on(struct data *data, uint8_t channel, uint8_t note, uint8_t ve
           if (remainder > data->pulse_loop_duration / 2)
           {
             multiple++;
-            pw_log_info("SYNC mode: Rounding up to %u pulses (remainder %u > half pulse %u)",
-                        multiple, remainder, data->pulse_loop_duration / 2);
+            rt_log_info(&data->rt_bridge.log, "SYNC mode: Rounding up to %u pulses (remainder %u > half pulse %u)",
+                                              multiple, remainder, data->pulse_loop_duration / 2);
           }
           else
           {
-            pw_log_info("SYNC mode: Rounding down to %u pulses (remainder %u <= half pulse %u)",
-                        multiple, remainder, data->pulse_loop_duration / 2);
+            rt_log_info(&data->rt_bridge.log, "SYNC mode: Rounding down to %u pulses (remainder %u <= half pulse %u)",
+                                              multiple, remainder, data->pulse_loop_duration / 2);
           }
           // Otherwise round down (keep current multiple)
         }
         else
         {
-          pw_log_info("SYNC mode: Exact multiple - no adjustment needed");
+          rt_log_info(&data->rt_bridge.log, "SYNC mode: Exact multiple - no adjustment needed");
         }
 
         uint32_t target_duration = multiple * data->pulse_loop_duration;
         if (loop->recorded_frames != target_duration)
         {
-          loop->recorded_frames = target_duration;
-          pw_log_info("SYNC mode: Adjusted loop %d duration to %u frames (%ux pulse)",
-                      note, target_duration, multiple);
+          target_duration = loop_storage_set_length(data, loop, target_duration);
+          rt_log_info(&data->rt_bridge.log, "SYNC mode: Adjusted loop %d duration to %u frames (%ux pulse)",
+                                            note, target_duration, multiple);
         }
         else
         {
-          pw_log_info("SYNC mode: Loop %d duration already aligned at %u frames (%ux pulse)",
-                      note, target_duration, multiple);
+          rt_log_info(&data->rt_bridge.log, "SYNC mode: Loop %d duration already aligned at %u frames (%ux pulse)",
+                                            note, target_duration, multiple);
         }
       }
       else
       {
-        pw_log_info("Non-sync alignment: sync_enabled=%s, pulse_duration=%u",
-                    is_sync_mode_enabled(data) ? "true" : "false", data->pulse_loop_duration);
+        rt_log_info(&data->rt_bridge.log, "Non-sync alignment: sync_enabled=%s, pulse_duration=%u",
+                                          is_sync_mode_enabled(data) ? "true" : "false", data->pulse_loop_duration);
       }
 
       // In NORMAL mode, after recording stops, start playing immediately
       if (data->current_playback_mode == PLAYBACK_MODE_NORMAL)
       {
         loop->current_state = LOOP_STATE_PLAYING;
-        loop->playback_position = 0;
-        loop->is_playing = true;
-        pw_log_info("NORMAL mode: Recording stopped for note %d, starting playback immediately", note);
+        loop_storage_seek(data, loop, 0);
+        set_loop_playing(data, loop, true);
+        rt_log_info(&data->rt_bridge.log, "NORMAL mode: Recording stopped for note %d, starting playback immediately", note);
       }
       else
       {
         loop->current_state = LOOP_STATE_STOPPED;
-        loop->is_playing = false;
+        set_loop_playing(data, loop, false);
       }
 
       if (data->currently_recording_note == note)
@@ -425,9 +356,9 @@ void handle_note_on(struct data *data, uint8_t channel, uint8_t note, uint8_t ve
     else if (loop->loop_ready && loop->recorded_frames > 0)
     {
       // Has content and not playing, so start it
-      pw_log_info("NORMAL mode: Starting playback for note %d", note);
+      rt_log_info(&data->rt_bridge.log, "NORMAL mode: Starting playback for note %d", note);
       loop->current_state = LOOP_STATE_PLAYING;
-      loop->pending_start = false; // Clear any pending start from previous state
+      set_loop_pending_start(data, loop, false); // Clear any pending start from previous state
 
       // Calculate synchronized start position in sync mode
       if (data->sync_mode_enabled && data->pulse_loop_duration > 0)
@@ -441,11 +372,11 @@ void handle_note_on(struct data *data, uint8_t channel, uint8_t note, uint8_t ve
 
         if (note == data->pulse_loop_note)
         {
-          pw_log_info("SYNC mode: Pulse loop %d syncing to theoretical position %u", note, reference_position);
+          rt_log_info(&data->rt_bridge.log, "SYNC mode: Pulse loop %d syncing to theoretical position %u", note, reference_position);
         }
         else
         {
-          pw_log_info("SYNC mode: Loop %d syncing to theoretical pulse position %u", note, reference_position);
+          rt_log_info(&data->rt_bridge.log, "SYNC mode: Loop %d syncing to theoretical pulse position %u", note, reference_position);
         }
 
         if (found_reference)
@@ -460,46 +391,46 @@ void handle_note_on(struct data *data, uint8_t channel, uint8_t note, uint8_t ve
             if (reference_position < loop->recorded_frames)
             {
               // Reference position fits within this loop - start there
-              loop->playback_position = reference_position;
+              loop_storage_seek(data, loop, reference_position);
             }
             else
             {
               // Reference position is beyond this loop's length - use modulo
-              loop->playback_position = reference_position % loop->recorded_frames;
+              loop_storage_seek(data, loop, reference_position % loop->recorded_frames);
             }
 
-            loop->is_playing = true;
+            set_loop_playing(data, loop, true);
 
-            pw_log_info("SYNC mode: Starting loop %d at synchronized position %u (reference at %u, cutoff at %u)",
-                        note, loop->playback_position, reference_position, cutoff_position);
+            rt_log_info(&data->rt_bridge.log, "SYNC mode: Starting loop %d at synchronized position %u (reference at %u, cutoff at %u)",
+                                              note, loop->playback_position, reference_position, cutoff_position);
           }
           else
           {
             // After cutoff - mark as pending start and wait for next pulse cycle
-            loop->playback_position = 0;
-            loop->is_playing = false;
-            loop->pending_start = true;
+            loop_storage_seek(data, loop, 0);
+            set_loop_playing(data, loop, false);
+            set_loop_pending_start(data, loop, true);
 
-            pw_log_info("SYNC mode: Loop %d marked as pending start - waiting for next pulse cycle (reference at %u, cutoff at %u)",
-                        note, reference_position, cutoff_position);
+            rt_log_info(&data->rt_bridge.log, "SYNC mode: Loop %d marked as pending start - waiting for next pulse cycle (reference at %u, cutoff at %u)",
+                                              note, reference_position, cutoff_position);
           }
         }
         else
         {
           // No reference loop found - start immediately from beginning
-          loop->playback_position = 0;
-          loop->is_playing = true;
-          pw_log_info("SYNC mode: No reference loop found, starting loop %d from beginning", note);
+          loop_storage_seek(data, loop, 0);
+          set_loop_playing(data, loop, true);
+          rt_log_info(&data->rt_bridge.log, "SYNC mode: No reference loop found, starting loop %d from beginning", note);
         }
       }
       else
       {
         // Not in sync mode or no pulse duration set - start playing immediately
-        loop->playback_position = 0;
-        loop->is_playing = true;
+        loop_storage_seek(data, loop, 0);
+        set_loop_playing(data, loop, true);
       }
 
-      loop->pending_record = false;
+      set_loop_pending_record(data, loop, false);
     }
     else
     {
@@ -522,22 +453,28 @@ void handle_note_on(struct data *data, uint8_t channel, uint8_t note, uint8_t ve
 
 void handle_note_off(struct data *data, uint8_t channel, uint8_t note, uint8_t velocity)
 {
-  pw_log_info("Note Off: channel=%d, note=%d, velocity=%d, mode=%s, sync=%s",
-              channel, note, velocity, get_playback_mode_name(data),
-              is_sync_mode_enabled(data) ? "ON" : "OFF");
+  rt_log_info(&data->rt_bridge.log, "Note Off: channel=%d, note=%d, velocity=%d, mode=%s, sync=%s",
+                                    channel, note, velocity, get_playback_mode_name(data),
+                                    is_sync_mode_enabled(data) ? "ON" : "OFF");
+
+  if (session_loader_loading(&data->session_loader, note))
+  {
+    rt_log_info(&data->rt_bridge.log, "Loop %d is still loading, ignoring Note Off", note);
+    return;
+  }
 
   // Get the loop first to check its state
   struct memory_loop *loop = get_loop_by_note(data, note);
   if (!loop)
   {
-    pw_log_error("Failed to get loop for note %d", note);
+    rt_log_error(&data->rt_bridge.log, "Failed to get loop for note %d", note);
     return;
   }
 
   if (data->current_playback_mode == PLAYBACK_MODE_NORMAL)
   {
     // NORMAL mode: Always ignore Note Off messages - recordings are stopped by 2nd Note On
-    pw_log_info("NORMAL mode: Ignoring Note Off for note %d", note);
+    rt_log_info(&data->rt_bridge.log, "NORMAL mode: Ignoring Note Off for note %d", note);
     return;
   }
 
@@ -545,9 +482,9 @@ void handle_note_off(struct data *data, uint8_t channel, uint8_t note, uint8_t v
 
   if (loop->current_state == LOOP_STATE_PLAYING)
   {
-    pw_log_info("TRIGGER mode: Stopping playback for note %d", note);
+    rt_log_info(&data->rt_bridge.log, "TRIGGER mode: Stopping playback for note %d", note);
     loop->current_state = LOOP_STATE_STOPPED;
-    loop->is_playing = false;
+    set_loop_playing(data, loop, false);
   }
   else if (loop->current_state == LOOP_STATE_RECORDING)
   {
@@ -566,12 +503,11 @@ void handle_note_off(struct data *data, uint8_t channel, uint8_t note, uint8_t v
         if (pulse_position <= recording_cutoff_position)
         {
           // Before cutoff - stop immediately and align to pulse boundary
-          pw_log_info("SYNC mode: Stopping recording for note %d immediately (pulse at %u, cutoff at %u)",
-                      note, pulse_position, recording_cutoff_position);
+          rt_log_info(&data->rt_bridge.log, "SYNC mode: Stopping recording for note %d immediately (pulse at %u, cutoff at %u)",
+                                            note, pulse_position, recording_cutoff_position);
 
           // Stop the recording immediately
           stop_loop_recording_rt(data, note);
-          usleep(1000); // 1ms
 
           // Calculate target duration to be a multiple of pulse duration
           uint32_t target_duration = loop->recorded_frames;
@@ -609,59 +545,56 @@ void handle_note_off(struct data *data, uint8_t channel, uint8_t note, uint8_t v
           }
 
           // Set the aligned duration and start playback in sync
-          loop->recorded_frames = target_duration;
+          target_duration = loop_storage_set_length(data, loop, target_duration);
           loop->loop_ready = true; // Mark loop as ready for playback
           loop->current_state = LOOP_STATE_PLAYING;
 
           // Start playing in sync with current pulse position
           if (pulse_position < loop->recorded_frames)
           {
-            loop->playback_position = pulse_position;
+            loop_storage_seek(data, loop, pulse_position);
           }
           else
           {
-            loop->playback_position = pulse_position % loop->recorded_frames;
+            loop_storage_seek(data, loop, pulse_position % loop->recorded_frames);
           }
 
-          loop->is_playing = true;
-          loop->pending_stop = false;
+          set_loop_playing(data, loop, true);
+          set_loop_pending_stop(data, loop, false);
 
           if (data->currently_recording_note == note)
           {
             data->currently_recording_note = 255;
           }
 
-          pw_log_info("SYNC mode: Recording for note %d stopped at %u frames, playing in sync at position %u",
-                      note, target_duration, loop->playback_position);
+          rt_log_info(&data->rt_bridge.log, "SYNC mode: Recording for note %d stopped at %u frames, playing in sync at position %u",
+                                            note, target_duration, loop->playback_position);
           return;
         }
         else
         {
           // After cutoff - mark for stopping at next pulse reset
-          loop->pending_stop = true;
-          pw_log_info("SYNC mode: Marking recording for note %d to stop at next pulse reset (pulse at %u, cutoff at %u)",
-                      note, pulse_position, recording_cutoff_position);
+          set_loop_pending_stop(data, loop, true);
+          rt_log_info(&data->rt_bridge.log, "SYNC mode: Marking recording for note %d to stop at next pulse reset (pulse at %u, cutoff at %u)",
+                                            note, pulse_position, recording_cutoff_position);
           return; // Don't stop immediately
         }
       }
       else
       {
         // No pulse loop or pulse not playing - mark for stopping at next pulse reset
-        loop->pending_stop = true;
-        pw_log_info("SYNC mode: No active pulse loop, marking recording for note %d to stop at next pulse reset", note);
+        set_loop_pending_stop(data, loop, true);
+        rt_log_info(&data->rt_bridge.log, "SYNC mode: No active pulse loop, marking recording for note %d to stop at next pulse reset", note);
         return; // Don't stop immediately
       }
     }
 
-    pw_log_info("TRIGGER mode: Stopping recording for note %d", note);
+    rt_log_info(&data->rt_bridge.log, "TRIGGER mode: Stopping recording for note %d", note);
     stop_loop_recording_rt(data, note);
 
-    /* Give the system a moment to process the stop command */
-    usleep(1000); // 1ms
-
     loop->loop_ready = true; // Mark loop as ready for playback
     loop->current_state = LOOP_STATE_STOPPED;
-    loop->is_playing = false;
+    set_loop_playing(data, loop, false);
     if (data->currently_recording_note == note)
     {
       data->currently_recording_note = 255;
@@ -675,13 +608,12 @@ void handle_note_off(struct data *data, uint8_t channel, uint8_t note, uint8_t v
       {
         data->pulse_loop_duration = loop->recorded_frames;
         data->waiting_for_pulse_reset = true; // Prevent new recordings until reset
-        // Update pulse timeline if it wasn't initialized yet
-        if (data->pulse_timeline_start_frame == 0)
+        // Start the pulse timeline if it wasn't running yet
+        if (!data->pulse_scheduled)
         {
-          data->pulse_timeline_start_frame = data->current_sample_frame;
-          data->previous_pulse_position = 0;
+          sync_scheduler_start(data, data->current_sample_frame);
         }
-        pw_log_info("SYNC mode: Pulse loop recorded with %u frames", data->pulse_loop_duration);
+        rt_log_info(&data->rt_bridge.log, "SYNC mode: Pulse loop recorded with %u frames", data->pulse_loop_duration);
       }
       else
       {
@@ -696,15 +628,15 @@ void handle_note_off(struct data *data, uint8_t channel, uint8_t note, uint8_t v
           // Adjust loop duration to be exactly a multiple of pulse duration
           if (loop->recorded_frames != target_duration)
           {
-            loop->recorded_frames = target_duration;
-            pw_log_info("SYNC mode: Adjusted loop duration to %u frames (%ux pulse)",
-                        target_duration, multiple);
+            target_duration = loop_storage_set_length(data, loop, target_duration);
+            rt_log_info(&data->rt_bridge.log, "SYNC mode: Adjusted loop duration to %u frames (%ux pulse)",
+                                              target_duration, multiple);
           }
         }
       }
     }
 
-    pw_log_info("TRIGGER mode: Recording stopped for note %d, ready for playback on next Note On", note);
+    rt_log_info(&data->rt_bridge.log, "TRIGGER mode: Recording stopped for note %d, ready for playback on next Note On", note);
   }
 }
 
@@ -740,11 +672,11 @@ void handle_control_change(struct data *data, uint8_t channel, uint8_t controlle
     if (new_speed != 1.0f)
     {
       set_rubberband_enabled(data, true);
-      pw_log_info("MIDI CC%d: Speed %.2fx (rubberband auto-enabled)", controller, new_speed);
+      rt_log_info(&data->rt_bridge.log, "MIDI CC%d: Speed %.2fx (rubberband auto-enabled)", controller, new_speed);
     }
     else
     {
-      pw_log_info("MIDI CC%d: Speed %.2fx (normal)", controller, new_speed);
+      rt_log_info(&data->rt_bridge.log, "MIDI CC%d: Speed %.2fx (normal)", controller, new_speed);
     }
   }
   break;
@@ -777,11 +709,11 @@ void handle_control_change(struct data *data, uint8_t channel, uint8_t controlle
     if (pitch_shift != 0.0f)
     {
       set_rubberband_enabled(data, true);
-      pw_log_info("MIDI CC%d: Pitch shift %.2f semitones (rubberband auto-enabled)", controller, pitch_shift);
+      rt_log_info(&data->rt_bridge.log, "MIDI CC%d: Pitch shift %.2f semitones (rubberband auto-enabled)", controller, pitch_shift);
     }
     else
     {
-      pw_log_info("MIDI CC%d: Pitch shift %.2f semitones (normal)", controller, pitch_shift);
+      rt_log_info(&data->rt_bridge.log, "MIDI CC%d: Pitch shift %.2f semitones (normal)", controller, pitch_shift);
     }
   }
   break;
@@ -810,7 +742,7 @@ void handle_control_change(struct data *data, uint8_t channel, uint8_t controlle
     /* Set record player mode (disables rubberband, links speed and pitch) */
     set_record_player_mode(data, speed_pitch_factor);
 
-    pw_log_info("MIDI CC%d: Record player mode %.2fx speed/pitch", controller, speed_pitch_factor);
+    rt_log_info(&data->rt_bridge.log, "MIDI CC%d: Record player mode %.2fx speed/pitch", controller, speed_pitch_factor);
   }
   break;
 
@@ -822,7 +754,7 @@ void handle_control_change(struct data *data, uint8_t channel, uint8_t controlle
     /* Set the volume */
     set_volume(data, volume);
 
-    pw_log_info("MIDI CC%d: Volume set to %.2f", controller, volume);
+    rt_log_info(&data->rt_bridge.log, "MIDI CC%d: Volume set to %.2f", controller, volume);
   }
   break;
 
@@ -845,8 +777,8 @@ void handle_control_change(struct data *data, uint8_t channel, uint8_t controlle
       toggle_playback_mode(data);
     }
 
-    pw_log_info("MIDI CC%d: Playback mode set to %s (value=%d)",
-                controller, get_playback_mode_name(data), value);
+    rt_log_info(&data->rt_bridge.log, "MIDI CC%d: Playback mode set to %s (value=%d)",
+                                      controller, get_playback_mode_name(data), value);
   }
   break;
 
@@ -869,8 +801,8 @@ void handle_control_change(struct data *data, uint8_t channel, uint8_t controlle
       toggle_sync_mode(data);
     }
 
-    pw_log_info("MIDI CC%d: Sync mode %s (value=%d)",
-                controller, is_sync_mode_enabled(data) ? "ENABLED" : "DISABLED", value);
+    rt_log_info(&data->rt_bridge.log, "MIDI CC%d: Sync mode %s (value=%d)",
+                                      controller, is_sync_mode_enabled(data) ? "ENABLED" : "DISABLED", value);
   }
   break;
 
@@ -885,8 +817,8 @@ void handle_control_change(struct data *data, uint8_t channel, uint8_t controlle
 
     data->sync_cutoff_percentage = cutoff_percentage;
 
-    pw_log_info("MIDI CC%d: Sync playback cutoff set to %.1f%% (value=%d)",
-                controller, cutoff_percentage * 100.0f, value);
+    rt_log_info(&data->rt_bridge.log, "MIDI CC%d: Sync playback cutoff set to %.1f%% (value=%d)",
+                                      controller, cutoff_percentage * 100.0f, value);
   }
   break;
 
@@ -901,112 +833,108 @@ void handle_control_change(struct data *data, uint8_t channel, uint8_t controlle
 
     data->sync_recording_cutoff_percentage = recording_cutoff_percentage;
 
-    pw_log_info("MIDI CC%d: Sync recording cutoff set to %.1f%% (value=%d)",
-                controller, recording_cutoff_percentage * 100.0f, value);
+    rt_log_info(&data->rt_bridge.log, "MIDI CC%d: Sync recording cutoff set to %.1f%% (value=%d)",
+                                      controller, recording_cutoff_percentage * 100.0f, value);
   }
   break;
 
   case SAVE_CONFIG_CC_NUMBER:
   {
-    /* Save current configuration when any value > 0 is received (trigger mode) */
-    if (value > 0)
+    /* Save current configuration when any value > 0 is received (trigger mode).
+       The state is snapshotted here and written by the worker thread. */
+    if (value > 0 && config_snapshot_save_rt(data))
     {
-      /* Generate timestamp-based filename */
-      time_t now = time(NULL);
-      struct tm *tm_info = localtime(&now);
-      char filename[256];
-
-      snprintf(filename, sizeof(filename), "uphonor_session_%04d%02d%02d_%02d%02d%02d.json",
-               tm_info->tm_year + 1900,
-               tm_info->tm_mon + 1,
-               tm_info->tm_mday,
-               tm_info->tm_hour,
-               tm_info->tm_min,
-               tm_info->tm_sec);
-
-      /* Save the configuration */
-      config_result_t result = config_save_state(data, filename);
-
-      if (result == CONFIG_SUCCESS)
-      {
-        pw_log_info("MIDI CC%d: Configuration saved to %s", controller, filename);
-      }
-      else
-      {
-        pw_log_error("MIDI CC%d: Failed to save configuration: %s",
-                     controller, config_get_error_message(result));
-      }
+      rt_log_info(&data->rt_bridge.log, "MIDI CC%d: Configuration save requested", controller);
     }
   }
   break;
 
   default:
-    pw_log_debug("Unhandled CC: controller=%d, value=%d", controller, value);
+    rt_log_debug(&data->rt_bridge.log, "Unhandled CC: controller=%d, value=%d", controller, value);
     break;
   }
 }
 
-void parse_midi_sequence(struct data *data, struct spa_pod_sequence *seq)
+/* Apply one control from the input sequence */
+void handle_midi_control(struct data *data, struct spa_pod_control *c)
 {
-  struct spa_pod_control *c;
+  rt_log_trace(&data->rt_bridge.log, "process_midi: found control at offset %u, type %d",
+                                     c->offset, c->type);
 
-  SPA_POD_SEQUENCE_FOREACH(seq, c)
+  if (c->type == SPA_CONTROL_UMP)
   {
-    pw_log_trace("process_midi: found control at offset %u, type %d",
-                 c->offset, c->type);
+    rt_log_trace(&data->rt_bridge.log, "process_midi: found UMP control at offset %u", c->offset);
 
-    if (c->type == SPA_CONTROL_UMP)
+    if (SPA_POD_BODY_SIZE(&c->value) >= sizeof(uint32_t))
     {
-      pw_log_trace("process_midi: found UMP control at offset %u", c->offset);
-
-      if (SPA_POD_BODY_SIZE(&c->value) >= sizeof(uint32_t))
+      uint32_t *midi_data = (uint32_t *)SPA_POD_BODY(&c->value);
+      if (midi_data != NULL)
       {
-        uint32_t *midi_data = (uint32_t *)SPA_POD_BODY(&c->value);
-        if (midi_data != NULL)
-        {
-          pw_log_debug("MIDI input received: 0x%08x", *midi_data);
-          data->reset_audio = true;
-        }
+        rt_log_debug(&data->rt_bridge.log, "MIDI input received: 0x%08x", *midi_data);
+        data->reset_audio = true;
       }
     }
-    else if (c->type == SPA_CONTROL_Midi)
-    {
-      pw_log_trace("process_midi: found raw MIDI control at offset %u", c->offset);
+  }
+  else if (c->type == SPA_CONTROL_Midi)
+  {
+    rt_log_trace(&data->rt_bridge.log, "process_midi: found raw MIDI control at offset %u", c->offset);
 
-      if (SPA_POD_BODY_SIZE(&c->value) >= sizeof(uint8_t))
+    if (SPA_POD_BODY_SIZE(&c->value) >= sizeof(uint8_t))
+    {
+      uint8_t *midi_data = (uint8_t *)SPA_POD_BODY(&c->value);
+      if (midi_data != NULL)
       {
-        uint8_t *midi_data = (uint8_t *)SPA_POD_BODY(&c->value);
-        if (midi_data != NULL)
-        {
-          handle_midi_message(data, midi_data);
-        }
+        handle_midi_message(data, midi_data);
       }
     }
   }
 }
 
+void parse_midi_sequence(struct data *data, struct spa_pod_sequence *seq)
+{
+  struct spa_pod_control *c;
+
+  SPA_POD_SEQUENCE_FOREACH(seq, c)
+  {
+    handle_midi_control(data, c);
+  }
+}
+
+struct spa_pod_sequence *midi_input_sequence(struct data *data, struct pw_buffer *in_buf)
+{
+  struct spa_data *in_d = &in_buf->buffer->datas[0];
+
+  if (in_d->chunk->size == 0)
+  {
+    return NULL;
+  }
+
+  rt_log_trace(&data->rt_bridge.log, "process_midi: received MIDI chunk of size %u",
+                                     in_d->chunk->size);
+
+  // Parse the incoming MIDI data
+  struct spa_pod *pod = spa_pod_from_data(in_d->data, in_d->chunk->size,
+                                          in_d->chunk->offset, in_d->chunk->size);
+
+  if (pod == NULL || !spa_pod_is_sequence(pod))
+  {
+    return NULL;
+  }
+  return (struct spa_pod_sequence *)pod;
+}
+
+/* Apply the whole cycle's MIDI at once - on_process() instead applies each
+   event at its offset, see process.c */
 void process_midi_input(struct data *data, struct spa_io_position *position)
 {
   struct pw_buffer *in_buf;
 
   if ((in_buf = pw_filter_dequeue_buffer(data->midi_in)) != NULL)
   {
-    struct spa_data *in_d = &in_buf->buffer->datas[0];
-
-    if (in_d->chunk->size > 0)
+    struct spa_pod_sequence *seq = midi_input_sequence(data, in_buf);
+    if (seq != NULL)
     {
-      pw_log_trace("process_midi: received MIDI chunk of size %u",
-                   in_d->chunk->size);
-
-      // Parse the incoming MIDI data
-      struct spa_pod *pod = spa_pod_from_data(in_d->data, in_d->chunk->size,
-                                              in_d->chunk->offset, in_d->chunk->size);
-
-      if (pod != NULL && spa_pod_is_sequence(pod))
-      {
-        struct spa_pod_sequence *seq = (struct spa_pod_sequence *)pod;
-        parse_midi_sequence(data, seq);
-      }
+      parse_midi_sequence(data, seq);
     }
 
     // Queue the input buffer back
@@ -1025,7 +953,7 @@ void process_midi_output(struct data *data, struct spa_io_position *position)
   // Use the clock sample position
   if (data->clock_id != position->clock.id)
   {
-    pw_log_info("switch to clock %u", position->clock.id);
+    rt_log_info(&data->rt_bridge.log, "switch to clock %u", position->clock.id);
     data->offset = position->clock.position - data->position;
     data->clock_id = position->clock.id;
   }
@@ -1071,7 +999,7 @@ void process_midi_output(struct data *data, struct spa_io_position *position)
       uint32_t event = 0x20903c7f;
       spa_pod_builder_control(&builder, sample_offset, SPA_CONTROL_UMP);
       spa_pod_builder_bytes(&builder, &event, sizeof(event));
-      pw_log_info("note on at %" PRIu64, sample_position + sample_offset);
+      rt_log_info(&data->rt_bridge.log, "note on at %" PRIu64, sample_position + sample_offset);
     }
     else
     {
@@ -1079,7 +1007,7 @@ void process_midi_output(struct data *data, struct spa_io_position *position)
       uint32_t event = 0x20803c7f;
       spa_pod_builder_control(&builder, sample_offset, SPA_CONTROL_UMP);
       spa_pod_builder_bytes(&builder, &event, sizeof(event));
-      pw_log_info("note off at %" PRIu64, sample_position + sample_offset);
+      rt_log_info(&data->rt_bridge.log, "note off at %" PRIu64, sample_position + sample_offset);
     }
 
     sample_offset += sample_period;
@@ -1090,6 +1018,6 @@ void process_midi_output(struct data *data, struct spa_io_position *position)
   spa_pod_builder_pop(&builder, &frame);
   d->chunk->size = builder.state.offset;
 
-  pw_log_trace("produced %u/%u bytes", d->chunk->size, d->maxsize);
+  rt_log_trace(&data->rt_bridge.log, "produced %u/%u bytes", d->chunk->size, d->maxsize);
   pw_filter_queue_buffer(data->midi_out, buf);
 }
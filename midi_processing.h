@@ -11,12 +11,11 @@ void handle_note_on(struct data *data, uint8_t channel, uint8_t note, uint8_t ve
 void handle_note_off(struct data *data, uint8_t channel, uint8_t note, uint8_t velocity);
 void handle_control_change(struct data *data, uint8_t channel, uint8_t controller, uint8_t value);
 
-/* Pulse timeline functions */
-uint32_t get_theoretical_pulse_position(struct data *data);
-void update_pulse_timeline(struct data *data, uint64_t current_frame);
-void check_theoretical_pulse_reset(struct data *data);
-
 /* MIDI utility functions */
 void parse_midi_sequence(struct data *data, struct spa_pod_sequence *seq);
+void handle_midi_control(struct data *data, struct spa_pod_control *c);
+
+/* Sequence held in a dequeued MIDI input buffer, NULL if it carries none */
+struct spa_pod_sequence *midi_input_sequence(struct data *data, struct pw_buffer *in_buf);
 
 #endif /* MIDI_PROCESSING_H */
@@ -0,0 +1,117 @@
+#include "mix_kernels.h"
+#include <stdbool.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define MIX_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+void mix_gain_accumulate_scalar(float *restrict dst, const float *restrict src,
+                                float gain, uint32_t n_samples)
+{
+  for (uint32_t i = 0; i < n_samples; i++)
+  {
+    dst[i] += src[i] * gain;
+  }
+}
+
+#ifdef MIX_KERNELS_X86
+__attribute__((target("sse2"))) static void mix_gain_accumulate_sse2(float *restrict dst, const float *restrict src,
+                                                                     float gain, uint32_t n_samples)
+{
+  __m128 g = _mm_set1_ps(gain);
+  uint32_t i = 0;
+
+  for (; i + 8 <= n_samples; i += 8)
+  {
+    __m128 a0 = _mm_add_ps(_mm_loadu_ps(dst + i), _mm_mul_ps(_mm_loadu_ps(src + i), g));
+    __m128 a1 = _mm_add_ps(_mm_loadu_ps(dst + i + 4), _mm_mul_ps(_mm_loadu_ps(src + i + 4), g));
+    _mm_storeu_ps(dst + i, a0);
+    _mm_storeu_ps(dst + i + 4, a1);
+  }
+  for (; i < n_samples; i++)
+  {
+    dst[i] += src[i] * gain;
+  }
+}
+
+__attribute__((target("avx2,fma"))) static void mix_gain_accumulate_avx2(float *restrict dst, const float *restrict src,
+                                                                         float gain, uint32_t n_samples)
+{
+  __m256 g = _mm256_set1_ps(gain);
+  uint32_t i = 0;
+
+  for (; i + 16 <= n_samples; i += 16)
+  {
+    __m256 a0 = _mm256_fmadd_ps(_mm256_loadu_ps(src + i), g, _mm256_loadu_ps(dst + i));
+    __m256 a1 = _mm256_fmadd_ps(_mm256_loadu_ps(src + i + 8), g, _mm256_loadu_ps(dst + i + 8));
+    _mm256_storeu_ps(dst + i, a0);
+    _mm256_storeu_ps(dst + i + 8, a1);
+  }
+  for (; i + 8 <= n_samples; i += 8)
+  {
+    _mm256_storeu_ps(dst + i, _mm256_fmadd_ps(_mm256_loadu_ps(src + i), g, _mm256_loadu_ps(dst + i)));
+  }
+  for (; i < n_samples; i++)
+  {
+    dst[i] += src[i] * gain;
+  }
+}
+#endif
+
+mix_gain_accumulate_fn mix_gain_accumulate = mix_gain_accumulate_scalar;
+static const char *selected_name = "scalar";
+
+int mix_kernels_select(const char *name)
+{
+  if (strcmp(name, "scalar") == 0)
+  {
+    mix_gain_accumulate = mix_gain_accumulate_scalar;
+    selected_name = "scalar";
+    return 0;
+  }
+#ifdef MIX_KERNELS_X86
+  __builtin_cpu_init();
+  if (strcmp(name, "sse2") == 0 && __builtin_cpu_supports("sse2"))
+  {
+    mix_gain_accumulate = mix_gain_accumulate_sse2;
+    selected_name = "sse2";
+    return 0;
+  }
+  if (strcmp(name, "avx2-fma") == 0 && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+  {
+    mix_gain_accumulate = mix_gain_accumulate_avx2;
+    selected_name = "avx2-fma";
+    return 0;
+  }
+#endif
+  return -1;
+}
+
+void mix_kernels_init(void)
+{
+  if (mix_kernels_select("avx2-fma") == 0)
+    return;
+  if (mix_kernels_select("sse2") == 0)
+    return;
+  mix_kernels_select("scalar");
+}
+
+const char *mix_kernels_name(void)
+{
+  return selected_name;
+}
+
+void mix_flush_denormals(void)
+{
+#ifdef MIX_KERNELS_X86
+  static __thread bool flushed = false;
+  if (!flushed)
+  {
+    /* FTZ (bit 15) and DAZ (bit 6) - decaying loop tails otherwise go denormal */
+    _mm_setcsr(_mm_getcsr() | 0x8040);
+    flushed = true;
+  }
+#endif
+}
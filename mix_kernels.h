@@ -0,0 +1,34 @@
+#ifndef MIX_KERNELS_H
+#define MIX_KERNELS_H
+
+#include <stdint.h>
+
+/* Gain-multiply-accumulate kernels for the loop mixer.
+ *
+ * dst[i] += src[i] * gain for a contiguous run. The best implementation
+ * for the running CPU (AVX2/FMA, SSE2 or scalar) is picked once by
+ * mix_kernels_init() and called through mix_gain_accumulate. */
+
+typedef void (*mix_gain_accumulate_fn)(float *restrict dst, const float *restrict src,
+                                       float gain, uint32_t n_samples);
+
+extern mix_gain_accumulate_fn mix_gain_accumulate;
+
+/* Select the kernel for this CPU (non-RT, call once at startup) */
+void mix_kernels_init(void);
+
+/* Name of the selected kernel ("avx2-fma", "sse2" or "scalar") */
+const char *mix_kernels_name(void);
+
+/* Force a specific kernel by name, returns 0 on success (benchmarks) */
+int mix_kernels_select(const char *name);
+
+/* Enable flush-to-zero/denormals-are-zero for the calling thread.
+ * Cheap after the first call on a thread - safe to call every RT cycle. */
+void mix_flush_denormals(void);
+
+/* Individual kernels, exposed for benchmarking */
+void mix_gain_accumulate_scalar(float *restrict dst, const float *restrict src,
+                                float gain, uint32_t n_samples);
+
+#endif /* MIX_KERNELS_H */
@@ -1,65 +1,180 @@
 #include "uphonor.h"
 #include "audio_processing_rt.h"
+#include "mix_kernels.h"
 #include <stdbool.h>
+#include <string.h>
+
+/* Mix one loop into buf: each contiguous run (bounded by the loop point and
+ * pool block ends) goes straight through the SIMD gain-accumulate kernel */
+static void mix_loop_into_rt(struct data *data, struct memory_loop *loop, float *buf, uint32_t n_samples)
+{
+  uint32_t total_frames = loop->recorded_frames;
+  uint32_t mixed = 0;
+
+  while (mixed < n_samples)
+  {
+    if (loop->playback_position >= total_frames)
+    {
+      loop->playback_position = 0; /* Loop back to beginning */
+    }
+
+    uint32_t span;
+    const float *src = loop_storage_span(data, loop, loop->playback_position, &span);
+
+    uint32_t run = n_samples - mixed;
+    if (run > span)
+    {
+      run = span;
+    }
+    if (run > total_frames - loop->playback_position)
+    {
+      run = total_frames - loop->playback_position;
+    }
+
+    mix_gain_accumulate(buf + mixed, src, loop->volume, run);
+    loop->playback_position += run;
+    mixed += run;
+  }
+}
+
+/* Mix one loop at its own speed through the band-limited resampler, pitch
+ * following like tape. Its position runs at speed rather than with the
+ * clock, so the anchor is moved along with it */
+static void mix_loop_varispeed_rt(struct data *data, struct memory_loop *loop, float *buf, uint32_t n_samples)
+{
+  struct loop_storage_reader reader = {data, loop};
+  float *work = data->temp_audio_buffer;
+  float *out = work + RESAMPLER_WORK_FRAMES;
+
+  for (uint32_t done = 0; done < n_samples;)
+  {
+    uint32_t block = n_samples - done;
+    if (block > RESAMPLER_BLOCK)
+    {
+      block = RESAMPLER_BLOCK;
+    }
+
+    resampler_process_rt(&loop->resampler, out, block, loop->speed, loop_storage_pull_rt, &reader, work);
+    mix_gain_accumulate(buf + done, out, loop->volume, block);
+    done += block;
+  }
+
+  loop->anchor_frame = data->current_sample_frame + n_samples - loop->playback_position;
+}
+
+/* Put a loop back where it would be had it played the frames it missed,
+ * at the pace it goes round its take */
+static void resync_loop_rt(struct data *data, struct memory_loop *loop)
+{
+  bool at_speed = loop->varispeed || loop->stretch_slot != STRETCH_SLOT_NONE || loop_freeze_live_rt(data, loop);
+  loop_storage_resync(loop, data->current_sample_frame, at_speed ? loop->speed : 1.0f);
+  resampler_reset(&loop->resampler);
+
+  /* A live stretcher has already stretched ahead from the old position -
+     the next block takes a fresh one from the new position */
+  stretch_loop_release_rt(&data->stretch, loop);
+  loop_freeze_seek_rt(data, loop);
+}
 
 /* Mix all active memory loops into output buffer */
 sf_count_t mix_all_active_loops_rt(struct data *data, float *buf, uint32_t n_samples)
 {
+  /* Keep decaying tails from going denormal on this thread */
+  mix_flush_denormals();
+
   /* Initialize output buffer to silence */
-  for (uint32_t i = 0; i < n_samples; i++)
+  memset(buf, 0, n_samples * sizeof(float));
+
+  /* Frames went unmixed since the last block - jump every loop to where its
+   * anchor says it should be now instead of letting it lag behind */
+  if (data->loop_positions_stale)
   {
-    buf[i] = 0.0f;
+    for (uint8_t v = 0; v < data->playing_voices.count; v++)
+    {
+      resync_loop_rt(data, &data->memory_loops[data->playing_voices.notes[v]]);
+    }
+    data->loop_positions_stale = false;
   }
 
+  /* Stale renders go, settled loops get queued for one; stretchers of loops
+     that stopped, froze or went back to unity return to the pool */
+  loop_freeze_update_rt(data);
+  stretch_pool_collect_rt(&data->stretch);
+
   bool any_playing = false;
-  float temp_buffer[n_samples]; /* Buffer for individual loop */
 
-  /* Mix all active loops */
-  for (int note = 0; note < 128; note++)
+  /* Mix all active loops - only the playing voices, not all 128 notes */
+  for (uint8_t v = 0; v < data->playing_voices.count; v++)
   {
-    struct memory_loop *loop = &data->memory_loops[note];
+    struct memory_loop *loop = &data->memory_loops[data->playing_voices.notes[v]];
 
-    if (!loop->is_playing || !loop->loop_ready || loop->recorded_frames == 0)
+    if (!loop->loop_ready || loop->recorded_frames == 0 ||
+        loop->first_block == LOOP_POOL_NONE || loop->recorded_frames > loop->buffer_size)
       continue;
 
     any_playing = true;
 
-    /* Read from this loop into temp buffer */
-    sf_count_t frames_read = read_audio_frames_from_memory_loop_basic_rt(loop, temp_buffer, n_samples);
+    if (loop->varispeed)
+    {
+      mix_loop_varispeed_rt(data, loop, buf, n_samples);
+      continue;
+    }
 
-    /* Mix this loop into output buffer with volume control */
-    for (uint32_t i = 0; i < frames_read && i < n_samples; i++)
+    /* Loops with their own speed or pitch play their frozen render, or else
+       from a pooled stretcher; with none free they play as recorded */
+    if ((loop->speed != 1.0f || loop->pitch != 0.0f) &&
+        (loop_freeze_mix_rt(data, loop, buf, n_samples) ||
+         stretch_loop_mix_rt(&data->stretch, &data->loop_pool, loop, buf, n_samples)))
     {
-      buf[i] += temp_buffer[i] * loop->volume;
+      // Both go round the take at the loop's speed - the anchor moves along, as for varispeed
+      loop->anchor_frame = data->current_sample_frame + n_samples - loop->playback_position;
+      continue;
     }
+
+    mix_loop_into_rt(data, loop, buf, n_samples);
+  }
+
+  /* A streamed file plays as one more voice, at the playback speed - time-stretched
+     on the stretch thread when rubberband is on, resampled (record-player mode) otherwise */
+  if (stretch_file_mix_rt(&data->stretch, &data->disk_stream, buf, n_samples, data->playback_speed,
+                          data->pitch_shift, data->rubberband_enabled, 1.0f) > 0)
+  {
+    any_playing = true;
   }
 
   return any_playing ? n_samples : 0;
 }
 
+void loop_clock_begin_cycle_rt(struct data *data, uint64_t cycle_frame, uint32_t n_samples)
+{
+  if (data->next_cycle_frame == 0)
+  {
+    /* First cycle: loops restored before the clock was known are anchored
+     * to it from the positions they were given */
+    for (uint8_t v = 0; v < data->playing_voices.count; v++)
+    {
+      struct memory_loop *loop = &data->memory_loops[data->playing_voices.notes[v]];
+      loop->anchor_frame = cycle_frame - loop->playback_position;
+    }
+  }
+  else if (cycle_frame != data->next_cycle_frame)
+  {
+    /* The graph skipped or repeated frames; a quantum change alone keeps
+     * the clock contiguous and needs nothing */
+    data->loop_positions_stale = true;
+  }
+  data->next_cycle_frame = cycle_frame + n_samples;
+}
+
 /* Basic memory loop reading for individual loops */
-sf_count_t read_audio_frames_from_memory_loop_basic_rt(struct memory_loop *loop, float *buf, uint32_t n_samples)
+sf_count_t read_audio_frames_from_memory_loop_basic_rt(struct data *data, struct memory_loop *loop, float *buf, uint32_t n_samples)
 {
-  if (!loop || !loop->buffer || !loop->loop_ready || !buf)
+  if (!loop || loop->first_block == LOOP_POOL_NONE || !loop->loop_ready || !buf)
     return 0;
 
   if (loop->recorded_frames == 0)
     return 0;
 
-  uint32_t frames_copied = 0;
-  uint32_t total_frames = loop->recorded_frames;
-
-  for (uint32_t i = 0; i < n_samples; i++)
-  {
-    if (loop->playback_position >= total_frames)
-    {
-      loop->playback_position = 0; /* Loop back to beginning */
-    }
-
-    buf[i] = loop->buffer[loop->playback_position];
-    loop->playback_position++;
-    frames_copied++;
-  }
-
-  return frames_copied;
+  /* Copies contiguous runs block by block, wrapping at the loop end */
+  return loop_storage_read(data, loop, buf, n_samples);
 }
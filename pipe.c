@@ -21,9 +21,10 @@ static void on_param_changed(void *userdata, void *object, uint32_t id, const st
 
   pw_log_info("  rate:%d channels:%d\n",
               data->format.info.raw.rate, data->format.info.raw.channels);
+  data->rt_bridge.rt_sample_rate = data->format.info.raw.rate;
 
   /* Initialize rubberband now that we have format information */
-  if (!data->rubberband_state && data->format.info.raw.rate > 0)
+  if (!stretch_worker_ready(&data->stretch) && data->format.info.raw.rate > 0)
   {
     pw_log_info("DEBUG: Initializing rubberband with sample rate %d", data->format.info.raw.rate);
     if (init_rubberband(data) < 0)
@@ -34,7 +35,6 @@ static void on_param_changed(void *userdata, void *object, uint32_t id, const st
     else
     {
       pw_log_info("Rubberband initialized successfully");
-      pw_log_info("DEBUG: Rubberband initialized successfully, state: %p", data->rubberband_state);
     }
   }
 }
\ No newline at end of file
@@ -8,18 +8,15 @@ int start_playing(struct data *data, const char *filename)
     return -1;
   }
 
-  data->current_state = HOLO_STATE_PLAYING;
-  memset(&data->fileinfo, 0, sizeof(data->fileinfo));
-
-  data->file = sf_open(filename, SFM_READ, &data->fileinfo);
-  if (data->file == NULL)
+  /* The disk thread reads the file; the process callback mixes it from memory */
+  if (disk_stream_open(&data->disk_stream, filename, &data->fileinfo) < 0)
   {
-    pw_log_error("failed to open file: %s", filename);
     return -1;
   }
+  data->current_state = HOLO_STATE_PLAYING;
 
   /* Initialize or reset rubberband when loading a new file */
-  if (data->rubberband_state)
+  if (stretch_worker_ready(&data->stretch))
   {
     rubberband_reset_data(data);
   }
@@ -37,7 +34,6 @@ int start_playing(struct data *data, const char *filename)
     if (init_rubberband(data) == 0)
     {
       pw_log_info("Rubberband initialized successfully with file format");
-      pw_log_info("DEBUG: Rubberband initialized successfully, state: %p", (void *)data->rubberband_state);
     }
     else
     {
@@ -2,30 +2,106 @@
 #include "audio_processing.h"
 #include "audio_processing_rt.h"
 #include "midi_processing.h"
+#include "sync_scheduler.h"
+#include "session_loader.h"
+#include "session_file.h"
+#include "engine_command.h"
+
+/* Run the audio path over [offset, offset + n_samples) of the cycle */
+static void process_block(struct data *data, const float *in, struct audio_output_rt *out,
+                          uint32_t offset, uint32_t n_samples)
+{
+  // Handle audio input (recording) - RT-optimized
+  handle_audio_input_block_rt(data, in ? in + offset : NULL, n_samples);
+
+  // Process audio output (playback) - RT-optimized
+  // Only process if we're in playing state
+  process_audio_output_block_rt(data, out, offset, n_samples);
+}
+
+/* Run the audio path from *done up to end, splitting the block at pulse
+   boundaries so the actions queued for one start on its exact sample */
+static void process_until(struct data *data, const float *in, struct audio_output_rt *out,
+                          uint64_t cycle_frame, uint32_t *done, uint32_t end)
+{
+  for (;;)
+  {
+    data->current_sample_frame = cycle_frame + *done;
+    uint32_t to_pulse = sync_frames_to_pulse(data, data->current_sample_frame);
+    if (to_pulse == 0)
+    {
+      // Also runs before MIDI events on the boundary frame, so they see the new pulse
+      sync_pulse_boundary_rt(data);
+      continue;
+    }
+    if (*done >= end)
+      return;
+
+    uint32_t n = SPA_MIN(end - *done, to_pulse);
+    process_block(data, in, out, *done, n);
+    *done += n;
+  }
+}
 
 void on_process(void *userdata, struct spa_io_position *position)
 {
   struct data *data = userdata;
   uint32_t n_samples = position->clock.duration;
+  uint64_t cycle_frame = position->clock.position;
+
+  // Pulse boundaries are scheduled ahead, nothing is detected per cycle
+  sync_scheduler_begin_cycle(data, cycle_frame);
+
+  // Loops whose session audio finished loading come online on this cycle
+  session_loader_publish_rt(data);
 
-  // Update pulse timeline for sync mode
-  if (data->sync_mode_enabled && data->pulse_loop_duration > 0)
+  // A pending session save snapshots the loops here, between two cycles
+  session_file_snapshot_rt(data);
+
+  // Outcome of a CC 81 save the worker finished since the last cycle
+  config_snapshot_collect_rt(data);
+
+  loop_clock_begin_cycle_rt(data, cycle_frame, n_samples);
+
+  // Varispeed voices share a fixed tap budget per cycle
+  resampler_begin_cycle_rt(n_samples);
+
+  // Input samples are always consumed, even when not recording
+  const float *in = pw_filter_get_dsp_buffer(data->audio_in, n_samples);
+
+  struct audio_output_rt out;
+  audio_output_begin_rt(&out, n_samples);
+
+  // Split the cycle at each MIDI event and pulse boundary so recording,
+  // backfill and mixing run right up to the frame where something changes
+  uint32_t done = 0;
+
+  // Commands from non-RT threads take effect on the first frame, after a
+  // pulse boundary that falls there - like MIDI at offset 0
+  process_until(data, in, &out, cycle_frame, &done, 0);
+  engine_command_drain_rt(data);
+
+  struct pw_buffer *midi_buf = pw_filter_dequeue_buffer(data->midi_in);
+  struct spa_pod_sequence *seq = midi_buf ? midi_input_sequence(data, midi_buf) : NULL;
+  if (seq)
+  {
+    struct spa_pod_control *c;
+    SPA_POD_SEQUENCE_FOREACH(seq, c)
+    {
+      process_until(data, in, &out, cycle_frame, &done, SPA_MIN(c->offset, n_samples));
+      handle_midi_control(data, c);
+    }
+  }
+  if (midi_buf)
   {
-    update_pulse_timeline(data, position->clock.position);
-    check_theoretical_pulse_reset(data);
+    pw_filter_queue_buffer(data->midi_in, midi_buf);
   }
 
-  // Process MIDI input and output (always needed for control)
-  process_midi_input(data, position);
+  // Rest of the cycle after the last event (all of it without MIDI)
+  process_until(data, in, &out, cycle_frame, &done, n_samples);
 
-  // Check for sync mode playback reset
-  check_sync_playback_reset(data);
+  audio_output_end_rt(data, &out);
 
-  // Handle audio input (recording) - RT-optimized
-  // Only process if recording is enabled or if we need to monitor levels
-  handle_audio_input_rt(data, n_samples);
-
-  // Process audio output (playback) - RT-optimized
-  // Only process if we're in playing state
-  process_audio_output_rt(data, position);
+  // Wake the non-RT worker once for everything queued this cycle
+  rt_bridge_notify(&data->rt_bridge);
 }
@@ -0,0 +1,157 @@
+#include "rate_convert.h"
+#include "uphonor.h"
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool rate_convert_supported(uint32_t in_rate, uint32_t out_rate)
+{
+  return in_rate > 0 && out_rate > 0 && (double)in_rate / out_rate <= RESAMPLER_MAX_SPEED;
+}
+
+uint32_t rate_convert_frames(uint64_t frames, uint32_t in_rate, uint32_t out_rate)
+{
+  uint64_t converted = (frames * out_rate + in_rate / 2) / in_rate;
+  return converted > UINT32_MAX ? UINT32_MAX : (uint32_t)converted;
+}
+
+bool rate_convert_cache_path(const char *source, uint32_t rate, char *path, size_t size)
+{
+  /* Keyed by the full path, so the same name in two directories is two entries */
+  char resolved[PATH_MAX];
+  const char *key = realpath(source, resolved) ? resolved : source;
+  uint64_t hash = UINT64_C(14695981039346656037); // FNV-1a
+  for (const char *c = key; *c; c++)
+  {
+    hash ^= (unsigned char)*c;
+    hash *= UINT64_C(1099511628211);
+  }
+
+  // The file's own name first, to keep the directory readable
+  const char *base = strrchr(source, '/');
+  base = base ? base + 1 : source;
+  const char *dot = strrchr(base, '.');
+  int stem = dot && dot != base ? (int)(dot - base) : (int)strlen(base);
+
+  int n = snprintf(path, size, "%s/%.*s-%016llx-%u.wav", RATE_CONVERT_CACHE_DIR, stem, base,
+                   (unsigned long long)hash, rate);
+  return n > 0 && (size_t)n < size;
+}
+
+SNDFILE *rate_convert_cache_open(const char *source, const char *path, uint32_t rate, SF_INFO *info)
+{
+  struct stat source_st, entry_st;
+  if (stat(source, &source_st) != 0 || stat(path, &entry_st) != 0)
+  {
+    return NULL;
+  }
+
+  /* A source rewritten since it was converted is converted again */
+  if (entry_st.st_mtim.tv_sec < source_st.st_mtim.tv_sec ||
+      (entry_st.st_mtim.tv_sec == source_st.st_mtim.tv_sec && entry_st.st_mtim.tv_nsec < source_st.st_mtim.tv_nsec))
+  {
+    return NULL;
+  }
+
+  memset(info, 0, sizeof(*info));
+  SNDFILE *file = sf_open(path, SFM_READ, info);
+  if (file && (info->samplerate != (int)rate || info->channels != 1))
+  {
+    sf_close(file);
+    return NULL;
+  }
+  return file;
+}
+
+/* Temporary entry next to path, renamed into place once it is complete.
+   Loader threads converting the same file each write their own. */
+static SNDFILE *rate_convert_cache_create(const char *path, uint32_t rate, char *tmp, size_t size)
+{
+  mkdir(RATE_CONVERT_CACHE_DIR, 0755); // Already there after the first conversion
+
+  int n = snprintf(tmp, size, "%s.XXXXXX", path);
+  if (n < 0 || (size_t)n >= size)
+  {
+    return NULL;
+  }
+  int fd = mkstemp(tmp);
+  if (fd < 0)
+  {
+    printf("Warning: Could not create rate conversion cache entry %s\n", path);
+    return NULL;
+  }
+  close(fd);
+
+  SF_INFO info = {.samplerate = (int)rate, .channels = 1, .format = SF_FORMAT_WAV | SF_FORMAT_FLOAT};
+  SNDFILE *file = sf_open(tmp, SFM_WRITE, &info);
+  if (!file)
+  {
+    printf("Warning: Could not write rate conversion cache entry %s - %s\n", path, sf_strerror(NULL));
+    unlink(tmp);
+  }
+  return file;
+}
+
+uint32_t rate_convert_into_loop(struct data *data, struct memory_loop *loop, resampler_pull_fn pull, void *ctx,
+                                uint32_t in_rate, uint32_t out_rate, uint32_t out_frames, float *scratch,
+                                const char *cache_path)
+{
+  float *work = scratch;
+  float *out = scratch + RESAMPLER_WORK_FRAMES;
+  double ratio = (double)in_rate / out_rate;
+
+  char tmp[1024];
+  SNDFILE *cache = cache_path ? rate_convert_cache_create(cache_path, out_rate, tmp, sizeof(tmp)) : NULL;
+
+  /* Output frame 0 is input frame 0, not the filter delay before it */
+  struct resampler rs;
+  resampler_prime(&rs, pull, ctx);
+
+  uint32_t stored = 0;
+  while (stored < out_frames)
+  {
+    uint32_t block = out_frames - stored;
+    if (block > RESAMPLER_BLOCK)
+    {
+      block = RESAMPLER_BLOCK;
+    }
+
+    if (resampler_convert(&rs, out, block, ratio, pull, ctx, work) == 0)
+    {
+      break;
+    }
+
+    uint32_t appended = loop_storage_append(data, loop, out, block);
+    if (cache && sf_writef_float(cache, out, appended) != (sf_count_t)appended)
+    {
+      // Disk full or similar - the loop still loads, just without an entry
+      sf_close(cache);
+      unlink(tmp);
+      cache = NULL;
+    }
+
+    stored += appended;
+    if (appended < block)
+    {
+      break; /* Out of loop memory */
+    }
+  }
+
+  if (cache)
+  {
+    sf_close(cache);
+    if (stored == out_frames && rename(tmp, cache_path) == 0)
+    {
+      printf("Cached %u Hz conversion: %s\n", out_rate, cache_path);
+    }
+    else
+    {
+      unlink(tmp);
+    }
+  }
+
+  return stored;
+}
@@ -0,0 +1,53 @@
+#ifndef RATE_CONVERT_H
+#define RATE_CONVERT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sndfile.h>
+#include "resampler.h"
+
+struct data;
+struct memory_loop;
+
+/* Sample-rate conversion of session audio.
+ *
+ * Loop audio saved at a different rate from the graph's plays at the wrong
+ * pitch and length. Session loading converts it to the graph rate on the way
+ * into the loop's block chain. This runs on the loader threads, never the RT
+ * thread, through the band-limited resampler (resampler.h) at its top tier.
+ *
+ * A converted file is also written to RATE_CONVERT_CACHE_DIR, named after the
+ * source path and the target rate, and the next load of the file at that
+ * rate reads the converted copy instead. An entry older than its source is
+ * ignored and written again. Entries are written under a temporary name and
+ * renamed into place, so an interrupted load never leaves a short one. */
+
+#define RATE_CONVERT_CACHE_DIR "recordings/.rate_cache"
+
+/* Scratch one conversion needs: the resampler work area plus one output block */
+#define RATE_CONVERT_SCRATCH_FRAMES (RESAMPLER_WORK_FRAMES + RESAMPLER_BLOCK)
+
+/* True if audio at in_rate can be converted to out_rate */
+bool rate_convert_supported(uint32_t in_rate, uint32_t out_rate);
+
+/* Length of frames frames at in_rate once converted to out_rate */
+uint32_t rate_convert_frames(uint64_t frames, uint32_t in_rate, uint32_t out_rate);
+
+/* Cache entry for source converted to rate. Returns false if the path does not fit. */
+bool rate_convert_cache_path(const char *source, uint32_t rate, char *path, size_t size);
+
+/* Open the cache entry at path if it is at rate and no older than source,
+   else return NULL */
+SNDFILE *rate_convert_cache_open(const char *source, const char *path, uint32_t rate, SF_INFO *info);
+
+/* Convert the input pulled through pull from in_rate to out_rate and append
+   out_frames frames of it to loop. scratch must hold
+   RATE_CONVERT_SCRATCH_FRAMES frames. If cache_path is not NULL, the output
+   is also stored there. Returns the frames stored, which is short only when
+   the loop pool runs out; no cache entry is written in that case. */
+uint32_t rate_convert_into_loop(struct data *data, struct memory_loop *loop, resampler_pull_fn pull, void *ctx,
+                                uint32_t in_rate, uint32_t out_rate, uint32_t out_frames, float *scratch,
+                                const char *cache_path);
+
+#endif /* RATE_CONVERT_H */
@@ -0,0 +1,585 @@
+/* Offline renderer
+ *
+ * Drives the real on_process() path - MIDI input, recording and loop
+ * playback - without a PipeWire graph, as fast as the CPU allows. Input
+ * audio comes from a WAV file, MIDI from a timestamped event script, and
+ * the clock is a synthetic spa_io_position at any quantum. The output is
+ * written to a WAV file and the time spent in every process cycle is
+ * recorded, so runs are reproducible on build machines.
+ *
+ * The disk stream and the stretchers, which the client runs on their own
+ * threads ahead of the play head, are filled here between cycles instead,
+ * outside the timed section, and loop freeze renders are waited for.
+ * Rendering runs far faster than real time, so the threads would fall
+ * behind by a different amount on every run.
+ *
+ *   uphonor-render -i input.wav -m events.txt -o output.wav [-q 256] [-t timings.csv]
+ *
+ * The engine reaches its ports only through pw_filter_get_dsp_buffer(),
+ * pw_filter_dequeue_buffer() and pw_filter_queue_buffer(). This file
+ * defines those three itself; definitions in the executable take precedence
+ * over libpipewire's, so the engine sees the ports below instead of a filter.
+ *
+ * Event script: one event per line, "<time> <status> [<data1> [<data2>]]".
+ * Time is in seconds, or in frames with an "f" suffix. Bytes are decimal or
+ * 0x hex, '#' starts a comment:
+ *
+ *   # record loop 60 for two bars at 120 bpm, then play it back
+ *   0.0     0x90 60 100
+ *   4.0     0x80 60 0
+ *   192000f 0x90 60 100
+ */
+#include "uphonor.h"
+#include <getopt.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define RENDER_MAX_QUANTUM 8192
+#define RENDER_MIDI_POD_SIZE 16384
+#define RENDER_MIDI_EVENT_SIZE 32 /* Upper bound for one control in the pod */
+
+/* Stand-in for a pw_filter port: one buffer, handed out once per cycle */
+struct render_port
+{
+  float *dsp; /* pw_filter_get_dsp_buffer() result, NULL for none */
+  struct pw_buffer pw;
+  struct spa_buffer buffer;
+  struct spa_data data;
+  struct spa_chunk chunk;
+  bool dequeued;
+  bool queued;
+};
+
+struct render_event
+{
+  uint64_t frame;
+  uint32_t line; /* Script order, keeps events at the same frame stable */
+  uint8_t size;
+  uint8_t bytes[3];
+};
+
+struct render_options
+{
+  const char *input;
+  const char *events;
+  const char *output;
+  const char *timings;
+  uint32_t quantum;
+  uint32_t rate;
+  double duration; /* Seconds, 0 for input length + tail */
+  double tail;     /* Seconds rendered after the input ends */
+};
+
+static struct render_port audio_in_port, audio_out_port, midi_in_port, midi_out_port;
+
+void *pw_filter_get_dsp_buffer(void *port_data, uint32_t n_samples)
+{
+  (void)n_samples; // Port buffers hold RENDER_MAX_QUANTUM frames
+  struct render_port *port = port_data;
+  return port ? port->dsp : NULL;
+}
+
+struct pw_buffer *pw_filter_dequeue_buffer(void *port_data)
+{
+  struct render_port *port = port_data;
+  if (!port || !port->buffer.datas || port->dequeued)
+    return NULL;
+  port->dequeued = true;
+  return &port->pw;
+}
+
+int pw_filter_queue_buffer(void *port_data, struct pw_buffer *buffer)
+{
+  struct render_port *port = port_data;
+  if (!port || buffer != &port->pw)
+    return -EINVAL;
+  port->queued = true;
+  return 0;
+}
+
+static void render_port_init(struct render_port *port, void *memory, uint32_t size)
+{
+  memset(port, 0, sizeof(*port));
+  port->data.data = memory;
+  port->data.maxsize = size;
+  port->data.chunk = &port->chunk;
+  port->buffer.n_datas = 1;
+  port->buffer.datas = &port->data;
+  port->pw.buffer = &port->buffer;
+}
+
+static void render_port_reset(struct render_port *port)
+{
+  port->dequeued = false;
+  port->queued = false;
+  port->chunk.offset = 0;
+  port->chunk.size = 0;
+  port->chunk.stride = 0;
+}
+
+static int compare_events(const void *a, const void *b)
+{
+  const struct render_event *ea = a, *eb = b;
+  if (ea->frame != eb->frame)
+    return ea->frame < eb->frame ? -1 : 1;
+  return ea->line < eb->line ? -1 : ea->line > eb->line;
+}
+
+/* Read the event script, sorted by frame. Returns the event count or -1. */
+static int load_events(const char *path, uint32_t rate, struct render_event **events)
+{
+  FILE *f = fopen(path, "r");
+  if (!f)
+  {
+    fprintf(stderr, "Could not open event script %s: %s\n", path, strerror(errno));
+    return -1;
+  }
+
+  char line[256];
+  uint32_t line_no = 0;
+  int count = 0, capacity = 0;
+  *events = NULL;
+
+  while (fgets(line, sizeof(line), f))
+  {
+    line_no++;
+    char *comment = strchr(line, '#');
+    if (comment)
+      *comment = '\0';
+
+    char *p = line, *end;
+    while (*p == ' ' || *p == '\t')
+      p++;
+    if (*p == '\0' || *p == '\n' || *p == '\r')
+      continue;
+
+    struct render_event ev = {.line = line_no};
+    double t = strtod(p, &end);
+    if (end == p || t < 0.0)
+    {
+      fprintf(stderr, "%s:%u: bad event time\n", path, line_no);
+      goto fail;
+    }
+    if (*end == 'f')
+    {
+      ev.frame = (uint64_t)t;
+      end++;
+    }
+    else
+    {
+      ev.frame = (uint64_t)(t * rate + 0.5);
+    }
+
+    p = end;
+    while (ev.size < 3)
+    {
+      unsigned long byte = strtoul(p, &end, 0);
+      if (end == p)
+        break;
+      if (byte > 0xff)
+      {
+        fprintf(stderr, "%s:%u: byte out of range\n", path, line_no);
+        goto fail;
+      }
+      ev.bytes[ev.size++] = (uint8_t)byte;
+      p = end;
+    }
+    if (ev.size == 0 || !(ev.bytes[0] & 0x80))
+    {
+      fprintf(stderr, "%s:%u: expected a status byte\n", path, line_no);
+      goto fail;
+    }
+
+    if (count == capacity)
+    {
+      capacity = capacity ? capacity * 2 : 64;
+      struct render_event *grown = realloc(*events, capacity * sizeof(**events));
+      if (!grown)
+        goto fail;
+      *events = grown;
+    }
+    (*events)[count++] = ev;
+  }
+
+  fclose(f);
+  qsort(*events, count, sizeof(**events), compare_events);
+  return count;
+
+fail:
+  fclose(f);
+  free(*events);
+  *events = NULL;
+  return -1;
+}
+
+/* Fill the MIDI input pod with the events due before frame end. Events that
+   do not fit are left for the next cycle and delivered at offset 0. */
+static int build_midi_cycle(struct render_port *port, const struct render_event *events,
+                            int n_events, int next, uint64_t start, uint64_t end)
+{
+  struct spa_pod_builder b;
+  struct spa_pod_frame frame;
+
+  int first = next;
+
+  spa_pod_builder_init(&b, port->data.data, port->data.maxsize);
+  spa_pod_builder_push_sequence(&b, &frame, 0);
+  while (next < n_events && events[next].frame < end &&
+         b.state.offset + RENDER_MIDI_EVENT_SIZE < port->data.maxsize)
+  {
+    const struct render_event *ev = &events[next++];
+    uint32_t offset = ev->frame > start ? (uint32_t)(ev->frame - start) : 0;
+    spa_pod_builder_control(&b, offset, SPA_CONTROL_Midi);
+    spa_pod_builder_bytes(&b, ev->bytes, ev->size);
+  }
+  spa_pod_builder_pop(&b, &frame);
+
+  port->chunk.offset = 0;
+  port->chunk.size = next > first ? b.state.offset : 0; /* Quiet cycles carry no sequence */
+  port->chunk.stride = 1;
+  return next;
+}
+
+/* Next input block as mono, zero padded past the end of the file */
+static void read_input(SNDFILE *file, const SF_INFO *info, float *scratch, float *out, uint32_t frames)
+{
+  sf_count_t got = 0;
+  if (file)
+  {
+    if (info->channels == 1)
+    {
+      got = sf_readf_float(file, out, frames);
+    }
+    else
+    {
+      got = sf_readf_float(file, scratch, frames);
+      for (sf_count_t i = 0; i < got; i++)
+      {
+        float sum = 0.0f;
+        for (int c = 0; c < info->channels; c++)
+          sum += scratch[i * info->channels + c];
+        out[i] = sum / info->channels;
+      }
+    }
+    if (got < 0)
+      got = 0;
+  }
+  memset(out + got, 0, (frames - got) * sizeof(float));
+}
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * SPA_NSEC_PER_SEC + (uint64_t)ts.tv_nsec;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+static void print_usage(const char *program_name)
+{
+  printf("Usage: %s -o OUTPUT.wav [OPTIONS]\n", program_name);
+  printf("\nRenders the looper offline, faster than real time.\n");
+  printf("\nOptions:\n");
+  printf("  -i, --input FILE      Input audio (mixed down to mono), silence if omitted\n");
+  printf("  -m, --midi FILE       Timestamped MIDI event script\n");
+  printf("  -o, --output FILE     Output WAV (mono, 32 bit float)\n");
+  printf("  -t, --timings FILE    Per-cycle timings as CSV\n");
+  printf("  -q, --quantum FRAMES  Frames per process cycle (default 256, max %d)\n", RENDER_MAX_QUANTUM);
+  printf("  -r, --rate HZ         Sample rate (default: input rate, else 48000)\n");
+  printf("  -d, --duration SEC    Length to render (default: input length + tail)\n");
+  printf("  -l, --tail SEC        Extra time after the input ends (default 0)\n");
+  printf("  -h, --help            Show this help message\n");
+}
+
+static int parse_options(int argc, char *argv[], struct render_options *opts)
+{
+  static const struct option long_options[] = {
+      {"input", required_argument, NULL, 'i'},
+      {"midi", required_argument, NULL, 'm'},
+      {"output", required_argument, NULL, 'o'},
+      {"timings", required_argument, NULL, 't'},
+      {"quantum", required_argument, NULL, 'q'},
+      {"rate", required_argument, NULL, 'r'},
+      {"duration", required_argument, NULL, 'd'},
+      {"tail", required_argument, NULL, 'l'},
+      {"help", no_argument, NULL, 'h'},
+      {NULL, 0, NULL, 0},
+  };
+  int c;
+
+  opts->quantum = 256;
+  while ((c = getopt_long(argc, argv, "i:m:o:t:q:r:d:l:h", long_options, NULL)) != -1)
+  {
+    switch (c)
+    {
+    case 'i':
+      opts->input = optarg;
+      break;
+    case 'm':
+      opts->events = optarg;
+      break;
+    case 'o':
+      opts->output = optarg;
+      break;
+    case 't':
+      opts->timings = optarg;
+      break;
+    case 'q':
+      opts->quantum = (uint32_t)strtoul(optarg, NULL, 10);
+      break;
+    case 'r':
+      opts->rate = (uint32_t)strtoul(optarg, NULL, 10);
+      break;
+    case 'd':
+      opts->duration = strtod(optarg, NULL);
+      break;
+    case 'l':
+      opts->tail = strtod(optarg, NULL);
+      break;
+    case 'h':
+      print_usage(argv[0]);
+      return 1;
+    default:
+      print_usage(argv[0]);
+      return -1;
+    }
+  }
+
+  if (!opts->output)
+  {
+    fprintf(stderr, "No output file given\n");
+    print_usage(argv[0]);
+    return -1;
+  }
+  if (opts->quantum == 0 || opts->quantum > RENDER_MAX_QUANTUM)
+  {
+    fprintf(stderr, "Quantum must be between 1 and %d frames\n", RENDER_MAX_QUANTUM);
+    return -1;
+  }
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  struct render_options opts = {0};
+  int status = parse_options(argc, argv, &opts);
+  if (status != 0)
+    return status > 0 ? 0 : 1;
+
+  /* Input decides the rate unless one is forced */
+  SF_INFO in_info = {0};
+  SNDFILE *in_file = NULL;
+  if (opts.input)
+  {
+    in_file = sf_open(opts.input, SFM_READ, &in_info);
+    if (!in_file)
+    {
+      fprintf(stderr, "Could not open input %s: %s\n", opts.input, sf_strerror(NULL));
+      return 1;
+    }
+    if (opts.rate == 0)
+      opts.rate = (uint32_t)in_info.samplerate;
+    else if ((uint32_t)in_info.samplerate != opts.rate)
+      fprintf(stderr, "Warning: input is %d Hz, rendering at %u Hz without resampling\n",
+              in_info.samplerate, opts.rate);
+  }
+  if (opts.rate == 0)
+    opts.rate = ENGINE_DEFAULT_RATE;
+
+  uint64_t total_frames = opts.duration > 0.0
+                              ? (uint64_t)(opts.duration * opts.rate + 0.5)
+                              : (uint64_t)(in_file ? in_info.frames : 0) + (uint64_t)(opts.tail * opts.rate + 0.5);
+  if (total_frames == 0)
+  {
+    fprintf(stderr, "Nothing to render - give an input file, --duration or --tail\n");
+    sf_close(in_file);
+    return 1;
+  }
+
+  struct render_event *events = NULL;
+  int n_events = 0;
+  if (opts.events && (n_events = load_events(opts.events, opts.rate, &events)) < 0)
+  {
+    sf_close(in_file);
+    return 1;
+  }
+
+  struct data data = {
+      0,
+  };
+  if (engine_init(&data, opts.rate) < 0)
+  {
+    free(events);
+    sf_close(in_file);
+    return 1;
+  }
+
+  /* Logging only - no connection to a PipeWire daemon is made */
+  pw_init(&argc, &argv);
+  rt_log_set_level(&data.rt_bridge.log,
+                   rt_log_level_from_string(getenv("UPHONOR_RT_LOG_LEVEL"), pw_log_level));
+
+  /* What on_param_changed() would have been told by the graph */
+  data.format.media_type = SPA_MEDIA_TYPE_audio;
+  data.format.media_subtype = SPA_MEDIA_SUBTYPE_raw;
+  data.format.info.raw.rate = opts.rate;
+  data.format.info.raw.channels = 1;
+  disk_stream_stop(&data.disk_stream);
+  data.stretch.synchronous = true;
+  if (init_rubberband(&data) < 0)
+    fprintf(stderr, "Warning: rubberband initialization failed\n");
+
+  float *in_buf = calloc(RENDER_MAX_QUANTUM, sizeof(float));
+  float *out_buf = calloc(RENDER_MAX_QUANTUM, sizeof(float));
+  float *scratch = malloc(RENDER_MAX_QUANTUM * (in_file ? in_info.channels : 1) * sizeof(float));
+  uint8_t *midi_pod = malloc(RENDER_MIDI_POD_SIZE);
+  uint64_t n_cycles = (total_frames + opts.quantum - 1) / opts.quantum;
+  uint64_t *cycle_ns = malloc(n_cycles * sizeof(uint64_t));
+  uint64_t *sorted_ns = malloc(n_cycles * sizeof(uint64_t));
+
+  SF_INFO out_info = {.samplerate = (int)opts.rate, .channels = 1, .format = SF_FORMAT_WAV | SF_FORMAT_FLOAT};
+  SNDFILE *out_file = sf_open(opts.output, SFM_WRITE, &out_info);
+  FILE *timings = opts.timings ? fopen(opts.timings, "w") : NULL;
+
+  if (!in_buf || !out_buf || !scratch || !midi_pod || !cycle_ns || !sorted_ns || !out_file ||
+      (opts.timings && !timings))
+  {
+    if (!out_file)
+      fprintf(stderr, "Could not open output %s: %s\n", opts.output, sf_strerror(NULL));
+    else if (opts.timings && !timings)
+      fprintf(stderr, "Could not open timings file %s: %s\n", opts.timings, strerror(errno));
+    else
+      fprintf(stderr, "Out of memory\n");
+    status = 1;
+    goto cleanup;
+  }
+
+  render_port_init(&audio_in_port, NULL, 0);
+  audio_in_port.dsp = in_buf;
+  render_port_init(&audio_out_port, out_buf, RENDER_MAX_QUANTUM * sizeof(float));
+  render_port_init(&midi_in_port, midi_pod, RENDER_MIDI_POD_SIZE);
+  render_port_init(&midi_out_port, NULL, 0);
+  midi_out_port.buffer.datas = NULL; /* Nothing listens to MIDI output */
+  data.audio_in = (struct pw_filter_port *)&audio_in_port;
+  data.audio_out = (struct pw_filter_port *)&audio_out_port;
+  data.midi_in = (struct pw_filter_port *)&midi_in_port;
+  data.midi_out = (struct pw_filter_port *)&midi_out_port;
+
+  if (timings)
+    fprintf(timings, "cycle,frame,events,ns\n");
+
+  printf("Rendering %.2f s at %u Hz, quantum %u (%" PRIu64 " cycles, %d events)\n",
+         (double)total_frames / opts.rate, opts.rate, opts.quantum, n_cycles, n_events);
+
+  struct spa_io_position position;
+  memset(&position, 0, sizeof(position));
+  position.clock.rate.num = 1;
+  position.clock.rate.denom = opts.rate;
+  position.clock.rate_diff = 1.0;
+
+  uint32_t ring_size = data.rt_bridge.audio_buffer.size;
+  bool pace_worker = true;
+  uint64_t frame = 0, busy_ns = 0;
+  int next_event = 0;
+  uint64_t wall_start = now_ns();
+
+  for (uint64_t cycle = 0; cycle < n_cycles; cycle++)
+  {
+    uint32_t n_samples = (uint32_t)SPA_MIN((uint64_t)opts.quantum, total_frames - frame);
+
+    /* The last cycle still runs a full quantum, like the graph would */
+    position.clock.position = frame;
+    position.clock.duration = opts.quantum;
+    position.clock.nsec = frame * SPA_NSEC_PER_SEC / opts.rate;
+    position.clock.next_nsec = (frame + opts.quantum) * SPA_NSEC_PER_SEC / opts.rate;
+
+    read_input(in_file, &in_info, scratch, in_buf, opts.quantum);
+
+    /* What the disk and stretch threads would have queued by now, and
+       the freeze renders queued last cycle */
+    disk_stream_fill(&data.disk_stream);
+    stretch_worker_service(&data.stretch, 0);
+    disk_stream_fill(&data.disk_stream);
+    loop_freeze_wait_idle(&data.freeze);
+
+    int first_event = next_event;
+    render_port_reset(&audio_out_port);
+    render_port_reset(&midi_in_port);
+    next_event = build_midi_cycle(&midi_in_port, events, n_events, next_event,
+                                  frame, frame + opts.quantum);
+
+    uint64_t start = now_ns();
+    on_process(&data, &position);
+    uint64_t elapsed = now_ns() - start;
+
+    /* A buffer that was not queued (no loops playing) is silence */
+    uint32_t out_frames = 0;
+    if (audio_out_port.queued && audio_out_port.chunk.stride > 0)
+      out_frames = audio_out_port.chunk.size / (uint32_t)audio_out_port.chunk.stride;
+    if (out_frames < n_samples)
+      memset(out_buf + out_frames, 0, (n_samples - out_frames) * sizeof(float));
+    sf_writef_float(out_file, out_buf, n_samples);
+
+    cycle_ns[cycle] = elapsed;
+    busy_ns += elapsed;
+    if (timings)
+      fprintf(timings, "%" PRIu64 ",%" PRIu64 ",%d,%" PRIu64 "\n",
+              cycle, frame, next_event - first_event, elapsed);
+
+    /* Rendering outruns the worker - let it catch up before the
+       recording ring overflows, outside the timed section */
+    if (pace_worker && audio_ring_buffer_read_space(&data.rt_bridge.audio_buffer) > ring_size / 2 &&
+        !rt_bridge_wait_idle(&data.rt_bridge, ring_size / 4))
+    {
+      fprintf(stderr, "Warning: worker is not draining the recording ring, no longer waiting for it\n");
+      pace_worker = false;
+    }
+
+    frame += opts.quantum;
+  }
+
+  /* Let pending loop and recording writes reach the disk */
+  rt_bridge_wait_idle(&data.rt_bridge, 0);
+  uint64_t wall_ns = now_ns() - wall_start;
+
+  memcpy(sorted_ns, cycle_ns, n_cycles * sizeof(uint64_t));
+  qsort(sorted_ns, n_cycles, sizeof(uint64_t), compare_u64);
+  double budget_ns = (double)opts.quantum * SPA_NSEC_PER_SEC / opts.rate;
+  double audio_sec = (double)total_frames / opts.rate;
+
+  printf("\nCycle time (budget %.1f us per cycle):\n", budget_ns / 1000.0);
+  printf("  mean %.2f us  p50 %.2f us  p99 %.2f us  max %.2f us\n",
+         busy_ns / 1000.0 / n_cycles,
+         sorted_ns[n_cycles / 2] / 1000.0,
+         sorted_ns[(n_cycles * 99) / 100] / 1000.0,
+         sorted_ns[n_cycles - 1] / 1000.0);
+  printf("  worst cycle used %.1f%% of the budget\n", 100.0 * sorted_ns[n_cycles - 1] / budget_ns);
+  printf("Rendered %.2f s of audio in %.3f s (%.1fx real time, %.1fx in on_process alone)\n",
+         audio_sec, wall_ns / 1e9, audio_sec / (wall_ns / 1e9), audio_sec / (busy_ns / 1e9));
+  printf("Output written to %s\n", opts.output);
+
+cleanup:
+  if (timings)
+    fclose(timings);
+  if (out_file)
+    sf_close(out_file);
+  if (in_file)
+    sf_close(in_file);
+
+  engine_cleanup(&data);
+  pw_deinit();
+
+  free(events);
+  free(in_buf);
+  free(out_buf);
+  free(scratch);
+  free(midi_pod);
+  free(cycle_ns);
+  free(sorted_ns);
+  return status;
+}
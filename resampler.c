@@ -0,0 +1,418 @@
+#include "resampler.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define RESAMPLER_X86 1
+#include <immintrin.h>
+#endif
+
+#define RESAMPLER_HALF (RESAMPLER_MAX_TAPS / 2)
+#define RESAMPLER_PHASE_SHIFT 25 /* 32 - log2(RESAMPLER_PHASES) */
+#define RESAMPLER_PHASE_SCALE (1.0f / (float)(1u << RESAMPLER_PHASE_SHIFT))
+#define RESAMPLER_ONE ((uint64_t)1 << 32)
+
+_Static_assert(RESAMPLER_PHASES == 1u << (32 - RESAMPLER_PHASE_SHIFT), "RESAMPLER_PHASE_SHIFT must match RESAMPLER_PHASES");
+
+/* Speeds the banks are designed for - a voice uses the first one at or above its speed */
+static const float bank_speeds[] = {1.0f, 1.25f, 1.5f, 2.0f, 2.5f, 3.0f, 4.0f, 5.0f, 6.0f, RESAMPLER_MAX_SPEED};
+#define RESAMPLER_BANKS (sizeof(bank_speeds) / sizeof(bank_speeds[0]))
+
+struct resampler_tier
+{
+  const char *name;
+  uint32_t taps;
+  double beta;    /* Kaiser window shape */
+  double rolloff; /* Cutoff as a fraction of the output Nyquist */
+};
+
+static const struct resampler_tier tiers[RESAMPLER_QUALITY_COUNT] = {
+    [RESAMPLER_LINEAR] = {"linear", 2, 0.0, 1.0},
+    [RESAMPLER_LOW] = {"low", 8, 5.0, 0.80},
+    [RESAMPLER_MEDIUM] = {"medium", 16, 7.0, 0.90},
+    [RESAMPLER_HIGH] = {"high", 32, 9.0, 0.94},
+};
+
+/* (RESAMPLER_PHASES + 1) rows of taps coefficients per bank; the extra row
+   lets the phase interpolation read one past the last phase */
+static float *banks[RESAMPLER_QUALITY_COUNT][RESAMPLER_BANKS];
+static enum resampler_quality top_quality = RESAMPLER_LINEAR;
+
+/* Taps left this cycle - only the RT thread resamples away from unity */
+static uint64_t budget_left;
+
+typedef void (*resample_block_fn)(const float *restrict bank, uint32_t taps, const float *restrict x,
+                                  float *restrict out, uint32_t n, uint32_t frac, uint64_t step);
+
+/* Scalar reference: two dot products per frame, one per neighbouring phase */
+static void resample_block_scalar(const float *restrict bank, uint32_t taps, const float *restrict x,
+                                  float *restrict out, uint32_t n, uint32_t frac, uint64_t step)
+{
+  uint64_t p = frac;
+  for (uint32_t k = 0; k < n; k++, p += step)
+  {
+    const float *xs = x + (p >> 32);
+    uint32_t f = (uint32_t)p;
+    const float *c0 = bank + (f >> RESAMPLER_PHASE_SHIFT) * taps;
+    const float *c1 = c0 + taps;
+    float t = (float)(f & ((1u << RESAMPLER_PHASE_SHIFT) - 1)) * RESAMPLER_PHASE_SCALE;
+
+    float d0 = 0.0f, d1 = 0.0f;
+    for (uint32_t j = 0; j < taps; j++)
+    {
+      d0 += c0[j] * xs[j];
+      d1 += c1[j] * xs[j];
+    }
+    out[k] = d0 + (d1 - d0) * t;
+  }
+}
+
+#ifdef RESAMPLER_X86
+__attribute__((target("sse2"))) static inline float hsum_sse2(__m128 v)
+{
+  __m128 s = _mm_add_ps(v, _mm_movehl_ps(v, v));
+  s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 0x55));
+  return _mm_cvtss_f32(s);
+}
+
+/* taps is a multiple of 4 */
+__attribute__((target("sse2"))) static void resample_block_sse2(const float *restrict bank, uint32_t taps,
+                                                                const float *restrict x, float *restrict out,
+                                                                uint32_t n, uint32_t frac, uint64_t step)
+{
+  uint64_t p = frac;
+  for (uint32_t k = 0; k < n; k++, p += step)
+  {
+    const float *xs = x + (p >> 32);
+    uint32_t f = (uint32_t)p;
+    const float *c0 = bank + (f >> RESAMPLER_PHASE_SHIFT) * taps;
+    const float *c1 = c0 + taps;
+    float t = (float)(f & ((1u << RESAMPLER_PHASE_SHIFT) - 1)) * RESAMPLER_PHASE_SCALE;
+
+    __m128 a0 = _mm_setzero_ps(), a1 = _mm_setzero_ps();
+    for (uint32_t j = 0; j < taps; j += 4)
+    {
+      __m128 v = _mm_loadu_ps(xs + j);
+      a0 = _mm_add_ps(a0, _mm_mul_ps(_mm_loadu_ps(c0 + j), v));
+      a1 = _mm_add_ps(a1, _mm_mul_ps(_mm_loadu_ps(c1 + j), v));
+    }
+    float d0 = hsum_sse2(a0), d1 = hsum_sse2(a1);
+    out[k] = d0 + (d1 - d0) * t;
+  }
+}
+
+/* taps is a multiple of 8 */
+__attribute__((target("avx2,fma"))) static void resample_block_avx2(const float *restrict bank, uint32_t taps,
+                                                                    const float *restrict x, float *restrict out,
+                                                                    uint32_t n, uint32_t frac, uint64_t step)
+{
+  uint64_t p = frac;
+  for (uint32_t k = 0; k < n; k++, p += step)
+  {
+    const float *xs = x + (p >> 32);
+    uint32_t f = (uint32_t)p;
+    const float *c0 = bank + (f >> RESAMPLER_PHASE_SHIFT) * taps;
+    const float *c1 = c0 + taps;
+    float t = (float)(f & ((1u << RESAMPLER_PHASE_SHIFT) - 1)) * RESAMPLER_PHASE_SCALE;
+
+    __m256 a0 = _mm256_setzero_ps(), a1 = _mm256_setzero_ps();
+    for (uint32_t j = 0; j < taps; j += 8)
+    {
+      __m256 v = _mm256_loadu_ps(xs + j);
+      a0 = _mm256_fmadd_ps(_mm256_loadu_ps(c0 + j), v, a0);
+      a1 = _mm256_fmadd_ps(_mm256_loadu_ps(c1 + j), v, a1);
+    }
+    /* Fold both sums into one 128-bit register: d0 in the low half, d1 in the high */
+    __m256 lo = _mm256_permute2f128_ps(a0, a1, 0x20);
+    __m256 hi = _mm256_permute2f128_ps(a0, a1, 0x31);
+    __m256 s = _mm256_add_ps(lo, hi);
+    s = _mm256_hadd_ps(s, s);
+    s = _mm256_hadd_ps(s, s);
+    float d0 = _mm_cvtss_f32(_mm256_castps256_ps128(s));
+    float d1 = _mm_cvtss_f32(_mm256_extractf128_ps(s, 1));
+    out[k] = d0 + (d1 - d0) * t;
+  }
+}
+#endif
+
+static resample_block_fn resample_block = resample_block_scalar;
+static const char *kernel_name = "scalar";
+
+static double bessel_i0(double x)
+{
+  /* Power series, converges quickly for the betas used here */
+  double sum = 1.0, term = 1.0;
+  for (int k = 1; k < 50; k++)
+  {
+    term *= (x / (2.0 * k)) * (x / (2.0 * k));
+    sum += term;
+    if (term < sum * 1e-12)
+      break;
+  }
+  return sum;
+}
+
+/* Row ph holds the taps for an output frame ph / RESAMPLER_PHASES past an input frame */
+static float *build_bank(const struct resampler_tier *tier, double speed)
+{
+  uint32_t taps = tier->taps;
+  uint32_t half = taps / 2;
+  float *bank = malloc((RESAMPLER_PHASES + 1) * taps * sizeof(float));
+  if (!bank)
+    return NULL;
+
+  /* Cutoff in cycles per input frame */
+  double fc = 0.5 * tier->rolloff / (speed > 1.0 ? speed : 1.0);
+
+  for (uint32_t ph = 0; ph <= RESAMPLER_PHASES; ph++)
+  {
+    double f = (double)ph / RESAMPLER_PHASES;
+    float *row = bank + ph * taps;
+    double sum = 0.0;
+
+    for (uint32_t j = 0; j < taps; j++)
+    {
+      double t = (double)j - (double)half + 1.0 - f; /* Distance from the output position */
+      double value;
+      if (tier->beta == 0.0)
+      {
+        value = fabs(t) < 1.0 ? 1.0 - fabs(t) : 0.0; /* Linear */
+      }
+      else
+      {
+        double x = 2.0 * fc * t;
+        double sinc = fabs(x) < 1e-9 ? 1.0 : sin(M_PI * x) / (M_PI * x);
+        double r = t / half;
+        double window = fabs(r) < 1.0 ? bessel_i0(tier->beta * sqrt(1.0 - r * r)) / bessel_i0(tier->beta) : 0.0;
+        value = sinc * window;
+      }
+      row[j] = (float)value;
+      sum += value;
+    }
+
+    /* Unity gain at DC for every phase */
+    for (uint32_t j = 0; j < taps && sum != 0.0; j++)
+    {
+      row[j] = (float)(row[j] / sum);
+    }
+  }
+  return bank;
+}
+
+static void select_kernel(void)
+{
+#ifdef RESAMPLER_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+  {
+    resample_block = resample_block_avx2;
+    kernel_name = "avx2-fma";
+    return;
+  }
+  if (__builtin_cpu_supports("sse2"))
+  {
+    resample_block = resample_block_sse2;
+    kernel_name = "sse2";
+    return;
+  }
+#endif
+  resample_block = resample_block_scalar;
+  kernel_name = "scalar";
+}
+
+int resampler_init(enum resampler_quality quality)
+{
+  select_kernel();
+
+  for (uint32_t q = RESAMPLER_LOW; q < RESAMPLER_QUALITY_COUNT; q++)
+  {
+    for (uint32_t b = 0; b < RESAMPLER_BANKS; b++)
+    {
+      if (banks[q][b])
+        continue;
+      banks[q][b] = build_bank(&tiers[q], bank_speeds[b]);
+      if (!banks[q][b])
+      {
+        fprintf(stderr, "Failed to allocate resampler filter banks, varispeed stays linear\n");
+        top_quality = RESAMPLER_LINEAR;
+        return -1;
+      }
+    }
+  }
+
+  resampler_set_quality(resampler_quality_from_string(getenv("UPHONOR_RESAMPLER_QUALITY"), quality));
+  return 0;
+}
+
+void resampler_set_quality(enum resampler_quality quality)
+{
+  if (quality >= RESAMPLER_QUALITY_COUNT)
+    quality = RESAMPLER_HIGH;
+  /* Without its banks a tier cannot run */
+  if (quality != RESAMPLER_LINEAR && !banks[quality][0])
+    quality = RESAMPLER_LINEAR;
+  top_quality = quality;
+}
+
+enum resampler_quality resampler_get_quality(void)
+{
+  return top_quality;
+}
+
+enum resampler_quality resampler_quality_from_string(const char *name, enum resampler_quality fallback)
+{
+  if (!name || !*name)
+    return fallback;
+  for (uint32_t q = 0; q < RESAMPLER_QUALITY_COUNT; q++)
+  {
+    if (strcmp(name, tiers[q].name) == 0)
+      return (enum resampler_quality)q;
+  }
+  return fallback;
+}
+
+const char *resampler_quality_name(enum resampler_quality quality)
+{
+  return quality < RESAMPLER_QUALITY_COUNT ? tiers[quality].name : "unknown";
+}
+
+const char *resampler_kernel_name(void)
+{
+  return kernel_name;
+}
+
+void resampler_reset(struct resampler *rs)
+{
+  memset(rs->history, 0, sizeof(rs->history));
+  rs->frac = 0;
+}
+
+void resampler_begin_cycle_rt(uint32_t n_samples)
+{
+  budget_left = (uint64_t)n_samples * RESAMPLER_BUDGET_VOICES * 2 * tiers[top_quality].taps;
+}
+
+/* Best tier whose taps for n frames still fit the cycle's budget */
+static enum resampler_quality resampler_pick_tier(uint32_t n)
+{
+  enum resampler_quality quality = top_quality;
+  while (quality > RESAMPLER_LINEAR)
+  {
+    uint64_t cost = (uint64_t)n * 2 * tiers[quality].taps;
+    if (cost <= budget_left)
+    {
+      budget_left -= cost;
+      break;
+    }
+    quality--;
+  }
+  return quality;
+}
+
+/* Conversions are not budgeted - they run at the best tier that was built */
+static enum resampler_quality resampler_offline_tier(void)
+{
+  return banks[RESAMPLER_HIGH][0] ? RESAMPLER_HIGH : RESAMPLER_LINEAR;
+}
+
+static void resampler_run(struct resampler *rs, float *out, uint32_t n_samples, uint64_t step,
+                          resampler_pull_fn pull, void *ctx, float *work, bool budgeted)
+{
+  float speed = (float)((double)step / (double)RESAMPLER_ONE);
+
+  for (uint32_t done = 0; done < n_samples;)
+  {
+    uint32_t block = n_samples - done;
+    if (block > RESAMPLER_BLOCK)
+      block = RESAMPLER_BLOCK;
+
+    // Whole input frames this pass moves past
+    uint64_t end = (uint64_t)rs->frac + step * block;
+    uint32_t advance = (uint32_t)(end >> 32);
+
+    memcpy(work, rs->history, sizeof(rs->history));
+    uint32_t got = advance > 0 ? pull(ctx, work + RESAMPLER_MAX_TAPS, advance) : 0;
+    if (got < advance)
+    {
+      memset(work + RESAMPLER_MAX_TAPS + got, 0, (advance - got) * sizeof(float));
+    }
+
+    if (step == RESAMPLER_ONE && rs->frac == 0)
+    {
+      /* Unity on an input frame - a plain copy at the same delay as the filters */
+      memcpy(out + done, work + RESAMPLER_HALF - 1, block * sizeof(float));
+    }
+    else
+    {
+      enum resampler_quality quality = budgeted ? resampler_pick_tier(block) : resampler_offline_tier();
+      if (quality == RESAMPLER_LINEAR)
+      {
+        const float *x = work + RESAMPLER_HALF - 1;
+        uint64_t p = rs->frac;
+        for (uint32_t k = 0; k < block; k++, p += step)
+        {
+          const float *xs = x + (p >> 32);
+          float t = (float)(uint32_t)p * (1.0f / 4294967296.0f);
+          out[done + k] = xs[0] + (xs[1] - xs[0]) * t;
+        }
+      }
+      else
+      {
+        uint32_t b = 0;
+        while (b + 1 < RESAMPLER_BANKS && bank_speeds[b] < speed)
+          b++;
+        uint32_t half = tiers[quality].taps / 2;
+        resample_block(banks[quality][b], tiers[quality].taps, work + RESAMPLER_HALF - half, out + done, block,
+                       rs->frac, step);
+      }
+    }
+
+    memcpy(rs->history, work + advance, sizeof(rs->history));
+    rs->frac = (uint32_t)end;
+    done += block;
+  }
+}
+
+uint32_t resampler_process_rt(struct resampler *rs, float *out, uint32_t n_samples, float speed,
+                              resampler_pull_fn pull, void *ctx, float *work)
+{
+  if (!(speed > 0.0f))
+    speed = 0.0f;
+  if (speed > RESAMPLER_MAX_SPEED)
+    speed = RESAMPLER_MAX_SPEED;
+
+  /* Fixed point step, computed once per call rather than accumulated per frame */
+  uint64_t step = (uint64_t)((double)speed * (double)RESAMPLER_ONE);
+
+  /* Back at unity the phase drops to the input frame before it (less than a
+     frame's shift), so unity is always a plain copy and never spends budget */
+  if (step == RESAMPLER_ONE)
+  {
+    rs->frac = 0;
+  }
+
+  resampler_run(rs, out, n_samples, step, pull, ctx, work, true);
+  return n_samples;
+}
+
+void resampler_prime(struct resampler *rs, resampler_pull_fn pull, void *ctx)
+{
+  resampler_reset(rs);
+
+  /* The first output frame reads history[RESAMPLER_HALF - 1] */
+  uint32_t lead = RESAMPLER_HALF + 1;
+  pull(ctx, rs->history + RESAMPLER_MAX_TAPS - lead, lead);
+}
+
+uint32_t resampler_convert(struct resampler *rs, float *out, uint32_t n_samples, double ratio,
+                           resampler_pull_fn pull, void *ctx, float *work)
+{
+  if (!(ratio > 0.0) || ratio > RESAMPLER_MAX_SPEED)
+    return 0;
+
+  /* Rounded rather than truncated, the drift over a long file stays under a frame */
+  resampler_run(rs, out, n_samples, (uint64_t)llround(ratio * (double)RESAMPLER_ONE), pull, ctx, work, false);
+  return n_samples;
+}
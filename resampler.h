@@ -0,0 +1,101 @@
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Band-limited varispeed resampling.
+ *
+ * Playing audio at speed s reads s input frames per output frame. Linear
+ * interpolation between neighbours is cheap, but above unity it folds
+ * everything over the new Nyquist back into the audible band, and below
+ * unity it leaves images. Here each output frame is a windowed-sinc
+ * (Kaiser) filter over the input around its position. The coefficients come
+ * from a polyphase bank of RESAMPLER_PHASES sub-sample offsets and are
+ * interpolated between adjacent phases. Above unity the cutoff falls with
+ * the speed, so the filter low-passes as it decimates. Banks are built for
+ * a fixed ladder of speeds, and the next faster one is used.
+ *
+ * Quality tiers trade taps for CPU: linear (the old interpolator), low (8
+ * taps), medium (16) and high (32). AVX2/FMA, SSE2 or scalar kernels apply
+ * the taps, picked once for the CPU like the mix kernels. Every tier reads
+ * the same history with the same delay, so a voice can change tier between
+ * blocks without a glitch. The per-cycle budget relies on this. Each cycle
+ * the RT thread gets RESAMPLER_BUDGET_VOICES voices' worth of top-tier
+ * taps. A voice that would overrun the budget drops to the best tier that
+ * still fits, down to linear, so the cost per cycle stays bounded however
+ * many voices play at varispeed.
+ *
+ * Positions are 32.32 fixed point. resampler_init() builds the tables once
+ * and they are shared read-only. A struct resampler holds one voice's
+ * history and phase and is only touched by the thread pulling that voice. */
+
+#define RESAMPLER_PHASES 128        /* Sub-sample offsets per bank */
+#define RESAMPLER_MAX_TAPS 32       /* Taps at the top tier - every voice keeps this much history */
+#define RESAMPLER_BLOCK 256         /* Output frames per pass */
+#define RESAMPLER_MAX_SPEED 8.0f    /* Fastest playback, bounds the frames pulled per pass */
+#define RESAMPLER_BUDGET_VOICES 8   /* Top-tier voices per cycle before voices drop tiers */
+
+/* Work buffer a caller passes in: history plus the input for one pass */
+#define RESAMPLER_WORK_FRAMES (RESAMPLER_MAX_TAPS + (uint32_t)(RESAMPLER_BLOCK * RESAMPLER_MAX_SPEED) + 1)
+
+enum resampler_quality
+{
+  RESAMPLER_LINEAR, /* 2-point interpolation, no band limiting */
+  RESAMPLER_LOW,    /* 8 taps */
+  RESAMPLER_MEDIUM, /* 16 taps */
+  RESAMPLER_HIGH,   /* 32 taps */
+  RESAMPLER_QUALITY_COUNT
+};
+
+/* Pulls up to frames input frames into buf, returns frames read (the rest is silence) */
+typedef uint32_t (*resampler_pull_fn)(void *ctx, float *buf, uint32_t frames);
+
+struct resampler
+{
+  float history[RESAMPLER_MAX_TAPS]; /* Last input frames, oldest first */
+  uint32_t frac;                     /* Position between two input frames, 0.32 fixed point */
+};
+
+/* Build the filter banks and pick the kernel for this CPU (non-RT, call once at
+   startup). UPHONOR_RESAMPLER_QUALITY overrides quality. Returns -1 if the banks
+   could not be allocated - every voice then runs at linear. */
+int resampler_init(enum resampler_quality quality);
+
+/* Change the top tier (non-RT; benchmarks and the environment override) */
+void resampler_set_quality(enum resampler_quality quality);
+enum resampler_quality resampler_get_quality(void);
+
+enum resampler_quality resampler_quality_from_string(const char *name, enum resampler_quality fallback);
+const char *resampler_quality_name(enum resampler_quality quality);
+
+/* Name of the selected kernel ("avx2-fma", "sse2" or "scalar") */
+const char *resampler_kernel_name(void);
+
+/* Forget the history, e.g. after a seek (RT-safe) */
+void resampler_reset(struct resampler *rs);
+
+/* Refill the tap budget for a cycle of n_samples frames (RT thread, once per cycle) */
+void resampler_begin_cycle_rt(uint32_t n_samples);
+
+/* Produce n_samples frames at speed, pulling input through pull. work must
+   hold RESAMPLER_WORK_FRAMES frames. Output lags the input by
+   RESAMPLER_MAX_TAPS / 2 + 1 frames at every tier. Away from unity only the
+   RT thread may call this (the budget is its own); at exactly 1.0 it is a
+   copy any thread owning the voice can make. Returns n_samples. */
+uint32_t resampler_process_rt(struct resampler *rs, float *out, uint32_t n_samples, float speed,
+                              resampler_pull_fn pull, void *ctx, float *work);
+
+/* Sample-rate conversion (non-RT, any thread). resampler_prime() resets rs
+   and takes the first input frames into its history, so output frame 0
+   lines up with input frame 0 instead of lagging by the filter delay.
+   resampler_convert() then reads ratio input frames per output frame (the
+   input rate over the output rate, up to RESAMPLER_MAX_SPEED). It always
+   runs at the top tier and spends none of the RT budget. Input past the end
+   of the source reads as silence, so the filter tail rings out cleanly.
+   Returns n_samples, or 0 if the ratio is out of range. */
+void resampler_prime(struct resampler *rs, resampler_pull_fn pull, void *ctx);
+uint32_t resampler_convert(struct resampler *rs, float *out, uint32_t n_samples, double ratio,
+                           resampler_pull_fn pull, void *ctx, float *work);
+
+#endif /* RESAMPLER_H */
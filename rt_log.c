@@ -0,0 +1,240 @@
+#include "rt_log.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <pipewire/pipewire.h>
+
+int rt_log_init(struct rt_log *log, uint32_t records, enum spa_log_level level)
+{
+  uint32_t size = 1;
+  while (size < records)
+  {
+    size <<= 1;
+  }
+
+  memset(log, 0, sizeof(*log));
+
+  /* Written by the RT thread - keep it resident like the loop pool */
+  log->records = rt_memory_alloc(&log->region, size * sizeof(struct rt_log_record), RT_MEMORY_LOCKED);
+  if (!log->records)
+  {
+    return -1;
+  }
+
+  log->size = size;
+  log->mask = size - 1;
+  atomic_init(&log->write_idx, 0);
+  atomic_init(&log->read_idx, 0);
+  atomic_init(&log->dropped, 0);
+  atomic_init(&log->level, (int)level);
+
+  return 0;
+}
+
+void rt_log_destroy(struct rt_log *log)
+{
+  rt_memory_free(&log->region);
+  log->records = NULL;
+  log->size = 0;
+  log->mask = 0;
+}
+
+void rt_log_set_level(struct rt_log *log, enum spa_log_level level)
+{
+  atomic_store_explicit(&log->level, (int)level, memory_order_relaxed);
+}
+
+enum spa_log_level rt_log_get_level(struct rt_log *log)
+{
+  return (enum spa_log_level)atomic_load_explicit(&log->level, memory_order_relaxed);
+}
+
+enum spa_log_level rt_log_level_from_string(const char *str, enum spa_log_level fallback)
+{
+  static const char *const names[] = {"none", "error", "warn", "info", "debug", "trace"};
+
+  if (!str || !*str)
+    return fallback;
+
+  if (str[0] >= '0' && str[0] <= '5' && str[1] == '\0')
+    return (enum spa_log_level)(str[0] - '0');
+
+  for (int i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++)
+  {
+    if (strcasecmp(str, names[i]) == 0)
+      return (enum spa_log_level)i;
+  }
+  return fallback;
+}
+
+bool rt_log_push(struct rt_log *log, const struct rt_log_event *event,
+                 const struct rt_log_arg *args, uint32_t n_args)
+{
+  if (!log->records)
+    return false;
+
+  uint32_t w = atomic_load_explicit(&log->write_idx, memory_order_relaxed);
+
+  if (w - log->cached_read_idx >= log->size)
+  {
+    log->cached_read_idx = atomic_load_explicit(&log->read_idx, memory_order_acquire);
+    if (w - log->cached_read_idx >= log->size)
+    {
+      atomic_fetch_add_explicit(&log->dropped, 1, memory_order_relaxed);
+      return false;
+    }
+  }
+
+  struct rt_log_record *record = &log->records[w & log->mask];
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  record->event = event;
+  record->time_ns = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+  record->n_args = n_args < RT_LOG_MAX_ARGS ? n_args : RT_LOG_MAX_ARGS;
+  memcpy(record->args, args, record->n_args * sizeof(struct rt_log_arg));
+
+  atomic_store_explicit(&log->write_idx, w + 1, memory_order_release);
+  return true;
+}
+
+/* Format one conversion with the record's argument, whatever length
+ * modifier the call site used - the argument carries its own type */
+static int format_arg(char *out, size_t size, const char *spec, size_t spec_len,
+                      char conv, const struct rt_log_arg *arg)
+{
+  char fmt[32];
+
+  if (spec_len > sizeof(fmt) - 4)
+    spec_len = sizeof(fmt) - 4;
+  memcpy(fmt, spec, spec_len);
+
+  switch (conv)
+  {
+  case 'd':
+  case 'i':
+  case 'u':
+  case 'x':
+  case 'X':
+  case 'o':
+  {
+    long long v = arg->type == RT_LOG_ARG_DOUBLE   ? (long long)arg->v.f
+                  : arg->type == RT_LOG_ARG_STRING ? 0
+                                                   : (long long)arg->v.i;
+    fmt[spec_len] = 'l';
+    fmt[spec_len + 1] = 'l';
+    fmt[spec_len + 2] = conv;
+    fmt[spec_len + 3] = '\0';
+    return snprintf(out, size, fmt, v);
+  }
+  case 'c':
+    fmt[spec_len] = 'c';
+    fmt[spec_len + 1] = '\0';
+    return snprintf(out, size, fmt, (int)arg->v.i);
+  case 'f':
+  case 'F':
+  case 'e':
+  case 'E':
+  case 'g':
+  case 'G':
+  case 'a':
+  case 'A':
+  {
+    double v = arg->type == RT_LOG_ARG_DOUBLE ? arg->v.f
+               : arg->type == RT_LOG_ARG_UINT ? (double)arg->v.u
+                                              : (double)arg->v.i;
+    fmt[spec_len] = conv;
+    fmt[spec_len + 1] = '\0';
+    return snprintf(out, size, fmt, v);
+  }
+  case 's':
+    fmt[spec_len] = 's';
+    fmt[spec_len + 1] = '\0';
+    return snprintf(out, size, fmt, arg->type == RT_LOG_ARG_STRING && arg->v.s ? arg->v.s : "?");
+  default:
+    return snprintf(out, size, "%%%c", conv);
+  }
+}
+
+static void format_record(const struct rt_log_record *record, char *out, size_t size)
+{
+  const char *f = record->event->fmt;
+  uint32_t next_arg = 0;
+  size_t len = 0;
+
+  while (*f && len + 1 < size)
+  {
+    if (*f != '%')
+    {
+      out[len++] = *f++;
+      continue;
+    }
+    if (f[1] == '%')
+    {
+      out[len++] = '%';
+      f += 2;
+      continue;
+    }
+
+    /* Keep flags, width and precision, skip the length modifier */
+    const char *spec = f++;
+    while (*f && strchr("-+ #0123456789.", *f))
+      f++;
+    size_t spec_len = f - spec;
+    while (*f && strchr("hlLjzt", *f))
+      f++;
+    if (!*f)
+      break;
+    char conv = *f++;
+
+    int n;
+    if (next_arg < record->n_args)
+      n = format_arg(out + len, size - len, spec, spec_len, conv, &record->args[next_arg++]);
+    else
+      n = snprintf(out + len, size - len, "<missing>");
+
+    if (n > 0)
+      len += (size_t)n < size - len ? (size_t)n : size - len - 1;
+  }
+  out[len] = '\0';
+}
+
+uint32_t rt_log_drain(struct rt_log *log)
+{
+  if (!log->records)
+    return 0;
+
+  uint32_t r = atomic_load_explicit(&log->read_idx, memory_order_relaxed);
+  uint32_t w = atomic_load_explicit(&log->write_idx, memory_order_acquire);
+  uint32_t count = 0;
+  char message[512];
+
+  while (r != w)
+  {
+    const struct rt_log_record *record = &log->records[r & log->mask];
+    const struct rt_log_event *event = record->event;
+
+    format_record(record, message, sizeof(message));
+    pw_log_log(event->level, event->file, event->line, event->func,
+               "[rt %" PRIu64 ".%06" PRIu64 "] %s",
+               record->time_ns / 1000000000, (record->time_ns / 1000) % 1000000,
+               message);
+
+    r++;
+    count++;
+    atomic_store_explicit(&log->read_idx, r, memory_order_release);
+  }
+  log->emitted += count;
+
+  uint64_t dropped = atomic_load_explicit(&log->dropped, memory_order_relaxed);
+  if (dropped != log->dropped_reported)
+  {
+    pw_log_warn("RT log ring full: %" PRIu64 " records dropped (%" PRIu64 " total)",
+                dropped - log->dropped_reported, dropped);
+    log->dropped_reported = dropped;
+  }
+
+  return count;
+}
@@ -0,0 +1,182 @@
+#ifndef RT_LOG_H
+#define RT_LOG_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <spa/support/log.h>
+#include "rt_memory.h"
+
+/* Deferred logging for the RT thread.
+ *
+ * pw_log_* formats the message and writes it out on the calling thread,
+ * which is not acceptable inside the process callback. rt_log_* instead
+ * copies a fixed-size binary record (call site, timestamp and up to
+ * RT_LOG_MAX_ARGS numeric or static string arguments) into a lock-free
+ * single-producer ring. The non-RT worker formats and emits the records
+ * through pw_log later. Records that do not fit are counted, not waited on.
+ *
+ *   rt_log_info(&data->rt_bridge.log, "Loop %d stopped at %u frames", note, frames);
+ *
+ * Only call these from the RT thread - the ring has a single producer.
+ * String arguments are stored by pointer and must be string literals or
+ * otherwise outlive the record. */
+
+#define RT_LOG_MAX_ARGS 6
+#define RT_LOG_DEFAULT_RECORDS 1024
+
+enum rt_log_arg_type
+{
+  RT_LOG_ARG_INT,
+  RT_LOG_ARG_UINT,
+  RT_LOG_ARG_DOUBLE,
+  RT_LOG_ARG_STRING
+};
+
+struct rt_log_arg
+{
+  uint32_t type;
+  union
+  {
+    int64_t i;
+    uint64_t u;
+    double f;
+    const char *s;
+  } v;
+};
+
+/* Static description of one log call site; its address is the event id */
+struct rt_log_event
+{
+  enum spa_log_level level;
+  const char *file;
+  int line;
+  const char *func;
+  const char *fmt;
+};
+
+/* One ring entry */
+struct rt_log_record
+{
+  const struct rt_log_event *event;
+  uint64_t time_ns; /* CLOCK_MONOTONIC at the call */
+  uint32_t n_args;
+  struct rt_log_arg args[RT_LOG_MAX_ARGS];
+};
+
+struct rt_log
+{
+  struct rt_log_record *records;
+  struct rt_memory_region region;
+  uint32_t size; /* Power of 2 number of records */
+  uint32_t mask;
+
+  /* Free-running indices on separate cache lines */
+  _Alignas(64) _Atomic uint32_t write_idx;
+  uint32_t cached_read_idx; /* Producer's last view of read_idx */
+  _Atomic uint64_t dropped; /* Records lost to a full ring (RT side) */
+  _Alignas(64) _Atomic uint32_t read_idx;
+  uint64_t dropped_reported; /* Drops already reported by the worker */
+  uint64_t emitted;
+
+  /* Most verbose level recorded, can be changed at any time */
+  _Alignas(64) _Atomic int level;
+};
+
+/* Non-RT setup, records is rounded up to a power of 2 */
+int rt_log_init(struct rt_log *log, uint32_t records, enum spa_log_level level);
+void rt_log_destroy(struct rt_log *log);
+
+void rt_log_set_level(struct rt_log *log, enum spa_log_level level);
+enum spa_log_level rt_log_get_level(struct rt_log *log);
+
+/* Level named "error", "warn", "info", "debug", "trace" or a number 0-5,
+ * fallback if str is NULL or not recognised */
+enum spa_log_level rt_log_level_from_string(const char *str, enum spa_log_level fallback);
+
+/* RT-safe: copy a record into the ring, returns false if it was dropped */
+bool rt_log_push(struct rt_log *log, const struct rt_log_event *event,
+                 const struct rt_log_arg *args, uint32_t n_args);
+
+/* Non-RT: format and emit every pending record, returns how many */
+uint32_t rt_log_drain(struct rt_log *log);
+
+static inline bool rt_log_enabled(struct rt_log *log, enum spa_log_level level)
+{
+  return (int)level <= atomic_load_explicit(&log->level, memory_order_relaxed);
+}
+
+static inline struct rt_log_arg rt_log_arg_int(int64_t v)
+{
+  return (struct rt_log_arg){.type = RT_LOG_ARG_INT, .v.i = v};
+}
+
+static inline struct rt_log_arg rt_log_arg_uint(uint64_t v)
+{
+  return (struct rt_log_arg){.type = RT_LOG_ARG_UINT, .v.u = v};
+}
+
+static inline struct rt_log_arg rt_log_arg_double(double v)
+{
+  return (struct rt_log_arg){.type = RT_LOG_ARG_DOUBLE, .v.f = v};
+}
+
+static inline struct rt_log_arg rt_log_arg_string(const char *v)
+{
+  return (struct rt_log_arg){.type = RT_LOG_ARG_STRING, .v.s = v};
+}
+
+#define RT_LOG_ARG(x) _Generic((x),          \
+    float: rt_log_arg_double,                \
+    double: rt_log_arg_double,               \
+    char *: rt_log_arg_string,               \
+    const char *: rt_log_arg_string,         \
+    _Bool: rt_log_arg_uint,                  \
+    unsigned char: rt_log_arg_uint,          \
+    unsigned short: rt_log_arg_uint,         \
+    unsigned int: rt_log_arg_uint,           \
+    unsigned long: rt_log_arg_uint,          \
+    unsigned long long: rt_log_arg_uint,     \
+    default: rt_log_arg_int)(x)
+
+/* Count the format plus arguments (1 to RT_LOG_MAX_ARGS + 1) */
+#define RT_LOG_NARG(...) RT_LOG_NARG_(__VA_ARGS__, 7, 6, 5, 4, 3, 2, 1, 0)
+#define RT_LOG_NARG_(_1, _2, _3, _4, _5, _6, _7, N, ...) N
+#define RT_LOG_FMT(fmt, ...) fmt
+#define RT_LOG_CAT(a, b) RT_LOG_CAT_(a, b)
+#define RT_LOG_CAT_(a, b) a##b
+
+/* ", RT_LOG_ARG(a), ..." for every argument after the format */
+#define RT_LOG_ARGS_1(f)
+#define RT_LOG_ARGS_2(f, a) , RT_LOG_ARG(a)
+#define RT_LOG_ARGS_3(f, a, b) , RT_LOG_ARG(a), RT_LOG_ARG(b)
+#define RT_LOG_ARGS_4(f, a, b, c) , RT_LOG_ARG(a), RT_LOG_ARG(b), RT_LOG_ARG(c)
+#define RT_LOG_ARGS_5(f, a, b, c, d) , RT_LOG_ARG(a), RT_LOG_ARG(b), RT_LOG_ARG(c), RT_LOG_ARG(d)
+#define RT_LOG_ARGS_6(f, a, b, c, d, e) \
+  , RT_LOG_ARG(a), RT_LOG_ARG(b), RT_LOG_ARG(c), RT_LOG_ARG(d), RT_LOG_ARG(e)
+#define RT_LOG_ARGS_7(f, a, b, c, d, e, g) \
+  , RT_LOG_ARG(a), RT_LOG_ARG(b), RT_LOG_ARG(c), RT_LOG_ARG(d), RT_LOG_ARG(e), RT_LOG_ARG(g)
+
+/* The leading empty argument keeps the array non-empty for argument-less calls */
+#define rt_log_at(log, lvl, ...)                                                       \
+  do                                                                                   \
+  {                                                                                    \
+    static const struct rt_log_event rt_log_event_ = {                                 \
+        (lvl), __FILE__, __LINE__, __func__, RT_LOG_FMT(__VA_ARGS__, 0)};              \
+    if (rt_log_enabled((log), (lvl)))                                                  \
+    {                                                                                  \
+      const struct rt_log_arg rt_log_args_[] = {                                       \
+          {0} RT_LOG_CAT(RT_LOG_ARGS_, RT_LOG_NARG(__VA_ARGS__))(__VA_ARGS__)};        \
+      rt_log_push((log), &rt_log_event_, rt_log_args_ + 1,                             \
+                  sizeof(rt_log_args_) / sizeof(rt_log_args_[0]) - 1);                 \
+    }                                                                                  \
+  } while (0)
+
+#define rt_log_error(log, ...) rt_log_at(log, SPA_LOG_LEVEL_ERROR, __VA_ARGS__)
+#define rt_log_warn(log, ...) rt_log_at(log, SPA_LOG_LEVEL_WARN, __VA_ARGS__)
+#define rt_log_info(log, ...) rt_log_at(log, SPA_LOG_LEVEL_INFO, __VA_ARGS__)
+#define rt_log_debug(log, ...) rt_log_at(log, SPA_LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define rt_log_trace(log, ...) rt_log_at(log, SPA_LOG_LEVEL_TRACE, __VA_ARGS__)
+
+#endif /* RT_LOG_H */
@@ -0,0 +1,150 @@
+#include "rt_memory.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define HUGE_PAGE_SIZE (2UL * 1024 * 1024)
+
+static size_t round_up(size_t size, size_t align)
+{
+  return (size + align - 1) & ~(align - 1);
+}
+
+/* Write one byte per page so every page is backed before RT use */
+static void prefault(void *addr, size_t size)
+{
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  volatile uint8_t *p = addr;
+  for (size_t off = 0; off < size; off += page)
+  {
+    p[off] = 0;
+  }
+}
+
+void *rt_memory_alloc(struct rt_memory_region *region, size_t size, enum rt_memory_mode mode)
+{
+  memset(region, 0, sizeof(*region));
+  region->size = size;
+
+  if (size == 0)
+    return NULL;
+
+  if (mode == RT_MEMORY_LAZY)
+  {
+    region->addr = calloc(1, size);
+    return region->addr;
+  }
+
+  void *addr = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+  if (mode == RT_MEMORY_HUGETLB)
+  {
+    /* Explicit hugepages are already resident once MAP_POPULATE returns */
+    size_t huge_size = round_up(size, HUGE_PAGE_SIZE);
+    addr = mmap(NULL, huge_size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+    if (addr != MAP_FAILED)
+    {
+      region->mapped = huge_size;
+      region->pages = RT_MEMORY_PAGES_HUGETLB;
+      region->prefaulted = true;
+    }
+  }
+#endif
+
+  if (addr == MAP_FAILED)
+  {
+    /* Align to the hugepage size so THP can back the whole range */
+    size_t map_size = round_up(size, HUGE_PAGE_SIZE);
+    addr = mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED)
+      return NULL;
+
+    region->mapped = map_size;
+
+#ifdef MADV_HUGEPAGE
+    /* Must be advised before the pages are faulted in */
+    if (madvise(addr, map_size, MADV_HUGEPAGE) == 0)
+    {
+      region->pages = RT_MEMORY_PAGES_TRANSPARENT;
+    }
+#endif
+
+    prefault(addr, map_size);
+    region->prefaulted = true;
+  }
+
+  region->addr = addr;
+  region->locked = (mlock(addr, region->mapped) == 0);
+  return addr;
+}
+
+void rt_memory_free(struct rt_memory_region *region)
+{
+  if (!region->addr)
+    return;
+
+  if (region->mapped)
+  {
+    if (region->locked)
+    {
+      munlock(region->addr, region->mapped);
+    }
+    munmap(region->addr, region->mapped);
+  }
+  else
+  {
+    free(region->addr);
+  }
+
+  memset(region, 0, sizeof(*region));
+}
+
+enum rt_memory_mode rt_memory_mode_from_string(const char *str)
+{
+  if (str && strcasecmp(str, "lazy") == 0)
+    return RT_MEMORY_LAZY;
+  if (str && strcasecmp(str, "hugetlb") == 0)
+    return RT_MEMORY_HUGETLB;
+  return RT_MEMORY_LOCKED;
+}
+
+const char *rt_memory_pages_name(enum rt_memory_pages pages)
+{
+  switch (pages)
+  {
+  case RT_MEMORY_PAGES_TRANSPARENT:
+    return "transparent hugepages";
+  case RT_MEMORY_PAGES_HUGETLB:
+    return "hugetlb pages";
+  default:
+    return "normal pages";
+  }
+}
+
+void rt_memory_report(const char *name, const struct rt_memory_region *region)
+{
+  double mb = (double)region->size / (1024.0 * 1024.0);
+
+  if (!region->mapped)
+  {
+    printf("%s: %.1f MB, lazy (pages fault in on first use)\n", name, mb);
+    return;
+  }
+
+  printf("%s: %.1f MB, %s, %s, %s\n", name, mb,
+         region->prefaulted ? "prefaulted" : "not prefaulted",
+         region->locked ? "locked" : "NOT locked",
+         rt_memory_pages_name(region->pages));
+
+  if (!region->locked)
+  {
+    printf("  mlock failed - raise the memlock limit (ulimit -l) to keep %s resident\n", name);
+  }
+}
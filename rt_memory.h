@@ -0,0 +1,51 @@
+#ifndef RT_MEMORY_H
+#define RT_MEMORY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Page-fault-free memory for buffers the RT thread writes into.
+ *
+ * calloc'd memory is only backed on first touch, so the first write to
+ * every page of a loop or the backfill buffer takes a page fault inside
+ * the audio callback. Regions allocated here are mapped up front, faulted
+ * in before the audio thread starts, locked into RAM and backed by
+ * hugepages when the system offers them. */
+
+enum rt_memory_mode
+{
+  RT_MEMORY_LAZY,     /* Plain calloc - pages are backed on first touch */
+  RT_MEMORY_LOCKED,   /* mmap + prefault + mlock, transparent hugepages if available (default) */
+  RT_MEMORY_HUGETLB   /* Like LOCKED but try explicit hugetlbfs pages first */
+};
+
+enum rt_memory_pages
+{
+  RT_MEMORY_PAGES_NORMAL,
+  RT_MEMORY_PAGES_TRANSPARENT, /* MADV_HUGEPAGE accepted */
+  RT_MEMORY_PAGES_HUGETLB      /* MAP_HUGETLB mapping */
+};
+
+struct rt_memory_region
+{
+  void *addr;
+  size_t size;   /* Bytes requested */
+  size_t mapped; /* Bytes actually mapped (0 for calloc) */
+  bool prefaulted;
+  bool locked;
+  enum rt_memory_pages pages;
+};
+
+/* Allocate size zeroed bytes (non-RT). Returns NULL on failure.
+ * Locking failures are not fatal - check region->locked. */
+void *rt_memory_alloc(struct rt_memory_region *region, size_t size, enum rt_memory_mode mode);
+void rt_memory_free(struct rt_memory_region *region);
+
+/* Parse "lazy", "locked" or "hugetlb" (NULL/unknown -> RT_MEMORY_LOCKED) */
+enum rt_memory_mode rt_memory_mode_from_string(const char *str);
+const char *rt_memory_pages_name(enum rt_memory_pages pages);
+
+/* Print how a region ended up backed (startup diagnostics) */
+void rt_memory_report(const char *name, const struct rt_memory_region *region);
+
+#endif /* RT_MEMORY_H */
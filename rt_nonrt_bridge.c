@@ -4,6 +4,8 @@
 #include <stdio.h>
 #include <time.h>
 #include <unistd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 #include <pipewire/pipewire.h>
 
 /* Ring buffer utilities */
@@ -32,8 +34,10 @@ int audio_ring_buffer_init(struct audio_ring_buffer *rb, uint32_t size)
 
   rb->size = size;
   rb->mask = size - 1;
-  rb->write_idx = 0;
-  rb->read_idx = 0;
+  atomic_init(&rb->write_idx, 0);
+  atomic_init(&rb->read_idx, 0);
+  rb->cached_read_idx = 0;
+  rb->cached_write_idx = 0;
 
   return 0;
 }
@@ -47,34 +51,41 @@ void audio_ring_buffer_destroy(struct audio_ring_buffer *rb)
   }
   rb->size = 0;
   rb->mask = 0;
-  rb->write_idx = 0;
-  rb->read_idx = 0;
+  atomic_store_explicit(&rb->write_idx, 0, memory_order_relaxed);
+  atomic_store_explicit(&rb->read_idx, 0, memory_order_relaxed);
+  rb->cached_read_idx = 0;
+  rb->cached_write_idx = 0;
 }
 
 uint32_t audio_ring_buffer_write_space(const struct audio_ring_buffer *rb)
 {
-  uint32_t w = rb->write_idx;
-  uint32_t r = rb->read_idx;
-  uint32_t space = (r - w - 1) & (rb->size - 1);
-  return space;
+  uint32_t w = atomic_load_explicit(&rb->write_idx, memory_order_relaxed);
+  uint32_t r = atomic_load_explicit(&rb->read_idx, memory_order_acquire);
+  return rb->size - (w - r);
 }
 
 uint32_t audio_ring_buffer_read_space(const struct audio_ring_buffer *rb)
 {
-  uint32_t w = rb->write_idx;
-  uint32_t r = rb->read_idx;
-  uint32_t space = (w - r) & (rb->size - 1);
-  return space;
+  uint32_t w = atomic_load_explicit(&rb->write_idx, memory_order_acquire);
+  uint32_t r = atomic_load_explicit(&rb->read_idx, memory_order_relaxed);
+  return w - r;
 }
 
 uint32_t audio_ring_buffer_write(struct audio_ring_buffer *rb,
                                  const float *data,
                                  uint32_t samples)
 {
-  uint32_t to_write = samples;
-  uint32_t w = rb->write_idx;
-  uint32_t available = audio_ring_buffer_write_space(rb);
+  uint32_t w = atomic_load_explicit(&rb->write_idx, memory_order_relaxed);
+  uint32_t available = rb->size - (w - rb->cached_read_idx);
+
+  if (samples > available)
+  {
+    /* Only touch the consumer's cache line when the cached view is full */
+    rb->cached_read_idx = atomic_load_explicit(&rb->read_idx, memory_order_acquire);
+    available = rb->size - (w - rb->cached_read_idx);
+  }
 
+  uint32_t to_write = samples;
   if (to_write > available)
   {
     to_write = available; /* Clamp to available space */
@@ -101,8 +112,8 @@ uint32_t audio_ring_buffer_write(struct audio_ring_buffer *rb,
     memcpy(&rb->data[0], &data[cnt1], (to_write - cnt1) * sizeof(float));
   }
 
-  /* Update write pointer atomically */
-  rb->write_idx = (w + to_write);
+  /* Publish the samples */
+  atomic_store_explicit(&rb->write_idx, w + to_write, memory_order_release);
 
   return to_write;
 }
@@ -111,10 +122,17 @@ uint32_t audio_ring_buffer_read(struct audio_ring_buffer *rb,
                                 float *data,
                                 uint32_t samples)
 {
-  uint32_t to_read = samples;
-  uint32_t r = rb->read_idx;
-  uint32_t available = audio_ring_buffer_read_space(rb);
+  uint32_t r = atomic_load_explicit(&rb->read_idx, memory_order_relaxed);
+  uint32_t available = rb->cached_write_idx - r;
 
+  if (samples > available)
+  {
+    /* Only touch the producer's cache line when the cached view runs dry */
+    rb->cached_write_idx = atomic_load_explicit(&rb->write_idx, memory_order_acquire);
+    available = rb->cached_write_idx - r;
+  }
+
+  uint32_t to_read = samples;
   if (to_read > available)
   {
     to_read = available; /* Clamp to available data */
@@ -141,12 +159,26 @@ uint32_t audio_ring_buffer_read(struct audio_ring_buffer *rb,
     memcpy(&data[cnt1], &rb->data[0], (to_read - cnt1) * sizeof(float));
   }
 
-  /* Update read pointer atomically */
-  rb->read_idx = (r + to_read);
+  /* Hand the space back to the producer */
+  atomic_store_explicit(&rb->read_idx, r + to_read, memory_order_release);
 
   return to_read;
 }
 
+uint32_t audio_ring_buffer_skip(struct audio_ring_buffer *rb, uint32_t samples)
+{
+  uint32_t r = atomic_load_explicit(&rb->read_idx, memory_order_relaxed);
+  rb->cached_write_idx = atomic_load_explicit(&rb->write_idx, memory_order_acquire);
+  uint32_t available = rb->cached_write_idx - r;
+  if (samples > available)
+  {
+    samples = available;
+  }
+
+  atomic_store_explicit(&rb->read_idx, r + samples, memory_order_release);
+  return samples;
+}
+
 /* Message queue implementation */
 int message_queue_init(struct message_queue *mq, uint32_t size)
 {
@@ -160,8 +192,10 @@ int message_queue_init(struct message_queue *mq, uint32_t size)
 
   mq->size = size;
   mq->mask = size - 1;
-  mq->write_idx = 0;
-  mq->read_idx = 0;
+  atomic_init(&mq->write_idx, 0);
+  atomic_init(&mq->read_idx, 0);
+  mq->cached_read_idx = 0;
+  mq->cached_write_idx = 0;
 
   return 0;
 }
@@ -175,49 +209,104 @@ void message_queue_destroy(struct message_queue *mq)
   }
   mq->size = 0;
   mq->mask = 0;
-  mq->write_idx = 0;
-  mq->read_idx = 0;
+  atomic_store_explicit(&mq->write_idx, 0, memory_order_relaxed);
+  atomic_store_explicit(&mq->read_idx, 0, memory_order_relaxed);
+  mq->cached_read_idx = 0;
+  mq->cached_write_idx = 0;
 }
 
 bool message_queue_push(struct message_queue *mq, const struct rt_message *msg)
 {
-  uint32_t w = mq->write_idx;
-  uint32_t next_w = w + 1;
+  uint32_t w = atomic_load_explicit(&mq->write_idx, memory_order_relaxed);
 
-  /* Check if queue is full */
-  if ((next_w & (mq->size - 1)) == (mq->read_idx & (mq->size - 1)))
+  /* Check if queue is full, refreshing the consumer index only if it looks so */
+  if (w - mq->cached_read_idx >= mq->size)
   {
-    return false; /* Queue full */
+    mq->cached_read_idx = atomic_load_explicit(&mq->read_idx, memory_order_acquire);
+    if (w - mq->cached_read_idx >= mq->size)
+    {
+      return false; /* Queue full */
+    }
   }
 
   /* Copy message */
   mq->messages[w & mq->mask] = *msg;
 
-  /* Update write pointer */
-  mq->write_idx = next_w;
+  /* Publish it */
+  atomic_store_explicit(&mq->write_idx, w + 1, memory_order_release);
 
   return true;
 }
 
 bool message_queue_pop(struct message_queue *mq, struct rt_message *msg)
 {
-  uint32_t r = mq->read_idx;
+  uint32_t r = atomic_load_explicit(&mq->read_idx, memory_order_relaxed);
 
-  /* Check if queue is empty */
-  if ((r & (mq->size - 1)) == (mq->write_idx & (mq->size - 1)))
+  /* Check if queue is empty, refreshing the producer index only if it looks so */
+  if (r == mq->cached_write_idx)
   {
-    return false; /* Queue empty */
+    mq->cached_write_idx = atomic_load_explicit(&mq->write_idx, memory_order_acquire);
+    if (r == mq->cached_write_idx)
+    {
+      return false; /* Queue empty */
+    }
   }
 
   /* Copy message */
   *msg = mq->messages[r & mq->mask];
 
-  /* Update read pointer */
-  mq->read_idx = r + 1;
+  /* Release the slot */
+  atomic_store_explicit(&mq->read_idx, r + 1, memory_order_release);
 
   return true;
 }
 
+/* Move up to max_frames from the ring into the open recording file */
+static uint32_t write_ring_to_file(struct nonrt_worker *worker, float **audio_buffer,
+                                   uint32_t *audio_buffer_size, uint32_t max_frames)
+{
+  uint32_t available = audio_ring_buffer_read_space(worker->audio_buffer);
+  if (available > max_frames)
+  {
+    available = max_frames;
+  }
+  if (available == 0)
+  {
+    return 0;
+  }
+
+  /* Ensure buffer is large enough */
+  if (available > *audio_buffer_size)
+  {
+    float *grown = realloc(*audio_buffer, available * sizeof(float));
+    if (!grown)
+    {
+      fprintf(stderr, "Failed to reallocate audio buffer\n");
+      return 0;
+    }
+    *audio_buffer = grown;
+    *audio_buffer_size = available;
+  }
+
+  /* Read from ring buffer and write to file */
+  uint32_t read = audio_ring_buffer_read(worker->audio_buffer, *audio_buffer, available);
+
+  sf_count_t written = sf_writef_float(worker->record_file, *audio_buffer, read);
+
+  if (written != read)
+  {
+    fprintf(stderr, "Audio write error: wrote %ld of %d frames\n",
+            written, read);
+    worker->buffer_underruns++;
+  }
+  else
+  {
+    worker->frames_written += written;
+  }
+
+  return read;
+}
+
 /* Non-RT worker thread */
 void *nonrt_worker_thread(void *arg)
 {
@@ -234,7 +323,7 @@ void *nonrt_worker_thread(void *arg)
     return NULL;
   }
 
-  while (worker->running)
+  while (atomic_load_explicit(&worker->running, memory_order_acquire))
   {
     bool did_work = false;
 
@@ -253,7 +342,17 @@ void *nonrt_worker_thread(void *arg)
           worker->record_fileinfo.format = SF_FORMAT_WAV | SF_FORMAT_FLOAT;
 
           /* Generate filename if needed */
-          if (strlen(msg.data.recording.filename) == 0)
+          if (strlen(msg.data.recording.filename) == 0 && msg.data.recording.take_time != 0)
+          {
+            /* Loop take - same name the loop file will get */
+            char loop_name[256];
+            rt_bridge_format_loop_filename(loop_name, sizeof(loop_name),
+                                           msg.data.recording.midi_note,
+                                           msg.data.recording.take_time);
+            snprintf(worker->current_filename, sizeof(worker->current_filename),
+                     "recordings/%s", loop_name);
+          }
+          else if (strlen(msg.data.recording.filename) == 0)
           {
             time_t now = time(NULL);
             struct tm *tm_info = localtime(&now);
@@ -286,12 +385,27 @@ void *nonrt_worker_thread(void *arg)
       case RT_MSG_STOP_RECORDING:
         if (worker->recording_active)
         {
+          /* Flush everything the RT thread pushed before it sent the stop */
+          uint32_t remaining = msg.data.stop.flush_idx -
+                               atomic_load_explicit(&worker->audio_buffer->read_idx, memory_order_relaxed);
+          while (remaining > 0)
+          {
+            uint32_t moved = write_ring_to_file(worker, &audio_buffer, &audio_buffer_size, remaining);
+            if (moved == 0)
+            {
+              break;
+            }
+            remaining -= moved;
+          }
+
           sf_close(worker->record_file);
           worker->record_file = NULL;
           worker->recording_active = false;
           printf("Stopped recording: %s (%lu frames written)\n",
                  worker->current_filename, worker->frames_written);
         }
+        /* Acknowledge the stop even if nothing was open so a waiter never hangs */
+        atomic_store_explicit(&worker->stop_ack_seq, msg.data.stop.seq, memory_order_release);
         break;
 
       case RT_MSG_AUDIO_LEVEL:
@@ -308,23 +422,52 @@ void *nonrt_worker_thread(void *arg)
 
       case RT_MSG_WRITE_LOOP_TO_FILE:
         /* Write completed memory loop to file */
-        if (msg.data.loop_write.audio_data && msg.data.loop_write.num_frames > 0)
+        if (msg.data.loop_write.pool && msg.data.loop_write.first_block != LOOP_POOL_NONE &&
+            msg.data.loop_write.num_frames > 0)
         {
           SF_INFO loop_fileinfo = {0};
           loop_fileinfo.samplerate = msg.data.loop_write.sample_rate;
           loop_fileinfo.channels = 1; /* Memory loops are mono */
           loop_fileinfo.format = SF_FORMAT_WAV | SF_FORMAT_FLOAT;
 
+          char loop_name[256];
+          if (msg.data.loop_write.filename[0])
+          {
+            memcpy(loop_name, msg.data.loop_write.filename, sizeof(loop_name));
+          }
+          else
+          {
+            rt_bridge_format_loop_filename(loop_name, sizeof(loop_name),
+                                           msg.data.loop_write.midi_note,
+                                           msg.data.loop_write.take_time);
+          }
+
           char loop_filepath[512];
           snprintf(loop_filepath, sizeof(loop_filepath),
-                   "recordings/%s", msg.data.loop_write.filename);
+                   "recordings/%s", loop_name);
 
           SNDFILE *loop_file = sf_open(loop_filepath, SFM_WRITE, &loop_fileinfo);
           if (loop_file)
           {
-            sf_count_t written = sf_writef_float(loop_file,
-                                                 msg.data.loop_write.audio_data,
-                                                 msg.data.loop_write.num_frames);
+            /* Walk the block chain, writing one block at a time */
+            struct loop_pool *pool = msg.data.loop_write.pool;
+            uint32_t block = msg.data.loop_write.first_block;
+            sf_count_t written = 0;
+            while (block != LOOP_POOL_NONE && written < msg.data.loop_write.num_frames)
+            {
+              sf_count_t run = msg.data.loop_write.num_frames - written;
+              if (run > pool->block_frames)
+              {
+                run = pool->block_frames;
+              }
+              sf_count_t block_written = sf_writef_float(loop_file, loop_pool_block(pool, block), run);
+              written += block_written;
+              if (block_written != run)
+              {
+                break;
+              }
+              block = pool->chain[block];
+            }
             sf_close(loop_file);
 
             if (written == msg.data.loop_write.num_frames)
@@ -344,10 +487,24 @@ void *nonrt_worker_thread(void *arg)
                     loop_filepath, sf_strerror(NULL));
           }
         }
+
+        /* Done with the chain - hand back the reference the RT thread took for us */
+        if (msg.data.loop_write.pool && msg.data.loop_write.first_block != LOOP_POOL_NONE)
+        {
+          loop_pool_chain_unref(msg.data.loop_write.pool, msg.data.loop_write.first_block,
+                                LOOP_POOL_NONE, 0);
+        }
+        break;
+
+      case RT_MSG_RUN_TASK:
+        if (msg.data.task.run)
+        {
+          msg.data.task.run(msg.data.task.arg);
+        }
         break;
 
       case RT_MSG_QUIT:
-        worker->running = false;
+        atomic_store_explicit(&worker->running, false, memory_order_release);
         break;
       }
     }
@@ -355,57 +512,45 @@ void *nonrt_worker_thread(void *arg)
     /* Process audio data from ring buffer */
     if (worker->recording_active && worker->record_file)
     {
-      uint32_t available = audio_ring_buffer_read_space(worker->audio_buffer);
-
-      if (available > 0)
+      uint64_t before = worker->frames_written;
+      if (write_ring_to_file(worker, &audio_buffer, &audio_buffer_size, UINT32_MAX) > 0)
       {
         did_work = true;
-        /* Ensure buffer is large enough */
-        if (available > audio_buffer_size)
-        {
-          audio_buffer_size = available;
-          audio_buffer = realloc(audio_buffer, audio_buffer_size * sizeof(float));
-          if (!audio_buffer)
-          {
-            fprintf(stderr, "Failed to reallocate audio buffer\n");
-            break;
-          }
-        }
 
-        /* Read from ring buffer and write to file */
-        uint32_t read = audio_ring_buffer_read(worker->audio_buffer,
-                                               audio_buffer, available);
-
-        sf_count_t written = sf_writef_float(worker->record_file,
-                                             audio_buffer, read);
-
-        if (written != read)
+        /* Sync to disk periodically (about once a second of audio) */
+        uint32_t second = worker->record_fileinfo.samplerate > 0 ? (uint32_t)worker->record_fileinfo.samplerate : 1;
+        if (worker->frames_written / second != before / second)
         {
-          fprintf(stderr, "Audio write error: wrote %ld of %d frames\n",
-                  written, read);
-          worker->buffer_underruns++;
-        }
-        else
-        {
-          worker->frames_written += written;
-        }
-
-        /* Sync to disk periodically */
-        if (worker->frames_written % 48000 == 0)
-        { /* Every ~1 second at 48kHz */
           sf_write_sync(worker->record_file);
         }
       }
     }
 
-    /* Sleep only when there's no work to do to prevent busy-wait */
+    /* Emit log records from the RT thread */
+    if (rt_log_drain(worker->log) > 0)
+    {
+      did_work = true;
+    }
+
+    /* Block until the RT thread signals more work (or the idle timeout) */
     if (!did_work)
     {
-      usleep(1000); /* 1ms - allows thread to yield CPU when idle */
+      struct pollfd pfd = {.fd = worker->wake_fd, .events = POLLIN};
+      int timeout = worker->wake_fd >= 0 ? RT_BRIDGE_IDLE_TIMEOUT_MS : 1;
+      if (poll(&pfd, 1, timeout) > 0 && (pfd.revents & POLLIN))
+      {
+        uint64_t count;
+        if (read(worker->wake_fd, &count, sizeof(count)) < 0)
+        {
+          /* EAGAIN - already consumed */
+        }
+      }
     }
   }
 
   /* Cleanup */
+  rt_log_drain(worker->log);
+
   if (worker->recording_active && worker->record_file)
   {
     sf_close(worker->record_file);
@@ -441,11 +586,28 @@ int rt_nonrt_bridge_init(struct rt_nonrt_bridge *bridge,
     return -1;
   }
 
+  /* Initialize the RT log ring (level is raised to pw_log's once PipeWire is up) */
+  if (rt_log_init(&bridge->log, RT_LOG_DEFAULT_RECORDS, SPA_LOG_LEVEL_WARN) < 0)
+  {
+    audio_ring_buffer_destroy(&bridge->audio_buffer);
+    message_queue_destroy(&bridge->msg_queue);
+    return -1;
+  }
+
+  /* Wakeup channel - without it the worker falls back to 1ms polling */
+  bridge->worker.wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (bridge->worker.wake_fd < 0)
+  {
+    fprintf(stderr, "eventfd failed, RT worker will poll\n");
+  }
+
   /* Initialize worker thread data */
   bridge->worker.audio_buffer = &bridge->audio_buffer;
   bridge->worker.msg_queue = &bridge->msg_queue;
-  bridge->worker.running = true;
+  bridge->worker.log = &bridge->log;
+  atomic_init(&bridge->worker.running, true);
   bridge->worker.recording_active = false;
+  atomic_init(&bridge->worker.stop_ack_seq, 0);
   bridge->worker.frames_written = 0;
   bridge->worker.buffer_overruns = 0;
   bridge->worker.buffer_underruns = 0;
@@ -455,11 +617,17 @@ int rt_nonrt_bridge_init(struct rt_nonrt_bridge *bridge,
   {
     audio_ring_buffer_destroy(&bridge->audio_buffer);
     message_queue_destroy(&bridge->msg_queue);
+    rt_log_destroy(&bridge->log);
+    if (bridge->worker.wake_fd >= 0)
+    {
+      close(bridge->worker.wake_fd);
+    }
     return -1;
   }
 
-  bridge->rt_recording_enabled = false;
-  bridge->rt_sample_rate = 48000;
+  atomic_store_explicit(&bridge->rt_recording_enabled, false, memory_order_relaxed);
+  atomic_init(&bridge->stop_request_seq, 0);
+  bridge->rt_sample_rate = 0; /* Set by the engine once it knows the graph rate */
   bridge->rt_channels = 1;
 
   return 0;
@@ -470,11 +638,14 @@ void rt_nonrt_bridge_destroy(struct rt_nonrt_bridge *bridge)
   if (!bridge)
     return;
 
-  /* Signal worker thread to quit */
+  /* Signal worker thread to quit. Queued behind any pending loop writes so
+     those still reach the disk; only a full queue forces it out directly. */
   struct rt_message quit_msg = {.type = RT_MSG_QUIT};
-  message_queue_push(&bridge->msg_queue, &quit_msg);
-
-  bridge->worker.running = false;
+  if (!message_queue_push(&bridge->msg_queue, &quit_msg))
+  {
+    atomic_store_explicit(&bridge->worker.running, false, memory_order_release);
+  }
+  rt_bridge_wake_worker(bridge);
 
   /* Wait for worker thread to finish */
   pthread_join(bridge->worker.thread, NULL);
@@ -482,6 +653,12 @@ void rt_nonrt_bridge_destroy(struct rt_nonrt_bridge *bridge)
   /* Cleanup */
   audio_ring_buffer_destroy(&bridge->audio_buffer);
   message_queue_destroy(&bridge->msg_queue);
+  rt_log_destroy(&bridge->log);
+  if (bridge->worker.wake_fd >= 0)
+  {
+    close(bridge->worker.wake_fd);
+    bridge->worker.wake_fd = -1;
+  }
 }
 
 void rt_nonrt_bridge_cleanup(struct rt_nonrt_bridge *bridge)
@@ -492,12 +669,13 @@ void rt_nonrt_bridge_cleanup(struct rt_nonrt_bridge *bridge)
   }
 
   /* Stop the worker thread */
-  bridge->worker.running = false;
+  atomic_store_explicit(&bridge->worker.running, false, memory_order_release);
 
   /* Send quit message to ensure thread wakes up */
   struct rt_message quit_msg = {
       .type = RT_MSG_QUIT};
   rt_bridge_send_message(bridge, &quit_msg);
+  rt_bridge_wake_worker(bridge);
 
   /* Wait for worker thread to finish */
   pthread_join(bridge->worker.thread, NULL);
@@ -522,6 +700,14 @@ void rt_nonrt_bridge_cleanup(struct rt_nonrt_bridge *bridge)
     free(bridge->msg_queue.messages);
     bridge->msg_queue.messages = NULL;
   }
+
+  rt_log_destroy(&bridge->log);
+
+  if (bridge->worker.wake_fd >= 0)
+  {
+    close(bridge->worker.wake_fd);
+    bridge->worker.wake_fd = -1;
+  }
 }
 
 /* RT-safe functions */
@@ -529,17 +715,27 @@ bool rt_bridge_push_audio(struct rt_nonrt_bridge *bridge,
                           const float *samples,
                           uint32_t n_samples)
 {
-  if (!bridge->rt_recording_enabled)
+  if (!atomic_load_explicit(&bridge->rt_recording_enabled, memory_order_relaxed))
   {
     return true; /* Not recording, no error */
   }
 
-  uint32_t written = audio_ring_buffer_write(&bridge->audio_buffer, samples, n_samples);
+  struct audio_ring_buffer *rb = &bridge->audio_buffer;
+  uint32_t written = audio_ring_buffer_write(rb, samples, n_samples);
+
+  /* Wake the worker once a batch has built up. The fill is judged against
+   * the producer's cached read index, so it can only overestimate. */
+  uint32_t filled = atomic_load_explicit(&rb->write_idx, memory_order_relaxed) - rb->cached_read_idx;
+  if (filled >= RT_BRIDGE_WAKE_AUDIO_SAMPLES)
+  {
+    bridge->wake_pending = true;
+  }
 
   if (written < n_samples)
   {
     /* Buffer overrun detected - could increment a counter here */
     bridge->worker.buffer_overruns++;
+    bridge->wake_pending = true;
     return false;
   }
 
@@ -549,17 +745,144 @@ bool rt_bridge_push_audio(struct rt_nonrt_bridge *bridge,
 bool rt_bridge_send_message(struct rt_nonrt_bridge *bridge,
                             const struct rt_message *msg)
 {
-  return message_queue_push(&bridge->msg_queue, msg);
+  if (!message_queue_push(&bridge->msg_queue, msg))
+  {
+    return false;
+  }
+  bridge->wake_pending = true;
+  return true;
+}
+
+void rt_bridge_notify(struct rt_nonrt_bridge *bridge)
+{
+  uint32_t log_idx = atomic_load_explicit(&bridge->log.write_idx, memory_order_relaxed);
+
+  if (!bridge->wake_pending && log_idx == bridge->notified_log_idx)
+  {
+    return;
+  }
+
+  bridge->wake_pending = false;
+  bridge->notified_log_idx = log_idx;
+  rt_bridge_wake_worker(bridge);
+}
+
+void rt_bridge_wake_worker(struct rt_nonrt_bridge *bridge)
+{
+  /* A non-blocking eventfd write is a bounded syscall - safe from the RT thread */
+  if (bridge->worker.wake_fd >= 0)
+  {
+    uint64_t one = 1;
+    if (write(bridge->worker.wake_fd, &one, sizeof(one)) < 0)
+    {
+      /* EAGAIN - the counter is saturated, the worker is awake anyway */
+    }
+  }
 }
 
 void rt_bridge_set_recording_enabled(struct rt_nonrt_bridge *bridge, bool enabled)
 {
-  bridge->rt_recording_enabled = enabled;
+  atomic_store_explicit(&bridge->rt_recording_enabled, enabled, memory_order_relaxed);
 }
 
 bool rt_bridge_is_recording_enabled(struct rt_nonrt_bridge *bridge)
 {
-  return bridge->rt_recording_enabled;
+  return atomic_load_explicit(&bridge->rt_recording_enabled, memory_order_relaxed);
+}
+
+bool rt_bridge_stop_recording(struct rt_nonrt_bridge *bridge)
+{
+  /* No more audio after this point - the stop carries where the data ends */
+  atomic_store_explicit(&bridge->rt_recording_enabled, false, memory_order_relaxed);
+
+  struct rt_message msg = {
+      .type = RT_MSG_STOP_RECORDING,
+      .data.stop = {
+          .flush_idx = atomic_load_explicit(&bridge->audio_buffer.write_idx, memory_order_relaxed),
+          .seq = atomic_load_explicit(&bridge->stop_request_seq, memory_order_relaxed) + 1}};
+
+  if (!rt_bridge_send_message(bridge, &msg))
+  {
+    return false;
+  }
+
+  /* Published so a non-RT thread can wait for the matching acknowledgement */
+  atomic_store_explicit(&bridge->stop_request_seq, msg.data.stop.seq, memory_order_release);
+  return true;
+}
+
+bool rt_bridge_recording_flushed(const struct rt_nonrt_bridge *bridge)
+{
+  return atomic_load_explicit(&bridge->worker.stop_ack_seq, memory_order_acquire) ==
+         atomic_load_explicit(&bridge->stop_request_seq, memory_order_acquire);
+}
+
+bool rt_bridge_wait_recording_stopped(struct rt_nonrt_bridge *bridge)
+{
+  const struct timespec pause = {.tv_sec = 0, .tv_nsec = 100000};
+
+  rt_bridge_wake_worker(bridge);
+  for (int waited = 0; waited < 10000; waited++)
+  {
+    if (rt_bridge_recording_flushed(bridge))
+    {
+      return true;
+    }
+    if (!atomic_load_explicit(&bridge->worker.running, memory_order_acquire))
+    {
+      return false;
+    }
+    nanosleep(&pause, NULL);
+  }
+  return false;
+}
+
+bool rt_bridge_wait_idle(struct rt_nonrt_bridge *bridge, uint32_t max_pending)
+{
+  const struct timespec pause = {.tv_sec = 0, .tv_nsec = 100000};
+  uint32_t last_msg_idx = 0, last_audio_idx = 0;
+  int stalled = 0;
+
+  while (atomic_load_explicit(&bridge->worker.running, memory_order_acquire))
+  {
+    uint32_t msg_idx = atomic_load_explicit(&bridge->msg_queue.read_idx, memory_order_acquire);
+    uint32_t audio_idx = atomic_load_explicit(&bridge->audio_buffer.read_idx, memory_order_acquire);
+
+    if (msg_idx == atomic_load_explicit(&bridge->msg_queue.write_idx, memory_order_acquire) &&
+        audio_ring_buffer_read_space(&bridge->audio_buffer) <= max_pending)
+    {
+      return true;
+    }
+
+    /* Nothing drains the ring while no recording file is open */
+    if (msg_idx == last_msg_idx && audio_idx == last_audio_idx)
+    {
+      if (++stalled >= 10000)
+      {
+        return false;
+      }
+    }
+    else
+    {
+      stalled = 0;
+      last_msg_idx = msg_idx;
+      last_audio_idx = audio_idx;
+    }
+
+    rt_bridge_wake_worker(bridge);
+    nanosleep(&pause, NULL);
+  }
+  return false;
+}
+
+void rt_bridge_format_loop_filename(char *buffer, size_t size, uint8_t midi_note, time_t take_time)
+{
+  struct tm tm_info;
+  localtime_r(&take_time, &tm_info);
+  snprintf(buffer, size, "loop_note_%03d_%04d-%02d-%02d_%02d-%02d-%02d.wav",
+           midi_note,
+           tm_info.tm_year + 1900, tm_info.tm_mon + 1, tm_info.tm_mday,
+           tm_info.tm_hour, tm_info.tm_min, tm_info.tm_sec);
 }
 
 /* Non-RT safe utility functions */
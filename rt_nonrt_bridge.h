@@ -2,11 +2,30 @@
 #define RT_NONRT_BRIDGE_H
 
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <sndfile.h>
-
-/* Use volatile for basic thread safety - can be upgraded to atomics later */
+#include <time.h>
+#include "loop_pool.h"
+#include "rt_log.h"
+
+/* The ring buffer and message queue are single-producer/single-consumer:
+ * the RT thread writes, the worker reads. Indices are free-running and
+ * published with release stores / observed with acquire loads, so the
+ * data copied before an index update is visible once the other side sees
+ * the new index, on weakly ordered CPUs too. Each side's index sits on
+ * its own cache line next to a cached copy of the other side's index,
+ * which is only refreshed when the cached view says full (or empty). */
+#define RT_BRIDGE_CACHE_LINE 64
+
+/* The worker blocks on an eventfd instead of polling. The RT thread marks
+ * work as it queues it and signals at most once per cycle from
+ * rt_bridge_notify(). Plain recording audio only signals once the ring
+ * holds RT_BRIDGE_WAKE_AUDIO_SAMPLES, so the worker writes in batches.
+ * The idle timeout bounds how long anything can sit unnoticed. */
+#define RT_BRIDGE_IDLE_TIMEOUT_MS 100
+#define RT_BRIDGE_WAKE_AUDIO_SAMPLES 4096
 
 /* Lock-free ring buffer for audio data */
 struct audio_ring_buffer
@@ -14,8 +33,14 @@ struct audio_ring_buffer
   float *data;
   uint32_t size; /* Power of 2 size */
   uint32_t mask; /* size - 1 for fast modulo */
-  volatile uint32_t write_idx;
-  volatile uint32_t read_idx;
+
+  /* Producer (RT thread) */
+  _Alignas(RT_BRIDGE_CACHE_LINE) _Atomic uint32_t write_idx;
+  uint32_t cached_read_idx;
+
+  /* Consumer (worker thread) */
+  _Alignas(RT_BRIDGE_CACHE_LINE) _Atomic uint32_t read_idx;
+  uint32_t cached_write_idx;
 };
 
 /* Message types for RT -> Non-RT communication */
@@ -26,7 +51,8 @@ enum rt_message_type
   RT_MSG_AUDIO_LEVEL,
   RT_MSG_ERROR,
   RT_MSG_QUIT,
-  RT_MSG_WRITE_LOOP_TO_FILE /* Write completed memory loop to file */
+  RT_MSG_WRITE_LOOP_TO_FILE, /* Write completed memory loop to file */
+  RT_MSG_RUN_TASK            /* Run a deferred job on the worker (e.g. writing a session) */
 };
 
 /* Message structure for RT -> Non-RT communication */
@@ -37,11 +63,18 @@ struct rt_message
   {
     struct
     {
-      char filename[256];
+      char filename[256]; /* Empty: named by the worker from midi_note/take_time */
       uint32_t sample_rate;
       uint32_t channels;
+      uint8_t midi_note; /* Loop being recorded (255 for a plain recording) */
+      time_t take_time;  /* Wall-clock start of the take (0 if not a loop take) */
     } recording;
     struct
+    {
+      uint32_t flush_idx; /* Ring write index at stop - worker drains up to here */
+      uint32_t seq;       /* Acknowledged through worker.stop_ack_seq once closed */
+    } stop;
+    struct
     {
       float rms_level;
     } audio_level;
@@ -51,11 +84,19 @@ struct rt_message
     } error;
     struct
     {
-      char filename[256];
-      float *audio_data;   /* Pointer to memory loop buffer */
-      uint32_t num_frames; /* Number of frames to write */
+      char filename[256];           /* Empty: named by the worker from midi_note/take_time */
+      uint8_t midi_note;
+      time_t take_time;
+      struct loop_pool *pool;       /* Pool holding the loop's block chain */
+      uint32_t first_block;         /* First block of the memory loop (referenced for the writer) */
+      uint32_t num_frames;          /* Number of frames to write */
       uint32_t sample_rate;
     } loop_write;
+    struct
+    {
+      void (*run)(void *arg); /* Called on the worker thread */
+      void *arg;
+    } task;
   } data;
 };
 
@@ -65,8 +106,14 @@ struct message_queue
   struct rt_message *messages;
   uint32_t size;
   uint32_t mask;
-  volatile uint32_t write_idx;
-  volatile uint32_t read_idx;
+
+  /* Producer (RT thread) */
+  _Alignas(RT_BRIDGE_CACHE_LINE) _Atomic uint32_t write_idx;
+  uint32_t cached_read_idx;
+
+  /* Consumer (worker thread) */
+  _Alignas(RT_BRIDGE_CACHE_LINE) _Atomic uint32_t read_idx;
+  uint32_t cached_write_idx;
 };
 
 /* Non-RT worker thread data */
@@ -75,7 +122,9 @@ struct nonrt_worker
   pthread_t thread;
   struct audio_ring_buffer *audio_buffer;
   struct message_queue *msg_queue;
-  volatile bool running;
+  struct rt_log *log;
+  int wake_fd; /* eventfd signalled when there is work, -1 to poll */
+  _Atomic bool running;
 
   /* Recording state (managed by non-RT thread) */
   SNDFILE *record_file;
@@ -83,6 +132,9 @@ struct nonrt_worker
   bool recording_active;
   char current_filename[512];
 
+  /* Stop handshake - last stop sequence whose file has been flushed and closed */
+  _Atomic uint32_t stop_ack_seq;
+
   /* Performance monitoring */
   uint64_t frames_written;
   uint64_t buffer_overruns;
@@ -94,10 +146,14 @@ struct rt_nonrt_bridge
 {
   struct audio_ring_buffer audio_buffer;
   struct message_queue msg_queue;
+  struct rt_log log; /* Deferred RT logging, emitted by the worker */
   struct nonrt_worker worker;
 
   /* RT thread state */
-  volatile bool rt_recording_enabled;
+  _Atomic bool rt_recording_enabled;
+  _Atomic uint32_t stop_request_seq; /* Last stop sequence sent by the RT thread */
+  bool wake_pending;         /* Work queued this cycle, signalled by rt_bridge_notify */
+  uint32_t notified_log_idx; /* Log ring write index at the last signal */
   uint32_t rt_sample_rate;
   uint32_t rt_channels;
 };
@@ -120,6 +176,30 @@ bool rt_bridge_send_message(struct rt_nonrt_bridge *bridge,
 void rt_bridge_set_recording_enabled(struct rt_nonrt_bridge *bridge, bool enabled);
 bool rt_bridge_is_recording_enabled(struct rt_nonrt_bridge *bridge);
 
+/* Wake the worker if anything was queued this cycle (call once at the end of each cycle) */
+void rt_bridge_notify(struct rt_nonrt_bridge *bridge);
+
+/* Wake the worker now (non-RT callers, shutdown) */
+void rt_bridge_wake_worker(struct rt_nonrt_bridge *bridge);
+
+/* Non-RT: wait until the worker has taken every queued message and the
+   recording ring holds at most max_pending samples. Gives up and returns
+   false if the worker makes no progress for a second. */
+bool rt_bridge_wait_idle(struct rt_nonrt_bridge *bridge, uint32_t max_pending);
+
+/* Send a stop that flushes everything pushed so far; returns false if the queue is full */
+bool rt_bridge_stop_recording(struct rt_nonrt_bridge *bridge);
+
+/* True once the worker has flushed and closed the file for the last stop */
+bool rt_bridge_recording_flushed(const struct rt_nonrt_bridge *bridge);
+
+/* Non-RT: wait until the last stop is acknowledged. Gives up and returns
+   false if the worker has exited or takes longer than a second. */
+bool rt_bridge_wait_recording_stopped(struct rt_nonrt_bridge *bridge);
+
+/* Name a loop take "loop_note_NNN_YYYY-MM-DD_HH-MM-SS.wav" (non-RT: uses localtime) */
+void rt_bridge_format_loop_filename(char *buffer, size_t size, uint8_t midi_note, time_t take_time);
+
 /* Non-RT safe utility functions */
 const char *rt_bridge_get_current_filename(struct rt_nonrt_bridge *bridge);
 bool rt_bridge_is_recording_active(struct rt_nonrt_bridge *bridge);
@@ -135,6 +215,8 @@ uint32_t audio_ring_buffer_write(struct audio_ring_buffer *rb,
 uint32_t audio_ring_buffer_read(struct audio_ring_buffer *rb,
                                 float *data,
                                 uint32_t samples);
+/* Consumer side: drop up to samples without copying them */
+uint32_t audio_ring_buffer_skip(struct audio_ring_buffer *rb, uint32_t samples);
 
 /* Message queue operations (lock-free) */
 int message_queue_init(struct message_queue *mq, uint32_t size);
@@ -3,75 +3,31 @@
 
 int init_rubberband(struct data *data)
 {
-  pw_log_info("DEBUG: init_rubberband called");
-
   if (!data)
   {
-    pw_log_error("DEBUG: init_rubberband failed - data is NULL");
-    return -1;
-  }
-
-  /* Get sample rate from format info */
-  uint32_t sample_rate = data->format.info.raw.rate > 0 ? data->format.info.raw.rate : 48000;
-  pw_log_info("DEBUG: Using sample rate %d for rubberband init", sample_rate);
-
-  /* Create rubberband state for realtime processing with ultra-low latency and maximum responsiveness */
-  data->rubberband_state = rubberband_new(
-      sample_rate,                            /* sample rate */
-      1,                                      /* channels (mono) */
-      RubberBandOptionProcessRealTime |       /* realtime processing */
-          RubberBandOptionTransientsCrisp |   /* crisp transients for quick response */
-          RubberBandOptionThreadingNever |    /* no threading in RT context */
-          RubberBandOptionWindowShort |       /* shorter analysis window for lower latency */
-          RubberBandOptionFormantShifted |    /* allow formant shifting for better responsiveness */
-          RubberBandOptionSmoothingOff |      /* disable smoothing for lower latency */
-          RubberBandOptionPhaseIndependent |  /* reduce phase artifacts that can cause latency */
-          RubberBandOptionPitchHighSpeed |    /* fast pitch processing for immediate response */
-          RubberBandOptionEngineFaster |      /* use faster engine for lower latency */
-          RubberBandOptionDetectorPercussive, /* percussive detector for quick parameter changes */
-      1.0,                                    /* initial time ratio (no speed change) */
-      1.0                                     /* initial pitch scale (no pitch change) */
-  );
-
-  if (!data->rubberband_state)
-  {
-    pw_log_error("DEBUG: rubberband_new failed - returned NULL");
     return -1;
   }
 
-  pw_log_info("DEBUG: rubberband_new succeeded, state=%p", data->rubberband_state);
+  /* Negotiated rate, or the one the engine was set up for */
+  uint32_t sample_rate = data->format.info.raw.rate;
+  pw_log_info("Using sample rate %d for rubberband init", sample_rate);
 
-  /* Set maximum process size to very small chunks for immediate responsiveness */
-  rubberband_set_max_process_size(data->rubberband_state, 256);
-
-  /* Set up buffer sizes - use very small buffers for maximum responsiveness */
-  /* Use minimal buffer size for rubberband to reduce latency to absolute minimum */
-  data->rubberband_buffer_size = 256; /* Even smaller buffer size for ultra-low latency */
-  if (data->max_buffer_size > 0 && data->max_buffer_size < 256)
+  /* RubberBand runs on the stretch thread, ahead of the play head - the
+     process callback only copies its output (see stretch_worker.h) */
+  if (stretch_worker_start(&data->stretch, sample_rate, &data->disk_stream, &data->rt_bridge.log) < 0)
   {
-    data->rubberband_buffer_size = data->max_buffer_size;
+    return -1;
   }
 
-  /* Allocate input and output buffers */
-  data->rubberband_input_buffer = malloc(data->rubberband_buffer_size * sizeof(float));
-  data->rubberband_output_buffer = malloc(data->rubberband_buffer_size * sizeof(float));
-
-  if (!data->rubberband_input_buffer || !data->rubberband_output_buffer)
+  /* Loops whose stretch settles are rendered offline on their own thread (see loop_freeze.h) */
+  if (loop_freeze_start(&data->freeze, &data->loop_pool, sample_rate, &data->rt_bridge.log) < 0)
   {
-    cleanup_rubberband(data);
-    return -1;
+    pw_log_warn("Loop freeze unavailable, stretched loops stay live");
   }
 
-  /* Initialize default values */
   /* Note: Do NOT reset pitch_shift here - it should be preserved from CLI settings */
   /* Note: Do NOT reset rubberband_enabled here - it should be preserved from CLI settings */
-
-  /* Apply any previously set pitch shift from CLI */
-  if (data->pitch_shift != 0.0f)
-  {
-    float pitch_scale = powf(2.0f, data->pitch_shift / 12.0f);
-    rubberband_set_pitch_scale(data->rubberband_state, pitch_scale);
-  }
+  /* Speed and pitch reach the stretcher from the mixer on every cycle */
 
   return 0;
 }
@@ -83,33 +39,19 @@ void cleanup_rubberband(struct data *data)
     return;
   }
 
-  if (data->rubberband_state)
-  {
-    rubberband_delete(data->rubberband_state);
-    data->rubberband_state = NULL;
-  }
-
-  if (data->rubberband_input_buffer)
-  {
-    free(data->rubberband_input_buffer);
-    data->rubberband_input_buffer = NULL;
-  }
-
-  if (data->rubberband_output_buffer)
-  {
-    free(data->rubberband_output_buffer);
-    data->rubberband_output_buffer = NULL;
-  }
+  /* Renders hold loop memory - drop them while the pool is still there */
+  loop_freeze_stop(&data->freeze);
+  stretch_worker_stop(&data->stretch);
 }
 
 void rubberband_reset_data(struct data *data)
 {
-  if (!data || !data->rubberband_state)
+  if (!data)
   {
     return;
   }
 
-  rubberband_reset(data->rubberband_state);
+  stretch_worker_reset(&data->stretch);
 }
 
 void set_pitch_shift(struct data *data, float semitones)
@@ -119,22 +61,8 @@ void set_pitch_shift(struct data *data, float semitones)
     return;
   }
 
+  /* Applied by the stretch thread, which re-seeks on the change */
   data->pitch_shift = semitones;
-
-  if (data->rubberband_state)
-  {
-    if (semitones == 0.0f)
-    {
-      /* Explicitly set pitch scale to 1.0 for no pitch shift */
-      rubberband_set_pitch_scale(data->rubberband_state, 1.0);
-    }
-    else
-    {
-      /* Convert semitones to pitch scale (2^(semitones/12)) */
-      float pitch_scale = powf(2.0f, semitones / 12.0f);
-      rubberband_set_pitch_scale(data->rubberband_state, pitch_scale);
-    }
-  }
 }
 
 void set_rubberband_enabled(struct data *data, bool enabled)
@@ -144,25 +72,49 @@ void set_rubberband_enabled(struct data *data, bool enabled)
     return;
   }
 
-  bool was_enabled = data->rubberband_enabled;
+  /* Switching on hands the file to the stretch thread, which starts from a
+     clean state; switching off takes it back to varispeed */
   data->rubberband_enabled = enabled;
+}
 
-  /* If we're enabling rubberband, reset it and configure parameters */
-  if (enabled && !was_enabled && data->rubberband_state)
+void set_loop_stretch(struct data *data, uint8_t midi_note, float speed, float semitones)
+{
+  if (!data || midi_note > 127)
   {
-    rubberband_reset(data->rubberband_state);
+    return;
+  }
 
-    /* Set time ratio for speed changes (inverse of playback speed) */
-    rubberband_set_time_ratio(data->rubberband_state, 1.0 / data->playback_speed);
+  /* Same range as the playback speed; the loop takes a pooled stretcher
+     the next time it is mixed away from unity and gives it back at unity */
+  if (speed < 0.1f)
+    speed = 0.1f; // Minimum 0.1x speed
+  if (speed > 8.0f)
+    speed = 8.0f; // Maximum 8x speed
 
-    /* Set pitch scale for pitch shifts (separate from speed) */
-    float pitch_scale = powf(2.0f, data->pitch_shift / 12.0f);
-    rubberband_set_pitch_scale(data->rubberband_state, pitch_scale);
+  struct memory_loop *loop = &data->memory_loops[midi_note];
+  if (speed != loop->speed || semitones != loop->pitch)
+  {
+    /* A render of the old settings is dropped; a new one waits a loop cycle */
+    loop->stretch_since = data->current_sample_frame;
+  }
+  loop->speed = speed;
+  loop->pitch = semitones;
+}
 
-    /* For speed-only changes, ensure pitch scale is exactly 1.0 to preserve pitch */
-    if (data->pitch_shift == 0.0f && data->playback_speed != 1.0f)
-    {
-      rubberband_set_pitch_scale(data->rubberband_state, 1.0);
-    }
+void set_loop_varispeed(struct data *data, uint8_t midi_note, bool enabled)
+{
+  if (!data || midi_note > 127)
+  {
+    return;
+  }
+
+  /* A varispeed loop plays its speed through the resampler and ignores its
+     pitch; its stretcher and render are dropped by the mixer */
+  struct memory_loop *loop = &data->memory_loops[midi_note];
+  if (enabled != loop->varispeed)
+  {
+    resampler_reset(&loop->resampler);
+    loop->stretch_since = data->current_sample_frame;
   }
+  loop->varispeed = enabled;
 }
@@ -0,0 +1,485 @@
+#include "session_file.h"
+#include "uphonor.h"
+#include "sync_scheduler.h"
+#include "rate_convert.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+_Static_assert(sizeof(struct session_file_header) == 96, "session header layout changed");
+_Static_assert(sizeof(struct session_file_loop) == 544, "session loop entry layout changed");
+
+static uint64_t align_up(uint64_t offset)
+{
+  return (offset + SESSION_FILE_ALIGN - 1) & ~(uint64_t)(SESSION_FILE_ALIGN - 1);
+}
+
+bool session_file_is_binary(const char *filename)
+{
+  size_t len = strlen(filename);
+  size_t ext = strlen(SESSION_FILE_EXTENSION);
+  return len > ext && strcmp(filename + len - ext, SESSION_FILE_EXTENSION) == 0;
+}
+
+/* Copy the settings and loop index and reference every indexed chain.
+   Bounded work with no allocation, so the process callback can call it. */
+static void session_snapshot_take(struct data *data, struct session_saver *saver)
+{
+  struct session_file_header *header = &saver->header;
+  memset(header, 0, sizeof(*header));
+  memcpy(header->magic, SESSION_FILE_MAGIC, sizeof(header->magic));
+  header->version = SESSION_FILE_VERSION;
+  header->header_size = sizeof(struct session_file_header);
+  header->loop_entry_size = sizeof(struct session_file_loop);
+  header->data_alignment = SESSION_FILE_ALIGN;
+  header->sample_rate = data->rt_bridge.rt_sample_rate;
+  header->volume = data->volume;
+  header->playback_speed = data->playback_speed;
+  header->pitch_shift = data->pitch_shift;
+  header->sync_cutoff_percentage = data->sync_cutoff_percentage;
+  header->sync_recording_cutoff_percentage = data->sync_recording_cutoff_percentage;
+  header->pulse_loop_duration = data->pulse_loop_duration;
+  header->holo_state = (uint8_t)data->current_state;
+  header->playback_mode = (uint8_t)data->current_playback_mode;
+  header->sync_mode_enabled = data->sync_mode_enabled;
+  header->rubberband_enabled = data->rubberband_enabled;
+  header->pulse_loop_note = data->pulse_loop_note;
+
+  uint32_t count = 0;
+  for (int i = 0; i < 128; i++)
+  {
+    struct memory_loop *loop = &data->memory_loops[i];
+
+    // Only finished takes - a loop being recorded or loaded has nothing stable to save
+    if (!loop->loop_ready || loop->recorded_frames == 0 || loop->first_block == LOOP_POOL_NONE ||
+        loop->current_state == LOOP_STATE_RECORDING || session_loader_loading(&data->session_loader, i))
+      continue;
+
+    struct session_file_loop *entry = &saver->loops[count];
+    memset(entry, 0, sizeof(*entry));
+    entry->take_time = loop->take_time;
+    entry->frames = loop->recorded_frames;
+    entry->sample_rate = loop->sample_rate;
+    entry->volume = loop->volume;
+    entry->midi_note = loop->midi_note;
+    entry->state = (uint8_t)loop->current_state;
+    memcpy(entry->filename, loop->loop_filename, sizeof(entry->filename));
+
+    /* Chains only grow and a new take starts a new chain, so the first
+       frames frames stay as they are while we hold a reference */
+    loop_pool_chain_ref(&data->loop_pool, loop->first_block);
+    saver->first_block[count++] = loop->first_block;
+  }
+  header->loop_count = count;
+  saver->loop_count = count;
+}
+
+static void session_snapshot_release(struct data *data, struct session_saver *saver)
+{
+  for (uint32_t i = 0; i < saver->loop_count; i++)
+  {
+    loop_pool_chain_unref(&data->loop_pool, saver->first_block[i], LOOP_POOL_NONE, 0);
+  }
+  saver->loop_count = 0;
+}
+
+static bool write_at(int fd, const void *buf, size_t size, uint64_t offset)
+{
+  const char *p = buf;
+  while (size > 0)
+  {
+    ssize_t n = pwrite(fd, p, size, (off_t)offset);
+    if (n < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    p += n;
+    size -= (size_t)n;
+    offset += (uint64_t)n;
+  }
+  return true;
+}
+
+static int session_file_write(struct data *data, struct session_saver *saver)
+{
+  struct loop_pool *pool = &data->loop_pool;
+  struct session_file_header *header = &saver->header;
+
+  /* Lay the samples out after the index, each loop on an aligned offset */
+  uint64_t offset = header->header_size + (uint64_t)saver->loop_count * header->loop_entry_size;
+  header->file_size = offset;
+  for (uint32_t i = 0; i < saver->loop_count; i++)
+  {
+    offset = align_up(offset);
+    saver->loops[i].data_offset = offset;
+    offset += (uint64_t)saver->loops[i].frames * sizeof(float);
+    header->file_size = offset;
+  }
+
+  /* Written beside the target and renamed over it, so a reader only ever
+     sees a complete file */
+  char tmp_path[1100];
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", saver->filename);
+  int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0)
+  {
+    fprintf(stderr, "Could not create session file %s: %s\n", tmp_path, strerror(errno));
+    return -1;
+  }
+
+  bool ok = write_at(fd, header, sizeof(*header), 0) &&
+            write_at(fd, saver->loops, (size_t)saver->loop_count * sizeof(saver->loops[0]),
+                     header->header_size);
+
+  for (uint32_t i = 0; ok && i < saver->loop_count; i++)
+  {
+    /* Walk the chain, one block per write */
+    struct session_file_loop *entry = &saver->loops[i];
+    uint32_t block = saver->first_block[i];
+    uint32_t written = 0;
+    while (ok && written < entry->frames && block != LOOP_POOL_NONE)
+    {
+      uint32_t run = entry->frames - written;
+      if (run > pool->block_frames)
+      {
+        run = pool->block_frames;
+      }
+      ok = write_at(fd, loop_pool_block(pool, block), run * sizeof(float),
+                    entry->data_offset + (uint64_t)written * sizeof(float));
+      written += run;
+      block = pool->chain[block];
+    }
+    ok = ok && written == entry->frames;
+  }
+
+  // The last loop's samples end the file; make sure the size matches the header
+  ok = ok && ftruncate(fd, (off_t)header->file_size) == 0;
+
+  if (close(fd) != 0)
+  {
+    ok = false;
+  }
+  if (!ok || rename(tmp_path, saver->filename) != 0)
+  {
+    fprintf(stderr, "Could not write session file %s: %s\n", saver->filename, strerror(errno));
+    unlink(tmp_path);
+    return -1;
+  }
+
+  printf("Saved session to %s: %u loops, %.1f MB\n", saver->filename, saver->loop_count,
+         header->file_size / (1024.0 * 1024.0));
+  return 0;
+}
+
+/* Runs on the bridge worker with the snapshot the process callback took */
+static void session_file_write_task(void *arg)
+{
+  struct session_saver *saver = arg;
+
+  saver->result = session_file_write(saver->data, saver);
+  session_snapshot_release(saver->data, saver);
+  atomic_store_explicit(&saver->state, SESSION_SAVE_DONE, memory_order_release);
+}
+
+void session_file_snapshot_rt(struct data *data)
+{
+  struct session_saver *saver = &data->session_saver;
+
+  if (atomic_load_explicit(&saver->state, memory_order_relaxed) != SESSION_SAVE_REQUESTED)
+    return;
+
+  int expected = SESSION_SAVE_REQUESTED;
+  if (!atomic_compare_exchange_strong_explicit(&saver->state, &expected, SESSION_SAVE_WRITING,
+                                               memory_order_acquire, memory_order_relaxed))
+    return;
+
+  session_snapshot_take(data, saver);
+
+  struct rt_message msg = {
+      .type = RT_MSG_RUN_TASK,
+      .data.task = {.run = session_file_write_task, .arg = saver}};
+  if (!rt_bridge_send_message(&data->rt_bridge, &msg))
+  {
+    rt_log_warn(&data->rt_bridge.log, "Message queue full, session not saved");
+    // Drop the references again - the chains are exactly as the loops have them now
+    for (uint32_t i = 0; i < saver->loop_count; i++)
+    {
+      struct memory_loop *loop = &data->memory_loops[saver->loops[i].midi_note];
+      loop_pool_chain_unref(&data->loop_pool, saver->first_block[i], loop->last_block, loop->block_count);
+    }
+    saver->loop_count = 0;
+    saver->result = -1;
+    atomic_store_explicit(&saver->state, SESSION_SAVE_DONE, memory_order_release);
+  }
+}
+
+int session_file_save(struct data *data, const char *filename)
+{
+  struct session_saver *saver = &data->session_saver;
+
+  int expected = SESSION_SAVE_IDLE;
+  if (!atomic_compare_exchange_strong(&saver->state, &expected, SESSION_SAVE_CLAIMED))
+  {
+    fprintf(stderr, "A session save is already in progress\n");
+    return -1;
+  }
+
+  saver->data = data;
+  snprintf(saver->filename, sizeof(saver->filename), "%s", filename);
+  atomic_store_explicit(&saver->state, SESSION_SAVE_REQUESTED, memory_order_release);
+
+  // The process callback takes the snapshot at its next cycle boundary
+  for (int waited_ms = 0;; waited_ms++)
+  {
+    int state = atomic_load_explicit(&saver->state, memory_order_acquire);
+    if (state == SESSION_SAVE_DONE)
+      break;
+
+    if (state == SESSION_SAVE_REQUESTED && waited_ms >= SESSION_FILE_SNAPSHOT_TIMEOUT_MS)
+    {
+      // No cycle ran (not connected yet, or suspended) - nothing else touches
+      // the loops, so take the snapshot and write it from here
+      expected = SESSION_SAVE_REQUESTED;
+      if (atomic_compare_exchange_strong(&saver->state, &expected, SESSION_SAVE_WRITING))
+      {
+        session_snapshot_take(data, saver);
+        session_file_write_task(saver);
+        break;
+      }
+    }
+
+    usleep(1000);
+  }
+
+  int result = saver->result;
+  atomic_store_explicit(&saver->state, SESSION_SAVE_IDLE, memory_order_release);
+  return result;
+}
+
+/* A loop's floats in the mapping, read through by rate conversion */
+struct mapped_loop_source
+{
+  const float *samples;
+  uint32_t frames;
+  uint32_t position;
+};
+
+static uint32_t mapped_loop_pull(void *ctx, float *buf, uint32_t frames)
+{
+  struct mapped_loop_source *source = ctx;
+  uint32_t n = source->frames - source->position;
+  if (n > frames)
+  {
+    n = frames;
+  }
+  memcpy(buf, source->samples + source->position, n * sizeof(float));
+  source->position += n;
+  return n;
+}
+
+/* Check everything the loader relies on before touching the engine */
+static const struct session_file_header *session_file_validate(const void *map, size_t size)
+{
+  const struct session_file_header *header = map;
+  if (size < sizeof(*header) || memcmp(header->magic, SESSION_FILE_MAGIC, sizeof(header->magic)) != 0)
+  {
+    fprintf(stderr, "Not a uPhonor session file\n");
+    return NULL;
+  }
+  if (header->version != SESSION_FILE_VERSION || header->header_size != sizeof(*header) ||
+      header->loop_entry_size != sizeof(struct session_file_loop))
+  {
+    fprintf(stderr, "Unsupported session file version %u\n", header->version);
+    return NULL;
+  }
+  if (header->file_size != size || header->loop_count > 128 ||
+      header->header_size + (uint64_t)header->loop_count * header->loop_entry_size > size)
+  {
+    fprintf(stderr, "Session file is truncated or corrupt\n");
+    return NULL;
+  }
+
+  const struct session_file_loop *loops = (const void *)((const char *)map + header->header_size);
+  for (uint32_t i = 0; i < header->loop_count; i++)
+  {
+    if (loops[i].midi_note > 127 || loops[i].data_offset % sizeof(float) != 0 ||
+        loops[i].data_offset > size || (uint64_t)loops[i].frames * sizeof(float) > size - loops[i].data_offset)
+    {
+      fprintf(stderr, "Session file loop %u is corrupt\n", i);
+      return NULL;
+    }
+  }
+  return header;
+}
+
+int session_file_load(struct data *data, const char *filename)
+{
+  struct timespec started;
+  clock_gettime(CLOCK_MONOTONIC, &started);
+
+  int fd = open(filename, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+  {
+    fprintf(stderr, "Could not open session file %s: %s\n", filename, strerror(errno));
+    return -1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0)
+  {
+    fprintf(stderr, "Session file %s is empty\n", filename);
+    close(fd);
+    return -1;
+  }
+
+  /* Populated up front: the copies below then run at memory speed */
+  size_t size = (size_t)st.st_size;
+  void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+  {
+    fprintf(stderr, "Could not map session file %s: %s\n", filename, strerror(errno));
+    return -1;
+  }
+
+  const struct session_file_header *header = session_file_validate(map, size);
+  if (!header)
+  {
+    munmap(map, size);
+    return -1;
+  }
+
+  /* Loops saved at another rate are converted to the graph rate as they are
+     copied in. Not cached - the mapping is as fast to convert as a cached
+     file would be to read. */
+  uint32_t graph_rate = data->format.info.raw.rate;
+  float *scratch = NULL;
+  if (header->sample_rate != graph_rate)
+  {
+    scratch = malloc(RATE_CONVERT_SCRATCH_FRAMES * sizeof(float));
+    printf("Session sample rate is %u Hz, converting to %u Hz\n", header->sample_rate, graph_rate);
+  }
+
+  // Loops still loading from an earlier session must be in before they are replaced
+  session_loader_wait(data);
+
+  /* Global state */
+  data->volume = header->volume;
+  data->playback_speed = header->playback_speed;
+  data->pitch_shift = header->pitch_shift;
+  data->rubberband_enabled = header->rubberband_enabled;
+  data->sync_mode_enabled = header->sync_mode_enabled;
+  data->current_state = (enum holo_state)header->holo_state;
+  data->current_playback_mode = (enum playback_mode)header->playback_mode;
+  data->pulse_loop_note = header->pulse_loop_note > 127 ? 255 : header->pulse_loop_note;
+  data->pulse_loop_duration = header->pulse_loop_duration;
+  if (scratch && rate_convert_supported(header->sample_rate, graph_rate))
+  {
+    data->pulse_loop_duration = rate_convert_frames(header->pulse_loop_duration, header->sample_rate, graph_rate);
+  }
+  data->sync_cutoff_percentage = header->sync_cutoff_percentage;
+  data->sync_recording_cutoff_percentage = header->sync_recording_cutoff_percentage;
+  // The process callback restarts the pulse timeline for the new duration
+  sync_scheduler_reset(data);
+
+  const struct session_file_loop *loops = (const void *)((const char *)map + header->header_size);
+  bool in_session[128] = {false};
+  for (uint32_t i = 0; i < header->loop_count; i++)
+  {
+    in_session[loops[i].midi_note] = true;
+  }
+
+  /* Loops not in the session are cleared and give their memory back */
+  for (int i = 0; i < 128; i++)
+  {
+    if (!in_session[i])
+    {
+      clear_memory_loop(data, i);
+    }
+  }
+
+  uint32_t loaded = 0;
+  uint64_t bytes = 0;
+  for (uint32_t i = 0; i < header->loop_count; i++)
+  {
+    const struct session_file_loop *entry = &loops[i];
+    uint8_t note = entry->midi_note;
+    struct memory_loop *loop = &data->memory_loops[note];
+
+    // Hidden until the next cycle publishes it; the old take's chain is
+    // dropped so the session's audio starts a fresh one
+    session_loader_hide(data, note);
+    set_loop_pending_record(data, loop, false);
+    set_loop_pending_stop(data, loop, false);
+    set_loop_pending_start(data, loop, false);
+    release_loop_memory(data, note);
+
+    loop->current_state = entry->state == LOOP_STATE_RECORDING ? LOOP_STATE_IDLE
+                                                                : (enum loop_state)entry->state;
+    loop->volume = entry->volume;
+    loop->sample_rate = entry->sample_rate;
+    loop->take_time = (time_t)entry->take_time;
+    loop->recording_to_memory = false;
+    memcpy(loop->loop_filename, entry->filename, sizeof(loop->loop_filename));
+    loop->loop_filename[sizeof(loop->loop_filename) - 1] = '\0';
+
+    /* Raw floats - one copy from the mapping into the loop's chain */
+    const float *samples = (const float *)((const char *)map + entry->data_offset);
+    bool convert = entry->sample_rate != graph_rate;
+    if (convert && (!scratch || !rate_convert_supported(entry->sample_rate, graph_rate)))
+    {
+      printf("Warning: Cannot convert loop %d from %u Hz to %u Hz, loading it as is\n",
+             note, entry->sample_rate, graph_rate);
+      convert = false;
+    }
+
+    uint32_t frames = convert ? rate_convert_frames(entry->frames, entry->sample_rate, graph_rate) : entry->frames;
+    uint32_t stored = 0;
+    if (acquire_loop_memory(data, note))
+    {
+      if (convert)
+      {
+        struct mapped_loop_source source = {samples, entry->frames, 0};
+        stored = rate_convert_into_loop(data, loop, mapped_loop_pull, &source, entry->sample_rate, graph_rate,
+                                        frames, scratch, NULL);
+        loop->sample_rate = graph_rate;
+      }
+      else
+      {
+        stored = loop_storage_append(data, loop, samples, entry->frames);
+      }
+    }
+    if (stored < frames)
+    {
+      printf("Warning: Not enough loop memory for loop %d, kept %u of %u frames\n",
+             note, stored, frames);
+    }
+
+    session_loader_complete(data, note, stored > 0);
+    if (stored > 0)
+    {
+      loaded++;
+      bytes += (uint64_t)stored * sizeof(float);
+    }
+  }
+
+  uint32_t loop_count = header->loop_count;
+  munmap(map, size);
+  free(scratch);
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  double elapsed_ms = (now.tv_sec - started.tv_sec) * 1e3 + (now.tv_nsec - started.tv_nsec) / 1e6;
+  printf("Loaded session %s: %u of %u loops, %.1f MB in %.1f ms\n", filename, loaded,
+         loop_count, bytes / (1024.0 * 1024.0), elapsed_ms);
+
+  return 0;
+}
@@ -0,0 +1,111 @@
+#ifndef SESSION_FILE_H
+#define SESSION_FILE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Single-file binary sessions (.uphs).
+ *
+ * A session file holds the global settings, an index of the loops that have
+ * audio and each loop's samples as raw mono floats, every loop starting on a
+ * SESSION_FILE_ALIGN boundary:
+ *
+ *   header | loop index (loop_count entries) | pad | loop 0 samples | pad | ...
+ *
+ * Saving takes a snapshot at a cycle boundary in the process callback: the
+ * settings and loop index are copied and every loop's block chain gets an
+ * extra reference, so recording or clearing a loop afterwards cannot change
+ * what is saved. The bridge worker then writes the file next to its target
+ * and renames it into place.
+ *
+ * Loading maps the file and copies each loop's samples straight into its
+ * block chain - there is nothing to decode. Loops are published through the
+ * session loader, so they come online at the next cycle.
+ *
+ * Fields are in host byte order; the version guards the layout. */
+
+#define SESSION_FILE_MAGIC "UPHSESS"   /* 8 bytes with the terminator */
+#define SESSION_FILE_VERSION 1
+#define SESSION_FILE_ALIGN 4096        /* Alignment of each loop's samples in the file */
+#define SESSION_FILE_EXTENSION ".uphs"
+#define SESSION_FILE_NAME_SIZE 512     /* Matches memory_loop.loop_filename */
+#define SESSION_FILE_SNAPSHOT_TIMEOUT_MS 200 /* Without a cycle by then the saver takes the snapshot itself */
+
+struct data;
+
+struct session_file_header
+{
+  char magic[8];            /* SESSION_FILE_MAGIC */
+  uint32_t version;         /* SESSION_FILE_VERSION */
+  uint32_t header_size;     /* sizeof(struct session_file_header) */
+  uint32_t loop_entry_size; /* sizeof(struct session_file_loop) */
+  uint32_t loop_count;      /* Index entries following the header */
+  uint32_t data_alignment;  /* SESSION_FILE_ALIGN at save time */
+  uint32_t sample_rate;     /* Engine rate the session was saved at */
+  uint64_t file_size;       /* Total size, catches truncated files */
+
+  /* Global state */
+  float volume;
+  float playback_speed;
+  float pitch_shift;
+  float sync_cutoff_percentage;
+  float sync_recording_cutoff_percentage;
+  uint32_t pulse_loop_duration;
+  uint8_t holo_state;    /* enum holo_state */
+  uint8_t playback_mode; /* enum playback_mode */
+  uint8_t sync_mode_enabled;
+  uint8_t rubberband_enabled;
+  uint8_t pulse_loop_note;
+  uint8_t reserved[27];
+};
+
+struct session_file_loop
+{
+  uint64_t data_offset; /* Aligned offset of the loop's samples */
+  int64_t take_time;    /* Wall-clock start of the take, names it if filename is empty */
+  uint32_t frames;      /* Mono float frames at data_offset */
+  uint32_t sample_rate;
+  float volume;
+  uint8_t midi_note;
+  uint8_t state; /* enum loop_state */
+  uint8_t reserved[2];
+  char filename[SESSION_FILE_NAME_SIZE];
+};
+
+enum session_save_state
+{
+  SESSION_SAVE_IDLE,
+  SESSION_SAVE_CLAIMED,   /* A requester is filling in the request */
+  SESSION_SAVE_REQUESTED, /* Waiting for the process callback to take the snapshot */
+  SESSION_SAVE_WRITING,   /* Snapshot taken, the worker is writing it */
+  SESSION_SAVE_DONE       /* result holds the outcome */
+};
+
+/* One save in flight and the snapshot it writes */
+struct session_saver
+{
+  _Atomic int state; /* enum session_save_state */
+  int result;        /* 0 or -1, valid once DONE */
+  struct data *data;
+  char filename[1024];
+
+  struct session_file_header header;
+  uint32_t loop_count;
+  struct session_file_loop loops[128];
+  uint32_t first_block[128]; /* Referenced chain of each indexed loop */
+};
+
+/* Non-RT: save the running session to filename and wait until it is written */
+int session_file_save(struct data *data, const char *filename);
+
+/* Non-RT: replace the session with the one in filename */
+int session_file_load(struct data *data, const char *filename);
+
+/* RT: take the snapshot for a pending save (call at the start of each cycle) */
+void session_file_snapshot_rt(struct data *data);
+
+/* True if filename names a binary session */
+bool session_file_is_binary(const char *filename);
+
+#endif /* SESSION_FILE_H */
@@ -0,0 +1,233 @@
+#include "session_loader.h"
+#include "uphonor.h"
+#include "config.h"
+#include "sync_scheduler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static void session_loader_finish_job(struct session_loader *sl)
+{
+  // Whoever finishes the last file reports the whole load
+  if (atomic_fetch_add_explicit(&sl->jobs_finished, 1, memory_order_acq_rel) + 1 == sl->job_count)
+  {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double elapsed = (now.tv_sec - sl->started.tv_sec) + (now.tv_nsec - sl->started.tv_nsec) / 1e9;
+    printf("Audio loading complete: %d files loaded, %d failed in %.2f s\n",
+           atomic_load(&sl->files_loaded), atomic_load(&sl->files_failed), elapsed);
+  }
+}
+
+static void *session_loader_thread(void *arg)
+{
+  struct session_loader *sl = arg;
+  struct data *data = sl->data;
+  struct session_chunk chunk = {NULL, 0, NULL};
+
+  for (;;)
+  {
+    uint32_t job = atomic_fetch_add_explicit(&sl->next_job, 1, memory_order_relaxed);
+    if (job >= sl->job_count)
+      break;
+
+    uint8_t note = sl->jobs[job];
+    struct memory_loop *loop = &data->memory_loops[note];
+
+    /* Try to load from recordings directory first, then the current directory */
+    char full_path[1024];
+    snprintf(full_path, sizeof(full_path), "recordings/%s", loop->loop_filename);
+
+    /* Loaded at the graph rate, whatever rate the take was saved at */
+    uint32_t rate = data->format.info.raw.rate;
+    bool loaded = load_audio_file_into_loop(data, loop, full_path, rate, &chunk) ||
+                  load_audio_file_into_loop(data, loop, loop->loop_filename, rate, &chunk);
+    if (loaded)
+    {
+      atomic_fetch_add_explicit(&sl->files_loaded, 1, memory_order_relaxed);
+    }
+    else
+    {
+      printf("Loop %d: Audio file '%s' failed to load, resetting to IDLE\n", note, loop->loop_filename);
+      atomic_fetch_add_explicit(&sl->files_failed, 1, memory_order_relaxed);
+    }
+    session_loader_complete(data, note, loaded);
+
+    session_loader_finish_job(sl);
+  }
+
+  free(chunk.samples);
+  free(chunk.scratch);
+  return NULL;
+}
+
+void session_loader_hide(struct data *data, uint8_t note)
+{
+  struct session_loader *sl = &data->session_loader;
+  struct memory_loop *loop = &data->memory_loops[note];
+
+  // Keep MIDI off the loop and hide it from the mixer until it is published
+  atomic_fetch_or_explicit(&sl->loading[note >> 6], UINT64_C(1) << (note & 63), memory_order_release);
+  loop->loop_ready = false;
+  set_loop_playing(data, loop, false);
+
+  /* The saved length is only trusted once the audio is actually loaded */
+  loop->recorded_frames = 0;
+
+  /* RECORDING state should not be restored - always start fresh */
+  if (loop->current_state == LOOP_STATE_RECORDING)
+  {
+    loop->current_state = LOOP_STATE_IDLE;
+    printf("Loop %d: Recording state not restored, set to IDLE\n", note);
+  }
+}
+
+void session_loader_complete(struct data *data, uint8_t note, bool loaded)
+{
+  struct session_loader *sl = &data->session_loader;
+  uint64_t bit = UINT64_C(1) << (note & 63);
+
+  if (loaded)
+  {
+    // Storage and length are complete - hand the loop to the process callback
+    atomic_fetch_or_explicit(&sl->done[note >> 6], bit, memory_order_release);
+    return;
+  }
+
+  struct memory_loop *loop = &data->memory_loops[note];
+  loop->recorded_frames = 0;
+  loop->current_state = LOOP_STATE_IDLE;
+  /* Clear the filename since the audio couldn't be loaded */
+  memset(loop->loop_filename, 0, sizeof(loop->loop_filename));
+  release_loop_memory(data, note);
+
+  // Never published, so MIDI may use the slot right away
+  atomic_fetch_and_explicit(&sl->loading[note >> 6], ~bit, memory_order_release);
+}
+
+int session_loader_start(struct data *data)
+{
+  struct session_loader *sl = &data->session_loader;
+
+  // A previous load has to finish before its loops are touched again
+  session_loader_wait(data);
+
+  sl->data = data;
+  sl->job_count = 0;
+  atomic_store(&sl->next_job, 0);
+  atomic_store(&sl->jobs_finished, 0);
+  atomic_store(&sl->files_loaded, 0);
+  atomic_store(&sl->files_failed, 0);
+
+  for (int i = 0; i < 128; i++)
+  {
+    struct memory_loop *loop = &data->memory_loops[i];
+
+    /* Skip loops that have no filename */
+    if (loop->loop_filename[0] == '\0')
+      continue;
+
+    session_loader_hide(data, i);
+
+    /* Loops only own memory once armed - take a block for the restored audio */
+    if (!acquire_loop_memory(data, i))
+    {
+      printf("No loop memory available for loop %d: %s\n", i, loop->loop_filename);
+      atomic_fetch_add_explicit(&sl->files_failed, 1, memory_order_relaxed);
+      session_loader_complete(data, i, false);
+      continue;
+    }
+
+    sl->jobs[sl->job_count++] = (uint8_t)i;
+  }
+
+  if (sl->job_count == 0)
+  {
+    printf("Audio loading complete: 0 files loaded, %d failed\n", atomic_load(&sl->files_failed));
+    return 0;
+  }
+
+  // Decoding is mostly I/O and libsndfile work, a few threads saturate the disk
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  uint32_t threads = cpus > 0 ? (uint32_t)cpus : 1;
+  if (threads > SESSION_LOADER_MAX_THREADS)
+    threads = SESSION_LOADER_MAX_THREADS;
+  if (threads > sl->job_count)
+    threads = sl->job_count;
+
+  clock_gettime(CLOCK_MONOTONIC, &sl->started);
+  printf("Loading %u loop files on %u threads, loops come online as they finish\n",
+         sl->job_count, threads);
+
+  for (uint32_t t = 0; t < threads; t++)
+  {
+    if (pthread_create(&sl->threads[sl->thread_count], NULL, session_loader_thread, sl) != 0)
+    {
+      pw_log_warn("session loader: could only start %u of %u threads", sl->thread_count, threads);
+      break;
+    }
+    sl->thread_count++;
+  }
+
+  if (sl->thread_count == 0)
+  {
+    // No thread at all - load everything here instead
+    session_loader_thread(sl);
+  }
+
+  return (int)sl->job_count;
+}
+
+int session_loader_wait(struct data *data)
+{
+  struct session_loader *sl = &data->session_loader;
+
+  for (uint32_t t = 0; t < sl->thread_count; t++)
+  {
+    pthread_join(sl->threads[t], NULL);
+  }
+  sl->thread_count = 0;
+
+  return atomic_load(&sl->files_loaded);
+}
+
+void session_loader_publish_rt(struct data *data)
+{
+  struct session_loader *sl = &data->session_loader;
+
+  for (int word = 0; word < 2; word++)
+  {
+    // Nothing finished - the common case costs one load per word
+    if (atomic_load_explicit(&sl->done[word], memory_order_relaxed) == 0)
+      continue;
+
+    uint64_t bits = atomic_exchange_explicit(&sl->done[word], 0, memory_order_acquire);
+    while (bits)
+    {
+      uint8_t note = (uint8_t)(word * 64 + __builtin_ctzll(bits));
+      uint64_t bit = bits & -bits;
+      bits &= bits - 1;
+
+      struct memory_loop *loop = &data->memory_loops[note];
+      loop->loop_ready = true;
+
+      // In sync mode the loop joins the pulse grid where it is now
+      uint32_t position = 0;
+      if (data->sync_mode_enabled)
+      {
+        position = get_theoretical_pulse_position(data) % loop->recorded_frames;
+      }
+      loop_storage_seek(data, loop, position);
+
+      if (loop->current_state == LOOP_STATE_PLAYING)
+      {
+        set_loop_playing(data, loop, true);
+      }
+
+      atomic_fetch_and_explicit(&sl->loading[word], ~bit, memory_order_release);
+      rt_log_info(&data->rt_bridge.log, "Loop %d online: %u frames, %s", note, loop->recorded_frames,
+                  loop->is_playing ? "playing" : "stopped");
+    }
+  }
+}
@@ -0,0 +1,77 @@
+#ifndef SESSION_LOADER_H
+#define SESSION_LOADER_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+/* Parallel, progressive loading of session loop audio.
+ *
+ * config_load_audio_files() queues every loop with a file and returns. A
+ * few loader threads claim loops from the queue and decode each file
+ * straight into the loop's block chain through one small reusable chunk
+ * buffer per thread. Files saved at another sample rate are converted to
+ * the graph's on the way (see rate_convert.h). A loop stays hidden from the
+ * RT side (not ready, not playing, MIDI ignored) while its file loads; when
+ * it completes the loader sets the loop's bit in done and the process
+ * callback publishes it at the start of the next cycle. The engine runs
+ * from the start and loops come online one by one as their files finish. */
+
+#define SESSION_LOADER_MAX_THREADS 8
+#define SESSION_LOADER_CHUNK_FRAMES 4096 /* Frames decoded per read */
+
+struct data;
+
+/* Decode buffer owned by one loader thread, grown to the widest file it meets */
+struct session_chunk
+{
+  float *samples;    /* SESSION_LOADER_CHUNK_FRAMES interleaved frames */
+  uint32_t channels; /* Channel count samples is sized for */
+  float *scratch;    /* Sample-rate conversion scratch, allocated by the first file that needs it */
+};
+
+struct session_loader
+{
+  struct data *data;
+  pthread_t threads[SESSION_LOADER_MAX_THREADS];
+  uint32_t thread_count;
+
+  uint8_t jobs[128]; /* Notes of the queued loops */
+  uint32_t job_count;
+  _Atomic uint32_t next_job;      /* Next entry of jobs to claim */
+  _Atomic uint32_t jobs_finished; /* Jobs loaded or failed */
+  struct timespec started;
+
+  _Atomic int files_loaded;
+  _Atomic int files_failed;
+
+  _Atomic uint64_t loading[2]; /* Loops with a load in flight or not yet published */
+  _Atomic uint64_t done[2];    /* Loaded loops waiting for the process callback */
+};
+
+/* Non-RT: load the audio of every loop with a filename in the background.
+   Returns the number of files queued. */
+int session_loader_start(struct data *data);
+
+/* Non-RT: wait for the loader threads; returns files loaded by the last start */
+int session_loader_wait(struct data *data);
+
+/* Non-RT: hide note's loop from the RT side before its audio is replaced */
+void session_loader_hide(struct data *data, uint8_t note);
+
+/* Non-RT: finish a hidden loop. A loaded loop is published at the next cycle;
+   one that failed is reset to IDLE and its memory returned. */
+void session_loader_complete(struct data *data, uint8_t note, bool loaded);
+
+/* RT: bring the loops loaded since the last cycle online */
+void session_loader_publish_rt(struct data *data);
+
+/* True while note's loop is being loaded - MIDI must leave it alone */
+static inline bool session_loader_loading(struct session_loader *sl, uint8_t note)
+{
+  return (atomic_load_explicit(&sl->loading[note >> 6], memory_order_acquire) >> (note & 63)) & 1;
+}
+
+#endif /* SESSION_LOADER_H */
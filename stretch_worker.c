@@ -0,0 +1,736 @@
+#include "stretch_worker.h"
+#include "uphonor.h"
+#include "mix_kernels.h"
+#include <math.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#define STRETCH_MIX_BLOCK 1024 /* Frames the RT side copies per pass */
+#define STRETCH_MAX_PASSES 64  /* Process/retrieve calls per stretcher per service pass */
+
+static uint32_t stretch_pull_disk(void *ctx, float *buf, uint32_t frames)
+{
+  // The stretch thread only gets here while it owns the disk ring
+  return disk_stream_read_rt(ctx, buf, frames, 1.0f);
+}
+
+static uint32_t stretch_pull_loop(void *ctx, float *buf, uint32_t frames)
+{
+  // The chain is referenced for as long as the loop holds the stretcher
+  struct stretcher *st = ctx;
+  uint32_t got = 0;
+
+  while (got < frames)
+  {
+    if (st->position >= st->frames)
+    {
+      st->position = 0; /* Loop back to beginning */
+    }
+
+    uint32_t span;
+    const float *src = loop_pool_seek(st->pool, st->first_block, &st->cursor, st->position, &span);
+    uint32_t run = SPA_MIN(frames - got, span);
+    run = SPA_MIN(run, st->frames - st->position);
+
+    memcpy(buf + got, src, run * sizeof(float));
+    st->position += run;
+    got += run;
+  }
+  return got;
+}
+
+static RubberBandState stretch_new_state(uint32_t sample_rate)
+{
+  /* Realtime mode, tuned for responsiveness. The thread is not the RT
+     thread, so the cost of a call no longer matters for xruns - only the
+     average has to keep up with playback. */
+  RubberBandState state = rubberband_new(
+      sample_rate,                            /* sample rate */
+      1,                                      /* channels (mono) */
+      RubberBandOptionProcessRealTime |       /* realtime processing */
+          RubberBandOptionTransientsCrisp |   /* crisp transients for quick response */
+          RubberBandOptionThreadingNever |    /* the stretch thread is the only thread */
+          RubberBandOptionWindowShort |       /* shorter analysis window for lower latency */
+          RubberBandOptionFormantShifted |    /* allow formant shifting for better responsiveness */
+          RubberBandOptionSmoothingOff |      /* disable smoothing for lower latency */
+          RubberBandOptionPhaseIndependent |  /* reduce phase artifacts that can cause latency */
+          RubberBandOptionPitchHighSpeed |    /* fast pitch processing for immediate response */
+          RubberBandOptionEngineFaster |      /* use faster engine for lower latency */
+          RubberBandOptionDetectorPercussive, /* percussive detector for quick parameter changes */
+      1.0,                                    /* initial time ratio (no speed change) */
+      1.0                                     /* initial pitch scale (no pitch change) */
+  );
+  if (state)
+  {
+    rubberband_set_max_process_size(state, STRETCH_CHUNK);
+  }
+  return state;
+}
+
+static void stretcher_destroy(struct stretcher *st)
+{
+  if (st->state)
+  {
+    rubberband_delete(st->state);
+    st->state = NULL;
+  }
+  free(st->in);
+  free(st->chunk);
+  free(st->mix);
+  st->in = st->chunk = st->mix = NULL;
+  audio_ring_buffer_destroy(&st->out);
+}
+
+static int stretcher_init(struct stretcher *st, uint32_t sample_rate, stretch_pull_fn pull, void *ctx)
+{
+  memset(st, 0, sizeof(*st));
+
+  st->lookahead = (uint32_t)((uint64_t)sample_rate * STRETCH_LOOKAHEAD_MS / 1000);
+  /* Room for the lookahead plus one retrieved chunk on top of it */
+  if (audio_ring_buffer_init(&st->out, st->lookahead + 2 * STRETCH_CHUNK) < 0)
+  {
+    return -1;
+  }
+
+  st->state = stretch_new_state(sample_rate);
+  st->in = malloc(STRETCH_CHUNK * sizeof(float));
+  st->chunk = malloc(STRETCH_CHUNK * sizeof(float));
+  st->mix = malloc(STRETCH_MIX_BLOCK * sizeof(float));
+  if (!st->state || !st->in || !st->chunk || !st->mix)
+  {
+    stretcher_destroy(st);
+    return -1;
+  }
+
+  st->pull = pull;
+  st->ctx = ctx;
+  st->rt_speed = 1.0f;
+  st->first_block = LOOP_POOL_NONE;
+  st->cursor.block = LOOP_POOL_NONE;
+  atomic_init(&st->owner, STRETCH_OWNER_RT);
+  atomic_init(&st->busy, false);
+  atomic_init(&st->speed, 1.0f);
+  atomic_init(&st->pitch, 0.0f);
+  atomic_init(&st->param_seq, 0);
+  atomic_init(&st->reset_seq, 0);
+  atomic_init(&st->flush_seq, 0);
+  atomic_init(&st->flush_idx, 0);
+
+  return 0;
+}
+
+static void stretch_worker_wake(struct stretch_worker *sw)
+{
+  /* A non-blocking eventfd write is a bounded syscall - safe from the RT thread */
+  if (sw->wake_fd >= 0)
+  {
+    uint64_t one = 1;
+    if (write(sw->wake_fd, &one, sizeof(one)) < 0)
+    {
+      /* EAGAIN - the counter is saturated, the thread is awake anyway */
+    }
+  }
+}
+
+static void stretch_worker_request_rt(struct stretch_worker *sw)
+{
+  if (!atomic_exchange_explicit(&sw->wake_requested, true, memory_order_acq_rel))
+  {
+    stretch_worker_wake(sw);
+  }
+}
+
+/* Drop everything stretched so far: the RT side skips the ring up to here */
+static void stretcher_flush(struct stretcher *st)
+{
+  uint32_t write_idx = atomic_load_explicit(&st->out.write_idx, memory_order_relaxed);
+  atomic_store_explicit(&st->flush_idx, write_idx, memory_order_relaxed);
+  atomic_fetch_add_explicit(&st->flush_seq, 1, memory_order_release);
+}
+
+/* Apply new speed/pitch, or restart after a reset, and re-seek */
+static void stretcher_apply(struct stretcher *st, bool restart)
+{
+  uint32_t seq = atomic_load_explicit(&st->param_seq, memory_order_acquire);
+  bool params = seq != st->param_served;
+
+  if (params)
+  {
+    st->param_served = seq;
+    float speed = atomic_load_explicit(&st->speed, memory_order_relaxed);
+    float pitch = atomic_load_explicit(&st->pitch, memory_order_relaxed);
+
+    /* Time ratio is the inverse of playback speed */
+    rubberband_set_time_ratio(st->state, 1.0 / speed);
+    rubberband_set_pitch_scale(st->state, pitch == 0.0f ? 1.0 : pow(2.0, pitch / 12.0));
+
+    /* Pitch changes respond faster from a clean state; a speed change alone
+       keeps the analysis going to avoid a gap */
+    if (pitch != st->applied_pitch)
+    {
+      restart = true;
+      st->applied_pitch = pitch;
+    }
+  }
+
+  if (restart)
+  {
+    rubberband_reset(st->state);
+  }
+  if (params || restart)
+  {
+    stretcher_flush(st);
+  }
+}
+
+/* Keep the output ring lookahead frames ahead (stretch thread, owns the source) */
+static void stretcher_fill(struct stretcher *st)
+{
+  for (int pass = 0; pass < STRETCH_MAX_PASSES; pass++)
+  {
+    if (audio_ring_buffer_read_space(&st->out) >= st->lookahead)
+      break;
+
+    int available = rubberband_available(st->state);
+    if (available > 0)
+    {
+      uint32_t n = SPA_MIN((uint32_t)available, (uint32_t)STRETCH_CHUNK);
+      n = SPA_MIN(n, audio_ring_buffer_write_space(&st->out));
+      float *out = st->chunk;
+      n = rubberband_retrieve(st->state, &out, n);
+      audio_ring_buffer_write(&st->out, st->chunk, n);
+      continue;
+    }
+
+    uint32_t required = rubberband_get_samples_required(st->state);
+    if (required == 0 || required > STRETCH_CHUNK)
+      required = STRETCH_CHUNK;
+
+    uint32_t got = st->pull(st->ctx, st->in, required);
+    if (got == 0)
+      break; /* Source stopped */
+
+    const float *in = st->in;
+    rubberband_process(st->state, &in, got, 0);
+  }
+}
+
+static void stretcher_service(struct stretcher *st)
+{
+  int owner = atomic_load_explicit(&st->owner, memory_order_acquire);
+  bool restart = false;
+
+  if (owner == STRETCH_OWNER_RELEASE)
+  {
+    // Done with the source - hand it back unless RT changed its mind meanwhile
+    int expected = STRETCH_OWNER_RELEASE;
+    if (atomic_compare_exchange_strong_explicit(&st->owner, &expected, STRETCH_OWNER_RT,
+                                                memory_order_acq_rel, memory_order_acquire))
+      return;
+    owner = expected;
+  }
+
+  if (owner == STRETCH_OWNER_REQUESTED)
+  {
+    int expected = STRETCH_OWNER_REQUESTED;
+    if (!atomic_compare_exchange_strong_explicit(&st->owner, &expected, STRETCH_OWNER_WORKER,
+                                                 memory_order_acq_rel, memory_order_acquire))
+      return; /* Withdrawn before we took it */
+    owner = STRETCH_OWNER_WORKER;
+    restart = true; /* Whatever is left from a previous run is stale */
+  }
+
+  if (owner != STRETCH_OWNER_WORKER)
+    return;
+
+  uint32_t reset = atomic_load_explicit(&st->reset_seq, memory_order_acquire);
+  if (reset != st->reset_served)
+  {
+    st->reset_served = reset;
+    restart = true;
+  }
+
+  stretcher_apply(st, restart);
+  stretcher_fill(st);
+}
+
+/* Service st unless another stretch thread already is */
+static void stretcher_try_service(struct stretcher *st)
+{
+  if (atomic_load_explicit(&st->owner, memory_order_relaxed) == STRETCH_OWNER_RT)
+    return; /* Nothing to do - skip the claim */
+
+  if (atomic_exchange_explicit(&st->busy, true, memory_order_acquire))
+    return;
+  stretcher_service(st);
+  atomic_store_explicit(&st->busy, false, memory_order_release);
+}
+
+void stretch_worker_service(struct stretch_worker *sw, uint32_t first)
+{
+  stretcher_try_service(&sw->file);
+
+  /* Threads start at different voices so they spread over the pool
+     instead of queueing up behind the same claims */
+  for (uint32_t i = 0; i < sw->voice_count; i++)
+  {
+    stretcher_try_service(&sw->voices[(first + i) % sw->voice_count]);
+  }
+}
+
+static void *stretch_worker_thread(void *arg)
+{
+  struct stretch_thread *thread = arg;
+  struct stretch_worker *sw = thread->sw;
+
+  while (atomic_load_explicit(&sw->running, memory_order_acquire))
+  {
+    /* Clear before servicing so a request made meanwhile wakes us again */
+    atomic_store_explicit(&sw->wake_requested, false, memory_order_release);
+    stretch_worker_service(sw, thread->first);
+
+    struct pollfd pfd = {.fd = sw->wake_fd, .events = POLLIN};
+    if (poll(&pfd, 1, STRETCH_POLL_MS) > 0 && (pfd.revents & POLLIN))
+    {
+      uint64_t count;
+      if (read(sw->wake_fd, &count, sizeof(count)) < 0)
+      {
+        /* EAGAIN - already consumed */
+      }
+    }
+  }
+
+  return NULL;
+}
+
+/* Loop stretchers: UPHONOR_STRETCH_VOICES, or STRETCH_VOICES_PER_THREAD per thread */
+static uint32_t stretch_pool_size(uint32_t thread_count)
+{
+  uint32_t voices = thread_count * STRETCH_VOICES_PER_THREAD;
+  const char *env = getenv("UPHONOR_STRETCH_VOICES");
+  if (env && *env)
+  {
+    voices = (uint32_t)strtoul(env, NULL, 10);
+  }
+  return SPA_MIN(voices, (uint32_t)STRETCH_POOL_MAX);
+}
+
+static void stretch_worker_free(struct stretch_worker *sw)
+{
+  for (uint32_t i = 0; i < sw->voice_count; i++)
+  {
+    stretcher_destroy(&sw->voices[i]);
+  }
+  free(sw->voices);
+  sw->voices = NULL;
+  sw->voice_count = 0;
+  stretcher_destroy(&sw->file);
+
+  if (sw->wake_fd >= 0)
+  {
+    close(sw->wake_fd);
+    sw->wake_fd = -1;
+  }
+}
+
+int stretch_worker_start(struct stretch_worker *sw, uint32_t sample_rate, struct disk_stream *ds,
+                         struct rt_log *log)
+{
+  if (stretch_worker_ready(sw))
+  {
+    return 0;
+  }
+
+  if (stretcher_init(&sw->file, sample_rate, stretch_pull_disk, ds) < 0)
+  {
+    pw_log_error("stretch: failed to set up the file stretcher");
+    return -1;
+  }
+  sw->sample_rate = sample_rate;
+  sw->log = log;
+
+  /* One core stays with the RT thread, the rest stretch. Without threads
+     the pool does not depend on the machine either. */
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  uint32_t thread_count = cpus > 1 ? (uint32_t)(cpus - 1) : 1;
+  thread_count = sw->synchronous ? STRETCH_MAX_THREADS : SPA_MIN(thread_count, (uint32_t)STRETCH_MAX_THREADS);
+
+  /* The pool is set up front - the RT thread only hands stretchers out */
+  uint32_t voice_count = stretch_pool_size(thread_count);
+  sw->voices = voice_count > 0 ? calloc(voice_count, sizeof(struct stretcher)) : NULL;
+  sw->voice_count = 0;
+  if (voice_count > 0 && !sw->voices)
+  {
+    pw_log_warn("stretch: no memory for %u loop stretchers, loops will not be stretched", voice_count);
+    voice_count = 0;
+  }
+  for (; sw->voice_count < voice_count; sw->voice_count++)
+  {
+    struct stretcher *st = &sw->voices[sw->voice_count];
+    if (stretcher_init(st, sample_rate, stretch_pull_loop, st) < 0)
+    {
+      pw_log_warn("stretch: only %u of %u loop stretchers could be set up", sw->voice_count, voice_count);
+      break;
+    }
+  }
+  sw->free_voices = sw->voice_count >= 32 ? UINT32_MAX : (UINT32_C(1) << sw->voice_count) - 1;
+  sw->releasing_voices = 0;
+  sw->pool_exhausted = false;
+
+  sw->thread_count = 0;
+  if (sw->synchronous)
+  {
+    sw->wake_fd = -1;
+    atomic_store_explicit(&sw->ready, true, memory_order_release);
+    pw_log_info("Time-stretching serviced by the caller at %u Hz, %u loop stretchers", sample_rate,
+                sw->voice_count);
+    return 0;
+  }
+
+  /* Without the eventfd the threads still service every STRETCH_POLL_MS */
+  sw->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (sw->wake_fd < 0)
+  {
+    pw_log_warn("eventfd failed, stretch threads will poll");
+  }
+
+  atomic_store_explicit(&sw->wake_requested, false, memory_order_relaxed);
+  atomic_store_explicit(&sw->running, true, memory_order_release);
+  for (uint32_t i = 0; i < thread_count; i++)
+  {
+    struct stretch_thread *thread = &sw->threads[i];
+    thread->sw = sw;
+    thread->first = sw->voice_count * i / thread_count;
+    if (pthread_create(&thread->thread, NULL, stretch_worker_thread, thread) != 0)
+      break;
+    sw->thread_count++;
+  }
+  if (sw->thread_count == 0)
+  {
+    atomic_store_explicit(&sw->running, false, memory_order_release);
+    stretch_worker_free(sw);
+    return -1;
+  }
+  atomic_store_explicit(&sw->ready, true, memory_order_release);
+
+  pw_log_info("Time-stretching on %u thread(s) at %u Hz, %d ms lookahead, %u loop stretchers",
+              sw->thread_count, sample_rate, STRETCH_LOOKAHEAD_MS, sw->voice_count);
+  return 0;
+}
+
+void stretch_worker_stop(struct stretch_worker *sw)
+{
+  if (!stretch_worker_ready(sw))
+  {
+    return;
+  }
+
+  atomic_store_explicit(&sw->ready, false, memory_order_release);
+  atomic_store_explicit(&sw->running, false, memory_order_release);
+  stretch_worker_wake(sw);
+  for (uint32_t i = 0; i < sw->thread_count; i++)
+  {
+    pthread_join(sw->threads[i].thread, NULL);
+  }
+  sw->thread_count = 0;
+
+  /* Loops still holding a stretcher keep their chain referenced until here */
+  for (uint32_t i = 0; i < sw->voice_count; i++)
+  {
+    struct stretcher *st = &sw->voices[i];
+    if (st->first_block != LOOP_POOL_NONE)
+    {
+      loop_pool_chain_unref(st->pool, st->first_block, st->last_block, st->block_count);
+      st->first_block = LOOP_POOL_NONE;
+    }
+    if (st->loop)
+    {
+      st->loop->stretch_slot = STRETCH_SLOT_NONE;
+      st->loop = NULL;
+    }
+  }
+
+  stretch_worker_free(sw);
+}
+
+void stretch_worker_reset(struct stretch_worker *sw)
+{
+  if (!stretch_worker_ready(sw))
+  {
+    return;
+  }
+  atomic_fetch_add_explicit(&sw->file.reset_seq, 1, memory_order_release);
+  stretch_worker_request_rt(sw);
+}
+
+/* RT: publish speed/pitch if they changed since the last cycle */
+static void stretcher_set_params_rt(struct stretch_worker *sw, struct stretcher *st, float speed, float pitch)
+{
+  if (speed == st->rt_speed && pitch == st->rt_pitch)
+    return;
+
+  st->rt_speed = speed;
+  st->rt_pitch = pitch;
+  atomic_store_explicit(&st->speed, speed, memory_order_relaxed);
+  atomic_store_explicit(&st->pitch, pitch, memory_order_relaxed);
+  atomic_fetch_add_explicit(&st->param_seq, 1, memory_order_release);
+  stretch_worker_request_rt(sw);
+}
+
+/* RT: add n_samples frames from the output ring into buf, silence where it ran dry */
+static void stretcher_mix_rt(struct stretch_worker *sw, struct stretcher *st, float *buf, uint32_t n_samples,
+                             float gain)
+{
+  // Skip whatever the stretch thread stretched before its last re-seek
+  uint32_t flush = atomic_load_explicit(&st->flush_seq, memory_order_acquire);
+  if (flush != st->flush_seen)
+  {
+    st->flush_seen = flush;
+    uint32_t stale_end = atomic_load_explicit(&st->flush_idx, memory_order_relaxed);
+    int32_t stale = (int32_t)(stale_end - atomic_load_explicit(&st->out.read_idx, memory_order_relaxed));
+    if (stale > 0)
+    {
+      audio_ring_buffer_skip(&st->out, (uint32_t)stale);
+    }
+  }
+
+  uint32_t total = 0;
+  while (total < n_samples)
+  {
+    uint32_t block = SPA_MIN(n_samples - total, (uint32_t)STRETCH_MIX_BLOCK);
+    uint32_t got = audio_ring_buffer_read(&st->out, st->mix, block);
+    mix_gain_accumulate(buf + total, st->mix, gain, got);
+    total += got;
+    if (got < block)
+      break;
+  }
+
+  if (total < n_samples)
+  {
+    /* Underrun - the missing part stays silent; log once per run */
+    if (!st->underrun)
+    {
+      st->underrun = true;
+      st->underruns++;
+      rt_log_warn(sw->log, "Stretch underrun: %u of %u frames missing", n_samples - total, n_samples);
+    }
+  }
+  else
+  {
+    st->underrun = false;
+  }
+
+  if (audio_ring_buffer_read_space(&st->out) < st->lookahead / 2)
+  {
+    stretch_worker_request_rt(sw);
+  }
+}
+
+uint32_t stretch_file_mix_rt(struct stretch_worker *sw, struct disk_stream *ds, float *buf, uint32_t n_samples,
+                             float speed, float pitch, bool stretch, float gain)
+{
+  if (!disk_stream_active(ds))
+  {
+    return 0;
+  }
+
+  // Underruns the stretch thread hit while reading the ring are logged here
+  disk_stream_log_underruns_rt(ds);
+
+  if (!stretch_worker_ready(sw))
+  {
+    return disk_stream_mix_rt(ds, buf, n_samples, speed, gain);
+  }
+
+  struct stretcher *st = &sw->file;
+  bool want = stretch && (speed != 1.0f || pitch != 0.0f);
+  int owner = atomic_load_explicit(&st->owner, memory_order_acquire);
+
+  if (want)
+  {
+    if (owner == STRETCH_OWNER_RT)
+    {
+      // From here on only the stretch thread reads the disk ring
+      atomic_store_explicit(&st->owner, STRETCH_OWNER_REQUESTED, memory_order_release);
+      stretch_worker_request_rt(sw);
+    }
+    else if (owner == STRETCH_OWNER_RELEASE)
+    {
+      int expected = STRETCH_OWNER_RELEASE;
+      if (!atomic_compare_exchange_strong_explicit(&st->owner, &expected, STRETCH_OWNER_WORKER,
+                                                   memory_order_acq_rel, memory_order_acquire))
+      {
+        /* Handed back just now - ask again */
+        atomic_store_explicit(&st->owner, STRETCH_OWNER_REQUESTED, memory_order_release);
+        stretch_worker_request_rt(sw);
+      }
+    }
+
+    stretcher_set_params_rt(sw, st, speed, pitch);
+    stretcher_mix_rt(sw, st, buf, n_samples, gain);
+    return n_samples;
+  }
+
+  if (owner == STRETCH_OWNER_REQUESTED)
+  {
+    int expected = STRETCH_OWNER_REQUESTED;
+    if (!atomic_compare_exchange_strong_explicit(&st->owner, &expected, STRETCH_OWNER_RT,
+                                                 memory_order_acq_rel, memory_order_acquire))
+    {
+      /* Taken over meanwhile - ask for it back */
+      atomic_store_explicit(&st->owner, STRETCH_OWNER_RELEASE, memory_order_release);
+      stretch_worker_request_rt(sw);
+    }
+  }
+  else if (owner == STRETCH_OWNER_WORKER)
+  {
+    atomic_store_explicit(&st->owner, STRETCH_OWNER_RELEASE, memory_order_release);
+    stretch_worker_request_rt(sw);
+  }
+
+  if (atomic_load_explicit(&st->owner, memory_order_acquire) == STRETCH_OWNER_RT)
+  {
+    return disk_stream_mix_rt(ds, buf, n_samples, speed, gain);
+  }
+
+  // The stretch thread still holds the disk ring - play out what it queued
+  stretcher_mix_rt(sw, st, buf, n_samples, gain);
+  return n_samples;
+}
+
+bool stretch_loop_mix_rt(struct stretch_worker *sw, struct loop_pool *pool, struct memory_loop *loop,
+                         float *buf, uint32_t n_samples)
+{
+  if (!stretch_worker_ready(sw))
+  {
+    return false;
+  }
+
+  if (loop->stretch_slot == STRETCH_SLOT_NONE)
+  {
+    if (sw->free_voices == 0)
+    {
+      if (!sw->pool_exhausted)
+      {
+        sw->pool_exhausted = true;
+        rt_log_warn(sw->log, "All %u loop stretchers in use, loop %u plays unstretched", sw->voice_count,
+                    loop->midi_note);
+      }
+      return false;
+    }
+
+    uint32_t slot = (uint32_t)__builtin_ctz(sw->free_voices);
+    struct stretcher *st = &sw->voices[slot];
+    sw->free_voices &= ~(UINT32_C(1) << slot);
+
+    // The stretch thread reads the take through its own reference
+    loop_pool_chain_ref(pool, loop->first_block);
+    st->loop = loop;
+    st->pool = pool;
+    st->first_block = loop->first_block;
+    st->last_block = loop->last_block;
+    st->block_count = loop->block_count;
+    st->frames = loop->recorded_frames;
+    st->position = loop->playback_position;
+    st->cursor.block = LOOP_POOL_NONE;
+    st->cursor.start = 0;
+    st->rt_speed = 0.0f; /* Publish this loop's settings below */
+    st->underrun = true; /* The ring starts empty - not worth a warning */
+
+    atomic_store_explicit(&st->owner, STRETCH_OWNER_REQUESTED, memory_order_release);
+    loop->stretch_slot = (uint8_t)slot;
+  }
+
+  struct stretcher *st = &sw->voices[loop->stretch_slot];
+  stretcher_set_params_rt(sw, st, loop->speed, loop->pitch);
+  stretcher_mix_rt(sw, st, buf, n_samples, loop->volume);
+
+  /* The stretch thread reads the take at the loop's speed; the position
+     follows it there, so a freeze render or a new stretcher takes over
+     where this one is */
+  loop_storage_advance_at_speed(loop, n_samples);
+  return true;
+}
+
+void stretch_loop_release_rt(struct stretch_worker *sw, struct memory_loop *loop)
+{
+  if (loop->stretch_slot == STRETCH_SLOT_NONE)
+  {
+    return;
+  }
+
+  uint32_t slot = loop->stretch_slot;
+  struct stretcher *st = &sw->voices[slot];
+
+  int expected = STRETCH_OWNER_REQUESTED;
+  if (!atomic_compare_exchange_strong_explicit(&st->owner, &expected, STRETCH_OWNER_RT,
+                                               memory_order_acq_rel, memory_order_acquire) &&
+      expected == STRETCH_OWNER_WORKER)
+  {
+    // A stretch thread is reading the chain - it hands the stretcher back on its next pass
+    atomic_store_explicit(&st->owner, STRETCH_OWNER_RELEASE, memory_order_release);
+    stretch_worker_request_rt(sw);
+  }
+
+  sw->releasing_voices |= UINT32_C(1) << slot;
+  st->loop = NULL;
+  loop->stretch_slot = STRETCH_SLOT_NONE;
+}
+
+void stretch_pool_collect_rt(struct stretch_worker *sw)
+{
+  if (!stretch_worker_ready(sw) || sw->voice_count == 0)
+  {
+    return;
+  }
+
+  uint32_t all = sw->voice_count >= 32 ? UINT32_MAX : (UINT32_C(1) << sw->voice_count) - 1;
+
+  /* Give up stretchers whose loop stopped, moved to another take, went back to unity or to varispeed */
+  uint32_t held = all & ~(sw->free_voices | sw->releasing_voices);
+  while (held)
+  {
+    uint32_t slot = (uint32_t)__builtin_ctz(held);
+    held &= held - 1;
+
+    struct stretcher *st = &sw->voices[slot];
+    struct memory_loop *loop = st->loop;
+    if (!loop->is_playing || loop->first_block != st->first_block || loop->recorded_frames != st->frames ||
+        (loop->speed == 1.0f && loop->pitch == 0.0f) || loop->varispeed)
+    {
+      stretch_loop_release_rt(sw, loop);
+    }
+    else
+    {
+      /* Follow the chain so whichever reference goes last frees all of it */
+      st->last_block = loop->last_block;
+      st->block_count = loop->block_count;
+    }
+  }
+
+  /* Hand back the ones the stretch threads are done with */
+  uint32_t releasing = sw->releasing_voices;
+  while (releasing)
+  {
+    uint32_t slot = (uint32_t)__builtin_ctz(releasing);
+    releasing &= releasing - 1;
+
+    struct stretcher *st = &sw->voices[slot];
+    if (atomic_load_explicit(&st->owner, memory_order_acquire) != STRETCH_OWNER_RT)
+      continue;
+
+    loop_pool_chain_unref(st->pool, st->first_block, st->last_block, st->block_count);
+    st->first_block = LOOP_POOL_NONE;
+
+    // Whatever is still queued belongs to the old loop
+    audio_ring_buffer_skip(&st->out, audio_ring_buffer_read_space(&st->out));
+    st->flush_seen = atomic_load_explicit(&st->flush_seq, memory_order_acquire);
+
+    sw->releasing_voices &= ~(UINT32_C(1) << slot);
+    sw->free_voices |= UINT32_C(1) << slot;
+    sw->pool_exhausted = false;
+  }
+}
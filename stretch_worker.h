@@ -0,0 +1,170 @@
+#ifndef STRETCH_WORKER_H
+#define STRETCH_WORKER_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <rubberband/rubberband-c.h>
+#include "rt_nonrt_bridge.h"
+#include "rt_log.h"
+#include "loop_pool.h"
+
+struct disk_stream;
+struct memory_loop;
+
+/* Time-stretching and pitch-shifting off the RT thread.
+ *
+ * A stretcher owns a RubberBand instance and a lock-free output ring. The
+ * stretch threads pull source frames, run RubberBand and keep each ring
+ * STRETCH_LOOKAHEAD_MS ahead of the play head; the RT thread only copies
+ * out of the rings and never calls into RubberBand.
+ *
+ * Speed and pitch are set by the RT thread (MIDI CC 74/75, per-loop
+ * settings) and applied by a stretch thread, which then re-seeks:
+ * everything already stretched at the old settings is dropped, so a change
+ * is heard as soon as the ring is refilled rather than after the whole
+ * lookahead plays out.
+ *
+ * The source is read by one thread at a time. For the streamed file the RT
+ * thread reads the disk ring itself while nothing is stretched and hands
+ * the ring to the stretch threads (and takes it back) through the owner
+ * handshake below, so the disk stream keeps a single consumer.
+ *
+ * Loops with their own speed or pitch borrow a stretcher from a pool set up
+ * at start and sized to the stretch threads. The RT thread assigns one when
+ * the loop first plays stretched, takes a reference on the loop's block
+ * chain for the stretch thread to read, and gives it up when the loop stops
+ * or returns to unity. All stretch threads wake together and split the busy
+ * stretchers between them, so many stretched loops run in parallel on
+ * worker cores. A loop that finds the pool empty plays unstretched. */
+
+#define STRETCH_LOOKAHEAD_MS 80     /* Stretched audio queued ahead of the play head */
+#define STRETCH_CHUNK 256           /* Frames per RubberBand process/retrieve call */
+#define STRETCH_POLL_MS 10          /* Stretch thread check interval without a wakeup */
+#define STRETCH_MAX_THREADS 4       /* Stretch threads at most (one less than the CPUs) */
+#define STRETCH_VOICES_PER_THREAD 4 /* Loop stretchers per stretch thread by default */
+#define STRETCH_POOL_MAX 32         /* Loop stretchers at most (UPHONOR_STRETCH_VOICES overrides the default) */
+#define STRETCH_SLOT_NONE 0xff      /* memory_loop.stretch_slot without a stretcher */
+
+/* Who reads a stretcher's source */
+enum stretch_owner
+{
+  STRETCH_OWNER_RT,        /* Not stretched - the RT thread reads the source directly */
+  STRETCH_OWNER_REQUESTED, /* RT stopped reading, waiting for a stretch thread to take over */
+  STRETCH_OWNER_WORKER,    /* A stretch thread reads the source and fills the ring */
+  STRETCH_OWNER_RELEASE    /* RT wants the source back, a stretch thread may still be reading */
+};
+
+/* Pulls up to frames source frames into buf (stretch thread), returns frames read */
+typedef uint32_t (*stretch_pull_fn)(void *ctx, float *buf, uint32_t frames);
+
+struct stretcher
+{
+  RubberBandState state;        /* Only touched by the stretch threads once running */
+  struct audio_ring_buffer out; /* Stretch thread writes, RT thread reads */
+  uint32_t lookahead;           /* Frames kept queued */
+  stretch_pull_fn pull;
+  void *ctx;
+
+  _Atomic int owner; /* enum stretch_owner */
+  _Atomic bool busy; /* Claimed by a stretch thread for a service pass */
+
+  /* Parameters, written by the RT thread and published through param_seq */
+  _Atomic float speed;
+  _Atomic float pitch; /* Semitones */
+  _Atomic uint32_t param_seq;
+  _Atomic uint32_t reset_seq; /* Bumped to restart the stretch (new file, rewind) */
+
+  /* Loop source, set by the RT thread before it hands the stretcher over */
+  struct memory_loop *loop; /* RT: loop holding the stretcher, NULL while free */
+  struct loop_pool *pool;
+  uint32_t first_block; /* Chain referenced while the loop holds the stretcher */
+  uint32_t last_block;
+  uint32_t block_count;
+  uint32_t frames;   /* Loop length */
+  uint32_t position; /* Next source frame (stretch thread) */
+  struct loop_pool_cursor cursor;
+
+  /* Stretch thread side */
+  float *in;    /* One chunk of source frames */
+  float *chunk; /* One chunk of retrieved output */
+  uint32_t param_served;
+  uint32_t reset_served;
+  float applied_pitch;
+  _Atomic uint32_t flush_seq; /* Bumped after a re-seek */
+  _Atomic uint32_t flush_idx; /* Ring write index at the re-seek - older frames are stale */
+
+  /* RT thread side */
+  float rt_speed;
+  float rt_pitch;
+  uint32_t flush_seen;
+  float *mix; /* One block of output before it is mixed */
+  bool underrun;
+  uint64_t underruns;
+};
+
+struct stretch_worker
+{
+  struct stretcher file;     /* Streamed file playback */
+  struct stretcher *voices;  /* Loop stretcher pool */
+  uint32_t voice_count;
+  uint32_t free_voices;      /* RT: pool slots not assigned to a loop */
+  uint32_t releasing_voices; /* RT: slots given up by their loop, not yet handed back */
+  bool pool_exhausted;       /* RT: logged once until a slot frees up */
+  uint32_t sample_rate;
+  struct rt_log *log;
+  bool synchronous; /* Set before start: no threads, the owner calls stretch_worker_service() */
+
+  _Atomic bool ready; /* Stretchers set up and the threads running */
+  struct stretch_thread
+  {
+    struct stretch_worker *sw;
+    pthread_t thread;
+    uint32_t first; /* Voice this thread starts its passes at */
+  } threads[STRETCH_MAX_THREADS];
+  uint32_t thread_count; /* Threads running */
+  int wake_fd; /* eventfd shared by the threads, -1 to poll */
+  _Atomic bool running;
+  _Atomic bool wake_requested; /* RT asked for work not yet served */
+};
+
+/* Non-RT: create the file stretcher and the loop pool at sample_rate and
+   start the stretch threads (none if synchronous is set) */
+int stretch_worker_start(struct stretch_worker *sw, uint32_t sample_rate, struct disk_stream *ds,
+                         struct rt_log *log);
+
+/* Non-RT: stop the threads and free the stretchers */
+void stretch_worker_stop(struct stretch_worker *sw);
+
+static inline bool stretch_worker_ready(const struct stretch_worker *sw)
+{
+  return atomic_load_explicit(&sw->ready, memory_order_acquire);
+}
+
+/* Drop what is stretched for the file and start over from the current position (RT-safe) */
+void stretch_worker_reset(struct stretch_worker *sw);
+
+/* Non-RT: one pass over the stretchers, starting at voice first and
+   skipping those another thread is servicing */
+void stretch_worker_service(struct stretch_worker *sw, uint32_t first);
+
+/* RT: mix the streamed file into buf at speed and pitch, scaled by gain.
+   With stretch false, or at unity settings, the disk ring is read directly
+   (varispeed). Returns 0 when no file is playing, else n_samples. */
+uint32_t stretch_file_mix_rt(struct stretch_worker *sw, struct disk_stream *ds, float *buf, uint32_t n_samples,
+                             float speed, float pitch, bool stretch, float gain);
+
+/* RT: mix a loop at its own speed and pitch through a pooled stretcher,
+   scaled by the loop volume. Returns false if no stretcher is free - the
+   caller then plays the loop unstretched. */
+bool stretch_loop_mix_rt(struct stretch_worker *sw, struct loop_pool *pool, struct memory_loop *loop,
+                         float *buf, uint32_t n_samples);
+
+/* RT: give up the loop's stretcher, if it has one */
+void stretch_loop_release_rt(struct stretch_worker *sw, struct memory_loop *loop);
+
+/* RT: return stretchers the threads are done with to the pool (once per cycle) */
+void stretch_pool_collect_rt(struct stretch_worker *sw);
+
+#endif /* STRETCH_WORKER_H */
@@ -0,0 +1,119 @@
+#include "sync_scheduler.h"
+
+void sync_scheduler_start(struct data *data, uint64_t start_frame)
+{
+  data->pulse_timeline_start_frame = start_frame;
+  data->next_pulse_frame = start_frame + data->pulse_loop_duration;
+  data->pulse_scheduled = data->pulse_loop_duration > 0;
+}
+
+void sync_scheduler_reset(struct data *data)
+{
+  data->pulse_scheduled = false;
+  data->next_pulse_frame = 0;
+}
+
+/* Put the next boundary back on the pulse grid just after frame. Only needed
+   when the clock jumps; normal boundaries advance by one pulse without a
+   division. */
+static void sync_scheduler_resync(struct data *data, uint64_t frame)
+{
+  uint32_t duration = data->pulse_loop_duration;
+  if (frame < data->pulse_timeline_start_frame)
+  {
+    sync_scheduler_start(data, frame);
+    return;
+  }
+  uint64_t into_pulse = (frame - data->pulse_timeline_start_frame) % duration;
+  data->next_pulse_frame = frame + (duration - into_pulse);
+}
+
+void sync_scheduler_begin_cycle(struct data *data, uint64_t cycle_frame)
+{
+  data->current_sample_frame = cycle_frame;
+
+  if (!data->sync_mode_enabled || data->pulse_loop_duration == 0)
+    return;
+
+  // A pulse duration restored from a session has no timeline yet
+  if (!data->pulse_scheduled)
+  {
+    sync_scheduler_start(data, cycle_frame);
+    rt_log_info(&data->rt_bridge.log, "SYNC mode: Pulse timeline started at frame %lu",
+                (unsigned long)cycle_frame);
+    return;
+  }
+
+  // The clock went backwards (driver restart); boundaries behind us are
+  // handled when the cycle reaches them
+  if (data->next_pulse_frame > cycle_frame + data->pulse_loop_duration)
+  {
+    sync_scheduler_resync(data, cycle_frame);
+  }
+}
+
+uint32_t sync_frames_to_pulse(const struct data *data, uint64_t frame)
+{
+  if (!data->pulse_scheduled || !data->sync_mode_enabled)
+    return UINT32_MAX;
+  if (frame >= data->next_pulse_frame)
+    return 0;
+  uint64_t ahead = data->next_pulse_frame - frame;
+  return ahead > UINT32_MAX ? UINT32_MAX : (uint32_t)ahead;
+}
+
+void sync_pulse_boundary_rt(struct data *data)
+{
+  rt_log_debug(&data->rt_bridge.log, "SYNC pulse boundary at frame %lu (%u voices playing)",
+               (unsigned long)data->current_sample_frame, data->playing_voices.count);
+
+  // New recordings may start from here on
+  data->waiting_for_pulse_reset = false;
+
+  // Only the queued actions run; stops go first so a recording ending on
+  // this boundary frees the recorder for one starting on it
+  if (!note_set_empty(&data->pending_stop_set))
+  {
+    stop_sync_pending_recordings_on_pulse_reset(data);
+  }
+  if (!note_set_empty(&data->pending_record_set))
+  {
+    start_sync_pending_recordings_on_pulse_reset(data);
+  }
+  if (!note_set_empty(&data->pending_start_set))
+  {
+    start_sync_pending_playback_on_pulse_reset(data);
+  }
+
+  // The actions may have cleared the pulse loop
+  if (data->pulse_loop_duration == 0)
+  {
+    sync_scheduler_reset(data);
+    return;
+  }
+
+  data->next_pulse_frame += data->pulse_loop_duration;
+  if (data->next_pulse_frame <= data->current_sample_frame)
+  {
+    // Fell more than a pulse behind (xrun or clock jump): fire once, then
+    // rejoin the grid rather than replaying every missed boundary
+    sync_scheduler_resync(data, data->current_sample_frame);
+  }
+}
+
+uint32_t get_theoretical_pulse_position(struct data *data)
+{
+  if (!data->pulse_scheduled || data->pulse_loop_duration == 0)
+  {
+    return 0;
+  }
+
+  // The boundary ahead is at most one pulse away, so the position is the
+  // distance back from it
+  uint64_t ahead = data->next_pulse_frame - data->current_sample_frame;
+  if (data->current_sample_frame >= data->next_pulse_frame || ahead >= data->pulse_loop_duration)
+  {
+    return 0;
+  }
+  return data->pulse_loop_duration - (uint32_t)ahead;
+}
@@ -0,0 +1,34 @@
+#ifndef SYNC_SCHEDULER_H
+#define SYNC_SCHEDULER_H
+
+#include "uphonor.h"
+
+/* Pulse boundary scheduling for sync mode.
+ *
+ * Boundaries fall every pulse_loop_duration frames from the frame the pulse
+ * timeline started. The next one is kept as an absolute frame, so the process
+ * callback only has to compare it with the block it is about to run: it
+ * splits the block there and runs the pending stop, record and start actions
+ * on that exact sample. */
+
+/* Start the pulse timeline at start_frame; the first boundary is one pulse later */
+void sync_scheduler_start(struct data *data, uint64_t start_frame);
+
+/* Drop the timeline, e.g. when the pulse loop is cleared */
+void sync_scheduler_reset(struct data *data);
+
+/* Called at the top of each cycle with the cycle's first frame */
+void sync_scheduler_begin_cycle(struct data *data, uint64_t cycle_frame);
+
+/* Frames from frame to the next boundary: 0 when it is due, UINT32_MAX when
+   no boundary is scheduled */
+uint32_t sync_frames_to_pulse(const struct data *data, uint64_t frame);
+
+/* Run the actions queued for the boundary at current_sample_frame and
+   schedule the next one */
+void sync_pulse_boundary_rt(struct data *data);
+
+/* Position of current_sample_frame within the pulse, 0 without a pulse */
+uint32_t get_theoretical_pulse_position(struct data *data);
+
+#endif /* SYNC_SCHEDULER_H */
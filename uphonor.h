@@ -21,6 +21,16 @@
 #include <rubberband/rubberband-c.h>
 #include "rt_nonrt_bridge.h"
 #include "audio_buffer_rt.h"
+#include "disk_stream.h"
+#include "resampler.h"
+#include "stretch_worker.h"
+#include "loop_freeze.h"
+#include "session_loader.h"
+#include "session_file.h"
+#include "config_snapshot.h"
+#include "engine_command.h"
+#include "loop_pool.h"
+#include "loop_index.h"
 
 struct port
 {
@@ -56,7 +66,8 @@ struct data
   float *temp_audio_buffer; // Pre-allocated temp buffer for multi-channel
 
   /* libsndfile stuff used to read samples from the input audio
-     file. */
+     file. Playback streams it through disk_stream, which owns its own
+     handle; fileinfo describes the file being played. */
   SNDFILE *file;
   SF_INFO fileinfo;
 
@@ -86,12 +97,10 @@ struct data
   double sample_position;
 
   /* Rubberband time-stretching and pitch-shifting */
-  RubberBandState rubberband_state;
-  float pitch_shift;               /* Pitch shift in semitones (12 = one octave up, -12 = one octave down) */
-  bool rubberband_enabled;         /* Whether to use rubberband processing */
-  float *rubberband_input_buffer;  /* Input buffer for rubberband */
-  float *rubberband_output_buffer; /* Output buffer for rubberband */
-  uint32_t rubberband_buffer_size; /* Size of rubberband buffers */
+  struct stretch_worker stretch; /* RubberBand on its own thread (see stretch_worker.h) */
+  float pitch_shift;             /* Pitch shift in semitones (12 = one octave up, -12 = one octave down) */
+  bool rubberband_enabled;       /* Whether to use rubberband processing */
+  struct loop_freeze freeze;     /* Offline renders of loops with settled stretch (see loop_freeze.h) */
 
   /* RT/Non-RT bridge for performance-critical operations */
   struct rt_nonrt_bridge rt_bridge;
@@ -99,13 +108,38 @@ struct data
   /* RT-optimized audio buffering system */
   struct audio_buffer_rt audio_buffer;
 
+  /* File playback, prefetched by its own disk thread */
+  struct disk_stream disk_stream;
+
+  /* Background loading of session loop audio */
+  struct session_loader session_loader;
+
+  /* Binary session save in flight (see session_file.h) */
+  struct session_saver session_saver;
+
+  /* JSON session save requested from MIDI (see config_snapshot.h) */
+  struct config_snapshot_saver snapshot_saver;
+
+  /* Commands queued by non-RT threads, drained by on_process (see engine_command.h) */
+  struct engine_command_queue commands;
+
+  /* Shared block pool backing the memory loops */
+  enum rt_memory_mode memory_mode; /* How RT-written buffers are backed (see rt_memory.h) */
+  struct loop_pool loop_pool;
+
   /* In-memory loop recording and playback - one loop per MIDI note */
   struct memory_loop
   {
-    float *buffer;              /* In-memory audio buffer for recorded loop */
-    uint32_t buffer_size;       /* Total allocated size of buffer */
+    uint32_t first_block;                 /* First pool block of the loop's chain (LOOP_POOL_NONE until armed) */
+    uint32_t last_block;                  /* Last block of the chain - recording grows from here */
+    uint32_t block_count;                 /* Number of blocks in the chain */
+    uint32_t buffer_size;                 /* Capacity of the chain in frames */
+    struct loop_pool_cursor read_cursor;  /* Playback position inside the chain */
+    struct loop_pool_cursor write_cursor; /* Recording position inside the chain */
     uint32_t recorded_frames;   /* Number of frames currently recorded */
-    uint32_t playback_position; /* Current playback position in the loop */
+    uint32_t playback_position; /* Current playback position in the loop (frames of the take) */
+    uint32_t position_frac;     /* Part of a frame past playback_position while stretched, 0.32 fixed point */
+    uint64_t anchor_frame;      /* Engine frame at which playback was (modulo the length) at position 0 */
     bool loop_ready;            /* Whether loop is ready for playback */
     bool recording_to_memory;   /* Whether we're currently recording to memory */
     bool is_playing;            /* Whether this loop is currently playing */
@@ -113,9 +147,18 @@ struct data
     bool pending_stop;          /* Whether this loop is waiting to stop recording at next pulse reset in sync mode */
     bool pending_start;         /* Whether this loop is waiting to start playing at next pulse reset in sync mode */
     uint32_t sample_rate;       /* Sample rate for the recorded loop */
-    char loop_filename[512];    /* Filename for eventual file write */
+    char loop_filename[512];    /* Filename for eventual file write (empty until named off the RT thread) */
+    time_t take_time;           /* Wall-clock start of the current take, used to name it */
     uint8_t midi_note;          /* MIDI note number (0-127) that controls this loop */
     float volume;               /* Individual volume for this loop (from note velocity) */
+    float speed;                /* Time-stretch factor for this loop (1.0 = as recorded) */
+    float pitch;                /* Pitch shift for this loop in semitones */
+    uint8_t stretch_slot;       /* Pooled stretcher in use (STRETCH_SLOT_NONE if none, see stretch_worker.h) */
+    uint64_t stretch_since;     /* Engine frame speed or pitch last changed */
+    uint8_t freeze_slot;        /* Render of the stretched take (LOOP_FREEZE_SLOT_NONE if none) */
+    uint32_t take_generation;   /* Bumped with every new chain, tells takes apart for the freeze cache */
+    bool varispeed;             /* Play at speed like tape - pitch follows, no stretcher (see resampler.h) */
+    struct resampler resampler; /* Varispeed history and phase */
 
     /* Per-loop state management */
     enum loop_state
@@ -127,6 +170,12 @@ struct data
     } current_state;
   } memory_loops[128]; /* One loop for each MIDI note (0-127) */
 
+  /* Active-loop indexes - kept in step with is_playing/pending_* by the set_loop_* helpers */
+  struct voice_list playing_voices;   /* Loops with is_playing set */
+  struct note_set pending_record_set; /* Loops with pending_record set */
+  struct note_set pending_stop_set;   /* Loops with pending_stop set */
+  struct note_set pending_start_set;  /* Loops with pending_start set */
+
   /* Global loop management */
   uint8_t active_loop_count;        /* Number of loops that have been used */
   uint8_t currently_recording_note; /* MIDI note currently being recorded (-1 if none) */
@@ -149,11 +198,15 @@ struct data
 
   /* Pulse timeline tracking */
   uint64_t pulse_timeline_start_frame; /* Frame when pulse timeline started */
-  uint64_t current_sample_frame;       /* Current sample frame position */
-  uint32_t previous_pulse_position;    /* Previous theoretical pulse position for reset detection */
+  uint64_t current_sample_frame;       /* Frame being processed, advanced at each split within the cycle */
+  uint64_t next_pulse_frame;           /* Frame of the next pulse boundary (see sync_scheduler.h) */
+  bool pulse_scheduled;                /* Whether next_pulse_frame is valid */
+  uint64_t next_cycle_frame;           /* Frame the next cycle should start at if the clock runs on */
+  bool loop_positions_stale;           /* Playing loops missed frames; re-derive positions from their anchors */
 
   /* Recording backfill buffer for sync mode */
   float *recording_backfill_buffer;   /* Circular buffer to store recent input audio */
+  struct rt_memory_region backfill_memory; /* Mapping behind the backfill buffer */
   uint32_t backfill_buffer_size;      /* Size of backfill buffer (should be >= pulse_loop_duration) */
   uint32_t backfill_write_position;   /* Current write position in circular buffer */
   uint32_t backfill_available_frames; /* Number of frames available in backfill buffer */
@@ -162,6 +215,13 @@ struct data
 /* Function declarations */
 void on_process(void *userdata, struct spa_io_position *position);
 
+/* Engine setup shared by uphonor and uphonor-render (engine.c). sample_rate
+   is the rate the graph is expected to run at; it stands in for the
+   negotiated format until PipeWire reports one. */
+#define ENGINE_DEFAULT_RATE 48000 /* When nothing says otherwise */
+int engine_init(struct data *data, uint32_t sample_rate);
+void engine_cleanup(struct data *data);
+
 /* Include modular headers */
 #include "audio_processing.h"
 #include "audio_processing_rt.h"
@@ -169,6 +229,7 @@ void on_process(void *userdata, struct spa_io_position *position);
 #include "buffer_manager.h"
 #include "config.h"
 #include "config_utils.h"
+#include "loop_storage.h"
 
 void process_loops(struct data *data, struct spa_io_position *position, uint8_t midi_note, float volume);
 
@@ -178,11 +239,19 @@ void set_playback_speed(struct data *data, float new_speed);
 void set_record_player_mode(struct data *data, float speed_pitch_factor);
 void set_pitch_shift(struct data *data, float semitones);
 void set_rubberband_enabled(struct data *data, bool enabled);
+void set_loop_stretch(struct data *data, uint8_t midi_note, float speed, float semitones);
+void set_loop_varispeed(struct data *data, uint8_t midi_note, bool enabled);
 float linear_to_db_volume(float linear_volume);
 
 /* Multi-loop management functions */
-int init_all_memory_loops(struct data *data, uint32_t max_seconds, uint32_t sample_rate);
+int init_all_memory_loops(struct data *data, uint32_t max_seconds, uint32_t budget_seconds, uint32_t sample_rate);
 void cleanup_all_memory_loops(struct data *data);
+void clear_memory_loop(struct data *data, uint8_t midi_note);
+void set_loop_playing(struct data *data, struct memory_loop *loop, bool playing);
+void set_loop_pending_record(struct data *data, struct memory_loop *loop, bool pending);
+void set_loop_pending_stop(struct data *data, struct memory_loop *loop, bool pending);
+void set_loop_pending_start(struct data *data, struct memory_loop *loop, bool pending);
+void rebuild_loop_index(struct data *data);
 struct memory_loop *get_loop_by_note(struct data *data, uint8_t midi_note);
 void stop_all_recordings(struct data *data);
 void stop_all_playback(struct data *data);
@@ -222,5 +291,6 @@ void state_changed(void *userdata, enum pw_filter_state old,
                    enum pw_filter_state state, const char *error);
 
 void do_quit(void *userdata, int signal_number);
+void do_save_session(void *userdata, int signal_number);
 
 #endif /* UPHONOR_H */
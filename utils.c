@@ -30,14 +30,9 @@ void set_playback_speed(struct data *data, float new_speed)
   if (new_speed > 8.0f)
     new_speed = 8.0f; // Maximum 8x speed
 
+  /* The stretch thread picks the new ratio up from the mixer */
   data->playback_speed = new_speed;
 
-  /* Update rubberband time ratio if enabled */
-  if (data->rubberband_enabled && data->rubberband_state)
-  {
-    rubberband_set_time_ratio(data->rubberband_state, 1.0 / new_speed);
-  }
-
   pw_log_info("Playback speed set to %.2fx", new_speed);
 }
 
@@ -52,11 +47,13 @@ void set_record_player_mode(struct data *data, float speed_pitch_factor)
   /* Disable rubberband processing */
   set_rubberband_enabled(data, false);
 
-  /* Set playback speed (this will affect both speed and pitch in record player mode) */
+  /* Set playback speed (this will affect both speed and pitch in record player mode);
+     the file voice plays it through the band-limited resampler */
   data->playback_speed = speed_pitch_factor;
 
   /* Reset pitch shift since it's controlled by speed in record player mode */
   data->pitch_shift = 0.0f;
 
-  pw_log_info("Record player mode: Speed/pitch set to %.2fx (rubberband disabled)", speed_pitch_factor);
+  pw_log_info("Record player mode: Speed/pitch set to %.2fx (rubberband disabled, %s resampler)", speed_pitch_factor,
+              resampler_quality_name(resampler_get_quality()));
 }